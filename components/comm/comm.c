@@ -8,6 +8,9 @@
  */
 
 #include "comm.h"
+#include "comm_fw_dist.h"
+#include "comm_beacon.h"
+#include "comm_rate.h"
 #include <string.h>
 #include <stdlib.h>
 #include "esp_log.h"
@@ -15,7 +18,9 @@
 #include "esp_now.h"
 #include "esp_mac.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "cJSON.h"
+#include "esp_timer.h"
 #include "freertos/task.h"
 
 static const char *TAG = "COMM";
@@ -24,13 +29,36 @@ static const char *TAG = "COMM";
 // Variables privadas
 // ============================================================================
 
+/** @brief Máximo de sensores en el registro */
+#define COMM_MAX_REGISTERED_SENSORS     COMM_MAX_SENSORS
+
 /** @brief Lista de sensores registrados */
-static sensor_info_t s_registered_sensors[10];  // Máximo 10 sensores por ahora
+static sensor_info_t s_registered_sensors[COMM_MAX_REGISTERED_SENSORS];
 static uint8_t s_sensor_count = 0;
 
+/** @brief Clave NVS del registro de sensores (namespace NVS_NAMESPACE_SYSTEM) */
+#define NVS_KEY_SENSORS         "comm_sensors"
+
+/** @brief Sensor emparejado tal como se guarda en NVS */
+typedef struct {
+    uint8_t mac_addr[6];
+    uint8_t type;
+    char device_id[DEVICE_ID_MAX_LEN];
+} stored_sensor_t;
+
+/** @brief Ventana de emparejamiento (hora de tick en ms en que vence) */
+static bool s_pairing_open = false;
+static uint32_t s_pairing_until_ms = 0;
+static portMUX_TYPE s_pairing_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void load_registry(void);
+
 /** @brief Cola para datos raw recibidos (procesados fuera del ISR) */
 static QueueHandle_t s_raw_data_queue = NULL;
 
+/** @brief Reintentos de esp_now_send cuando la cola interna está llena */
+#define COMM_SEND_RAW_RETRIES   10
+
 /** @brief Handle de la tarea de procesamiento */
 static TaskHandle_t s_comm_task_handle = NULL;
 
@@ -39,8 +67,95 @@ typedef struct {
     uint8_t data[ESPNOW_MAX_DATA_LEN];
     int len;
     uint8_t src_mac[6];
+    int8_t rssi;
+    uint64_t rx_time_ms;    /**< Hora del Gateway al recibir (para los slots) */
 } raw_data_t;
 
+// ============================================================================
+// Heartbeat adaptativo
+// ============================================================================
+
+/** @brief Período de mantenimiento (carga del canal, intervalos y liveness) */
+#define COMM_MAINTENANCE_PERIOD_MS      5000
+
+/** @brief Airtime estimado de una trama heartbeat JSON a 1 Mbps, con ACK MAC */
+#define COMM_HB_FRAME_AIRTIME_US        1500
+
+/**
+ * @brief Carga del canal a partir de la cual se estira el intervalo base
+ * 
+ * Con el registro limitado a MAX_SENSORS los heartbeats propios ocupan
+ * menos del 0,1 % del canal; lo que lo satura es el tráfico de otros
+ * equipos (incluido el enlace WiFi del Gateway), así que el intervalo se
+ * ajusta a la ocupación medida y no al número de sensores.
+ */
+#define COMM_HB_LOAD_TARGET_PERMILLE    200
+
+/** @brief Límites del intervalo de heartbeat asignado */
+#define COMM_HB_MIN_INTERVAL_S          30
+#define COMM_HB_MAX_INTERVAL_S          900
+
+/** @brief Cambio relativo mínimo (%) para reenviar la configuración */
+#define COMM_HB_HYSTERESIS_PCT          20
+
+/**
+ * @brief Envíos de CONFIG a un sensor que no informa su intervalo
+ * 
+ * Si el sensor informa hb_interval_s, el CONFIG se repite en cada respuesta
+ * a heartbeat hasta que lo confirme.
+ */
+#define COMM_HB_CONFIG_RETRIES          3
+
+/** @brief Margen adicional del timeout de liveness */
+#define COMM_HB_LIVENESS_GRACE_MS       5000
+
+/** @brief RSSI por debajo del cual el enlace se considera débil */
+#define COMM_HB_WEAK_RSSI_DBM           -80
+
+/**
+ * @brief Calidad de enlace de un sensor (paralelo a s_registered_sensors)
+ */
+typedef struct {
+    int16_t rssi_avg;           /**< RSSI promedio (EWMA) */
+    uint16_t hb_received;       /**< Heartbeats recibidos (contador con decaimiento) */
+    uint16_t hb_missed;         /**< Heartbeats perdidos estimados */
+    uint32_t last_hb_ms;        /**< Último heartbeat recibido */
+    uint16_t reported_hb_s;     /**< Intervalo que el sensor informa aplicar */
+    uint8_t config_retries;     /**< CONFIG pendientes de confirmar */
+} sensor_link_t;
+
+static sensor_link_t s_sensor_links[COMM_MAX_REGISTERED_SENSORS];
+
+/** @brief Tramas recibidas en la ventana de mantenimiento actual */
+static uint32_t s_rx_window_frames = 0;
+
+/** @brief Tramas descartadas por cola llena (escrito desde el callback de recepción) */
+static volatile uint32_t s_rx_dropped = 0;
+
+/** @brief Estadísticas de trabajo (solo comm_processing_task) y copia publicada */
+static comm_heartbeat_stats_t s_hb_stats = {0};
+static comm_heartbeat_stats_t s_hb_stats_published = {0};
+static portMUX_TYPE s_hb_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// ============================================================================
+// Planificador de slots
+// ============================================================================
+
+/** @brief Tolerancia en los bordes del slot (deriva del reloj del sensor) */
+#define COMM_SLOT_GUARD_MS              5
+
+/**
+ * @brief Última ocupación observada de cada slot
+ */
+typedef struct {
+    uint32_t superframe;        /**< Supertrama de la última trama en el slot */
+    int16_t sensor_idx;         /**< Sensor que la envió (-1 = ninguno) */
+} slot_usage_t;
+
+static slot_usage_t s_slot_usage[COMM_SLOT_COUNT];
+
+static comm_slot_stats_t s_slot_stats = {0};
+
 // ============================================================================
 // Funciones privadas
 // ============================================================================
@@ -76,8 +191,10 @@ static esp_err_t parse_json_message(const uint8_t *data, int len, controller_mes
         cJSON *ver = cJSON_GetObjectItem(header, "ver");
         cJSON *src_id = cJSON_GetObjectItem(header, "src_id");
         cJSON *src_type = cJSON_GetObjectItem(header, "src_type");
+        cJSON *epoch = cJSON_GetObjectItem(header, "epoch");
         
         if (ver) message->header.version = ver->valueint;
+        if (epoch && cJSON_IsNumber(epoch)) message->header.epoch = (uint32_t)epoch->valuedouble;
         if (src_id && cJSON_IsString(src_id)) {
             strncpy(message->header.src_id, src_id->valuestring, DEVICE_ID_MAX_LEN - 1);
             message->header.src_id[DEVICE_ID_MAX_LEN - 1] = '\0';
@@ -101,6 +218,7 @@ static esp_err_t parse_json_message(const uint8_t *data, int len, controller_mes
         cJSON *action = cJSON_GetObjectItem(payload, "action");
         cJSON *value = cJSON_GetObjectItem(payload, "value");
         cJSON *battery = cJSON_GetObjectItem(payload, "battery");
+        cJSON *hb_interval = cJSON_GetObjectItem(payload, "hb_interval_s");
         
         if (type && cJSON_IsString(type)) {
             if (strcmp(type->valuestring, "EVENT") == 0) {
@@ -140,12 +258,391 @@ static esp_err_t parse_json_message(const uint8_t *data, int len, controller_mes
         if (battery && cJSON_IsNumber(battery)) {
             message->payload.value = battery->valueint;
         }
+
+        // Intervalo de heartbeat que el sensor confirma estar aplicando
+        if (hb_interval && cJSON_IsNumber(hb_interval) && hb_interval->valueint > 0) {
+            message->payload.hb_interval_s = hb_interval->valueint;
+        }
     }
 
     cJSON_Delete(root);
     return ESP_OK;
 }
 
+/**
+ * @brief Busca un sensor registrado por su MAC
+ * @return Índice en s_registered_sensors o -1
+ */
+static int find_sensor_by_mac(const uint8_t *mac_addr)
+{
+    for (int i = 0; i < s_sensor_count; i++) {
+        if (s_registered_sensors[i].is_registered &&
+            memcmp(s_registered_sensors[i].mac_addr, mac_addr, 6) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Envía al sensor su intervalo de heartbeat (mensaje CONFIG)
+ */
+static esp_err_t send_heartbeat_config(const sensor_info_t *sensor)
+{
+    cJSON *root = cJSON_CreateObject();
+
+    cJSON *header = cJSON_CreateObject();
+    cJSON_AddNumberToObject(header, "ver", 1);
+    cJSON_AddStringToObject(header, "src_id", "GATEWAY");
+    cJSON_AddStringToObject(header, "src_type", "GATEWAY");
+    cJSON_AddItemToObject(root, "header", header);
+
+    cJSON *payload = cJSON_CreateObject();
+    cJSON_AddStringToObject(payload, "type", "CONFIG");
+    cJSON_AddNumberToObject(payload, "hb_interval_s", sensor->hb_interval_s);
+    cJSON_AddNumberToObject(payload, "slot", sensor->tx_slot);
+    cJSON_AddNumberToObject(payload, "slot_ms", COMM_SLOT_MS);
+    cJSON_AddNumberToObject(payload, "superframe_ms", COMM_SUPERFRAME_MS);
+    cJSON_AddItemToObject(root, "payload", payload);
+
+    char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    if (!json_str) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = comm_send_raw(sensor->mac_addr, (const uint8_t *)json_str, strlen(json_str));
+    free(json_str);
+
+    if (ret == ESP_OK) {
+        s_hb_stats.configs_sent++;
+        ESP_LOGD(TAG, "CONFIG a %s: heartbeat cada %u s", sensor->device_id, sensor->hb_interval_s);
+    }
+    return ret;
+}
+
+/**
+ * @brief Peso de airtime de un sensor según su calidad de enlace (x100)
+ * 
+ * Un enlace con pérdidas consume 1/(1-p) transmisiones por heartbeat útil;
+ * estirar su intervalo en la misma proporción mantiene acotado el airtime.
+ */
+static uint32_t link_weight_x100(const sensor_link_t *link)
+{
+    uint32_t total = link->hb_received + link->hb_missed;
+    uint32_t loss_permille = (total >= 4) ? (link->hb_missed * 1000 / total) : 0;
+    if (loss_permille > 750) {
+        loss_permille = 750;
+    }
+
+    uint32_t weight = 100000 / (1000 - loss_permille);
+    if (link->rssi_avg != 0 && link->rssi_avg < COMM_HB_WEAK_RSSI_DBM && weight < 150) {
+        weight = 150;
+    }
+    return weight;
+}
+
+/**
+ * @brief Heartbeats consecutivos perdidos tolerados antes de declarar offline
+ * 
+ * Se elige para que la probabilidad de perder esa racha con el enlace vivo
+ * quede por debajo de ~1e-6 por heartbeat.
+ */
+static uint32_t liveness_tolerance(const sensor_link_t *link)
+{
+    // Sin historia suficiente no se conocen las pérdidas: asumir ~20%
+    if (link->hb_received + link->hb_missed < 8) {
+        return 9;
+    }
+
+    // Estimación pesimista (una pérdida más): tras una racha sin pérdidas
+    // corta no se asume un enlace limpio
+    sensor_link_t pessimistic = *link;
+    pessimistic.hb_missed++;
+    uint32_t weight = link_weight_x100(&pessimistic);
+    if (weight < 103) {         // < ~3% pérdidas
+        return 4;
+    } else if (weight < 112) {  // < ~10% pérdidas
+        return 6;
+    } else if (weight < 125) {  // < ~20% pérdidas
+        return 9;
+    } else if (weight < 143) {  // < ~30% pérdidas
+        return 12;
+    }
+    return 16;
+}
+
+/**
+ * @brief Recalcula el intervalo de heartbeat y el timeout de liveness de cada sensor
+ */
+static void recompute_heartbeat_intervals(void)
+{
+    uint32_t active = 0;
+    for (int i = 0; i < s_sensor_count; i++) {
+        if (s_registered_sensors[i].is_registered) {
+            active++;
+        }
+    }
+    if (active == 0) {
+        return;
+    }
+
+    // Canal ocupado por encima del objetivo: estirar el intervalo en proporción
+    uint32_t base_s = COMM_HB_MIN_INTERVAL_S;
+    if (s_hb_stats.channel_load_permille > COMM_HB_LOAD_TARGET_PERMILLE) {
+        base_s = base_s * s_hb_stats.channel_load_permille / COMM_HB_LOAD_TARGET_PERMILLE;
+    }
+    if (base_s > COMM_HB_MAX_INTERVAL_S) {
+        base_s = COMM_HB_MAX_INTERVAL_S;
+    }
+    s_hb_stats.base_interval_s = base_s;
+
+    uint32_t airtime_ppm = 0;
+    for (int i = 0; i < s_sensor_count; i++) {
+        sensor_info_t *sensor = &s_registered_sensors[i];
+        sensor_link_t *link = &s_sensor_links[i];
+        if (!sensor->is_registered) {
+            continue;
+        }
+
+        uint32_t weight = link_weight_x100(link);
+        uint32_t interval_s = base_s * weight / 100;
+        if (interval_s > COMM_HB_MAX_INTERVAL_S) {
+            interval_s = COMM_HB_MAX_INTERVAL_S;
+        }
+
+        // Histéresis para no reconfigurar sensores por variaciones pequeñas
+        uint32_t current = sensor->hb_interval_s;
+        uint32_t delta = (interval_s > current) ? interval_s - current : current - interval_s;
+        if (current == 0 || delta * 100 > current * COMM_HB_HYSTERESIS_PCT) {
+            sensor->hb_interval_s = interval_s;
+            link->config_retries = COMM_HB_CONFIG_RETRIES;
+        }
+
+        // El sensor sigue informando otro intervalo: el CONFIG se perdió
+        if (link->config_retries == 0 && link->reported_hb_s &&
+            link->reported_hb_s != sensor->hb_interval_s) {
+            link->config_retries = 1;
+        }
+
+        // Mientras el sensor no confirme, vigilarlo con el intervalo más largo
+        uint32_t effective_s = sensor->hb_interval_s;
+        if (link->reported_hb_s > effective_s) {
+            effective_s = link->reported_hb_s;
+        }
+        sensor->liveness_timeout_ms = effective_s * 1000 * liveness_tolerance(link) + COMM_HB_LIVENESS_GRACE_MS;
+
+        airtime_ppm += weight * COMM_HB_FRAME_AIRTIME_US / (100 * sensor->hb_interval_s);
+    }
+    s_hb_stats.hb_airtime_ppm = airtime_ppm;
+}
+
+/**
+ * @brief Elige el slot menos ocupado para un sensor nuevo
+ * 
+ * Mientras haya menos sensores que slots cada uno tiene el suyo; por encima,
+ * los sensores se reparten de forma uniforme.
+ */
+static uint8_t assign_tx_slot(void)
+{
+    uint8_t usage[COMM_SLOT_COUNT] = {0};
+    for (int i = 0; i < s_sensor_count; i++) {
+        if (s_registered_sensors[i].is_registered) {
+            usage[s_registered_sensors[i].tx_slot % COMM_SLOT_COUNT]++;
+        }
+    }
+
+    // Recorrer con paso impar para separar slots consecutivos en el tiempo
+    uint8_t best = 0;
+    for (int n = 0, slot = 0; n < COMM_SLOT_COUNT; n++, slot = (slot + 7) % COMM_SLOT_COUNT) {
+        if (usage[slot] < usage[best]) {
+            best = slot;
+        }
+    }
+
+    taskENTER_CRITICAL(&s_hb_stats_lock);
+    if (usage[best] + 1 > s_slot_stats.max_sensors_per_slot) {
+        s_slot_stats.max_sensors_per_slot = usage[best] + 1;
+    }
+    taskEXIT_CRITICAL(&s_hb_stats_lock);
+    return best;
+}
+
+/**
+ * @brief Contabiliza una trama según el slot en que llegó
+ */
+static void account_slot_usage(int idx, const raw_data_t *raw, const controller_message_t *message)
+{
+    const sensor_info_t *sensor = &s_registered_sensors[idx];
+    bool urgent = (message->payload.type == MSG_TYPE_SENSOR_EVENT ||
+                   message->payload.type == MSG_TYPE_PANIC);
+
+    uint32_t superframe = (uint32_t)(raw->rx_time_ms / COMM_SUPERFRAME_MS);
+    uint32_t slot = (uint32_t)(raw->rx_time_ms % COMM_SUPERFRAME_MS) / COMM_SLOT_MS;
+    uint32_t offset = (uint32_t)((raw->rx_time_ms + COMM_SUPERFRAME_MS - sensor->tx_slot * COMM_SLOT_MS) % COMM_SUPERFRAME_MS);
+    bool in_slot = (offset < COMM_SLOT_MS + COMM_SLOT_GUARD_MS) ||
+                   (offset > COMM_SUPERFRAME_MS - COMM_SLOT_GUARD_MS);
+
+    // Dentro del margen la trama cuenta en su slot aunque la deriva del
+    // sensor la haya corrido al vecino: solo comparten slot los sensores
+    // que tienen el mismo asignado
+    if (in_slot) {
+        uint64_t slot_start_ms = (offset < COMM_SUPERFRAME_MS / 2) ?
+                                 raw->rx_time_ms - offset :
+                                 raw->rx_time_ms + (COMM_SUPERFRAME_MS - offset);
+        superframe = (uint32_t)(slot_start_ms / COMM_SUPERFRAME_MS);
+        slot = sensor->tx_slot;
+    }
+
+    slot_usage_t *usage = &s_slot_usage[slot];
+    bool conflict = (usage->sensor_idx >= 0 && usage->sensor_idx != idx &&
+                     usage->superframe == superframe);
+    usage->superframe = superframe;
+    usage->sensor_idx = idx;
+
+    taskENTER_CRITICAL(&s_hb_stats_lock);
+    if (urgent) {
+        s_slot_stats.urgent_frames++;
+    } else if (in_slot) {
+        s_slot_stats.in_slot_frames++;
+    } else {
+        s_slot_stats.off_slot_frames++;
+    }
+    if (conflict) {
+        s_slot_stats.slot_conflicts++;
+    }
+    taskEXIT_CRITICAL(&s_hb_stats_lock);
+}
+
+/**
+ * @brief Actualiza el registro con una trama recibida de un sensor
+ * 
+ * Registra sensores nuevos solo con la ventana de emparejamiento abierta
+ * (las tramas de MACs desconocidas se descartan), mantiene RSSI/last_seen y, en
+ * heartbeats, estima pérdidas y responde con CONFIG si el intervalo cambió.
+ */
+static void update_sensor_from_message(const raw_data_t *raw, const controller_message_t *message)
+{
+    int idx = find_sensor_by_mac(raw->src_mac);
+    if (idx < 0) {
+        if (message->header.src_id[0] == '\0' || message->header.src_type == DEV_TYPE_GATEWAY) {
+            return;
+        }
+        // Sin autenticación en ESP-Now: solo se registra durante el emparejamiento
+        if (!comm_pairing_is_open()) {
+            ESP_LOGD(TAG, "Trama de MAC no emparejada " MACSTR " ignorada", MAC2STR(raw->src_mac));
+            return;
+        }
+        if (comm_register_sensor(raw->src_mac, message->header.src_id, message->header.src_type) != ESP_OK) {
+            return;
+        }
+        idx = find_sensor_by_mac(raw->src_mac);
+        if (idx < 0) {
+            return;
+        }
+        recompute_heartbeat_intervals();
+    }
+
+    sensor_info_t *sensor = &s_registered_sensors[idx];
+    sensor_link_t *link = &s_sensor_links[idx];
+    uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+    account_slot_usage(idx, raw, message);
+    comm_rate_note_rx(raw->src_mac, raw->rssi);
+
+    sensor->last_seen = now_ms;
+    sensor->last_rssi = raw->rssi;
+    link->rssi_avg = (link->rssi_avg == 0) ? raw->rssi : (3 * link->rssi_avg + raw->rssi) / 4;
+    if (!sensor->online) {
+        sensor->online = 1;
+        ESP_LOGI(TAG, "Sensor %s en línea", sensor->device_id);
+    }
+
+    if (message->payload.type != MSG_TYPE_HEARTBEAT) {
+        return;
+    }
+
+    if (message->payload.hb_interval_s) {
+        link->reported_hb_s = message->payload.hb_interval_s;
+        if (link->reported_hb_s == sensor->hb_interval_s) {
+            link->config_retries = 0;
+        }
+    }
+
+    // Estimar heartbeats perdidos a partir del hueco desde el anterior
+    if (link->reported_hb_s && link->last_hb_ms) {
+        uint32_t expected_ms = link->reported_hb_s * 1000;
+        uint32_t gap_ms = now_ms - link->last_hb_ms;
+        uint32_t periods = (gap_ms + expected_ms / 2) / expected_ms;
+        if (periods > 1) {
+            link->hb_missed += periods - 1;
+        }
+    }
+    link->hb_received++;
+    link->last_hb_ms = now_ms;
+
+    // Olvidar historia antigua para seguir cambios del enlace
+    if (link->hb_received + link->hb_missed > 64) {
+        link->hb_received /= 2;
+        link->hb_missed = (link->hb_missed + 1) / 2;
+    }
+
+    // La respuesta al heartbeat lleva la configuración pendiente
+    if (link->config_retries > 0 && sensor->hb_interval_s) {
+        send_heartbeat_config(sensor);
+        link->config_retries--;
+    }
+}
+
+/**
+ * @brief Mantenimiento periódico: carga del canal, intervalos y liveness
+ */
+static void comm_maintenance(void)
+{
+    // Ocupación = tramas/s * airtime por trama
+    uint32_t load = s_rx_window_frames * COMM_HB_FRAME_AIRTIME_US / COMM_MAINTENANCE_PERIOD_MS;
+    s_rx_window_frames = 0;
+
+    // Descartes en la cola indican saturación aunque el airtime medido sea bajo
+    uint32_t dropped = s_rx_dropped;
+    if (dropped != s_hb_stats.rx_dropped && load < 2 * COMM_HB_LOAD_TARGET_PERMILLE) {
+        load = 2 * COMM_HB_LOAD_TARGET_PERMILLE;
+    }
+    s_hb_stats.rx_dropped = dropped;
+    s_hb_stats.channel_load_permille = (3 * s_hb_stats.channel_load_permille + load) / 4;
+
+    recompute_heartbeat_intervals();
+    comm_rate_evaluate();
+
+    uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    uint8_t registered = 0;
+    uint8_t online = 0;
+    for (int i = 0; i < s_sensor_count; i++) {
+        sensor_info_t *sensor = &s_registered_sensors[i];
+        if (!sensor->is_registered) {
+            continue;
+        }
+        registered++;
+        if (sensor->online && sensor->liveness_timeout_ms &&
+            now_ms - sensor->last_seen > sensor->liveness_timeout_ms) {
+            sensor->online = 0;
+            s_hb_stats.liveness_timeouts++;
+            ESP_LOGW(TAG, "Sensor %s sin heartbeat en %lu ms, marcado offline",
+                     sensor->device_id, (unsigned long)sensor->liveness_timeout_ms);
+        }
+        if (sensor->online) {
+            online++;
+        }
+    }
+    s_hb_stats.sensor_count = registered;
+    s_hb_stats.sensors_online = online;
+
+    taskENTER_CRITICAL(&s_hb_stats_lock);
+    s_hb_stats_published = s_hb_stats;
+    taskEXIT_CRITICAL(&s_hb_stats_lock);
+}
+
 /**
  * @brief Tarea de procesamiento de mensajes ESP-Now
  * 
@@ -156,10 +653,33 @@ static void comm_processing_task(void *pvParameters)
     ESP_LOGI(TAG, "Comm processing task iniciada");
     
     raw_data_t raw_data;
+    TickType_t next_maintenance = xTaskGetTickCount() + pdMS_TO_TICKS(COMM_MAINTENANCE_PERIOD_MS);
     
     while (1) {
+        // El mantenimiento corre en esta tarea para no compartir el registro con otra
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(now - next_maintenance) >= 0) {
+            comm_maintenance();
+            next_maintenance = now + pdMS_TO_TICKS(COMM_MAINTENANCE_PERIOD_MS);
+        }
+
+        // Beacons pedidos por el timer o por cambios de estado: se transmiten
+        // desde aquí porque comm_send_raw() reintenta con vTaskDelay
+        comm_beacon_process();
+
         // Esperar datos raw de la cola
-        if (xQueueReceive(s_raw_data_queue, &raw_data, portMAX_DELAY) == pdTRUE) {
+        if (xQueueReceive(s_raw_data_queue, &raw_data, next_maintenance - now) == pdTRUE) {
+            // Entrada vacía de comm_wake_task(): solo despierta la tarea
+            if (raw_data.len == 0) {
+                continue;
+            }
+            s_rx_window_frames++;
+
+            // Tramas binarias de distribución de firmware (no son JSON)
+            if (raw_data.data[0] == COMM_FW_DIST_MAGIC) {
+                comm_fw_dist_handle_frame(raw_data.src_mac, raw_data.data, raw_data.len);
+                continue;
+            }
             
             // Crear estructura de mensaje
             controller_message_t message;
@@ -167,8 +687,13 @@ static void comm_processing_task(void *pvParameters)
             
             // Parsear el mensaje JSON (fuera del ISR)
             if (parse_json_message(raw_data.data, raw_data.len, &message) == ESP_OK) {
-                // RSSI placeholder
-                message.rssi = -50;
+                message.rssi = raw_data.rssi;
+
+                // Registro, liveness y negociación del intervalo de heartbeat
+                update_sensor_from_message(&raw_data, &message);
+
+                // Contadores de tráfico por estado y detección de época obsoleta
+                comm_beacon_note_rx(raw_data.src_mac, &message);
                 
                 // Enviar a la cola del controlador
                 if (xQueueSend(gSystemCtx.controller_queue, &message, pdMS_TO_TICKS(100)) != pdPASS) {
@@ -204,11 +729,14 @@ void comm_esp_now_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *d
     raw_data.len = len;
     memcpy(raw_data.data, data, len);
     memcpy(raw_data.src_mac, recv_info->src_addr, 6);
+    raw_data.rssi = recv_info->rx_ctrl ? recv_info->rx_ctrl->rssi : 0;
+    raw_data.rx_time_ms = comm_get_gateway_time_ms();
     
     // Enviar a la cola de procesamiento (desde ISR)
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     if (xQueueSendFromISR(s_raw_data_queue, &raw_data, &xHigherPriorityTaskWoken) != pdPASS) {
-        // Cola llena - descartar
+        // Cola llena - descartar (cuenta como carga para el heartbeat adaptativo)
+        s_rx_dropped++;
     }
     
     if (xHigherPriorityTaskWoken) {
@@ -216,8 +744,21 @@ void comm_esp_now_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *d
     }
 }
 
+void comm_wake_task(void)
+{
+    if (s_raw_data_queue == NULL) {
+        return;
+    }
+
+    raw_data_t wake = { .len = 0 };
+    // Con la cola llena la tarea ya está despierta: no hace falta esperar
+    xQueueSend(s_raw_data_queue, &wake, 0);
+}
+
 void comm_esp_now_send_cb(const esp_now_send_info_t *tx_info, esp_now_send_status_t status)
 {
+    comm_rate_note_tx_status(tx_info ? tx_info->des_addr : NULL, status == ESP_NOW_SEND_SUCCESS);
+
     if (status == ESP_NOW_SEND_SUCCESS) {
         ESP_LOGD(TAG, "Mensaje enviado exitosamente");
     } else {
@@ -248,12 +789,19 @@ esp_err_t comm_init(void)
         return ESP_ERR_NO_MEM;
     }
 
+    for (int i = 0; i < COMM_SLOT_COUNT; i++) {
+        s_slot_usage[i].sensor_idx = -1;
+    }
+
     // Inicializar WiFi en modo estación (requerido para ESP-Now)
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_start());
 
+    // Long Range opcional para sensores lejanos (no es fatal si falla)
+    comm_rate_init();
+
     // Inicializar ESP-Now
     ESP_ERROR_CHECK(esp_now_init());
     
@@ -270,6 +818,9 @@ esp_err_t comm_init(void)
     };
     ESP_ERROR_CHECK(esp_now_add_peer(&broadcast_peer));
 
+    // Restaurar los sensores emparejados antes de recibir tramas
+    load_registry();
+
     // Crear tarea de procesamiento
     BaseType_t task_ret = xTaskCreate(
         comm_processing_task,
@@ -285,6 +836,11 @@ esp_err_t comm_init(void)
         return ESP_ERR_NO_MEM;
     }
 
+    // Difundir el estado del sistema a los sensores
+    if (comm_beacon_init() != ESP_OK) {
+        ESP_LOGW(TAG, "No se pudo iniciar el beacon de estado");
+    }
+
     ESP_LOGI(TAG, "Módulo de comunicación inicializado correctamente");
     
     // Imprimir MAC del gateway
@@ -354,8 +910,12 @@ esp_err_t comm_send_message(const uint8_t *dest_mac, const controller_message_t
     const uint8_t *target_mac = dest_mac ? dest_mac : (uint8_t[]){0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
     
     ESP_LOGI(TAG, "Enviando mensaje: %s", json_str);
-    esp_err_t ret = esp_now_send(target_mac, (uint8_t *)json_str, strlen(json_str));
+    size_t json_len = strlen(json_str);
+    esp_err_t ret = esp_now_send(target_mac, (uint8_t *)json_str, json_len);
     free(json_str);
+    if (ret == ESP_OK) {
+        comm_rate_note_tx(target_mac, json_len);
+    }
     
     return ret;
 }
@@ -365,52 +925,199 @@ esp_err_t comm_broadcast_message(const controller_message_t *message)
     return comm_send_message(NULL, message);
 }
 
-esp_err_t comm_register_sensor(const uint8_t *mac_addr, const char *device_id, device_type_t type)
+esp_err_t comm_send_raw(const uint8_t *dest_mac, const uint8_t *data, size_t len)
 {
-    if (s_sensor_count >= 10) {
-        return ESP_ERR_NO_MEM;
+    if (!data || len == 0 || len > ESPNOW_MAX_DATA_LEN) {
+        return ESP_ERR_INVALID_ARG;
     }
 
+    const uint8_t *target_mac = dest_mac ? dest_mac : (uint8_t[]){0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+    // La cola interna de ESP-Now es pequeña: ante ráfagas reintentar brevemente
+    esp_err_t ret = ESP_FAIL;
+    for (int attempt = 0; attempt < COMM_SEND_RAW_RETRIES; attempt++) {
+        ret = esp_now_send(target_mac, data, len);
+        if (ret != ESP_ERR_ESPNOW_NO_MEM) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
+
+    if (ret == ESP_OK) {
+        comm_rate_note_tx(target_mac, len);
+    }
+    return ret;
+}
+
+/**
+ * @brief Agrega al sensor como peer ESP-Now y a la gestión de tasa
+ * 
+ * Un sensor re-registrado puede tener todavía su peer de antes.
+ */
+static void add_sensor_peer(const uint8_t *mac_addr)
+{
+    esp_now_peer_info_t peer = {
+        .channel = 0,
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
+    };
+    memcpy(peer.peer_addr, mac_addr, 6);
+    esp_err_t err = esp_now_add_peer(&peer);
+    if (err == ESP_OK || err == ESP_ERR_ESPNOW_EXIST) {
+        comm_rate_peer_added(mac_addr);
+    } else {
+        ESP_LOGW(TAG, "No se pudo agregar el peer " MACSTR ": %s", MAC2STR(mac_addr), esp_err_to_name(err));
+    }
+}
+
+/**
+ * @brief Guarda en NVS los sensores registrados
+ * 
+ * Solo cambia al emparejar o desregistrar un sensor, no con el tráfico.
+ */
+static void save_registry(void)
+{
+    stored_sensor_t stored[COMM_MAX_REGISTERED_SENSORS];
+    size_t count = 0;
+    for (int i = 0; i < s_sensor_count; i++) {
+        const sensor_info_t *sensor = &s_registered_sensors[i];
+        if (!sensor->is_registered) {
+            continue;
+        }
+        memcpy(stored[count].mac_addr, sensor->mac_addr, 6);
+        stored[count].type = (uint8_t)sensor->type;
+        memcpy(stored[count].device_id, sensor->device_id, DEVICE_ID_MAX_LEN);
+        count++;
+    }
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE_SYSTEM, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK) {
+        err = count > 0 ? nvs_set_blob(nvs_handle, NVS_KEY_SENSORS, stored, count * sizeof(stored_sensor_t))
+                        : nvs_erase_key(nvs_handle, NVS_KEY_SENSORS);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "No se pudo guardar el registro de sensores: %s", esp_err_to_name(err));
+    }
+}
+
+/**
+ * @brief Agrega o actualiza un sensor en el registro
+ * 
+ * @param[out] changed true si el sensor es nuevo, se re-registró o cambió de MAC
+ */
+static esp_err_t register_sensor(const uint8_t *mac_addr, const char *device_id, device_type_t type,
+                                 bool *changed)
+{
+    *changed = false;
+
     // Verificar si ya existe
     for (int i = 0; i < s_sensor_count; i++) {
-        if (strcmp(s_registered_sensors[i].device_id, device_id) == 0) {
+        sensor_info_t *sensor = &s_registered_sensors[i];
+        if (strcmp(sensor->device_id, device_id) == 0) {
+            bool mac_changed = memcmp(sensor->mac_addr, mac_addr, 6) != 0;
+            bool was_registered = sensor->is_registered;
+            if (was_registered && mac_changed) {
+                comm_rate_peer_removed(sensor->mac_addr);
+            }
+
             // Actualizar información
-            s_registered_sensors[i].is_registered = 1;
-            s_registered_sensors[i].last_seen = xTaskGetTickCount() * portTICK_PERIOD_MS;
+            memcpy(sensor->mac_addr, mac_addr, 6);
+            sensor->is_registered = 1;
+            sensor->last_seen = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+            // Re-registro después de comm_unregister_sensor o con otra MAC
+            if (!was_registered || mac_changed) {
+                add_sensor_peer(mac_addr);
+                *changed = true;
+                ESP_LOGI(TAG, "Sensor re-registrado: %s", device_id);
+            }
             return ESP_OK;
         }
     }
 
+    if (s_sensor_count >= COMM_MAX_REGISTERED_SENSORS) {
+        return ESP_ERR_NO_MEM;
+    }
+
     // Agregar nuevo sensor
+    memset(&s_sensor_links[s_sensor_count], 0, sizeof(sensor_link_t));
     sensor_info_t *sensor = &s_registered_sensors[s_sensor_count];
     strncpy(sensor->device_id, device_id, DEVICE_ID_MAX_LEN - 1);
     sensor->device_id[DEVICE_ID_MAX_LEN - 1] = '\0';
+    memcpy(sensor->mac_addr, mac_addr, 6);
     sensor->type = type;
     sensor->state = 0;
     sensor->is_registered = 1;
     sensor->last_seen = xTaskGetTickCount() * portTICK_PERIOD_MS;
     sensor->last_rssi = 0;
+    sensor->online = 1;
+    sensor->hb_interval_s = 0;
+    sensor->liveness_timeout_ms = 0;
+    sensor->tx_slot = assign_tx_slot();
     
     s_sensor_count++;
 
-    // Agregar como peer ESP-Now
-    esp_now_peer_info_t peer = {
-        .channel = 0,
-        .ifidx = WIFI_IF_STA,
-        .encrypt = false,
-    };
-    memcpy(peer.peer_addr, mac_addr, 6);
-    esp_now_add_peer(&peer);
+    add_sensor_peer(mac_addr);
+    *changed = true;
 
     ESP_LOGI(TAG, "Sensor registrado: %s", device_id);
     return ESP_OK;
 }
 
+/**
+ * @brief Restaura los sensores emparejados guardados en NVS
+ */
+static void load_registry(void)
+{
+    stored_sensor_t stored[COMM_MAX_REGISTERED_SENSORS];
+    size_t size = sizeof(stored);
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_SYSTEM, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    esp_err_t err = nvs_get_blob(nvs_handle, NVS_KEY_SENSORS, stored, &size);
+    nvs_close(nvs_handle);
+    if (err != ESP_OK || size % sizeof(stored_sensor_t) != 0) {
+        return;
+    }
+
+    size_t count = size / sizeof(stored_sensor_t);
+    for (size_t i = 0; i < count; i++) {
+        bool changed;
+        stored[i].device_id[DEVICE_ID_MAX_LEN - 1] = '\0';
+        register_sensor(stored[i].mac_addr, stored[i].device_id, (device_type_t)stored[i].type, &changed);
+    }
+    if (count > 0) {
+        recompute_heartbeat_intervals();
+        ESP_LOGI(TAG, "%u sensores emparejados restaurados", (unsigned)count);
+    }
+}
+
+esp_err_t comm_register_sensor(const uint8_t *mac_addr, const char *device_id, device_type_t type)
+{
+    bool changed;
+    esp_err_t err = register_sensor(mac_addr, device_id, type, &changed);
+    if (err == ESP_OK && changed) {
+        save_registry();
+    }
+    return err;
+}
+
 esp_err_t comm_unregister_sensor(const char *device_id)
 {
     for (int i = 0; i < s_sensor_count; i++) {
         if (strcmp(s_registered_sensors[i].device_id, device_id) == 0) {
             s_registered_sensors[i].is_registered = 0;
+            comm_rate_peer_removed(s_registered_sensors[i].mac_addr);
+            save_registry();
             ESP_LOGI(TAG, "Sensor desregistrado: %s", device_id);
             return ESP_OK;
         }
@@ -431,6 +1138,93 @@ esp_err_t comm_get_sensor_info(const char *device_id, sensor_info_t *sensor_info
     return ESP_ERR_NOT_FOUND;
 }
 
+size_t comm_get_registered_sensor_ids(char ids[][DEVICE_ID_MAX_LEN], size_t max)
+{
+    size_t count = 0;
+    for (int i = 0; i < s_sensor_count && count < max; i++) {
+        if (s_registered_sensors[i].is_registered) {
+            strncpy(ids[count], s_registered_sensors[i].device_id, DEVICE_ID_MAX_LEN - 1);
+            ids[count][DEVICE_ID_MAX_LEN - 1] = '\0';
+            count++;
+        }
+    }
+    return count;
+}
+
+void comm_pairing_open(uint32_t duration_s)
+{
+    if (duration_s == 0) {
+        duration_s = COMM_PAIRING_DEFAULT_S;
+    } else if (duration_s > COMM_PAIRING_MAX_S) {
+        duration_s = COMM_PAIRING_MAX_S;
+    }
+    uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+    taskENTER_CRITICAL(&s_pairing_lock);
+    s_pairing_open = true;
+    s_pairing_until_ms = now_ms + duration_s * 1000;
+    taskEXIT_CRITICAL(&s_pairing_lock);
+
+    ESP_LOGI(TAG, "Ventana de emparejamiento abierta por %lu s", (unsigned long)duration_s);
+}
+
+void comm_pairing_close(void)
+{
+    taskENTER_CRITICAL(&s_pairing_lock);
+    bool was_open = s_pairing_open;
+    s_pairing_open = false;
+    taskEXIT_CRITICAL(&s_pairing_lock);
+
+    if (was_open) {
+        ESP_LOGI(TAG, "Ventana de emparejamiento cerrada");
+    }
+}
+
+bool comm_pairing_is_open(void)
+{
+    uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+    taskENTER_CRITICAL(&s_pairing_lock);
+    bool open = s_pairing_open && (int32_t)(s_pairing_until_ms - now_ms) > 0;
+    bool expired = s_pairing_open && !open;
+    if (expired) {
+        s_pairing_open = false;
+    }
+    taskEXIT_CRITICAL(&s_pairing_lock);
+
+    if (expired) {
+        ESP_LOGI(TAG, "Ventana de emparejamiento vencida");
+    }
+    return open;
+}
+
+uint64_t comm_get_gateway_time_ms(void)
+{
+    return (uint64_t)(esp_timer_get_time() / 1000);
+}
+
+esp_err_t comm_get_slot_stats(comm_slot_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&s_hb_stats_lock);
+    *stats = s_slot_stats;
+    taskEXIT_CRITICAL(&s_hb_stats_lock);
+    return ESP_OK;
+}
+
+esp_err_t comm_get_heartbeat_stats(comm_heartbeat_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&s_hb_stats_lock);
+    *stats = s_hb_stats_published;
+    taskEXIT_CRITICAL(&s_hb_stats_lock);
+    return ESP_OK;
+}
+
 void comm_get_gateway_mac(uint8_t *mac_addr)
 {
     esp_wifi_get_mac(WIFI_IF_STA, mac_addr);
@@ -441,11 +1235,14 @@ void comm_print_registered_sensors(void)
     ESP_LOGI(TAG, "Sensores registrados: %d", s_sensor_count);
     for (int i = 0; i < s_sensor_count; i++) {
         if (s_registered_sensors[i].is_registered) {
-            ESP_LOGI(TAG, "  - %s (tipo: %d, estado: %d, RSSI: %d)",
+            ESP_LOGI(TAG, "  - %s (tipo: %d, estado: %d, RSSI: %d, heartbeat: %u s, slot: %u, %s)",
                      s_registered_sensors[i].device_id,
                      s_registered_sensors[i].type,
                      s_registered_sensors[i].state,
-                     s_registered_sensors[i].last_rssi);
+                     s_registered_sensors[i].last_rssi,
+                     s_registered_sensors[i].hb_interval_s,
+                     s_registered_sensors[i].tx_slot,
+                     s_registered_sensors[i].online ? "online" : "offline");
         }
     }
 }
@@ -0,0 +1,319 @@
+/**
+ * @file comm_beacon.c
+ * @brief Implementación del beacon de estado del sistema
+ *
+ * Secuencia de envío tras un cambio de estado: inmediato y luego a 1 s,
+ * 2 s, 4 s... hasta COMM_BEACON_PERIOD_MS, para que un sensor que perdió
+ * la primera trama se entere rápido sin mantener tráfico alto.
+ *
+ * El timer y los cambios de estado solo marcan el beacon como pendiente;
+ * la transmisión ocurre en comm_processing_task (comm_beacon_process()),
+ * ya que comm_send_raw() puede reintentar con vTaskDelay y no debe
+ * bloquear la tarea de esp_timer ni al controller.
+ */
+
+#include "comm_beacon.h"
+#include "comm.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+static const char *TAG = "COMM_BCN";
+
+// ============================================================================
+// Configuración
+// ============================================================================
+
+/** @brief Primera repetición tras un cambio de estado */
+#define COMM_BEACON_FAST_MS         1000
+
+/** @brief Período del beacon en régimen estable */
+#define COMM_BEACON_PERIOD_MS       60000
+
+/** @brief Intervalo mínimo entre beacons de corrección por época obsoleta */
+#define COMM_BEACON_RESYNC_MIN_MS   1000
+
+/** @brief Clave NVS de la época (namespace NVS_NAMESPACE_SYSTEM) */
+#define NVS_KEY_BEACON_EPOCH        "bcn_epoch"
+
+#define STATE_SLOTS                 4
+
+// ============================================================================
+// Variables privadas
+// ============================================================================
+
+static SemaphoreHandle_t s_beacon_mutex = NULL;
+static esp_timer_handle_t s_beacon_timer = NULL;
+static bool s_initialized = false;
+
+static system_state_t s_state = SYS_STATE_DISARMED;
+static uint32_t s_epoch = 0;
+static uint32_t s_repeat_ms = COMM_BEACON_PERIOD_MS;
+static int64_t s_state_since_us = 0;
+static int64_t s_last_resync_us = 0;
+static bool s_send_pending = false;
+
+static comm_beacon_stats_t s_stats = {0};
+
+// ============================================================================
+// Funciones privadas
+// ============================================================================
+
+static inline int state_slot(system_state_t state)
+{
+    return (state >= 0 && state < STATE_SLOTS) ? (int)state : 0;
+}
+
+static void load_epoch(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_SYSTEM, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        nvs_get_u32(nvs_handle, NVS_KEY_BEACON_EPOCH, &s_epoch);
+        nvs_close(nvs_handle);
+    }
+}
+
+static void save_epoch(uint32_t epoch)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE_SYSTEM, NVS_READWRITE, &nvs_handle) == ESP_OK) {
+        nvs_set_u32(nvs_handle, NVS_KEY_BEACON_EPOCH, epoch);
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+}
+
+/**
+ * @brief Acumula el tiempo transcurrido en el estado actual
+ * @note Llamar con s_beacon_mutex tomado
+ */
+static void account_state_time(int64_t now_us)
+{
+    s_stats.time_in_state_s[state_slot(s_state)] += (uint32_t)((now_us - s_state_since_us) / 1000000);
+    // Conservar el resto de segundo para no perder tiempo por redondeo
+    s_state_since_us = now_us - ((now_us - s_state_since_us) % 1000000);
+}
+
+/**
+ * @brief Construye y transmite el beacon
+ *
+ * @param dest_mac Destino (NULL = broadcast)
+ */
+static void send_beacon(const uint8_t *dest_mac)
+{
+    comm_beacon_frame_t frame = {
+        .magic = COMM_BEACON_MAGIC,
+        .version = COMM_BEACON_VERSION,
+    };
+
+    xSemaphoreTake(s_beacon_mutex, portMAX_DELAY);
+    frame.state = (uint8_t)s_state;
+    frame.flags = (s_state == SYS_STATE_DISARMED) ? COMM_BEACON_FLAG_LOW_TRAFFIC : 0;
+    frame.epoch = s_epoch;
+    frame.next_beacon_s = (uint16_t)(s_repeat_ms / 1000);
+    xSemaphoreGive(s_beacon_mutex);
+
+    frame.superframe_ms = COMM_SUPERFRAME_MS;
+    frame.slot_ms = COMM_SLOT_MS;
+    // Tomar la hora lo más cerca posible del envío
+    frame.gw_time_ms = (uint32_t)(comm_get_gateway_time_ms() % COMM_GW_TIME_WRAP_MS);
+
+    if (comm_send_raw(dest_mac, (const uint8_t *)&frame, sizeof(frame)) == ESP_OK) {
+        xSemaphoreTake(s_beacon_mutex, portMAX_DELAY);
+        s_stats.beacons_sent++;
+        xSemaphoreGive(s_beacon_mutex);
+    }
+}
+
+/**
+ * @brief Marca el beacon como pendiente y despierta a comm_processing_task
+ */
+static void request_beacon(void)
+{
+    xSemaphoreTake(s_beacon_mutex, portMAX_DELAY);
+    s_send_pending = true;
+    xSemaphoreGive(s_beacon_mutex);
+
+    comm_wake_task();
+}
+
+static void schedule_next(uint32_t delay_ms)
+{
+    esp_timer_stop(s_beacon_timer);
+    esp_timer_start_once(s_beacon_timer, (uint64_t)delay_ms * 1000);
+}
+
+/**
+ * @brief Callback del timer: repite el beacon con backoff exponencial
+ */
+static void beacon_timer_callback(void *arg)
+{
+    xSemaphoreTake(s_beacon_mutex, portMAX_DELAY);
+    uint32_t next_ms = s_repeat_ms * 2;
+    if (next_ms > COMM_BEACON_PERIOD_MS) {
+        next_ms = COMM_BEACON_PERIOD_MS;
+    }
+    s_repeat_ms = next_ms;
+    xSemaphoreGive(s_beacon_mutex);
+
+    request_beacon();
+    schedule_next(next_ms);
+}
+
+// ============================================================================
+// Funciones públicas
+// ============================================================================
+
+esp_err_t comm_beacon_init(void)
+{
+    if (s_initialized) {
+        return ESP_OK;
+    }
+
+    s_beacon_mutex = xSemaphoreCreateMutex();
+    if (!s_beacon_mutex) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = &beacon_timer_callback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "comm_beacon"
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &s_beacon_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error creando timer de beacon: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    load_epoch();
+
+    // El controlador se inicializa antes que comm: tomar su estado actual
+    xSemaphoreTake(gSystemCtx.mutex, portMAX_DELAY);
+    s_state = gSystemCtx.current_state;
+    xSemaphoreGive(gSystemCtx.mutex);
+
+    s_state_since_us = esp_timer_get_time();
+    s_repeat_ms = COMM_BEACON_FAST_MS;
+    s_initialized = true;
+
+    ESP_LOGI(TAG, "Beacon de estado iniciado (estado %d, época %lu)", s_state, (unsigned long)s_epoch);
+
+    request_beacon();
+    schedule_next(COMM_BEACON_FAST_MS);
+    return ESP_OK;
+}
+
+void comm_beacon_notify_state(system_state_t state)
+{
+    if (!s_initialized) {
+        return;
+    }
+
+    xSemaphoreTake(s_beacon_mutex, portMAX_DELAY);
+    bool changed = (state != s_state);
+    if (changed) {
+        account_state_time(esp_timer_get_time());
+        s_state = state;
+        s_epoch++;
+        s_repeat_ms = COMM_BEACON_FAST_MS;
+    }
+    uint32_t epoch = s_epoch;
+    xSemaphoreGive(s_beacon_mutex);
+
+    if (!changed) {
+        return;
+    }
+
+    save_epoch(epoch);
+    ESP_LOGI(TAG, "Beacon: estado %d, época %lu", state, (unsigned long)epoch);
+
+    request_beacon();
+    schedule_next(COMM_BEACON_FAST_MS);
+}
+
+void comm_beacon_note_rx(const uint8_t *src_mac, const controller_message_t *message)
+{
+    if (!s_initialized || !message) {
+        return;
+    }
+
+    bool resync = false;
+    int64_t now_us = esp_timer_get_time();
+
+    xSemaphoreTake(s_beacon_mutex, portMAX_DELAY);
+    int slot = state_slot(s_state);
+    s_stats.rx_frames[slot]++;
+    if (message->payload.type == MSG_TYPE_SENSOR_EVENT &&
+        message->payload.action != SENSOR_ACTION_TAMPER) {
+        s_stats.rx_sensor_events[slot]++;
+    }
+    if (message->header.epoch != 0 && message->header.epoch != s_epoch) {
+        s_stats.stale_epoch_frames++;
+        if (now_us - s_last_resync_us >= (int64_t)COMM_BEACON_RESYNC_MIN_MS * 1000) {
+            s_last_resync_us = now_us;
+            resync = true;
+        }
+    }
+    xSemaphoreGive(s_beacon_mutex);
+
+    if (resync) {
+        ESP_LOGD(TAG, "Sensor %s con época obsoleta (%lu), reenviando beacon",
+                 message->header.src_id, (unsigned long)message->header.epoch);
+        request_beacon();
+    }
+}
+
+void comm_beacon_process(void)
+{
+    if (!s_initialized) {
+        return;
+    }
+
+    xSemaphoreTake(s_beacon_mutex, portMAX_DELAY);
+    bool pending = s_send_pending;
+    s_send_pending = false;
+    xSemaphoreGive(s_beacon_mutex);
+
+    if (pending) {
+        send_beacon(NULL);
+    }
+}
+
+esp_err_t comm_beacon_get_stats(comm_beacon_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_initialized) {
+        memset(stats, 0, sizeof(*stats));
+        return ESP_OK;
+    }
+
+    xSemaphoreTake(s_beacon_mutex, portMAX_DELAY);
+    account_state_time(esp_timer_get_time());
+    *stats = s_stats;
+    stats->epoch = s_epoch;
+    stats->state = s_state;
+    xSemaphoreGive(s_beacon_mutex);
+    return ESP_OK;
+}
+
+void comm_beacon_print_stats(void)
+{
+    comm_beacon_stats_t stats;
+    comm_beacon_get_stats(&stats);
+
+    ESP_LOGI(TAG, "Beacon: estado %d, época %lu, %lu enviados, %lu tramas con época obsoleta",
+             stats.state, (unsigned long)stats.epoch,
+             (unsigned long)stats.beacons_sent, (unsigned long)stats.stale_epoch_frames);
+    for (int i = 0; i < STATE_SLOTS; i++) {
+        uint32_t hours_x100 = stats.time_in_state_s[i] / 36;
+        ESP_LOGI(TAG, "  - estado %d: %lu s, %lu tramas, %lu eventos (%lu eventos/h)",
+                 i, (unsigned long)stats.time_in_state_s[i],
+                 (unsigned long)stats.rx_frames[i], (unsigned long)stats.rx_sensor_events[i],
+                 hours_x100 ? (unsigned long)(stats.rx_sensor_events[i] * 100 / hours_x100) : 0UL);
+    }
+}
@@ -0,0 +1,696 @@
+/**
+ * @file comm_fw_dist.c
+ * @brief Distribución de firmware de sensores sobre ESP-Now
+ *
+ * Una sesión avanza por rondas: el Gateway envía una ráfaga con los chunks
+ * que faltan en la ventana de cada sensor (o la unión de todas las ventanas
+ * en modo multicast), marca el último con FW_DATA_FLAG_ACK_REQ y espera las
+ * ACK. Los chunks que la ACK no confirma se reenvían en la ronda siguiente.
+ *
+ * Comportamiento esperado del sensor:
+ * - Ante OFFER de una imagen que ya tiene completa y verificada: DONE
+ * - Ante OFFER de una imagen parcial o nueva: ACK con su base persistida
+ * - Ante DATA con FW_DATA_FLAG_ACK_REQ: ACK (con jitter en multicast)
+ * - Al completar la imagen: verificar CRC32 y enviar DONE
+ */
+
+#include "comm_fw_dist.h"
+#include "comm.h"
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "freertos/task.h"
+
+static const char *TAG = "COMM_FW";
+
+// ============================================================================
+// Configuración
+// ============================================================================
+
+/** @brief Nombre de la partición con la imagen de los sensores */
+#define FW_PARTITION_LABEL          "sensor_fw"
+
+/** @brief Espera de ACK tras cada ráfaga */
+#define FW_ACK_TIMEOUT_MS           200
+
+/** @brief Espera adicional por sensor en multicast (las ACK llegan con jitter) */
+#define FW_MULTICAST_ACK_SLOT_MS    20
+
+/** @brief Rondas seguidas sin respuesta antes de dar un sensor por fallido */
+#define FW_MAX_MISSED_ROUNDS        30
+
+/**
+ * @brief Rondas seguidas con respuesta pero sin avance antes de dar un
+ * sensor por fallido (ej: ACK repetidas en VERIFYING sin llegar nunca DONE)
+ */
+#define FW_MAX_STALLED_ROUNDS       30
+
+/** @brief Tamaño de bloque para verificar el CRC de la partición */
+#define FW_CRC_BLOCK_SIZE           1024
+
+/**
+ * @brief Profundidad de la cola de respuestas de sensores
+ *
+ * En multicast una ronda puede traer de cada sensor la respuesta al OFFER
+ * y la ACK de la ráfaga.
+ */
+#define FW_EVENT_QUEUE_SIZE         (2 * COMM_FW_DIST_MAX_TARGETS)
+
+/** @brief Flag de trama DATA: el sensor debe responder con ACK */
+#define FW_DATA_FLAG_ACK_REQ        0x01
+
+// ============================================================================
+// Formato de tramas
+// ============================================================================
+
+typedef enum {
+    FW_FRAME_OFFER = 1,
+    FW_FRAME_DATA = 2,
+    FW_FRAME_ACK = 3,
+    FW_FRAME_DONE = 4,
+    FW_FRAME_ABORT = 5
+} fw_frame_type_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t type;
+    uint16_t session_id;
+} fw_frame_hdr_t;
+
+typedef struct __attribute__((packed)) {
+    fw_frame_hdr_t hdr;
+    uint32_t image_size;
+    uint32_t image_version;
+    uint32_t image_crc32;
+    uint16_t chunk_count;
+    uint8_t chunk_size;
+    uint8_t window;
+} fw_offer_frame_t;
+
+typedef struct __attribute__((packed)) {
+    fw_frame_hdr_t hdr;
+    uint16_t chunk_index;
+    uint8_t flags;
+    uint8_t data[COMM_FW_CHUNK_SIZE];
+} fw_data_frame_t;
+
+typedef struct __attribute__((packed)) {
+    fw_frame_hdr_t hdr;
+    uint16_t base;          /**< Primer chunk no recibido */
+    uint32_t bitmap;        /**< Bit i = chunk (base + i) recibido */
+} fw_ack_frame_t;
+
+typedef struct __attribute__((packed)) {
+    fw_frame_hdr_t hdr;
+    uint8_t status;         /**< 0 = imagen verificada */
+} fw_done_frame_t;
+
+_Static_assert(sizeof(fw_data_frame_t) <= ESPNOW_MAX_DATA_LEN, "trama DATA excede ESP-Now");
+
+// ============================================================================
+// Estado de la sesión
+// ============================================================================
+
+/** @brief Respuesta de un sensor, pasada de comm_processing_task a la tarea */
+typedef struct {
+    uint8_t mac[6];
+    uint8_t type;
+    uint8_t status;
+    uint16_t base;
+    uint32_t bitmap;
+} fw_event_t;
+
+typedef struct {
+    uint8_t mac[6];
+    char device_id[DEVICE_ID_MAX_LEN];
+    comm_fw_target_state_t state;
+    uint16_t base;
+    uint32_t bitmap;
+    bool acked_round;
+    bool progressed_round;      /**< La respuesta de esta ronda trajo avance */
+    uint8_t missed_rounds;
+    uint8_t stalled_rounds;
+    uint16_t sent_end;          /**< Chunks < sent_end ya enviados (unicast) */
+} fw_target_t;
+
+typedef struct {
+    const esp_partition_t *partition;
+    comm_fw_image_header_t image;
+    uint16_t chunk_count;
+    uint16_t session_id;
+    comm_fw_dist_mode_t mode;
+    fw_target_t targets[COMM_FW_DIST_MAX_TARGETS];
+    uint8_t target_count;
+    uint16_t sent_end;              /**< Chunks < sent_end ya enviados (multicast) */
+    volatile bool running;
+    volatile bool abort_requested;
+    comm_fw_dist_stats_t stats;     /**< Contadores de trabajo (solo la tarea) */
+} fw_session_t;
+
+static fw_session_t s_session = {0};
+
+/** @brief Copia publicada de las estadísticas */
+static comm_fw_dist_stats_t s_published_stats = {0};
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static QueueHandle_t s_event_queue = NULL;
+
+// ============================================================================
+// Funciones privadas
+// ============================================================================
+
+static void publish_stats(void)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_published_stats = s_session.stats;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+static inline bool target_is_finished(const fw_target_t *t)
+{
+    return t->state == COMM_FW_TARGET_DONE || t->state == COMM_FW_TARGET_FAILED;
+}
+
+static fw_target_t *find_target(const uint8_t *mac)
+{
+    for (int i = 0; i < s_session.target_count; i++) {
+        if (memcmp(s_session.targets[i].mac, mac, 6) == 0) {
+            return &s_session.targets[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Chunks de la ventana [base, base+32) que faltan en un sensor
+ */
+static uint32_t target_missing_mask(const fw_target_t *t, uint16_t base)
+{
+    uint32_t missing = 0;
+    for (int i = 0; i < COMM_FW_WINDOW_CHUNKS; i++) {
+        uint32_t chunk = (uint32_t)base + i;
+        if (chunk >= s_session.chunk_count) {
+            break;
+        }
+        if (chunk < t->base) {
+            continue;
+        }
+        uint32_t rel = chunk - t->base;
+        if (rel < COMM_FW_WINDOW_CHUNKS && (t->bitmap & (1UL << rel))) {
+            continue;
+        }
+        missing |= (1UL << i);
+    }
+    return missing;
+}
+
+static void fill_header(fw_frame_hdr_t *hdr, fw_frame_type_t type)
+{
+    hdr->magic = COMM_FW_DIST_MAGIC;
+    hdr->type = type;
+    hdr->session_id = s_session.session_id;
+}
+
+static void send_offer(const uint8_t *mac)
+{
+    fw_offer_frame_t offer;
+    fill_header(&offer.hdr, FW_FRAME_OFFER);
+    offer.image_size = s_session.image.size;
+    offer.image_version = s_session.image.version;
+    offer.image_crc32 = s_session.image.crc32;
+    offer.chunk_count = s_session.chunk_count;
+    offer.chunk_size = COMM_FW_CHUNK_SIZE;
+    offer.window = COMM_FW_WINDOW_CHUNKS;
+
+    comm_send_raw(mac, (const uint8_t *)&offer, sizeof(offer));
+}
+
+static void send_abort(const uint8_t *mac)
+{
+    fw_frame_hdr_t hdr;
+    fill_header(&hdr, FW_FRAME_ABORT);
+    comm_send_raw(mac, (const uint8_t *)&hdr, sizeof(hdr));
+}
+
+/**
+ * @brief Envía los chunks marcados en missing a partir de base
+ *
+ * Los chunks nuevos salen en orden creciente (la ventana solo avanza), así
+ * que todo chunk por debajo de sent_end es una retransmisión.
+ *
+ * @param mac Destino (NULL = broadcast)
+ * @param sent_end Marca de chunks ya enviados al destino
+ */
+static void send_window(const uint8_t *mac, uint16_t base, uint32_t missing, uint16_t *sent_end)
+{
+    fw_data_frame_t frame;
+    fill_header(&frame.hdr, FW_FRAME_DATA);
+
+    for (int i = 0; i < COMM_FW_WINDOW_CHUNKS && missing; i++) {
+        if (!(missing & (1UL << i))) {
+            continue;
+        }
+        missing &= ~(1UL << i);
+
+        uint16_t chunk = base + i;
+        uint32_t offset = (uint32_t)chunk * COMM_FW_CHUNK_SIZE;
+        size_t len = s_session.image.size - offset;
+        if (len > COMM_FW_CHUNK_SIZE) {
+            len = COMM_FW_CHUNK_SIZE;
+        }
+
+        esp_err_t err = esp_partition_read(s_session.partition,
+                                           sizeof(comm_fw_image_header_t) + offset,
+                                           frame.data, len);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error leyendo chunk %u: %s", chunk, esp_err_to_name(err));
+            continue;
+        }
+
+        frame.chunk_index = chunk;
+        frame.flags = (missing == 0) ? FW_DATA_FLAG_ACK_REQ : 0;
+
+        if (comm_send_raw(mac, (const uint8_t *)&frame,
+                          offsetof(fw_data_frame_t, data) + len) == ESP_OK) {
+            s_session.stats.frames_sent++;
+            if (chunk < *sent_end) {
+                s_session.stats.chunks_retransmitted++;
+            } else {
+                *sent_end = chunk + 1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Envía una ronda: OFFER a los pendientes y la ráfaga de chunks
+ */
+static void send_round(void)
+{
+    bool need_offer = false;
+    uint16_t group_base = UINT16_MAX;
+
+    for (int i = 0; i < s_session.target_count; i++) {
+        fw_target_t *t = &s_session.targets[i];
+
+        // Los sensores en VERIFYING reciben OFFER como sondeo: responden DONE
+        if (t->state == COMM_FW_TARGET_OFFERED || t->state == COMM_FW_TARGET_VERIFYING) {
+            if (s_session.mode == COMM_FW_DIST_UNICAST) {
+                send_offer(t->mac);
+            } else {
+                need_offer = true;
+            }
+        } else if (t->state == COMM_FW_TARGET_ACTIVE) {
+            if (s_session.mode == COMM_FW_DIST_UNICAST) {
+                send_window(t->mac, t->base, target_missing_mask(t, t->base), &t->sent_end);
+            } else if (t->base < group_base) {
+                group_base = t->base;
+            }
+        }
+    }
+
+    if (s_session.mode == COMM_FW_DIST_MULTICAST) {
+        if (need_offer) {
+            send_offer(NULL);
+        }
+        if (group_base != UINT16_MAX) {
+            // Unión de los chunks que le faltan a algún sensor activo
+            uint32_t missing = 0;
+            for (int i = 0; i < s_session.target_count; i++) {
+                if (s_session.targets[i].state == COMM_FW_TARGET_ACTIVE) {
+                    missing |= target_missing_mask(&s_session.targets[i], group_base);
+                }
+            }
+            send_window(NULL, group_base, missing, &s_session.sent_end);
+        }
+    }
+
+    s_session.stats.rounds++;
+}
+
+/**
+ * @brief Indica si una ACK trae avance respecto del estado conocido
+ *
+ * Avanza la primera ACK, un cambio de base (chunks nuevos confirmados o
+ * reanudación tras reiniciar) y chunks nuevos dentro de la misma ventana.
+ */
+static bool ack_progresses(const fw_target_t *t, const fw_event_t *ev)
+{
+    if (t->state == COMM_FW_TARGET_OFFERED || ev->base != t->base) {
+        return true;
+    }
+    return (ev->bitmap & ~t->bitmap) != 0;
+}
+
+static void apply_event(const fw_event_t *ev)
+{
+    fw_target_t *t = find_target(ev->mac);
+    if (!t) {
+        return;
+    }
+
+    bool progress = true;
+
+    if (ev->type == FW_FRAME_ACK) {
+        s_session.stats.acks_received++;
+
+        if (t->state == COMM_FW_TARGET_DONE) {
+            return;
+        }
+        progress = ack_progresses(t, ev);
+        if (t->state == COMM_FW_TARGET_FAILED) {
+            if (!progress && t->stalled_rounds >= FW_MAX_STALLED_ROUNDS) {
+                // Falló por no avanzar y sigue en el mismo punto: no se reanuda
+                return;
+            }
+            // El sensor volvió (ej: tras reiniciar); retomar desde su base
+            ESP_LOGI(TAG, "Sensor %s responde de nuevo, reanudando", t->device_id);
+            s_session.stats.targets_failed--;
+        }
+        if (t->state != COMM_FW_TARGET_OFFERED && ev->base < t->base) {
+            ESP_LOGI(TAG, "Sensor %s reanuda desde chunk %u (tenía %u)",
+                     t->device_id, ev->base, t->base);
+            s_session.stats.resumes++;
+        }
+
+        t->base = ev->base;
+        t->bitmap = ev->bitmap;
+        t->state = (t->base >= s_session.chunk_count) ? COMM_FW_TARGET_VERIFYING
+                                                       : COMM_FW_TARGET_ACTIVE;
+    } else if (ev->type == FW_FRAME_DONE) {
+        if (target_is_finished(t)) {
+            return;
+        }
+        if (ev->status == 0) {
+            t->state = COMM_FW_TARGET_DONE;
+            s_session.stats.targets_done++;
+            ESP_LOGI(TAG, "✅ Sensor %s actualizado", t->device_id);
+        } else {
+            t->state = COMM_FW_TARGET_FAILED;
+            s_session.stats.targets_failed++;
+            ESP_LOGW(TAG, "Sensor %s rechazó la imagen (status %u)", t->device_id, ev->status);
+        }
+    } else {
+        return;
+    }
+
+    t->acked_round = true;
+    t->missed_rounds = 0;
+    if (progress) {
+        t->progressed_round = true;
+        t->stalled_rounds = 0;
+    }
+}
+
+/**
+ * @brief Espera las respuestas de la ronda y penaliza a los que no responden
+ * o responden sin avanzar
+ */
+static void collect_responses(void)
+{
+    int pending = 0;
+    for (int i = 0; i < s_session.target_count; i++) {
+        s_session.targets[i].acked_round = false;
+        s_session.targets[i].progressed_round = false;
+        if (!target_is_finished(&s_session.targets[i])) {
+            pending++;
+        }
+    }
+
+    uint32_t timeout_ms = FW_ACK_TIMEOUT_MS;
+    if (s_session.mode == COMM_FW_DIST_MULTICAST) {
+        timeout_ms += FW_MULTICAST_ACK_SLOT_MS * pending;
+    }
+
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    fw_event_t ev;
+
+    while (pending > 0) {
+        int64_t remaining_us = deadline_us - esp_timer_get_time();
+        if (remaining_us <= 0) {
+            break;
+        }
+        if (xQueueReceive(s_event_queue, &ev, pdMS_TO_TICKS(remaining_us / 1000) + 1) != pdTRUE) {
+            break;
+        }
+
+        fw_target_t *t = find_target(ev.mac);
+        bool was_pending = t && !t->acked_round && !target_is_finished(t);
+        apply_event(&ev);
+        if (was_pending && t->acked_round) {
+            pending--;
+        }
+    }
+
+    for (int i = 0; i < s_session.target_count; i++) {
+        fw_target_t *t = &s_session.targets[i];
+        if (target_is_finished(t) || t->progressed_round) {
+            continue;
+        }
+        if (t->acked_round) {
+            if (++t->stalled_rounds >= FW_MAX_STALLED_ROUNDS) {
+                ESP_LOGW(TAG, "Sensor %s no avanza (%s), marcado como fallido", t->device_id,
+                         t->state == COMM_FW_TARGET_VERIFYING ? "sin DONE" : "sin chunks nuevos");
+                t->state = COMM_FW_TARGET_FAILED;
+                s_session.stats.targets_failed++;
+            }
+        } else if (++t->missed_rounds >= FW_MAX_MISSED_ROUNDS) {
+            ESP_LOGW(TAG, "Sensor %s sin respuesta, marcado como fallido", t->device_id);
+            t->state = COMM_FW_TARGET_FAILED;
+            s_session.stats.targets_failed++;
+        }
+    }
+}
+
+static bool session_has_pending_targets(void)
+{
+    for (int i = 0; i < s_session.target_count; i++) {
+        if (!target_is_finished(&s_session.targets[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Tarea que ejecuta la sesión de distribución
+ */
+static void fw_dist_task(void *pvParameters)
+{
+    int64_t start_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "Distribuyendo firmware v%lu (%lu bytes, %u chunks) a %u sensores [%s]",
+             (unsigned long)s_session.image.version, (unsigned long)s_session.image.size,
+             s_session.chunk_count, s_session.target_count,
+             s_session.mode == COMM_FW_DIST_MULTICAST ? "multicast" : "unicast");
+
+    while (!s_session.abort_requested && session_has_pending_targets()) {
+        send_round();
+        collect_responses();
+        s_session.stats.elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+        publish_stats();
+    }
+
+    if (s_session.abort_requested) {
+        ESP_LOGW(TAG, "Distribución cancelada");
+        for (int i = 0; i < s_session.target_count; i++) {
+            if (!target_is_finished(&s_session.targets[i])) {
+                send_abort(s_session.mode == COMM_FW_DIST_MULTICAST ? NULL : s_session.targets[i].mac);
+            }
+        }
+    }
+
+    s_session.stats.elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    s_session.stats.running = false;
+
+    ESP_LOGI(TAG, "Distribución finalizada en %lu ms: %u OK, %u fallidos, %lu tramas (%lu retransmitidas), %lu reanudaciones",
+             (unsigned long)s_session.stats.elapsed_ms,
+             s_session.stats.targets_done, s_session.stats.targets_failed,
+             (unsigned long)s_session.stats.frames_sent,
+             (unsigned long)s_session.stats.chunks_retransmitted,
+             (unsigned long)s_session.stats.resumes);
+
+    publish_stats();
+    s_session.running = false;
+
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Lee y valida la cabecera y el CRC de la imagen almacenada
+ */
+static esp_err_t load_image(void)
+{
+    s_session.partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                   ESP_PARTITION_SUBTYPE_ANY,
+                                                   FW_PARTITION_LABEL);
+    if (!s_session.partition) {
+        ESP_LOGE(TAG, "Partición %s no encontrada", FW_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = esp_partition_read(s_session.partition, 0, &s_session.image, sizeof(s_session.image));
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    uint32_t max_size = s_session.partition->size - sizeof(comm_fw_image_header_t);
+    uint32_t chunk_count = (s_session.image.size + COMM_FW_CHUNK_SIZE - 1) / COMM_FW_CHUNK_SIZE;
+
+    if (s_session.image.magic != COMM_FW_IMAGE_MAGIC || s_session.image.size == 0 ||
+        s_session.image.size > max_size || chunk_count > UINT16_MAX) {
+        ESP_LOGE(TAG, "No hay imagen válida en %s", FW_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_session.chunk_count = chunk_count;
+
+    uint8_t *block = malloc(FW_CRC_BLOCK_SIZE);
+    if (!block) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t crc = 0;
+    for (uint32_t offset = 0; offset < s_session.image.size; offset += FW_CRC_BLOCK_SIZE) {
+        size_t len = s_session.image.size - offset;
+        if (len > FW_CRC_BLOCK_SIZE) {
+            len = FW_CRC_BLOCK_SIZE;
+        }
+        err = esp_partition_read(s_session.partition, sizeof(comm_fw_image_header_t) + offset, block, len);
+        if (err != ESP_OK) {
+            free(block);
+            return err;
+        }
+        crc = esp_rom_crc32_le(crc, block, len);
+    }
+    free(block);
+
+    if (crc != s_session.image.crc32) {
+        ESP_LOGE(TAG, "CRC de imagen inválido (0x%08lx != 0x%08lx)",
+                 (unsigned long)crc, (unsigned long)s_session.image.crc32);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    return ESP_OK;
+}
+
+// ============================================================================
+// Funciones públicas
+// ============================================================================
+
+esp_err_t comm_fw_dist_start(const char *const *device_ids, size_t count, comm_fw_dist_mode_t mode)
+{
+    if (!device_ids || count == 0 || count > COMM_FW_DIST_MAX_TARGETS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_session.running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(&s_session, 0, sizeof(s_session));
+
+    // Resolver MACs en el registro de sensores
+    for (size_t i = 0; i < count; i++) {
+        sensor_info_t info;
+        if (comm_get_sensor_info(device_ids[i], &info) != ESP_OK || !info.is_registered) {
+            ESP_LOGE(TAG, "Sensor %s no registrado", device_ids[i]);
+            return ESP_ERR_NOT_FOUND;
+        }
+        fw_target_t *t = &s_session.targets[s_session.target_count++];
+        memcpy(t->mac, info.mac_addr, 6);
+        strncpy(t->device_id, info.device_id, DEVICE_ID_MAX_LEN - 1);
+        t->state = COMM_FW_TARGET_OFFERED;
+    }
+
+    esp_err_t err = load_image();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (!s_event_queue) {
+        s_event_queue = xQueueCreate(FW_EVENT_QUEUE_SIZE, sizeof(fw_event_t));
+        if (!s_event_queue) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    xQueueReset(s_event_queue);
+
+    s_session.mode = mode;
+    s_session.session_id = (uint16_t)(esp_random() | 1);
+    s_session.stats.running = true;
+    s_session.stats.mode = mode;
+    s_session.stats.image_size = s_session.image.size;
+    s_session.stats.chunk_count = s_session.chunk_count;
+    s_session.stats.target_count = s_session.target_count;
+    publish_stats();
+    s_session.running = true;
+
+    BaseType_t task_ret = xTaskCreate(fw_dist_task, "comm_fw", 4096, NULL, 3, NULL);
+    if (task_ret != pdPASS) {
+        ESP_LOGE(TAG, "Error al crear tarea de distribución");
+        s_session.running = false;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t comm_fw_dist_abort(void)
+{
+    if (!s_session.running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_session.abort_requested = true;
+    return ESP_OK;
+}
+
+bool comm_fw_dist_is_running(void)
+{
+    return s_session.running;
+}
+
+esp_err_t comm_fw_dist_get_stats(comm_fw_dist_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&s_stats_lock);
+    *stats = s_published_stats;
+    taskEXIT_CRITICAL(&s_stats_lock);
+    return ESP_OK;
+}
+
+void comm_fw_dist_handle_frame(const uint8_t *src_mac, const uint8_t *data, int len)
+{
+    if (!s_session.running || len < (int)sizeof(fw_frame_hdr_t)) {
+        return;
+    }
+
+    const fw_frame_hdr_t *hdr = (const fw_frame_hdr_t *)data;
+    if (hdr->session_id != s_session.session_id) {
+        ESP_LOGD(TAG, "Trama de sesión ajena (0x%04x)", hdr->session_id);
+        return;
+    }
+
+    fw_event_t ev = {0};
+    memcpy(ev.mac, src_mac, 6);
+    ev.type = hdr->type;
+
+    if (hdr->type == FW_FRAME_ACK && len >= (int)sizeof(fw_ack_frame_t)) {
+        const fw_ack_frame_t *ack = (const fw_ack_frame_t *)data;
+        ev.base = ack->base;
+        ev.bitmap = ack->bitmap;
+    } else if (hdr->type == FW_FRAME_DONE && len >= (int)sizeof(fw_done_frame_t)) {
+        ev.status = ((const fw_done_frame_t *)data)->status;
+    } else {
+        return;
+    }
+
+    if (xQueueSend(s_event_queue, &ev, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Cola de respuestas de firmware llena");
+    }
+}
@@ -0,0 +1,360 @@
+/**
+ * @file comm_rate.c
+ * @brief Implementación de la selección de tasa PHY por sensor
+ *
+ * La evaluación corre cada período de mantenimiento de comm. Por cada
+ * sensor se calcula la clase más rápida que su RSSI admite y se corrige con
+ * el ratio de entrega medido en la ventana: con pérdidas altas se baja un
+ * escalón aunque el RSSI sea bueno (interferencia, multipath).
+ */
+
+#include "comm_rate.h"
+#include "comm.h"
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+
+static const char *TAG = "COMM_RATE";
+
+// ============================================================================
+// Configuración
+// ============================================================================
+
+/** @brief Máximo de peers con tasa gestionada (igual al registro de comm) */
+#define COMM_RATE_MAX_PEERS         COMM_MAX_SENSORS
+
+/** @brief Margen de RSSI exigido para subir de clase */
+#define COMM_RATE_HYSTERESIS_DB     4
+
+/** @brief Envíos mínimos en la ventana para juzgar el ratio de entrega */
+#define COMM_RATE_MIN_SAMPLES       4
+
+/** @brief Ratio de entrega (%) por debajo del cual se baja un escalón */
+#define COMM_RATE_STEP_DOWN_PCT     80
+
+/** @brief Ratio de entrega (%) necesario para permitir subir */
+#define COMM_RATE_STEP_UP_PCT       95
+
+/** @brief Envíos sin ninguna entrega en LR para considerar al sensor no compatible */
+#define COMM_RATE_LR_PROBE_FRAMES   8
+
+/** @brief Cabecera MAC + action frame de ESP-Now sumada al payload */
+#define COMM_RATE_FRAME_OVERHEAD    43
+
+/**
+ * @brief Parámetros de cada clase de tasa
+ */
+typedef struct {
+    wifi_phy_mode_t phymode;
+    wifi_phy_rate_t rate;
+    uint32_t kbps;          /**< Tasa de datos */
+    uint16_t preamble_us;   /**< Preámbulo + cabecera PLCP */
+    int8_t min_rssi;        /**< RSSI mínimo para usar la clase */
+    const char *name;
+} rate_class_info_t;
+
+static const rate_class_info_t s_rate_table[COMM_RATE_CLASS_COUNT] = {
+    [COMM_RATE_LR_250K] = { WIFI_PHY_MODE_LR,   WIFI_PHY_RATE_LORA_250K, 250,   500, -128, "LR 250K" },
+    [COMM_RATE_1M]      = { WIFI_PHY_MODE_11B,  WIFI_PHY_RATE_1M_L,      1000,  192, -90,  "1M"      },
+    [COMM_RATE_MCS0]    = { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS0_LGI,  6500,  36,  -82,  "MCS0"    },
+    [COMM_RATE_MCS3]    = { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS3_LGI,  26000, 36,  -74,  "MCS3"    },
+    [COMM_RATE_MCS7]    = { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS7_LGI,  65000, 36,  -65,  "MCS7"    },
+};
+
+/**
+ * @brief Estado de tasa de un peer
+ */
+typedef struct {
+    uint8_t mac_addr[6];
+    bool in_use;
+    bool lr_unsupported;            /**< No recibió nada en LR */
+    comm_rate_class_t cls;          /**< Clase aplicada */
+    int16_t rssi_avg;               /**< RSSI promedio (EWMA, 0 = sin datos) */
+    uint16_t win_ok;                /**< Entregas en la ventana actual */
+    uint16_t win_fail;              /**< Fallos en la ventana actual */
+} rate_peer_t;
+
+// ============================================================================
+// Variables privadas
+// ============================================================================
+
+static rate_peer_t s_peers[COMM_RATE_MAX_PEERS];
+static comm_rate_stats_t s_stats = {0};
+
+/** @brief LR habilitado en la interfaz STA (CONFIG_COMM_LONG_RANGE) */
+static bool s_lr_enabled = false;
+
+/** @brief Protege s_peers y s_stats (el callback de envío corre en la tarea WiFi) */
+static portMUX_TYPE s_rate_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// ============================================================================
+// Funciones privadas
+// ============================================================================
+
+/**
+ * @note Llamar con s_rate_lock tomado
+ */
+static rate_peer_t *find_peer(const uint8_t *mac_addr)
+{
+    for (int i = 0; i < COMM_RATE_MAX_PEERS; i++) {
+        if (s_peers[i].in_use && memcmp(s_peers[i].mac_addr, mac_addr, 6) == 0) {
+            return &s_peers[i];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t frame_airtime_us(comm_rate_class_t cls, size_t len)
+{
+    const rate_class_info_t *info = &s_rate_table[cls];
+    return info->preamble_us + (uint32_t)((len + COMM_RATE_FRAME_OVERHEAD) * 8 * 1000 / info->kbps);
+}
+
+/**
+ * @brief Calcula la clase objetivo de un peer
+ * @note Llamar con s_rate_lock tomado
+ */
+static comm_rate_class_t select_class(rate_peer_t *peer)
+{
+    comm_rate_class_t current = peer->cls;
+    uint32_t attempts = peer->win_ok + peer->win_fail;
+
+    // Sensor que no recibe en LR: volver a 1 Mbps y no intentarlo más
+    if (current == COMM_RATE_LR_250K && attempts >= COMM_RATE_LR_PROBE_FRAMES && peer->win_ok == 0) {
+        peer->lr_unsupported = true;
+        s_stats.lr_unsupported++;
+        return COMM_RATE_1M;
+    }
+
+    if (peer->rssi_avg == 0) {
+        return current;
+    }
+
+    // Clase más rápida admitida por el RSSI, con histéresis para subir
+    comm_rate_class_t target = COMM_RATE_LR_250K;
+    for (int cls = COMM_RATE_CLASS_COUNT - 1; cls > COMM_RATE_LR_250K; cls--) {
+        int margin = (cls > current) ? COMM_RATE_HYSTERESIS_DB : 0;
+        if (peer->rssi_avg >= s_rate_table[cls].min_rssi + margin) {
+            target = (comm_rate_class_t)cls;
+            break;
+        }
+    }
+
+    // Corregir con el ratio de entrega medido
+    if (attempts >= COMM_RATE_MIN_SAMPLES) {
+        uint32_t delivery_pct = peer->win_ok * 100 / attempts;
+        if (delivery_pct < COMM_RATE_STEP_DOWN_PCT && current > COMM_RATE_LR_250K && target >= current) {
+            target = current - 1;
+        } else if (delivery_pct < COMM_RATE_STEP_UP_PCT && target > current) {
+            target = current;
+        }
+    }
+
+    // Subir de a un escalón por evaluación
+    if (target > current + 1) {
+        target = current + 1;
+    }
+
+    if (target == COMM_RATE_LR_250K && (peer->lr_unsupported || !s_lr_enabled)) {
+        target = COMM_RATE_1M;
+    }
+    return target;
+}
+
+static esp_err_t apply_class(const uint8_t *mac_addr, comm_rate_class_t cls)
+{
+    esp_now_rate_config_t rate_config = {
+        .phymode = s_rate_table[cls].phymode,
+        .rate = s_rate_table[cls].rate,
+        .ersu = false,
+        .dcm = false,
+    };
+    return esp_now_set_peer_rate_config(mac_addr, &rate_config);
+}
+
+// ============================================================================
+// Funciones públicas
+// ============================================================================
+
+esp_err_t comm_rate_init(void)
+{
+#if CONFIG_COMM_LONG_RANGE
+    // La STA es también el enlace con el AP (ver la ayuda de COMM_LONG_RANGE)
+    uint8_t protocol = 0;
+    esp_err_t err = esp_wifi_get_protocol(WIFI_IF_STA, &protocol);
+    if (err == ESP_OK && !(protocol & WIFI_PROTOCOL_LR)) {
+        err = esp_wifi_set_protocol(WIFI_IF_STA, protocol | WIFI_PROTOCOL_LR);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "No se pudo habilitar Long Range: %s", esp_err_to_name(err));
+    }
+    s_lr_enabled = (err == ESP_OK);
+    return err;
+#else
+    s_lr_enabled = false;
+    return ESP_OK;
+#endif
+}
+
+void comm_rate_peer_added(const uint8_t *mac_addr)
+{
+    bool added = false;
+    taskENTER_CRITICAL(&s_rate_lock);
+    rate_peer_t *peer = find_peer(mac_addr);
+    if (!peer) {
+        for (int i = 0; i < COMM_RATE_MAX_PEERS; i++) {
+            if (!s_peers[i].in_use) {
+                peer = &s_peers[i];
+                memset(peer, 0, sizeof(*peer));
+                memcpy(peer->mac_addr, mac_addr, 6);
+                peer->in_use = true;
+                peer->cls = COMM_RATE_1M;
+                s_stats.classes[COMM_RATE_1M].peers++;
+                added = true;
+                break;
+            }
+        }
+    }
+    taskEXIT_CRITICAL(&s_rate_lock);
+
+    // El peer ESP-Now puede conservar la tasa de un registro anterior
+    if (added) {
+        apply_class(mac_addr, COMM_RATE_1M);
+    }
+}
+
+void comm_rate_peer_removed(const uint8_t *mac_addr)
+{
+    taskENTER_CRITICAL(&s_rate_lock);
+    rate_peer_t *peer = find_peer(mac_addr);
+    if (peer) {
+        s_stats.classes[peer->cls].peers--;
+        peer->in_use = false;
+    }
+    taskEXIT_CRITICAL(&s_rate_lock);
+}
+
+void comm_rate_note_rx(const uint8_t *mac_addr, int8_t rssi)
+{
+    if (rssi == 0) {
+        return;
+    }
+    taskENTER_CRITICAL(&s_rate_lock);
+    rate_peer_t *peer = find_peer(mac_addr);
+    if (peer) {
+        peer->rssi_avg = (peer->rssi_avg == 0) ? rssi : (3 * peer->rssi_avg + rssi) / 4;
+    }
+    taskEXIT_CRITICAL(&s_rate_lock);
+}
+
+void comm_rate_note_tx(const uint8_t *mac_addr, size_t len)
+{
+    taskENTER_CRITICAL(&s_rate_lock);
+    rate_peer_t *peer = find_peer(mac_addr);
+    if (peer) {
+        comm_rate_class_stats_t *cls_stats = &s_stats.classes[peer->cls];
+        cls_stats->tx_frames++;
+        cls_stats->airtime_us += frame_airtime_us(peer->cls, len);
+        cls_stats->airtime_default_us += frame_airtime_us(COMM_RATE_1M, len);
+    }
+    taskEXIT_CRITICAL(&s_rate_lock);
+}
+
+void comm_rate_note_tx_status(const uint8_t *mac_addr, bool success)
+{
+    if (!mac_addr) {
+        return;
+    }
+    taskENTER_CRITICAL(&s_rate_lock);
+    rate_peer_t *peer = find_peer(mac_addr);
+    if (peer) {
+        if (success) {
+            peer->win_ok++;
+            s_stats.classes[peer->cls].tx_ok++;
+        } else {
+            peer->win_fail++;
+            s_stats.classes[peer->cls].tx_fail++;
+        }
+    }
+    taskEXIT_CRITICAL(&s_rate_lock);
+}
+
+void comm_rate_evaluate(void)
+{
+    for (int i = 0; i < COMM_RATE_MAX_PEERS; i++) {
+        uint8_t mac_addr[6];
+        comm_rate_class_t current;
+        comm_rate_class_t target;
+
+        taskENTER_CRITICAL(&s_rate_lock);
+        rate_peer_t *peer = &s_peers[i];
+        if (!peer->in_use) {
+            taskEXIT_CRITICAL(&s_rate_lock);
+            continue;
+        }
+        memcpy(mac_addr, peer->mac_addr, 6);
+        current = peer->cls;
+        target = select_class(peer);
+        // Ventana nueva solo si hubo muestras suficientes para juzgarla
+        if (peer->win_ok + peer->win_fail >= COMM_RATE_MIN_SAMPLES || target != current) {
+            peer->win_ok = 0;
+            peer->win_fail = 0;
+        }
+        taskEXIT_CRITICAL(&s_rate_lock);
+
+        if (target == current) {
+            continue;
+        }
+
+        esp_err_t err = apply_class(mac_addr, target);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Error aplicando tasa %s a " MACSTR ": %s",
+                     s_rate_table[target].name, MAC2STR(mac_addr), esp_err_to_name(err));
+            continue;
+        }
+
+        taskENTER_CRITICAL(&s_rate_lock);
+        if (peer->in_use && memcmp(peer->mac_addr, mac_addr, 6) == 0) {
+            s_stats.classes[current].peers--;
+            s_stats.classes[target].peers++;
+            peer->cls = target;
+            s_stats.rate_changes++;
+        }
+        taskEXIT_CRITICAL(&s_rate_lock);
+
+        ESP_LOGI(TAG, "Peer " MACSTR ": tasa %s -> %s",
+                 MAC2STR(mac_addr), s_rate_table[current].name, s_rate_table[target].name);
+    }
+}
+
+esp_err_t comm_rate_get_stats(comm_rate_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&s_rate_lock);
+    *stats = s_stats;
+    taskEXIT_CRITICAL(&s_rate_lock);
+    return ESP_OK;
+}
+
+void comm_rate_print_stats(void)
+{
+    comm_rate_stats_t stats;
+    comm_rate_get_stats(&stats);
+
+    ESP_LOGI(TAG, "Tasas: %lu cambios, %lu sensores sin LR",
+             (unsigned long)stats.rate_changes, (unsigned long)stats.lr_unsupported);
+    for (int i = 0; i < COMM_RATE_CLASS_COUNT; i++) {
+        const comm_rate_class_stats_t *cls = &stats.classes[i];
+        uint32_t done = cls->tx_ok + cls->tx_fail;
+        int64_t saved_us = (int64_t)cls->airtime_default_us - (int64_t)cls->airtime_us;
+        ESP_LOGI(TAG, "  - %-7s: %u peers, %lu tramas, entrega %lu%%, airtime ahorrado %lld ms",
+                 s_rate_table[i].name, cls->peers, (unsigned long)cls->tx_frames,
+                 done ? (unsigned long)(cls->tx_ok * 100 / done) : 0UL,
+                 (long long)(saved_us / 1000));
+    }
+}
@@ -0,0 +1,26 @@
+/**
+ * @file comm_host_test.c
+ * @brief Simulaciones de host del componente comm
+ */
+
+#include <stdlib.h>
+#include "unity.h"
+#include "comm_host_test.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    test_fw_dist_run();
+    test_hb_interval_run();
+    test_slots_run();
+    int failures = UNITY_END();
+    exit(failures == 0 ? 0 : 1);
+}
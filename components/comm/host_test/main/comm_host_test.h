@@ -0,0 +1,24 @@
+/**
+ * @file comm_host_test.h
+ * @brief Grupos de pruebas de las simulaciones de comm
+ */
+
+#ifndef COMM_HOST_TEST_H
+#define COMM_HOST_TEST_H
+
+/**
+ * @brief Distribución de firmware: rondas, pérdidas, reanudación y fallos
+ */
+void test_fw_dist_run(void);
+
+/**
+ * @brief Heartbeat adaptativo: negociación del intervalo, pérdidas y liveness
+ */
+void test_hb_interval_run(void);
+
+/**
+ * @brief Planificador de slots: colisiones con 10 a 200 sensores y desborde de la hora
+ */
+void test_slots_run(void);
+
+#endif // COMM_HOST_TEST_H
@@ -0,0 +1,83 @@
+/**
+ * @file comm_under_test.c
+ * @brief comm.c con el tick de FreeRTOS tomado del reloj simulado
+ *
+ * comm.c mide last_seen y los huecos entre heartbeats con
+ * xTaskGetTickCount(); con el reloj simulado las simulaciones avanzan
+ * horas de funcionamiento sin esperarlas. Las funciones comm_sim_* dan
+ * acceso al camino de recepción y al mantenimiento de comm_processing_task
+ * sin la tarea ni la cola (ver sim_radio.h).
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sim_radio.h"
+
+#define xTaskGetTickCount()     sim_clock_ticks()
+
+#include "../../comm.c"
+
+// ============================================================================
+// Acceso para las simulaciones
+// ============================================================================
+
+void comm_sim_reset(void)
+{
+    for (int i = 0; i < s_sensor_count; i++) {
+        if (s_registered_sensors[i].is_registered) {
+            comm_rate_peer_removed(s_registered_sensors[i].mac_addr);
+        }
+    }
+    s_sensor_count = 0;
+    memset(s_registered_sensors, 0, sizeof(s_registered_sensors));
+    memset(s_sensor_links, 0, sizeof(s_sensor_links));
+    memset(&s_hb_stats, 0, sizeof(s_hb_stats));
+    memset(&s_hb_stats_published, 0, sizeof(s_hb_stats_published));
+    memset(&s_slot_stats, 0, sizeof(s_slot_stats));
+    s_rx_window_frames = 0;
+    s_rx_dropped = 0;
+    s_pairing_open = false;
+    for (int i = 0; i < COMM_SLOT_COUNT; i++) {
+        s_slot_usage[i].superframe = 0;
+        s_slot_usage[i].sensor_idx = -1;
+    }
+}
+
+void comm_sim_receive(const uint8_t *src_mac, const uint8_t *data, int len, int8_t rssi)
+{
+    raw_data_t raw_data;
+    raw_data.len = len;
+    memcpy(raw_data.data, data, len);
+    memcpy(raw_data.src_mac, src_mac, 6);
+    raw_data.rssi = rssi;
+    raw_data.rx_time_ms = comm_get_gateway_time_ms();
+
+    // Mismo camino que comm_processing_task, sin la cola del controlador
+    s_rx_window_frames++;
+    controller_message_t message;
+    memset(&message, 0, sizeof(controller_message_t));
+    if (parse_json_message(raw_data.data, raw_data.len, &message) == ESP_OK) {
+        message.rssi = raw_data.rssi;
+        update_sensor_from_message(&raw_data, &message);
+    }
+}
+
+void comm_sim_channel_frames(uint32_t frames)
+{
+    s_rx_window_frames += frames;
+}
+
+void comm_sim_maintenance(void)
+{
+    comm_maintenance();
+}
+
+uint32_t comm_sim_reported_interval_s(const char *device_id)
+{
+    for (int i = 0; i < s_sensor_count; i++) {
+        if (strcmp(s_registered_sensors[i].device_id, device_id) == 0) {
+            return s_sensor_links[i].reported_hb_s;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file fakes.c
+ * @brief ESP-Now, WiFi y partición sensor_fw para el target linux
+ *
+ * esp_timer y el reloj simulado están en host_test_support (sim_clock.h).
+ */
+
+#include <string.h>
+#include "esp_now.h"
+#include "esp_wifi.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "system_globals.h"
+#include "sim_radio.h"
+
+/** @brief Tamaño de la partición sensor_fw simulada */
+#define SIM_FLASH_SIZE      (256 * 1024)
+
+system_context_t gSystemCtx;
+
+static sim_radio_listener_t s_listener = NULL;
+static uint32_t s_tx_frames = 0;
+static uint64_t s_rng_state = 1;
+
+static uint8_t s_flash[SIM_FLASH_SIZE];
+static const esp_partition_t s_partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .size = SIM_FLASH_SIZE,
+    .label = "sensor_fw",
+};
+
+// ============================================================================
+// Simulación
+// ============================================================================
+
+void sim_radio_set_listener(sim_radio_listener_t listener)
+{
+    s_listener = listener;
+}
+
+uint32_t sim_radio_tx_frames(void)
+{
+    return s_tx_frames;
+}
+
+uint32_t sim_clock_ticks(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+double sim_random(void)
+{
+    // LCG de 64 bits (Knuth MMIX): reproducible entre plataformas
+    s_rng_state = s_rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (double)(s_rng_state >> 11) / (double)(1ULL << 53);
+}
+
+void sim_random_seed(uint32_t seed)
+{
+    s_rng_state = seed;
+}
+
+void sim_flash_set(const uint8_t *data, size_t len)
+{
+    memset(s_flash, 0xFF, sizeof(s_flash));
+    memcpy(s_flash, data, len < sizeof(s_flash) ? len : sizeof(s_flash));
+}
+
+// ============================================================================
+// ESP-Now y WiFi
+// ============================================================================
+
+esp_err_t esp_now_init(void) { return ESP_OK; }
+esp_err_t esp_now_deinit(void) { return ESP_OK; }
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) { return ESP_OK; }
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb) { return ESP_OK; }
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer) { return ESP_OK; }
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr) { return ESP_OK; }
+bool esp_now_is_peer_exist(const uint8_t *peer_addr) { return true; }
+esp_err_t esp_now_set_peer_rate_config(const uint8_t *peer_addr, esp_now_rate_config_t *config) { return ESP_OK; }
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    s_tx_frames++;
+    if (s_listener) {
+        s_listener(peer_addr, data, len);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) { return ESP_OK; }
+esp_err_t esp_wifi_deinit(void) { return ESP_OK; }
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) { return ESP_OK; }
+esp_err_t esp_wifi_start(void) { return ESP_OK; }
+esp_err_t esp_wifi_stop(void) { return ESP_OK; }
+esp_err_t esp_wifi_set_protocol(wifi_interface_t ifx, uint8_t protocol_bitmap) { return ESP_OK; }
+
+esp_err_t esp_wifi_get_protocol(wifi_interface_t ifx, uint8_t *protocol_bitmap)
+{
+    *protocol_bitmap = WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    static const uint8_t gateway_mac[6] = {0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01};
+    memcpy(mac, gateway_mac, 6);
+    return ESP_OK;
+}
+
+// ============================================================================
+// Partición sensor_fw y aleatoriedad (main/CMakeLists.txt usa --wrap)
+// ============================================================================
+
+const esp_partition_t *__wrap_esp_partition_find_first(esp_partition_type_t type,
+                                                       esp_partition_subtype_t subtype,
+                                                       const char *label)
+{
+    return (label && strcmp(label, s_partition.label) == 0) ? &s_partition : NULL;
+}
+
+esp_err_t __wrap_esp_partition_read(const esp_partition_t *partition, size_t src_offset,
+                                    void *dst, size_t size)
+{
+    if (partition != &s_partition || src_offset + size > SIM_FLASH_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, s_flash + src_offset, size);
+    return ESP_OK;
+}
+
+uint32_t __wrap_esp_random(void)
+{
+    return (uint32_t)(sim_random() * 4294967296.0);
+}
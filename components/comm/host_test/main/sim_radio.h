@@ -0,0 +1,108 @@
+/**
+ * @file sim_radio.h
+ * @brief Canal ESP-Now, reloj y flash simulados para las pruebas de comm
+ *
+ * Las fuentes de comm se compilan sin cambios; fakes.c reemplaza ESP-Now,
+ * WiFi y la partición sensor_fw, y esp_timer es el de host_test_support
+ * (reloj en sim_clock.h, incluido acá). Toda trama que comm envía con
+ * esp_now_send() pasa por el listener registrado, que modela a los
+ * sensores y responde llamando a las funciones de recepción de comm.
+ */
+
+#ifndef SIM_RADIO_H
+#define SIM_RADIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sim_clock.h"
+
+/**
+ * @brief Receptor de las tramas transmitidas por el Gateway
+ *
+ * @param dest_mac Destino (FF:FF:FF:FF:FF:FF = broadcast)
+ * @param data Trama
+ * @param len Longitud
+ */
+typedef void (*sim_radio_listener_t)(const uint8_t *dest_mac, const uint8_t *data, size_t len);
+
+/**
+ * @brief Registra el receptor de las tramas del Gateway (NULL = descartar)
+ */
+void sim_radio_set_listener(sim_radio_listener_t listener);
+
+/**
+ * @brief Tramas enviadas por el Gateway desde el arranque
+ */
+uint32_t sim_radio_tx_frames(void);
+
+/**
+ * @brief Tick de FreeRTOS según el reloj simulado
+ *
+ * comm.c (comm_under_test.c) lo usa como xTaskGetTickCount(), así que sigue
+ * a sim_clock_advance_ms() igual que esp_timer_get_time(). En modo manual
+ * (sim_clock_set_manual()) las horas de recepción caen exactamente donde
+ * las ubica la simulación; las pruebas que esperan a tareas de comm
+ * (comm_fw_dist) necesitan el modo normal.
+ */
+uint32_t sim_clock_ticks(void);
+
+/**
+ * @brief Número pseudoaleatorio uniforme en [0, 1), reproducible
+ */
+double sim_random(void);
+
+/**
+ * @brief Reinicia la secuencia de sim_random() y esp_random()
+ */
+void sim_random_seed(uint32_t seed);
+
+/**
+ * @brief Contenido de la partición sensor_fw simulada
+ *
+ * @param data Cabecera comm_fw_image_header_t seguida de la imagen
+ * @param len Longitud
+ */
+void sim_flash_set(const uint8_t *data, size_t len);
+
+// ============================================================================
+// Acceso a comm.c (comm_under_test.c)
+// ============================================================================
+
+/**
+ * @brief Vacía el registro de sensores y las estadísticas de heartbeat y slots
+ */
+void comm_sim_reset(void);
+
+/**
+ * @brief Entrega una trama recibida como lo haría comm_processing_task
+ *
+ * Parsea el JSON, registra al sensor si es nuevo y actualiza su enlace
+ * (RSSI, heartbeats perdidos, confirmación del intervalo). Las respuestas
+ * CONFIG del Gateway salen por el listener de la radio.
+ *
+ * @param src_mac MAC del sensor
+ * @param data Trama JSON
+ * @param len Longitud
+ * @param rssi RSSI de recepción
+ */
+void comm_sim_receive(const uint8_t *src_mac, const uint8_t *data, int len, int8_t rssi);
+
+/**
+ * @brief Suma tramas de otros equipos a la ventana de carga del canal
+ */
+void comm_sim_channel_frames(uint32_t frames);
+
+/**
+ * @brief Ejecuta el mantenimiento periódico (carga, intervalos y liveness)
+ */
+void comm_sim_maintenance(void);
+
+/**
+ * @brief Intervalo que el sensor informó aplicar en su último heartbeat
+ *
+ * @return Segundos, 0 si el sensor no existe o no lo informó
+ */
+uint32_t comm_sim_reported_interval_s(const char *device_id);
+
+#endif // SIM_RADIO_H
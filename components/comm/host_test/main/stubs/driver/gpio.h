@@ -0,0 +1,11 @@
+/**
+ * @file gpio.h
+ * @brief gpio_num_t para system_globals.h en el target linux
+ */
+
+#pragma once
+
+typedef enum {
+    GPIO_NUM_0 = 0,
+    GPIO_NUM_21 = 21,
+} gpio_num_t;
@@ -0,0 +1,11 @@
+/**
+ * @file esp_mac.h
+ * @brief MACSTR/MAC2STR de esp_mac.h para el target linux
+ */
+
+#pragma once
+
+#include "esp_err.h"
+
+#define MAC2STR(a)  (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+#define MACSTR      "%02x:%02x:%02x:%02x:%02x:%02x"
@@ -0,0 +1,60 @@
+/**
+ * @file esp_wifi.h
+ * @brief Declaraciones mínimas de WiFi para el target linux
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define ESP_ERR_WIFI_BASE           0x3000
+
+#define WIFI_PROTOCOL_11B           0x1
+#define WIFI_PROTOCOL_11G           0x2
+#define WIFI_PROTOCOL_11N           0x4
+#define WIFI_PROTOCOL_LR            0x8
+
+typedef enum {
+    WIFI_IF_STA = 0,
+    WIFI_IF_AP,
+} wifi_interface_t;
+
+typedef enum {
+    WIFI_MODE_NULL = 0,
+    WIFI_MODE_STA,
+} wifi_mode_t;
+
+typedef enum {
+    WIFI_PHY_MODE_LR,
+    WIFI_PHY_MODE_11B,
+    WIFI_PHY_MODE_11G,
+    WIFI_PHY_MODE_HT20,
+} wifi_phy_mode_t;
+
+typedef enum {
+    WIFI_PHY_RATE_1M_L = 0x00,
+    WIFI_PHY_RATE_2M_L = 0x01,
+    WIFI_PHY_RATE_11M_L = 0x03,
+    WIFI_PHY_RATE_6M = 0x0B,
+    WIFI_PHY_RATE_MCS0_LGI = 0x10,
+    WIFI_PHY_RATE_MCS3_LGI = 0x13,
+    WIFI_PHY_RATE_MCS7_LGI = 0x17,
+    WIFI_PHY_RATE_LORA_250K = 0x29,
+    WIFI_PHY_RATE_LORA_500K = 0x2A,
+} wifi_phy_rate_t;
+
+typedef struct {
+    int unused;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT() { 0 }
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_deinit(void);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_stop(void);
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6]);
+esp_err_t esp_wifi_set_protocol(wifi_interface_t ifx, uint8_t protocol_bitmap);
+esp_err_t esp_wifi_get_protocol(wifi_interface_t ifx, uint8_t *protocol_bitmap);
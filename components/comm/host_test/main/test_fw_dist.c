@@ -0,0 +1,361 @@
+/**
+ * @file test_fw_dist.c
+ * @brief Simulación de la distribución de firmware con N sensores y pérdidas
+ *
+ * Cada sensor simulado implementa el lado sensor del protocolo (ver
+ * comm_fw_dist.c): responde ACK con su ventana a OFFER y a la última
+ * trama de cada ráfaga, y DONE al completar la imagen. Cada trama se
+ * pierde con probabilidad `loss` en cada sentido (pérdida efectiva tras
+ * los reintentos MAC).
+ *
+ * El tiempo de despliegue informado es el tiempo de sesión medido (incluye
+ * las esperas reales de ACK de comm_fw_dist) más el airtime modelado de
+ * las tramas a 1 Mbps.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "comm.h"
+#include "comm_fw_dist.h"
+#include "comm_host_test.h"
+#include "sim_radio.h"
+
+#define SIM_IMAGE_SIZE          (24 * 1024)
+#define SIM_CHUNKS              ((SIM_IMAGE_SIZE + COMM_FW_CHUNK_SIZE - 1) / COMM_FW_CHUNK_SIZE)
+#define SIM_SENSORS             COMM_FW_DIST_MAX_TARGETS
+
+/** @brief Airtime a 1 Mbps con preámbulo largo: trama DATA completa y tramas cortas */
+#define SIM_DATA_AIRTIME_US     2200
+#define SIM_SHORT_AIRTIME_US    400
+
+/** @brief Tramas que un sensor ignora mientras reinicia */
+#define SIM_REBOOT_SILENT_FRAMES 40
+
+/** @brief Espera máxima de una sesión (tiempo real) */
+#define SIM_SESSION_TIMEOUT_MS  120000
+
+/** @brief El sensor escribe en flash cada dos ventanas */
+#define SIM_PERSIST_CHUNKS      (2 * COMM_FW_WINDOW_CHUNKS)
+
+// Formato de tramas del protocolo (mismo que comm_fw_dist.c)
+enum { FRAME_OFFER = 1, FRAME_DATA = 2, FRAME_ACK = 3, FRAME_DONE = 4, FRAME_ABORT = 5 };
+#define FRAME_FLAG_ACK_REQ      0x01
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t type;
+    uint16_t session_id;
+} frame_hdr_t;
+
+typedef struct __attribute__((packed)) {
+    frame_hdr_t hdr;
+    uint16_t chunk_index;
+    uint8_t flags;
+    uint8_t data[COMM_FW_CHUNK_SIZE];
+} data_frame_t;
+
+typedef struct __attribute__((packed)) {
+    frame_hdr_t hdr;
+    uint16_t base;
+    uint32_t bitmap;
+} ack_frame_t;
+
+typedef struct __attribute__((packed)) {
+    frame_hdr_t hdr;
+    uint8_t status;
+} done_frame_t;
+
+/**
+ * @brief Sensor simulado
+ */
+typedef struct {
+    uint8_t mac[6];
+    char id[DEVICE_ID_MAX_LEN];
+    uint8_t chunks[(SIM_CHUNKS + 7) / 8];
+    uint16_t base;              /**< Primer chunk no recibido */
+    uint16_t session_id;
+    uint32_t received;          /**< Chunks nuevos recibidos */
+    double loss;                /**< Pérdida por trama en cada sentido */
+    int32_t reboot_at;          /**< Reinicia al recibir este número de chunks (-1 = nunca) */
+    uint32_t silent_frames;     /**< Tramas ignoradas (reiniciando) */
+    bool never_done;            /**< Completa la imagen pero nunca envía DONE */
+} sim_sensor_t;
+
+static sim_sensor_t s_sensors[SIM_SENSORS];
+static int s_sensor_count = 0;
+static uint32_t s_uplink_frames = 0;
+
+static uint8_t s_flash_image[sizeof(comm_fw_image_header_t) + SIM_IMAGE_SIZE];
+
+// ============================================================================
+// Sensores simulados
+// ============================================================================
+
+static bool chunk_received(const sim_sensor_t *s, uint32_t chunk)
+{
+    return s->chunks[chunk / 8] & (1 << (chunk % 8));
+}
+
+static void send_to_gateway(sim_sensor_t *s, const void *frame, size_t len)
+{
+    s_uplink_frames++;
+    if (sim_random() < s->loss) {
+        return;
+    }
+    comm_fw_dist_handle_frame(s->mac, frame, (int)len);
+}
+
+static void reply(sim_sensor_t *s)
+{
+    if (s->base >= SIM_CHUNKS && !s->never_done) {
+        done_frame_t done = {
+            .hdr = { COMM_FW_DIST_MAGIC, FRAME_DONE, s->session_id },
+            .status = 0,
+        };
+        send_to_gateway(s, &done, sizeof(done));
+        return;
+    }
+
+    ack_frame_t ack = {
+        .hdr = { COMM_FW_DIST_MAGIC, FRAME_ACK, s->session_id },
+        .base = s->base,
+        .bitmap = 0,
+    };
+    for (int i = 0; i < COMM_FW_WINDOW_CHUNKS && s->base + i < SIM_CHUNKS; i++) {
+        if (chunk_received(s, s->base + i)) {
+            ack.bitmap |= (1UL << i);
+        }
+    }
+    send_to_gateway(s, &ack, sizeof(ack));
+}
+
+/**
+ * @brief Reinicio: conserva solo los chunks ya escritos en flash
+ */
+static void reboot(sim_sensor_t *s)
+{
+    uint32_t persisted = (s->base / SIM_PERSIST_CHUNKS) * SIM_PERSIST_CHUNKS;
+    for (uint32_t chunk = persisted; chunk < SIM_CHUNKS; chunk++) {
+        s->chunks[chunk / 8] &= ~(1 << (chunk % 8));
+    }
+    s->base = persisted;
+    s->silent_frames = SIM_REBOOT_SILENT_FRAMES;
+    s->reboot_at = -1;
+}
+
+static void sensor_receive(sim_sensor_t *s, const uint8_t *data, size_t len)
+{
+    if (sim_random() < s->loss) {
+        return;
+    }
+    if (s->silent_frames > 0) {
+        s->silent_frames--;
+        return;
+    }
+
+    const frame_hdr_t *hdr = (const frame_hdr_t *)data;
+    if (hdr->type == FRAME_OFFER) {
+        s->session_id = hdr->session_id;
+        reply(s);
+    } else if (hdr->type == FRAME_DATA && hdr->session_id == s->session_id) {
+        const data_frame_t *frame = (const data_frame_t *)data;
+        uint16_t chunk = frame->chunk_index;
+        if (chunk < SIM_CHUNKS && !chunk_received(s, chunk)) {
+            s->chunks[chunk / 8] |= (1 << (chunk % 8));
+            s->received++;
+            while (s->base < SIM_CHUNKS && chunk_received(s, s->base)) {
+                s->base++;
+            }
+            if (s->reboot_at >= 0 && s->received == (uint32_t)s->reboot_at) {
+                reboot(s);
+                return;
+            }
+        }
+        if (frame->flags & FRAME_FLAG_ACK_REQ) {
+            reply(s);
+        }
+    }
+}
+
+static void radio_listener(const uint8_t *dest_mac, const uint8_t *data, size_t len)
+{
+    static const uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    if (len < sizeof(frame_hdr_t) || data[0] != COMM_FW_DIST_MAGIC) {
+        return;
+    }
+    bool is_broadcast = memcmp(dest_mac, broadcast, 6) == 0;
+    for (int i = 0; i < s_sensor_count; i++) {
+        if (is_broadcast || memcmp(dest_mac, s_sensors[i].mac, 6) == 0) {
+            sensor_receive(&s_sensors[i], data, len);
+        }
+    }
+}
+
+// ============================================================================
+// Escenarios
+// ============================================================================
+
+typedef struct {
+    comm_fw_dist_stats_t stats;
+    uint32_t rollout_ms;
+} rollout_result_t;
+
+static void setup_sensors(int count, double loss)
+{
+    memset(s_sensors, 0, sizeof(s_sensors));
+    s_sensor_count = count;
+    for (int i = 0; i < count; i++) {
+        sim_sensor_t *s = &s_sensors[i];
+        uint8_t mac[6] = {0x30, 0xAE, 0xA4, 0x00, 0x10, (uint8_t)i};
+        memcpy(s->mac, mac, 6);
+        snprintf(s->id, sizeof(s->id), "SIM-%02d", i);
+        s->loss = loss;
+        s->reboot_at = -1;
+        TEST_ASSERT_EQUAL(ESP_OK, comm_register_sensor(s->mac, s->id, DEV_TYPE_SENSOR_DOOR));
+    }
+}
+
+static rollout_result_t run_rollout(comm_fw_dist_mode_t mode)
+{
+    const char *ids[SIM_SENSORS];
+    for (int i = 0; i < s_sensor_count; i++) {
+        ids[i] = s_sensors[i].id;
+    }
+
+    s_uplink_frames = 0;
+    sim_radio_set_listener(radio_listener);
+    TEST_ASSERT_EQUAL(ESP_OK, comm_fw_dist_start(ids, s_sensor_count, mode));
+    TickType_t start = xTaskGetTickCount();
+    while (comm_fw_dist_is_running()) {
+        if (xTaskGetTickCount() - start > pdMS_TO_TICKS(SIM_SESSION_TIMEOUT_MS)) {
+            // La sesión no termina sola: cancelar para no colgar la prueba
+            comm_fw_dist_abort();
+            while (comm_fw_dist_is_running()) {
+                vTaskDelay(pdMS_TO_TICKS(10));
+            }
+            sim_radio_set_listener(NULL);
+            TEST_FAIL_MESSAGE("la sesión de distribución no terminó");
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    sim_radio_set_listener(NULL);
+
+    rollout_result_t result;
+    comm_fw_dist_get_stats(&result.stats);
+    uint64_t airtime_us = (uint64_t)result.stats.frames_sent * SIM_DATA_AIRTIME_US +
+                          (uint64_t)(result.stats.rounds + s_uplink_frames) * SIM_SHORT_AIRTIME_US;
+    result.rollout_ms = result.stats.elapsed_ms + (uint32_t)(airtime_us / 1000);
+    return result;
+}
+
+static void setup_image(void)
+{
+    comm_fw_image_header_t *header = (comm_fw_image_header_t *)s_flash_image;
+    uint8_t *image = s_flash_image + sizeof(*header);
+
+    sim_random_seed(1234);
+    for (int i = 0; i < SIM_IMAGE_SIZE; i++) {
+        image[i] = (uint8_t)(sim_random() * 256);
+    }
+    header->magic = COMM_FW_IMAGE_MAGIC;
+    header->size = SIM_IMAGE_SIZE;
+    header->version = 2;
+    header->crc32 = esp_rom_crc32_le(0, image, SIM_IMAGE_SIZE);
+    sim_flash_set(s_flash_image, sizeof(s_flash_image));
+}
+
+static void test_unicast_without_loss_sends_each_chunk_once(void)
+{
+    setup_sensors(3, 0.0);
+    rollout_result_t r = run_rollout(COMM_FW_DIST_UNICAST);
+
+    TEST_ASSERT_EQUAL(3, r.stats.targets_done);
+    TEST_ASSERT_EQUAL(0, r.stats.targets_failed);
+    TEST_ASSERT_EQUAL(3 * SIM_CHUNKS, r.stats.frames_sent);
+    TEST_ASSERT_EQUAL(0, r.stats.chunks_retransmitted);
+}
+
+static void test_multicast_sends_shared_chunks_once(void)
+{
+    setup_sensors(SIM_SENSORS, 0.0);
+    rollout_result_t r = run_rollout(COMM_FW_DIST_MULTICAST);
+
+    TEST_ASSERT_EQUAL(SIM_SENSORS, r.stats.targets_done);
+    TEST_ASSERT_EQUAL(SIM_CHUNKS, r.stats.frames_sent);
+}
+
+static void test_rollout_time_with_loss(void)
+{
+    static const int counts[] = {1, 5, SIM_SENSORS};
+    static const double losses[] = {0.0, 0.1, 0.3};
+
+    printf("\nDespliegue de %u bytes (%u chunks)\n", SIM_IMAGE_SIZE, SIM_CHUNKS);
+    printf("modo       sensores pérdida | rondas  tramas  retx  despliegue_ms\n");
+    for (int m = 0; m < 2; m++) {
+        comm_fw_dist_mode_t mode = m ? COMM_FW_DIST_MULTICAST : COMM_FW_DIST_UNICAST;
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+            for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+                sim_random_seed(100 + c * 10 + l);
+                setup_sensors(counts[c], losses[l]);
+                rollout_result_t r = run_rollout(mode);
+                printf("%-10s %8d %6.0f%% | %6lu %7lu %5lu %14lu\n",
+                       m ? "multicast" : "unicast", counts[c], losses[l] * 100,
+                       (unsigned long)r.stats.rounds, (unsigned long)r.stats.frames_sent,
+                       (unsigned long)r.stats.chunks_retransmitted, (unsigned long)r.rollout_ms);
+                TEST_ASSERT_EQUAL(counts[c], r.stats.targets_done);
+            }
+        }
+    }
+}
+
+static void test_sensor_reboot_resumes_from_persisted_chunks(void)
+{
+    setup_sensors(2, 0.0);
+    // Reinicia después de confirmar la base 96: retoma desde 64
+    s_sensors[1].reboot_at = 100;
+    rollout_result_t r = run_rollout(COMM_FW_DIST_UNICAST);
+
+    TEST_ASSERT_EQUAL(2, r.stats.targets_done);
+    TEST_ASSERT_EQUAL(1, r.stats.resumes);
+    // Se repiten las tramas perdidas mientras reiniciaba y los chunks
+    // posteriores a lo persistido, no la imagen completa
+    TEST_ASSERT_LESS_OR_EQUAL(SIM_REBOOT_SILENT_FRAMES + SIM_CHUNKS - SIM_PERSIST_CHUNKS,
+                              r.stats.chunks_retransmitted);
+}
+
+static void test_sensor_that_never_verifies_fails(void)
+{
+    setup_sensors(3, 0.0);
+    s_sensors[2].never_done = true;
+    rollout_result_t r = run_rollout(COMM_FW_DIST_MULTICAST);
+
+    // La sesión termina aunque el sensor siga respondiendo ACK
+    TEST_ASSERT_EQUAL(2, r.stats.targets_done);
+    TEST_ASSERT_EQUAL(1, r.stats.targets_failed);
+    TEST_ASSERT_LESS_THAN(60, r.stats.rounds);
+}
+
+static void test_silent_sensor_fails(void)
+{
+    setup_sensors(2, 0.0);
+    s_sensors[1].loss = 1.0;
+    rollout_result_t r = run_rollout(COMM_FW_DIST_UNICAST);
+
+    TEST_ASSERT_EQUAL(1, r.stats.targets_done);
+    TEST_ASSERT_EQUAL(1, r.stats.targets_failed);
+}
+
+void test_fw_dist_run(void)
+{
+    setup_image();
+    RUN_TEST(test_unicast_without_loss_sends_each_chunk_once);
+    RUN_TEST(test_multicast_sends_shared_chunks_once);
+    RUN_TEST(test_sensor_reboot_resumes_from_persisted_chunks);
+    RUN_TEST(test_sensor_that_never_verifies_fails);
+    RUN_TEST(test_silent_sensor_fails);
+    RUN_TEST(test_rollout_time_with_loss);
+}
@@ -0,0 +1,377 @@
+/**
+ * @file test_hb_interval.c
+ * @brief Simulación de la negociación del intervalo de heartbeat
+ *
+ * Cada sensor simulado envía heartbeats con el intervalo que está
+ * aplicando (campo hb_interval_s) y adopta el que le llega en un CONFIG del
+ * Gateway. Los heartbeats pasan por el mismo camino de recepción que
+ * comm_processing_task y el mantenimiento corre cada
+ * COMM_MAINTENANCE_PERIOD_MS sobre el reloj simulado, así que unas horas
+ * de funcionamiento se simulan en milisegundos.
+ *
+ * La pérdida se modela por trama y por sentido (subida: heartbeats,
+ * bajada: CONFIG), después de los reintentos MAC.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "cJSON.h"
+#include "comm.h"
+#include "comm_host_test.h"
+#include "sim_radio.h"
+
+/** @brief Registro completo del Gateway (tabla de peers de ESP-Now) */
+#define HB_SIM_SENSORS          MAX_SENSORS
+
+/** @brief Paso del reloj simulado */
+#define HB_SIM_STEP_MS          250
+
+/** @brief Período de mantenimiento de comm_processing_task (comm.c) */
+#define HB_SIM_MAINTENANCE_MS   5000
+
+/** @brief Intervalo de fábrica de los sensores antes del primer CONFIG */
+#define HB_SIM_DEFAULT_S        60
+
+/**
+ * @brief Sensor simulado
+ */
+typedef struct {
+    uint8_t mac[6];
+    char id[DEVICE_ID_MAX_LEN];
+    uint32_t interval_s;        /**< Intervalo que aplica */
+    uint64_t next_hb_ms;        /**< Próximo heartbeat (hora simulada) */
+    uint64_t last_hb_ms;        /**< Último heartbeat que llegó al Gateway */
+    double uplink_loss;         /**< Pérdida de heartbeats */
+    double downlink_loss;       /**< Pérdida de CONFIG */
+    int8_t rssi;
+    bool alive;                 /**< false = dejó de transmitir */
+    uint32_t configs_received;
+    uint32_t interval_changes;  /**< CONFIG que cambiaron el intervalo aplicado */
+} hb_sensor_t;
+
+/**
+ * @brief Resultado de una simulación
+ */
+typedef struct {
+    comm_heartbeat_stats_t stats;
+    uint32_t false_offline;     /**< Sensores vivos declarados offline */
+    uint64_t converged_ms;      /**< Hora en que todos aplicaron su intervalo (0 = nunca) */
+} hb_result_t;
+
+static hb_sensor_t s_hb_sensors[HB_SIM_SENSORS];
+static int s_hb_count = 0;
+static uint64_t s_now_ms = 0;
+
+// ============================================================================
+// Sensores simulados
+// ============================================================================
+
+static hb_sensor_t *find_by_mac(const uint8_t *mac)
+{
+    for (int i = 0; i < s_hb_count; i++) {
+        if (memcmp(s_hb_sensors[i].mac, mac, 6) == 0) {
+            return &s_hb_sensors[i];
+        }
+    }
+    return NULL;
+}
+
+static void send_heartbeat(hb_sensor_t *s)
+{
+    char json[160];
+    int len = snprintf(json, sizeof(json),
+                       "{\"header\":{\"ver\":1,\"src_id\":\"%s\",\"src_type\":\"SEC_SENSOR\"},"
+                       "\"payload\":{\"type\":\"HEARTBEAT\",\"battery\":90,\"hb_interval_s\":%lu}}",
+                       s->id, (unsigned long)s->interval_s);
+    if (sim_random() < s->uplink_loss) {
+        return;
+    }
+    s->last_hb_ms = s_now_ms;
+    comm_sim_receive(s->mac, (const uint8_t *)json, len, s->rssi);
+}
+
+/**
+ * @brief CONFIG del Gateway: el sensor aplica el intervalo desde el próximo heartbeat
+ */
+static void radio_listener(const uint8_t *dest_mac, const uint8_t *data, size_t len)
+{
+    hb_sensor_t *s = find_by_mac(dest_mac);
+    if (!s || !s->alive || sim_random() < s->downlink_loss) {
+        return;
+    }
+
+    cJSON *root = cJSON_ParseWithLength((const char *)data, len);
+    cJSON *payload = root ? cJSON_GetObjectItem(root, "payload") : NULL;
+    cJSON *type = payload ? cJSON_GetObjectItem(payload, "type") : NULL;
+    cJSON *interval = payload ? cJSON_GetObjectItem(payload, "hb_interval_s") : NULL;
+    if (cJSON_IsString(type) && strcmp(type->valuestring, "CONFIG") == 0 &&
+        cJSON_IsNumber(interval) && interval->valueint > 0) {
+        s->configs_received++;
+        if ((uint32_t)interval->valueint != s->interval_s) {
+            s->interval_s = interval->valueint;
+            s->interval_changes++;
+            s->next_hb_ms = s_now_ms + (uint64_t)s->interval_s * 1000;
+        }
+    }
+    cJSON_Delete(root);
+}
+
+static bool all_applied(void)
+{
+    for (int i = 0; i < s_hb_count; i++) {
+        sensor_info_t info;
+        if (!s_hb_sensors[i].alive) {
+            continue;
+        }
+        if (comm_get_sensor_info(s_hb_sensors[i].id, &info) != ESP_OK ||
+            info.hb_interval_s == 0 || info.hb_interval_s != s_hb_sensors[i].interval_s) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// Escenarios
+// ============================================================================
+
+static void setup_sensors(int count, double uplink_loss, double downlink_loss)
+{
+    comm_sim_reset();
+    memset(s_hb_sensors, 0, sizeof(s_hb_sensors));
+    s_hb_count = count;
+    s_now_ms = 0;
+    // Los sensores se registran con su primer heartbeat
+    comm_pairing_open(COMM_PAIRING_MAX_S);
+    for (int i = 0; i < count; i++) {
+        hb_sensor_t *s = &s_hb_sensors[i];
+        uint8_t mac[6] = {0x30, 0xAE, 0xA4, 0x00, 0x20, (uint8_t)i};
+        memcpy(s->mac, mac, 6);
+        snprintf(s->id, sizeof(s->id), "HB-%02d", i);
+        s->interval_s = HB_SIM_DEFAULT_S;
+        s->uplink_loss = uplink_loss;
+        s->downlink_loss = downlink_loss;
+        s->rssi = -60;
+        s->alive = true;
+        // Arranques escalonados dentro del primer intervalo
+        s->next_hb_ms = (uint64_t)(sim_random() * HB_SIM_DEFAULT_S * 1000);
+    }
+}
+
+/**
+ * @brief Avanza la simulación
+ *
+ * @param duration_ms Tiempo simulado
+ * @param foreign_frames Tramas de otros equipos por ventana de mantenimiento
+ * @param result Acumulado (puede venir de una corrida anterior)
+ */
+static void run_for(uint64_t duration_ms, uint32_t foreign_frames, hb_result_t *result)
+{
+    sim_radio_set_listener(radio_listener);
+    uint64_t end_ms = s_now_ms + duration_ms;
+    while (s_now_ms < end_ms) {
+        s_now_ms += HB_SIM_STEP_MS;
+        sim_clock_advance_ms(HB_SIM_STEP_MS);
+
+        for (int i = 0; i < s_hb_count; i++) {
+            hb_sensor_t *s = &s_hb_sensors[i];
+            if (s->alive && s_now_ms >= s->next_hb_ms) {
+                // Un CONFIG en la respuesta reprograma el siguiente
+                s->next_hb_ms += (uint64_t)s->interval_s * 1000;
+                send_heartbeat(s);
+            }
+        }
+
+        if (s_now_ms % HB_SIM_MAINTENANCE_MS == 0) {
+            comm_sim_channel_frames(foreign_frames);
+            uint32_t timeouts_before = result->stats.liveness_timeouts;
+            comm_sim_maintenance();
+            comm_get_heartbeat_stats(&result->stats);
+
+            // Un sensor vivo declarado offline es una falsa alarma
+            if (result->stats.liveness_timeouts != timeouts_before) {
+                for (int i = 0; i < s_hb_count; i++) {
+                    sensor_info_t info;
+                    comm_get_sensor_info(s_hb_sensors[i].id, &info);
+                    if (s_hb_sensors[i].alive && !info.online) {
+                        result->false_offline++;
+                    }
+                }
+            }
+            if (result->converged_ms == 0 && all_applied()) {
+                result->converged_ms = s_now_ms;
+            }
+        }
+    }
+    sim_radio_set_listener(NULL);
+}
+
+static uint32_t assigned_interval_s(const hb_sensor_t *s)
+{
+    sensor_info_t info;
+    TEST_ASSERT_EQUAL(ESP_OK, comm_get_sensor_info(s->id, &info));
+    return info.hb_interval_s;
+}
+
+static void test_clean_links_converge_to_base_interval(void)
+{
+    sim_random_seed(11);
+    setup_sensors(8, 0.0, 0.0);
+    hb_result_t r = {0};
+    run_for(10 * 60 * 1000, 0, &r);
+
+    TEST_ASSERT_EQUAL(8, r.stats.sensor_count);
+    TEST_ASSERT_EQUAL(8, r.stats.sensors_online);
+    for (int i = 0; i < s_hb_count; i++) {
+        TEST_ASSERT_EQUAL(r.stats.base_interval_s, assigned_interval_s(&s_hb_sensors[i]));
+        TEST_ASSERT_EQUAL(r.stats.base_interval_s, s_hb_sensors[i].interval_s);
+        TEST_ASSERT_EQUAL(s_hb_sensors[i].interval_s, comm_sim_reported_interval_s(s_hb_sensors[i].id));
+    }
+    // Un CONFIG por sensor: confirmado en el heartbeat siguiente
+    TEST_ASSERT_EQUAL(8, r.stats.configs_sent);
+    TEST_ASSERT_NOT_EQUAL(0, r.converged_ms);
+    TEST_ASSERT_LESS_OR_EQUAL(2 * HB_SIM_DEFAULT_S * 1000, r.converged_ms);
+    TEST_ASSERT_EQUAL(0, r.stats.liveness_timeouts);
+}
+
+static void test_lossy_and_weak_links_get_longer_intervals(void)
+{
+    sim_random_seed(12);
+    setup_sensors(3, 0.0, 0.0);
+    s_hb_sensors[1].uplink_loss = 0.3;
+    s_hb_sensors[2].rssi = -85;
+    hb_result_t r = {0};
+    run_for(4 * 3600 * 1000ULL, 0, &r);
+
+    uint32_t clean = assigned_interval_s(&s_hb_sensors[0]);
+    uint32_t lossy = assigned_interval_s(&s_hb_sensors[1]);
+    uint32_t weak = assigned_interval_s(&s_hb_sensors[2]);
+    TEST_ASSERT_EQUAL(r.stats.base_interval_s, clean);
+    TEST_ASSERT_GREATER_THAN(clean, lossy);
+    TEST_ASSERT_EQUAL(clean * 3 / 2, weak);
+
+    // El enlace con pérdidas tolera más heartbeats perdidos antes del offline
+    sensor_info_t clean_info;
+    sensor_info_t lossy_info;
+    comm_get_sensor_info(s_hb_sensors[0].id, &clean_info);
+    comm_get_sensor_info(s_hb_sensors[1].id, &lossy_info);
+    TEST_ASSERT_GREATER_THAN(clean_info.liveness_timeout_ms / clean, lossy_info.liveness_timeout_ms / lossy);
+
+    // Cambios de intervalo acotados por la histéresis (a lo sumo dos por hora)
+    TEST_ASSERT_LESS_OR_EQUAL(8, s_hb_sensors[1].interval_changes);
+}
+
+static void test_lost_config_is_retried_until_confirmed(void)
+{
+    sim_random_seed(13);
+    setup_sensors(6, 0.0, 0.7);
+    hb_result_t r = {0};
+    run_for(30 * 60 * 1000, 0, &r);
+
+    for (int i = 0; i < s_hb_count; i++) {
+        TEST_ASSERT_EQUAL(assigned_interval_s(&s_hb_sensors[i]), s_hb_sensors[i].interval_s);
+    }
+    TEST_ASSERT_NOT_EQUAL(0, r.converged_ms);
+    // Mientras no confirma se lo vigila con el intervalo más largo
+    TEST_ASSERT_EQUAL(0, r.stats.liveness_timeouts);
+}
+
+static void test_silent_sensor_goes_offline_within_timeout(void)
+{
+    sim_random_seed(14);
+    setup_sensors(4, 0.0, 0.0);
+    hb_result_t r = {0};
+    run_for(10 * 60 * 1000, 0, &r);
+
+    hb_sensor_t *gone = &s_hb_sensors[3];
+    sensor_info_t info;
+    comm_get_sensor_info(gone->id, &info);
+    uint32_t timeout_ms = info.liveness_timeout_ms;
+    gone->alive = false;
+    uint64_t last_hb_ms = gone->last_hb_ms;
+
+    // Detectado a lo sumo un período de mantenimiento después del timeout
+    while (s_now_ms - last_hb_ms <= timeout_ms + HB_SIM_MAINTENANCE_MS) {
+        run_for(HB_SIM_MAINTENANCE_MS, 0, &r);
+        comm_get_sensor_info(gone->id, &info);
+        if (!info.online) {
+            break;
+        }
+    }
+    TEST_ASSERT_FALSE(info.online);
+    TEST_ASSERT_GREATER_THAN(timeout_ms, s_now_ms - last_hb_ms);
+    TEST_ASSERT_EQUAL(1, r.stats.liveness_timeouts);
+    TEST_ASSERT_EQUAL(0, r.false_offline);
+    TEST_ASSERT_EQUAL(3, r.stats.sensors_online);
+}
+
+static void test_busy_channel_stretches_interval_at_sensor_cap(void)
+{
+    sim_random_seed(15);
+    setup_sensors(HB_SIM_SENSORS, 0.0, 0.0);
+    hb_result_t r = {0};
+    run_for(10 * 60 * 1000, 0, &r);
+
+    // Registro completo con el canal libre: intervalo mínimo
+    TEST_ASSERT_EQUAL(HB_SIM_SENSORS, r.stats.sensor_count);
+    TEST_ASSERT_EQUAL(30, r.stats.base_interval_s);
+
+    // ~90 % de ocupación por otros equipos: el intervalo crece con la carga
+    run_for(2 * 3600 * 1000ULL, 3000, &r);
+    TEST_ASSERT_GREATER_THAN(700, r.stats.channel_load_permille);
+    TEST_ASSERT_EQUAL(30 * r.stats.channel_load_permille / 200, r.stats.base_interval_s);
+    for (int i = 0; i < s_hb_count; i++) {
+        TEST_ASSERT_EQUAL(s_hb_sensors[i].interval_s, comm_sim_reported_interval_s(s_hb_sensors[i].id));
+        TEST_ASSERT_UINT32_WITHIN(r.stats.base_interval_s / 5, r.stats.base_interval_s, s_hb_sensors[i].interval_s);
+    }
+    TEST_ASSERT_EQUAL(0, r.false_offline);
+    TEST_ASSERT_EQUAL(HB_SIM_SENSORS, r.stats.sensors_online);
+}
+
+static void test_negotiation_table(void)
+{
+    static const int counts[] = {1, 5, HB_SIM_SENSORS};
+    static const double losses[] = {0.0, 0.1, 0.3};
+    // 0, ~30 % y ~90 % de ocupación del canal por otros equipos
+    static const uint32_t foreign[] = {0, 1000, 3000};
+
+    printf("\nNegociación del intervalo, 6 h simuladas\n");
+    printf("sensores pérdida  carga | base_s  prom_s  airtime_ppm  configs  convergencia_s  offline_falsos\n");
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+            for (size_t f = 0; f < sizeof(foreign) / sizeof(foreign[0]); f++) {
+                sim_random_seed(200 + c * 100 + l * 10 + f);
+                setup_sensors(counts[c], losses[l], losses[l]);
+                hb_result_t r = {0};
+                run_for(6 * 3600 * 1000ULL, foreign[f], &r);
+
+                uint32_t sum = 0;
+                for (int i = 0; i < s_hb_count; i++) {
+                    sum += s_hb_sensors[i].interval_s;
+                }
+                printf("%8d %6.0f%% %5lu%% | %6lu %7lu %12lu %8lu %15lu %15lu\n",
+                       counts[c], losses[l] * 100,
+                       (unsigned long)(r.stats.channel_load_permille / 10),
+                       (unsigned long)r.stats.base_interval_s, (unsigned long)(sum / s_hb_count),
+                       (unsigned long)r.stats.hb_airtime_ppm, (unsigned long)r.stats.configs_sent,
+                       (unsigned long)(r.converged_ms / 1000), (unsigned long)r.false_offline);
+
+                // El airtime de heartbeats queda por debajo del 1 % del canal
+                TEST_ASSERT_LESS_OR_EQUAL(10000, r.stats.hb_airtime_ppm);
+                TEST_ASSERT_NOT_EQUAL(0, r.converged_ms);
+                TEST_ASSERT_EQUAL(0, r.false_offline);
+            }
+        }
+    }
+}
+
+void test_hb_interval_run(void)
+{
+    RUN_TEST(test_clean_links_converge_to_base_interval);
+    RUN_TEST(test_lossy_and_weak_links_get_longer_intervals);
+    RUN_TEST(test_lost_config_is_retried_until_confirmed);
+    RUN_TEST(test_silent_sensor_goes_offline_within_timeout);
+    RUN_TEST(test_busy_channel_stretches_interval_at_sensor_cap);
+    RUN_TEST(test_negotiation_table);
+}
@@ -0,0 +1,535 @@
+/**
+ * @file test_slots.c
+ * @brief Simulación de colisiones con el planificador de slots
+ *
+ * Cada sensor simulado recibe su slot en el CONFIG del Gateway, se alinea
+ * a la supertrama con la hora del beacon (sumándole su propio reloj entre
+ * beacons, ver COMM_GW_TIME_WRAP_MS) y transmite el heartbeat en el primer
+ * inicio de su slot después de que vence, con un retardo aleatorio de
+ * hasta SLOT_SIM_JITTER_US. El reloj de cada sensor deriva hasta
+ * SLOT_SIM_DRIFT_PPM respecto del Gateway. Dos tramas que se solapan en el
+ * aire se pierden las dos.
+ *
+ * Como referencia, el modo sin slots transmite apenas vence el heartbeat
+ * (fase aleatoria por sensor, ALOHA puro).
+ *
+ * comm se compila con COMM_MAX_SENSORS = 200 (main/CMakeLists.txt): en el
+ * Gateway real el registro está limitado por la tabla de peers de ESP-Now.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "comm.h"
+#include "comm_beacon.h"
+#include "comm_rate.h"
+#include "comm_host_test.h"
+#include "sim_radio.h"
+
+#define SLOT_SIM_MAX_SENSORS    200
+
+/** @brief Airtime de un heartbeat (COMM_HB_FRAME_AIRTIME_US en comm.c) */
+#define SLOT_SIM_AIRTIME_US     1500
+
+/** @brief Retardo de acceso al medio y deriva del reloj del sensor dentro del slot */
+#define SLOT_SIM_JITTER_US      3000
+
+/** @brief Deriva máxima del cristal de un sensor */
+#define SLOT_SIM_DRIFT_PPM      40
+
+/** @brief Período de mantenimiento de comm_processing_task (comm.c) */
+#define SLOT_SIM_MAINTENANCE_MS 5000
+
+/** @brief Período del beacon con el que los sensores se realinean */
+#define SLOT_SIM_BEACON_MS      60000
+
+/** @brief Intervalo de fábrica de los sensores antes del primer CONFIG */
+#define SLOT_SIM_DEFAULT_S      60
+
+/**
+ * @brief Sensor simulado
+ */
+typedef struct {
+    uint8_t mac[6];
+    char id[DEVICE_ID_MAX_LEN];
+    int slot;                   /**< Slot asignado (-1 = sin CONFIG todavía) */
+    uint32_t interval_s;
+    double drift;               /**< Error relativo de su reloj */
+    uint64_t next_due_us;       /**< Vencimiento del próximo heartbeat */
+    uint64_t next_tx_us;        /**< Inicio de la próxima transmisión */
+    uint32_t beacon_gw_ms;      /**< gw_time_ms del último beacon */
+    uint64_t beacon_rx_us;      /**< Cuándo lo recibió */
+    bool synced;                /**< Recibió al menos un beacon */
+} slot_sensor_t;
+
+/**
+ * @brief Trama en el aire pendiente de resolver colisiones
+ */
+typedef struct {
+    int sensor;
+    uint64_t start_us;
+    bool collided;
+} air_frame_t;
+
+/**
+ * @brief Resultado de una simulación
+ */
+typedef struct {
+    uint32_t frames;            /**< Heartbeats transmitidos */
+    uint32_t collided;          /**< Heartbeats perdidos por colisión */
+    comm_slot_stats_t stats;    /**< Contadores del Gateway en la ventana medida */
+} slot_result_t;
+
+static slot_sensor_t s_slot_sensors[SLOT_SIM_MAX_SENSORS];
+static int s_slot_count = 0;
+static bool s_use_slots = true;
+static uint64_t s_now_ms = 0;
+static uint64_t s_next_maintenance_ms = 0;
+static uint64_t s_next_beacon_ms = 0;
+static bool s_beacon_state = false;
+static uint32_t s_beacon_phase_errors = 0;
+
+// ============================================================================
+// Reloj y beacon
+// ============================================================================
+
+static void clock_advance_to(uint64_t ms)
+{
+    while (s_now_ms < ms) {
+        uint64_t step = ms - s_now_ms;
+        if (step > 0x7FFFFFFF) {
+            step = 0x7FFFFFFF;
+        }
+        sim_clock_advance_ms((uint32_t)step);
+        s_now_ms += step;
+    }
+}
+
+static slot_sensor_t *find_by_mac(const uint8_t *mac)
+{
+    for (int i = 0; i < s_slot_count; i++) {
+        if (memcmp(s_slot_sensors[i].mac, mac, 6) == 0) {
+            return &s_slot_sensors[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Próximo inicio de transmisión según el reloj del sensor
+ */
+static uint64_t schedule_tx_us(const slot_sensor_t *s)
+{
+    uint64_t tx_us = s->next_due_us;
+    if (s_use_slots && s->slot >= 0 && s->synced) {
+        // Hora del Gateway estimada por el sensor: beacon + su propio reloj
+        uint64_t elapsed_us = (uint64_t)((s->next_due_us - s->beacon_rx_us) * (1.0 + s->drift));
+        uint64_t gw_us = (uint64_t)s->beacon_gw_ms * 1000 + elapsed_us;
+        uint64_t phase_us = gw_us % (COMM_SUPERFRAME_MS * 1000);
+        uint64_t target_us = (uint64_t)s->slot * COMM_SLOT_MS * 1000;
+        tx_us += (target_us + COMM_SUPERFRAME_MS * 1000 - phase_us) % (COMM_SUPERFRAME_MS * 1000);
+    }
+    return tx_us + (uint64_t)(sim_random() * SLOT_SIM_JITTER_US);
+}
+
+/**
+ * @brief Vencimiento del heartbeat siguiente según el reloj del sensor
+ */
+static uint64_t next_due_after(const slot_sensor_t *s, uint64_t from_us)
+{
+    return from_us + (uint64_t)(s->interval_s * 1e6 * (1.0 - s->drift));
+}
+
+static void radio_listener(const uint8_t *dest_mac, const uint8_t *data, size_t len)
+{
+    if (len == sizeof(comm_beacon_frame_t) && data[0] == COMM_BEACON_MAGIC) {
+        comm_beacon_frame_t beacon;
+        memcpy(&beacon, data, sizeof(beacon));
+        // La fase del beacon debe coincidir con la del Gateway
+        if (beacon.gw_time_ms % COMM_SUPERFRAME_MS != comm_get_gateway_time_ms() % COMM_SUPERFRAME_MS) {
+            s_beacon_phase_errors++;
+        }
+        for (int i = 0; i < s_slot_count; i++) {
+            s_slot_sensors[i].beacon_gw_ms = beacon.gw_time_ms;
+            s_slot_sensors[i].beacon_rx_us = s_now_ms * 1000;
+            s_slot_sensors[i].synced = true;
+        }
+        return;
+    }
+
+    slot_sensor_t *s = find_by_mac(dest_mac);
+    if (!s) {
+        return;
+    }
+    cJSON *root = cJSON_ParseWithLength((const char *)data, len);
+    cJSON *payload = root ? cJSON_GetObjectItem(root, "payload") : NULL;
+    cJSON *type = payload ? cJSON_GetObjectItem(payload, "type") : NULL;
+    cJSON *slot = payload ? cJSON_GetObjectItem(payload, "slot") : NULL;
+    cJSON *interval = payload ? cJSON_GetObjectItem(payload, "hb_interval_s") : NULL;
+    if (cJSON_IsString(type) && strcmp(type->valuestring, "CONFIG") == 0 &&
+        cJSON_IsNumber(slot) && cJSON_IsNumber(interval) && interval->valueint > 0) {
+        s->slot = slot->valueint;
+        s->interval_s = interval->valueint;
+        s->next_due_us = next_due_after(s, s_now_ms * 1000);
+        s->next_tx_us = schedule_tx_us(s);
+    }
+    cJSON_Delete(root);
+}
+
+/**
+ * @brief Cambia el estado del sistema para que comm_beacon transmita
+ *
+ * comm_processing_task no corre en la simulación: el beacon pendiente se
+ * transmite llamando a comm_beacon_process() como lo haría la tarea.
+ */
+static void send_beacon(void)
+{
+    s_beacon_state = !s_beacon_state;
+    comm_beacon_notify_state(s_beacon_state ? SYS_STATE_ARMED : SYS_STATE_DISARMED);
+    comm_beacon_process();
+}
+
+/**
+ * @brief Mantenimiento y beacons pendientes hasta la hora indicada
+ */
+static void run_periodic_until(uint64_t ms)
+{
+    while (s_next_maintenance_ms <= ms || s_next_beacon_ms <= ms) {
+        if (s_next_maintenance_ms <= s_next_beacon_ms) {
+            clock_advance_to(s_next_maintenance_ms);
+            comm_sim_maintenance();
+            s_next_maintenance_ms += SLOT_SIM_MAINTENANCE_MS;
+        } else {
+            clock_advance_to(s_next_beacon_ms);
+            send_beacon();
+            s_next_beacon_ms += SLOT_SIM_BEACON_MS;
+        }
+    }
+    clock_advance_to(ms);
+}
+
+// ============================================================================
+// Simulación
+// ============================================================================
+
+static void deliver(const air_frame_t *frame, slot_result_t *result)
+{
+    slot_sensor_t *s = &s_slot_sensors[frame->sensor];
+    result->frames++;
+    if (frame->collided) {
+        result->collided++;
+        return;
+    }
+
+    run_periodic_until(frame->start_us / 1000);
+    char json[160];
+    int len = snprintf(json, sizeof(json),
+                       "{\"header\":{\"ver\":1,\"src_id\":\"%s\",\"src_type\":\"PIR_SENSOR\"},"
+                       "\"payload\":{\"type\":\"HEARTBEAT\",\"battery\":90,\"hb_interval_s\":%lu}}",
+                       s->id, (unsigned long)s->interval_s);
+    comm_sim_receive(s->mac, (const uint8_t *)json, len, -60);
+}
+
+/**
+ * @brief Transmite los heartbeats hasta end_ms resolviendo colisiones
+ */
+static void run_until(uint64_t end_ms, slot_result_t *result)
+{
+    air_frame_t pending = { .sensor = -1 };
+    uint64_t busy_until_us = 0;
+
+    while (true) {
+        int next = -1;
+        for (int i = 0; i < s_slot_count; i++) {
+            if (next < 0 || s_slot_sensors[i].next_tx_us < s_slot_sensors[next].next_tx_us) {
+                next = i;
+            }
+        }
+        slot_sensor_t *s = &s_slot_sensors[next];
+        if (s->next_tx_us / 1000 >= end_ms) {
+            break;
+        }
+
+        air_frame_t frame = { .sensor = next, .start_us = s->next_tx_us, .collided = false };
+        s->next_due_us = next_due_after(s, s->next_due_us);
+        s->next_tx_us = schedule_tx_us(s);
+
+        // Solapamiento con cualquier trama que siga en el aire
+        if (pending.sensor >= 0 && frame.start_us < busy_until_us) {
+            pending.collided = true;
+            frame.collided = true;
+        }
+        if (frame.start_us + SLOT_SIM_AIRTIME_US > busy_until_us) {
+            busy_until_us = frame.start_us + SLOT_SIM_AIRTIME_US;
+        }
+        if (pending.sensor >= 0) {
+            deliver(&pending, result);
+        }
+        pending = frame;
+    }
+    if (pending.sensor >= 0) {
+        deliver(&pending, result);
+    }
+    run_periodic_until(end_ms);
+}
+
+static void setup_sensors(int count, bool use_slots, uint64_t start_ms, uint32_t spread_ms)
+{
+    comm_sim_reset();
+    sim_clock_set_manual(true);
+    s_now_ms = comm_get_gateway_time_ms();
+    clock_advance_to(start_ms);
+    s_beacon_phase_errors = 0;
+    // Los sensores se registran con su primer heartbeat
+    comm_pairing_open(COMM_PAIRING_MAX_S);
+
+    memset(s_slot_sensors, 0, sizeof(s_slot_sensors));
+    s_slot_count = count;
+    s_use_slots = use_slots;
+    s_next_maintenance_ms = s_now_ms + SLOT_SIM_MAINTENANCE_MS;
+    s_next_beacon_ms = s_now_ms;
+    for (int i = 0; i < count; i++) {
+        slot_sensor_t *s = &s_slot_sensors[i];
+        uint8_t mac[6] = {0x30, 0xAE, 0xA4, 0x00, (uint8_t)(0x30 + i / 256), (uint8_t)i};
+        memcpy(s->mac, mac, 6);
+        snprintf(s->id, sizeof(s->id), "SL-%03d", i);
+        s->slot = -1;
+        s->interval_s = SLOT_SIM_DEFAULT_S;
+        s->drift = (2 * sim_random() - 1) * SLOT_SIM_DRIFT_PPM / 1e6;
+        s->next_due_us = s_now_ms * 1000 + (uint64_t)(sim_random() * spread_ms * 1000);
+        s->next_tx_us = schedule_tx_us(s);
+    }
+    sim_radio_set_listener(radio_listener);
+}
+
+static void teardown_sensors(void)
+{
+    sim_radio_set_listener(NULL);
+    sim_clock_set_manual(false);
+}
+
+/**
+ * @brief Registra y configura los sensores, y mide durante duration_ms
+ */
+static slot_result_t run_scenario(int count, bool use_slots, uint64_t start_ms, uint32_t spread_ms,
+                                  uint64_t duration_ms)
+{
+    setup_sensors(count, use_slots, start_ms, spread_ms);
+
+    // Calentamiento: registro, CONFIG con slot e intervalo, primer beacon
+    slot_result_t warmup = {0};
+    run_until(s_now_ms + 3 * SLOT_SIM_DEFAULT_S * 1000, &warmup);
+
+    comm_slot_stats_t before;
+    comm_get_slot_stats(&before);
+    slot_result_t result = {0};
+    run_until(s_now_ms + duration_ms, &result);
+    comm_get_slot_stats(&result.stats);
+    result.stats.in_slot_frames -= before.in_slot_frames;
+    result.stats.off_slot_frames -= before.off_slot_frames;
+    result.stats.slot_conflicts -= before.slot_conflicts;
+
+    teardown_sensors();
+    return result;
+}
+
+static void init_beacon(void)
+{
+    if (!gSystemCtx.mutex) {
+        gSystemCtx.mutex = xSemaphoreCreateMutex();
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, comm_beacon_init());
+}
+
+// ============================================================================
+// Pruebas
+// ============================================================================
+
+static void test_one_sensor_per_slot_never_collides(void)
+{
+    sim_random_seed(21);
+    slot_result_t r = run_scenario(COMM_SLOT_COUNT, true, 0, SLOT_SIM_DEFAULT_S * 1000, 3600 * 1000);
+
+    TEST_ASSERT_GREATER_THAN(0, r.frames);
+    TEST_ASSERT_EQUAL(0, r.collided);
+    TEST_ASSERT_EQUAL(r.frames, r.stats.in_slot_frames);
+    TEST_ASSERT_EQUAL(0, r.stats.off_slot_frames);
+    TEST_ASSERT_EQUAL(0, r.stats.slot_conflicts);
+    TEST_ASSERT_EQUAL(1, r.stats.max_sensors_per_slot);
+}
+
+static void test_slot_phase_survives_32bit_time_wrap(void)
+{
+    // Cinco minutos antes de que la hora en ms desborde 32 bits (~49,7 días)
+    sim_random_seed(22);
+    slot_result_t r = run_scenario(COMM_SLOT_COUNT, true, 0xFFFFFFFFULL - 5 * 60 * 1000,
+                                   SLOT_SIM_DEFAULT_S * 1000, 10 * 60 * 1000);
+
+    TEST_ASSERT_GREATER_THAN(0xFFFFFFFFULL, s_now_ms);
+    TEST_ASSERT_EQUAL(0, s_beacon_phase_errors);
+    TEST_ASSERT_EQUAL(0, r.collided);
+    TEST_ASSERT_EQUAL(0, r.stats.off_slot_frames);
+    TEST_ASSERT_EQUAL(r.frames, r.stats.in_slot_frames);
+}
+
+static void test_collision_table(void)
+{
+    static const int counts[] = {10, COMM_SLOT_COUNT, 50, 100, SLOT_SIM_MAX_SENSORS};
+
+    printf("\nColisiones de heartbeats, 1 h simulada (airtime %u us)\n", SLOT_SIM_AIRTIME_US);
+    printf("sensores modo       | tramas  colisiones  tasa_%%  fuera_de_slot  conflictos  sensores_por_slot\n");
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        uint32_t collided[3];
+        for (int m = 0; m < 3; m++) {
+            // Modo 2: todos los sensores arrancan en el mismo segundo (vuelta de la energía)
+            sim_random_seed(300 + c);
+            slot_result_t r = run_scenario(counts[c], m != 1, 0, m == 2 ? 1000 : SLOT_SIM_DEFAULT_S * 1000,
+                                           3600 * 1000);
+            collided[m] = r.collided;
+            printf("%8d %-10s | %6lu %11lu %7.2f %14lu %11lu %18u\n",
+                   counts[c], m == 0 ? "slots" : m == 1 ? "aleatorio" : "slots_1s",
+                   (unsigned long)r.frames, (unsigned long)r.collided,
+                   r.frames ? 100.0 * r.collided / r.frames : 0.0,
+                   (unsigned long)r.stats.off_slot_frames, (unsigned long)r.stats.slot_conflicts,
+                   r.stats.max_sensors_per_slot);
+
+            TEST_ASSERT_EQUAL((counts[c] + COMM_SLOT_COUNT - 1) / COMM_SLOT_COUNT,
+                              r.stats.max_sensors_per_slot);
+            if (m == 0) {
+                TEST_ASSERT_EQUAL(0, r.stats.off_slot_frames);
+            }
+            if (m != 1 && counts[c] <= COMM_SLOT_COUNT) {
+                TEST_ASSERT_EQUAL(0, r.collided);
+            }
+        }
+        TEST_ASSERT_LESS_OR_EQUAL(collided[1], collided[0]);
+    }
+}
+
+/**
+ * @brief Peers con gestión de tasa según comm_rate
+ */
+static int rate_peer_count(void)
+{
+    comm_rate_stats_t stats;
+    TEST_ASSERT_EQUAL(ESP_OK, comm_rate_get_stats(&stats));
+    int peers = 0;
+    for (int i = 0; i < COMM_RATE_CLASS_COUNT; i++) {
+        peers += stats.classes[i].peers;
+    }
+    return peers;
+}
+
+static void test_reregistered_sensor_keeps_rate_peer(void)
+{
+    const uint8_t mac[6] = {0x24, 0x6f, 0x28, 0x00, 0x10, 0x01};
+    const uint8_t new_mac[6] = {0x24, 0x6f, 0x28, 0x00, 0x10, 0x02};
+
+    comm_sim_reset();
+    TEST_ASSERT_EQUAL(0, rate_peer_count());
+
+    TEST_ASSERT_EQUAL(ESP_OK, comm_register_sensor(mac, "reg-1", DEV_TYPE_SENSOR_PIR));
+    TEST_ASSERT_EQUAL(1, rate_peer_count());
+
+    // Re-registro tras la baja: vuelve a tener gestión de tasa
+    TEST_ASSERT_EQUAL(ESP_OK, comm_unregister_sensor("reg-1"));
+    TEST_ASSERT_EQUAL(0, rate_peer_count());
+    TEST_ASSERT_EQUAL(ESP_OK, comm_register_sensor(mac, "reg-1", DEV_TYPE_SENSOR_PIR));
+    TEST_ASSERT_EQUAL(1, rate_peer_count());
+
+    // Mismo sensor con otra MAC: reemplaza al peer anterior
+    TEST_ASSERT_EQUAL(ESP_OK, comm_register_sensor(new_mac, "reg-1", DEV_TYPE_SENSOR_PIR));
+    TEST_ASSERT_EQUAL(1, rate_peer_count());
+
+    comm_sim_reset();
+    TEST_ASSERT_EQUAL(0, rate_peer_count());
+}
+
+static void receive_heartbeat(const uint8_t *mac, const char *id)
+{
+    char json[160];
+    int len = snprintf(json, sizeof(json),
+                       "{\"header\":{\"ver\":1,\"src_id\":\"%s\",\"src_type\":\"PIR_SENSOR\"},"
+                       "\"payload\":{\"type\":\"HEARTBEAT\",\"battery\":90}}", id);
+    comm_sim_receive(mac, (const uint8_t *)json, len, -60);
+}
+
+static void test_unknown_sensor_needs_pairing_window(void)
+{
+    const uint8_t mac[6] = {0x24, 0x6f, 0x28, 0x00, 0x11, 0x01};
+    const uint8_t late_mac[6] = {0x24, 0x6f, 0x28, 0x00, 0x11, 0x02};
+
+    comm_sim_reset();
+    sim_clock_set_manual(true);
+    TEST_ASSERT_FALSE(comm_pairing_is_open());
+
+    // Sin ventana: ni registro ni peer para una MAC desconocida
+    receive_heartbeat(mac, "pair-1");
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, comm_get_sensor_info("pair-1", NULL));
+    TEST_ASSERT_EQUAL(0, rate_peer_count());
+
+    comm_pairing_open(10);
+    receive_heartbeat(mac, "pair-1");
+    TEST_ASSERT_EQUAL(ESP_OK, comm_get_sensor_info("pair-1", NULL));
+    TEST_ASSERT_EQUAL(1, rate_peer_count());
+
+    // Vencida la ventana, el emparejado sigue recibiéndose y el nuevo no
+    sim_clock_advance_ms(10000);
+    TEST_ASSERT_FALSE(comm_pairing_is_open());
+    receive_heartbeat(late_mac, "pair-2");
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, comm_get_sensor_info("pair-2", NULL));
+    receive_heartbeat(mac, "pair-1");
+    TEST_ASSERT_EQUAL(1, rate_peer_count());
+
+    // Cerrada antes de tiempo
+    comm_pairing_open(0);
+    TEST_ASSERT_TRUE(comm_pairing_is_open());
+    comm_pairing_close();
+    receive_heartbeat(late_mac, "pair-2");
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, comm_get_sensor_info("pair-2", NULL));
+
+    sim_clock_set_manual(false);
+    comm_sim_reset();
+}
+
+static uint32_t s_beacon_frames = 0;
+
+static void count_beacons(const uint8_t *dest_mac, const uint8_t *data, size_t len)
+{
+    if (len == sizeof(comm_beacon_frame_t) && data[0] == COMM_BEACON_MAGIC) {
+        s_beacon_frames++;
+    }
+}
+
+static void test_beacon_sent_only_from_comm_task(void)
+{
+    // Vaciar lo que hubiera quedado pendiente de otras pruebas
+    comm_beacon_process();
+
+    s_beacon_frames = 0;
+    sim_radio_set_listener(count_beacons);
+    s_beacon_state = !s_beacon_state;
+    comm_beacon_notify_state(s_beacon_state ? SYS_STATE_ARMED : SYS_STATE_DISARMED);
+    // El cambio de estado (o el timer) no transmite desde su contexto
+    TEST_ASSERT_EQUAL_UINT32(0, s_beacon_frames);
+
+    comm_beacon_process();
+    TEST_ASSERT_EQUAL_UINT32(1, s_beacon_frames);
+    comm_beacon_process();
+    TEST_ASSERT_EQUAL_UINT32(1, s_beacon_frames);
+    sim_radio_set_listener(NULL);
+}
+
+void test_slots_run(void)
+{
+    init_beacon();
+    RUN_TEST(test_one_sensor_per_slot_never_collides);
+    RUN_TEST(test_slot_phase_survives_32bit_time_wrap);
+    RUN_TEST(test_collision_table);
+    RUN_TEST(test_reregistered_sensor_keeps_rate_peer);
+    RUN_TEST(test_unknown_sensor_needs_pairing_window);
+    RUN_TEST(test_beacon_sent_only_from_comm_task);
+}
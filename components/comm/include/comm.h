@@ -14,6 +14,19 @@
 #include "system_globals.h"
 #include "esp_now.h"  // Para esp_now_recv_info_t y esp_now_send_status_t
 
+/**
+ * @brief Máximo de sensores registrados en comm
+ * 
+ * Igual al registro del controlador. Cada sensor ocupa un peer ESP-Now
+ * (CONFIG, firmware y tasa por peer) y la tabla de peers admite
+ * ESP_NOW_MAX_TOTAL_PEER_NUM (20) incluido el broadcast, así que no puede
+ * pasar de 19. Las simulaciones de host lo redefinen para probar el
+ * planificador de slots con más sensores.
+ */
+#ifndef COMM_MAX_SENSORS
+#define COMM_MAX_SENSORS        MAX_SENSORS
+#endif
+
 // ============================================================================
 // Inicialización y configuración
 // ============================================================================
@@ -58,6 +71,29 @@ esp_err_t comm_send_message(const uint8_t *dest_mac, const controller_message_t
  */
 esp_err_t comm_broadcast_message(const controller_message_t *message);
 
+/**
+ * @brief Envía una trama binaria sin codificar a un dispositivo
+ * 
+ * Usado por protocolos binarios (ej: distribución de firmware) que no
+ * pasan por el formato JSON de controller_message_t.
+ * 
+ * @param dest_mac Dirección MAC del dispositivo destino (NULL para broadcast)
+ * @param data Trama a enviar
+ * @param len Longitud de la trama (máximo ESPNOW_MAX_DATA_LEN)
+ * @return ESP_OK si la trama fue encolada en ESP-Now
+ * @return ESP_ERR_* en caso de error
+ */
+esp_err_t comm_send_raw(const uint8_t *dest_mac, const uint8_t *data, size_t len);
+
+/**
+ * @brief Despierta a comm_processing_task para atender trabajo pendiente
+ * 
+ * Los módulos que no deben transmitir desde su contexto (ej: el callback de
+ * esp_timer del beacon) marcan el trabajo y llaman a esta función; la
+ * tarea lo ejecuta en su siguiente vuelta. No bloquea.
+ */
+void comm_wake_task(void);
+
 // ============================================================================
 // Registro de sensores
 // ============================================================================
@@ -65,10 +101,14 @@ esp_err_t comm_broadcast_message(const controller_message_t *message);
 /**
  * @brief Registra un nuevo sensor en la lista de dispositivos conocidos
  * 
+ * El registro se guarda en NVS y se restaura en comm_init(), así que un
+ * sensor emparejado no necesita volver a emparejarse tras un reinicio.
+ * 
  * @param mac_addr Dirección MAC del sensor
  * @param device_id ID único del sensor
  * @param type Tipo de dispositivo
  * @return ESP_OK si el registro fue exitoso
+ * @return ESP_ERR_NO_MEM si el registro está lleno
  */
 esp_err_t comm_register_sensor(const uint8_t *mac_addr, const char *device_id, device_type_t type);
 
@@ -90,6 +130,137 @@ esp_err_t comm_unregister_sensor(const char *device_id);
  */
 esp_err_t comm_get_sensor_info(const char *device_id, sensor_info_t *sensor_info);
 
+/**
+ * @brief Copia los IDs de los sensores registrados
+ * 
+ * @param ids Arreglo destino
+ * @param max Capacidad del arreglo
+ * @return Número de IDs copiados
+ */
+size_t comm_get_registered_sensor_ids(char ids[][DEVICE_ID_MAX_LEN], size_t max);
+
+// ============================================================================
+// Emparejamiento de sensores
+// ============================================================================
+
+/** @brief Duración de la ventana de emparejamiento por defecto */
+#define COMM_PAIRING_DEFAULT_S  120
+
+/** @brief Duración máxima de la ventana de emparejamiento */
+#define COMM_PAIRING_MAX_S      86400
+
+/**
+ * @brief Abre la ventana de emparejamiento
+ * 
+ * Las tramas ESP-Now no están autenticadas: fuera de la ventana, las
+ * tramas de una MAC que no está en el registro se descartan sin
+ * registrarla ni agregarla como peer. Mientras la ventana está abierta, el
+ * primer mensaje de un sensor desconocido lo registra (y lo guarda en NVS).
+ * Se abre con el comando remoto PAIR (command_processor).
+ * 
+ * @param duration_s Segundos que queda abierta (0 = COMM_PAIRING_DEFAULT_S,
+ *                   se limita a COMM_PAIRING_MAX_S)
+ */
+void comm_pairing_open(uint32_t duration_s);
+
+/**
+ * @brief Cierra la ventana de emparejamiento antes de que venza
+ */
+void comm_pairing_close(void);
+
+/**
+ * @brief Indica si la ventana de emparejamiento está abierta
+ */
+bool comm_pairing_is_open(void);
+
+// ============================================================================
+// Heartbeat adaptativo
+// ============================================================================
+
+/**
+ * @brief Estadísticas del heartbeat adaptativo
+ * 
+ * El intervalo base es el mínimo (30 s) mientras la ocupación del canal
+ * está por debajo del 20 % y crece en proporción a ella por encima; cada
+ * sensor recibe el base escalado por la calidad de su enlace.
+ */
+typedef struct {
+    uint8_t sensor_count;           /**< Sensores registrados */
+    uint8_t sensors_online;         /**< Sensores dentro de su timeout de liveness */
+    uint32_t channel_load_permille; /**< Ocupación del canal medida (por mil, EWMA) */
+    uint32_t rx_dropped;            /**< Tramas descartadas por cola llena */
+    uint32_t base_interval_s;       /**< Intervalo base para un enlace sin pérdidas */
+    uint32_t hb_airtime_ppm;        /**< Airtime estimado de heartbeats (partes por millón) */
+    uint32_t configs_sent;          /**< Mensajes CONFIG enviados a sensores */
+    uint32_t liveness_timeouts;     /**< Sensores declarados offline */
+} comm_heartbeat_stats_t;
+
+/**
+ * @brief Obtiene las estadísticas del heartbeat adaptativo
+ * 
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK
+ */
+esp_err_t comm_get_heartbeat_stats(comm_heartbeat_stats_t *stats);
+
+// ============================================================================
+// Transmisión por slots
+// ============================================================================
+
+/**
+ * @brief Duración de un slot de transmisión
+ * 
+ * El tiempo se divide en supertramas de COMM_SLOT_COUNT slots alineadas a
+ * la hora del Gateway (gw_time_ms % COMM_SUPERFRAME_MS == 0), que los
+ * sensores obtienen del beacon de estado. Cada sensor registrado recibe un
+ * slot en el mensaje CONFIG y envía heartbeats y telemetría solo dentro de
+ * él. Los eventos de sensor y el pánico se transmiten de inmediato.
+ * 
+ * En el beacon la hora vuelve a cero cada COMM_GW_TIME_WRAP_MS, un múltiplo
+ * de la supertrama, así que la fase sigue siendo continua cuando el campo
+ * de 32 bits desborda. Entre beacons el sensor suma su propio reloj a
+ * gw_time_ms sin truncar a 32 bits.
+ */
+#define COMM_SLOT_MS            25
+
+/** @brief Slots por supertrama */
+#define COMM_SLOT_COUNT         40
+
+/** @brief Duración de la supertrama */
+#define COMM_SUPERFRAME_MS      (COMM_SLOT_MS * COMM_SLOT_COUNT)
+
+/** @brief Período de la hora del Gateway en el beacon (múltiplo de la supertrama, ~49,7 días) */
+#define COMM_GW_TIME_WRAP_MS    ((0xFFFFFFFFULL / COMM_SUPERFRAME_MS) * COMM_SUPERFRAME_MS)
+
+/**
+ * @brief Estadísticas del planificador de slots
+ * 
+ * Comparando slot_conflicts y off_slot_frames con el planificador activo e
+ * inactivo en sensores se obtiene la reducción de colisiones.
+ */
+typedef struct {
+    uint32_t in_slot_frames;        /**< Tramas no urgentes dentro de su slot */
+    uint32_t off_slot_frames;       /**< Tramas no urgentes fuera de su slot */
+    uint32_t urgent_frames;         /**< Eventos y pánico (exentos de slot) */
+    uint32_t slot_conflicts;        /**< Tramas de sensores distintos en el mismo slot y supertrama */
+    uint8_t max_sensors_per_slot;   /**< Ocupación del slot más cargado */
+} comm_slot_stats_t;
+
+/**
+ * @brief Hora del Gateway usada como referencia de los slots
+ * 
+ * @return Milisegundos desde el arranque (64 bits, sin desborde)
+ */
+uint64_t comm_get_gateway_time_ms(void);
+
+/**
+ * @brief Obtiene las estadísticas del planificador de slots
+ * 
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK
+ */
+esp_err_t comm_get_slot_stats(comm_slot_stats_t *stats);
+
 // ============================================================================
 // Callbacks (llamados desde ISR)
 // ============================================================================
@@ -0,0 +1,123 @@
+/**
+ * @file comm_beacon.h
+ * @brief Beacon de estado del sistema para los sensores ESP-Now
+ *
+ * El Gateway difunde por broadcast una trama binaria compacta con el estado
+ * del sistema cada vez que controller_set_state() lo cambia, repitiéndola con
+ * backoff exponencial hasta el período normal. Mientras el sistema está
+ * DESARMADO los sensores pueden pasar a modo de bajo tráfico (no reportar
+ * cada flanco OPEN/CLOSED).
+ *
+ * La época se incrementa con cada cambio y persiste en NVS. Un sensor cuyo
+ * estado conocido tenga una época distinta a la actual lo considera obsoleto;
+ * si el sensor informa su época en el header JSON ("epoch"), el Gateway le
+ * reenvía el beacon al detectar que está desactualizado.
+ *
+ * El beacon lleva además la hora del Gateway, referencia de la supertrama
+ * de slots de transmisión (ver COMM_SLOT_MS en comm.h).
+ */
+
+#ifndef COMM_BEACON_H
+#define COMM_BEACON_H
+
+#include "system_globals.h"
+
+// ============================================================================
+// Protocolo
+// ============================================================================
+
+/** @brief Primer byte de la trama de beacon */
+#define COMM_BEACON_MAGIC           0xF8
+
+/** @brief Versión del formato de beacon */
+#define COMM_BEACON_VERSION         2
+
+/** @brief Flag: el sensor puede suprimir eventos no urgentes */
+#define COMM_BEACON_FLAG_LOW_TRAFFIC    0x01
+
+/**
+ * @brief Trama de beacon de estado
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t magic;          /**< COMM_BEACON_MAGIC */
+    uint8_t version;        /**< COMM_BEACON_VERSION */
+    uint8_t state;          /**< system_state_t actual */
+    uint8_t flags;          /**< COMM_BEACON_FLAG_* */
+    uint32_t epoch;         /**< Época del estado (crece con cada cambio) */
+    uint16_t next_beacon_s; /**< Segundos hasta el próximo beacon */
+    uint32_t gw_time_ms;    /**< Hora del Gateway módulo COMM_GW_TIME_WRAP_MS */
+    uint16_t superframe_ms; /**< Duración de la supertrama de slots */
+    uint8_t slot_ms;        /**< Duración de un slot */
+} comm_beacon_frame_t;
+
+/**
+ * @brief Contadores de tráfico por estado del sistema
+ *
+ * Comparando eventos por hora en DESARMADO antes y después de que los
+ * sensores soporten el beacon se obtiene la reducción de tráfico.
+ */
+typedef struct {
+    uint32_t epoch;                 /**< Época actual */
+    system_state_t state;           /**< Estado difundido */
+    uint32_t beacons_sent;          /**< Beacons transmitidos */
+    uint32_t stale_epoch_frames;    /**< Tramas de sensores con época obsoleta */
+    uint32_t rx_frames[4];          /**< Tramas JSON recibidas por estado */
+    uint32_t rx_sensor_events[4];   /**< Eventos OPEN/CLOSED recibidos por estado */
+    uint32_t time_in_state_s[4];    /**< Segundos acumulados en cada estado */
+} comm_beacon_stats_t;
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * @brief Inicializa el beacon y difunde el estado actual
+ *
+ * Llamado desde comm_init() una vez que ESP-Now está listo.
+ *
+ * @return ESP_OK si se inicializó correctamente
+ */
+esp_err_t comm_beacon_init(void);
+
+/**
+ * @brief Notifica un cambio de estado del sistema
+ *
+ * Incrementa la época, pide el beacon a comm_processing_task y reinicia la
+ * secuencia de repeticiones. Seguro de llamar antes de comm_init().
+ *
+ * @param state Nuevo estado del sistema
+ */
+void comm_beacon_notify_state(system_state_t state);
+
+/**
+ * @brief Contabiliza una trama recibida de un sensor
+ *
+ * @note Llamado desde comm_processing_task
+ *
+ * @param src_mac MAC del remitente
+ * @param message Mensaje ya parseado
+ */
+void comm_beacon_note_rx(const uint8_t *src_mac, const controller_message_t *message);
+
+/**
+ * @brief Transmite el beacon si hay uno pendiente
+ *
+ * @note Llamado desde comm_processing_task, el único contexto que
+ * transmite beacons
+ */
+void comm_beacon_process(void);
+
+/**
+ * @brief Obtiene los contadores del beacon
+ *
+ * @param stats Estructura donde se copiarán los contadores
+ * @return ESP_OK
+ */
+esp_err_t comm_beacon_get_stats(comm_beacon_stats_t *stats);
+
+/**
+ * @brief Imprime los contadores del beacon (para debug)
+ */
+void comm_beacon_print_stats(void);
+
+#endif // COMM_BEACON_H
@@ -0,0 +1,153 @@
+/**
+ * @file comm_fw_dist.h
+ * @brief Distribución de firmware de sensores sobre ESP-Now
+ *
+ * El Gateway transmite una imagen de firmware almacenada en la partición
+ * "sensor_fw" a uno o varios sensores registrados. El protocolo usa tramas
+ * binarias (no JSON) identificadas por COMM_FW_DIST_MAGIC en el primer byte:
+ *
+ * - OFFER: anuncia la imagen (tamaño, versión, CRC32, número de chunks)
+ * - DATA:  un chunk de la imagen; el último de cada ráfaga pide ACK
+ * - ACK:   ventana recibida por el sensor (base + bitmap de 32 chunks)
+ * - DONE:  el sensor verificó el CRC de la imagen completa
+ *
+ * Las ACK permiten retransmisión selectiva de los chunks perdidos, y como
+ * la base la reporta el sensor, un sensor que reinicia a mitad de la
+ * transferencia retoma desde el último chunk que persistió.
+ *
+ * En modo multicast cada chunk compartido se envía una sola vez por
+ * broadcast para todos los sensores destino.
+ *
+ * Se inicia con el comando remoto FW_UPDATE (command_processor), que
+ * distribuye a todos los sensores registrados, o llamando a
+ * comm_fw_dist_start() con una lista de sensores.
+ */
+
+#ifndef COMM_FW_DIST_H
+#define COMM_FW_DIST_H
+
+#include "system_globals.h"
+
+// ============================================================================
+// Protocolo
+// ============================================================================
+
+/** @brief Primer byte de toda trama de distribución de firmware */
+#define COMM_FW_DIST_MAGIC          0xF7
+
+/** @brief Magic de la cabecera de imagen en la partición sensor_fw ("GFWI") */
+#define COMM_FW_IMAGE_MAGIC         0x49574647
+
+/** @brief Bytes de imagen por trama DATA */
+#define COMM_FW_CHUNK_SIZE          240
+
+/** @brief Chunks por ventana (uno por bit del bitmap de ACK) */
+#define COMM_FW_WINDOW_CHUNKS       32
+
+/** @brief Máximo de sensores destino por sesión (todo el registro del controlador) */
+#define COMM_FW_DIST_MAX_TARGETS    MAX_SENSORS
+
+/**
+ * @brief Cabecera de la imagen al inicio de la partición sensor_fw
+ *
+ * La imagen del sensor se escribe justo después de esta cabecera.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;         /**< COMM_FW_IMAGE_MAGIC */
+    uint32_t size;          /**< Tamaño de la imagen en bytes */
+    uint32_t version;       /**< Versión de firmware del sensor */
+    uint32_t crc32;         /**< CRC32 (esp_rom_crc32_le) de la imagen */
+} comm_fw_image_header_t;
+
+/**
+ * @brief Modo de distribución
+ */
+typedef enum {
+    COMM_FW_DIST_UNICAST = 0,   /**< Ráfagas independientes por sensor */
+    COMM_FW_DIST_MULTICAST = 1  /**< Chunks compartidos enviados una vez por broadcast */
+} comm_fw_dist_mode_t;
+
+/**
+ * @brief Estado de un sensor dentro de la sesión
+ */
+typedef enum {
+    COMM_FW_TARGET_OFFERED = 0, /**< OFFER enviado, esperando primera ACK */
+    COMM_FW_TARGET_ACTIVE,      /**< Transfiriendo chunks */
+    COMM_FW_TARGET_VERIFYING,   /**< Todos los chunks recibidos, esperando DONE */
+    COMM_FW_TARGET_DONE,        /**< Imagen verificada por el sensor */
+    COMM_FW_TARGET_FAILED       /**< Sin respuesta o CRC inválido */
+} comm_fw_target_state_t;
+
+/**
+ * @brief Estadísticas de la última sesión de distribución
+ */
+typedef struct {
+    bool running;               /**< Sesión en curso */
+    comm_fw_dist_mode_t mode;   /**< Modo de la sesión */
+    uint32_t image_size;        /**< Tamaño de la imagen */
+    uint16_t chunk_count;       /**< Chunks de la imagen */
+    uint8_t target_count;       /**< Sensores destino */
+    uint8_t targets_done;       /**< Sensores con imagen verificada */
+    uint8_t targets_failed;     /**< Sensores fallidos */
+    uint32_t frames_sent;       /**< Tramas DATA transmitidas */
+    uint32_t chunks_retransmitted; /**< Tramas DATA repetidas */
+    uint32_t acks_received;     /**< ACK recibidas */
+    uint32_t resumes;           /**< Sensores que retrocedieron su base (reinicio) */
+    uint32_t rounds;            /**< Rondas ráfaga/ACK */
+    uint32_t elapsed_ms;        /**< Tiempo total de despliegue */
+} comm_fw_dist_stats_t;
+
+// ============================================================================
+// API
+// ============================================================================
+
+/**
+ * @brief Inicia la distribución de la imagen a uno o varios sensores
+ *
+ * Los sensores se resuelven en el registro de comm (comm_register_sensor).
+ * La sesión se ejecuta en una tarea propia; consultar el progreso con
+ * comm_fw_dist_get_stats().
+ *
+ * @param device_ids IDs de los sensores destino
+ * @param count Número de sensores (máximo COMM_FW_DIST_MAX_TARGETS)
+ * @param mode Unicast o multicast
+ * @return ESP_OK si la sesión se inició
+ * @return ESP_ERR_INVALID_STATE si ya hay una sesión en curso
+ * @return ESP_ERR_NOT_FOUND si falta la partición, la imagen o algún sensor
+ * @return ESP_ERR_INVALID_CRC si la imagen almacenada está corrupta
+ */
+esp_err_t comm_fw_dist_start(const char *const *device_ids, size_t count, comm_fw_dist_mode_t mode);
+
+/**
+ * @brief Cancela la sesión en curso
+ *
+ * @return ESP_OK si se solicitó la cancelación
+ * @return ESP_ERR_INVALID_STATE si no hay sesión
+ */
+esp_err_t comm_fw_dist_abort(void);
+
+/**
+ * @brief Verifica si hay una sesión en curso
+ */
+bool comm_fw_dist_is_running(void);
+
+/**
+ * @brief Obtiene las estadísticas de la sesión actual o la última
+ *
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK
+ */
+esp_err_t comm_fw_dist_get_stats(comm_fw_dist_stats_t *stats);
+
+/**
+ * @brief Procesa una trama de distribución recibida de un sensor
+ *
+ * @note Llamado desde comm_processing_task, nunca desde ISR
+ *
+ * @param src_mac MAC del sensor
+ * @param data Trama recibida (data[0] == COMM_FW_DIST_MAGIC)
+ * @param len Longitud de la trama
+ */
+void comm_fw_dist_handle_frame(const uint8_t *src_mac, const uint8_t *data, int len);
+
+#endif // COMM_FW_DIST_H
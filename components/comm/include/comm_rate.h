@@ -0,0 +1,124 @@
+/**
+ * @file comm_rate.h
+ * @brief Selección de tasa PHY por sensor para ESP-Now
+ *
+ * ESP-Now transmite por defecto a 1 Mbps. Los sensores cercanos al Gateway
+ * pueden recibir a tasas 802.11n mucho más altas (menos airtime por trama),
+ * y los lejanos se benefician del modo Long Range de Espressif.
+ *
+ * Para cada sensor registrado se elige una clase de tasa a partir del RSSI
+ * promedio de sus tramas y del ratio de entrega de los envíos del Gateway
+ * (callback de envío de ESP-Now), y se aplica con
+ * esp_now_set_peer_rate_config(). La clase sube de a un escalón con
+ * histéresis y baja de inmediato ante pérdidas.
+ *
+ * @note La clase LR solo se usa con CONFIG_COMM_LONG_RANGE, que también
+ * cambia los protocolos del enlace STA con el AP (deshabilitado por
+ * defecto). Además el sensor tiene que habilitar WIFI_PROTOCOL_LR; si un
+ * sensor no recibe nada en LR se marca como no compatible.
+ */
+
+#ifndef COMM_RATE_H
+#define COMM_RATE_H
+
+#include "system_globals.h"
+
+/**
+ * @brief Clases de tasa, de la más robusta a la más rápida
+ */
+typedef enum {
+    COMM_RATE_LR_250K = 0,      /**< Long Range 250 kbps */
+    COMM_RATE_1M,               /**< 802.11b 1 Mbps (por defecto de ESP-Now) */
+    COMM_RATE_MCS0,             /**< 802.11n MCS0 6.5 Mbps */
+    COMM_RATE_MCS3,             /**< 802.11n MCS3 26 Mbps */
+    COMM_RATE_MCS7,             /**< 802.11n MCS7 65 Mbps */
+    COMM_RATE_CLASS_COUNT
+} comm_rate_class_t;
+
+/**
+ * @brief Contadores de una clase de tasa
+ *
+ * airtime_default_us es el airtime que habrían ocupado las mismas tramas a
+ * 1 Mbps; la diferencia con airtime_us es el airtime ahorrado (negativo en LR).
+ */
+typedef struct {
+    uint8_t peers;                  /**< Sensores usando esta clase */
+    uint32_t tx_frames;             /**< Tramas enviadas */
+    uint32_t tx_ok;                 /**< Entregas confirmadas */
+    uint32_t tx_fail;               /**< Entregas fallidas */
+    uint64_t airtime_us;            /**< Airtime estimado de las tramas enviadas */
+    uint64_t airtime_default_us;    /**< Airtime equivalente a 1 Mbps */
+} comm_rate_class_stats_t;
+
+/**
+ * @brief Estadísticas de selección de tasa
+ */
+typedef struct {
+    comm_rate_class_stats_t classes[COMM_RATE_CLASS_COUNT];
+    uint32_t rate_changes;          /**< Cambios de clase aplicados */
+    uint32_t lr_unsupported;        /**< Sensores que no respondieron en LR */
+} comm_rate_stats_t;
+
+/**
+ * @brief Habilita el protocolo LR en la interfaz STA
+ *
+ * Sin CONFIG_COMM_LONG_RANGE no cambia los protocolos de la STA y la
+ * clase más robusta pasa a ser 1 Mbps.
+ *
+ * @return ESP_OK si se configuró correctamente (o LR está deshabilitado)
+ */
+esp_err_t comm_rate_init(void);
+
+/**
+ * @brief Alta de un sensor como peer (comienza en COMM_RATE_1M)
+ */
+void comm_rate_peer_added(const uint8_t *mac_addr);
+
+/**
+ * @brief Baja de un sensor
+ */
+void comm_rate_peer_removed(const uint8_t *mac_addr);
+
+/**
+ * @brief Registra el RSSI de una trama recibida del sensor
+ *
+ * @note Llamado desde comm_processing_task
+ */
+void comm_rate_note_rx(const uint8_t *mac_addr, int8_t rssi);
+
+/**
+ * @brief Registra un envío unicast encolado en ESP-Now
+ *
+ * @param mac_addr Destino
+ * @param len Longitud del payload
+ */
+void comm_rate_note_tx(const uint8_t *mac_addr, size_t len);
+
+/**
+ * @brief Registra el resultado de un envío
+ *
+ * @note Llamado desde el callback de envío de ESP-Now (tarea WiFi)
+ */
+void comm_rate_note_tx_status(const uint8_t *mac_addr, bool success);
+
+/**
+ * @brief Reevalúa la clase de tasa de cada sensor
+ *
+ * @note Llamado periódicamente desde comm_processing_task
+ */
+void comm_rate_evaluate(void);
+
+/**
+ * @brief Obtiene los contadores por clase de tasa
+ *
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK
+ */
+esp_err_t comm_rate_get_stats(comm_rate_stats_t *stats);
+
+/**
+ * @brief Imprime los contadores por clase de tasa (para debug)
+ */
+void comm_rate_print_stats(void);
+
+#endif // COMM_RATE_H
@@ -3,19 +3,84 @@
  * @brief Procesador de comandos remotos desde Supabase
  *
  * Este componente consulta periódicamente la tabla system_commands
- * y ejecuta comandos ARM/DISARM/TEST en el sistema local.
+ * y ejecuta comandos ARM/DISARM/TEST/FW_UPDATE/PAIR en el sistema local.
+ *
+ * Es además el punto único de ejecución de comandos: los que llegan por
+ * WebSocket (realtime_commands) o MQTT (mqtt_backend) también pasan por
+ * command_processor_submit(), que descarta ids repetidos y reporta el
+ * resultado de cada comando.
  */
 
 #ifndef COMMAND_PROCESSOR_H
 #define COMMAND_PROCESSOR_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 
+/** @brief Largo máximo de un id de comando (UUID + '\0') */
+#define COMMAND_ID_LEN      40
+
+/**
+ * @brief Origen de un comando
+ */
+typedef enum {
+    COMMAND_SOURCE_REALTIME = 0,    /**< postgres_changes por WebSocket */
+    COMMAND_SOURCE_REST,            /**< Consulta REST */
+    COMMAND_SOURCE_MQTT,            /**< Topic de comandos del broker MQTT (mqtt_backend) */
+} command_source_t;
+
+/**
+ * @brief Resultado de un comando
+ */
+typedef struct {
+    const char *command_id;     /**< Id del comando */
+    const char *command;        /**< ARM, DISARM, TEST... */
+    const char *status;         /**< "executed", "failed" o "expired" */
+    const char *result;         /**< Detalle legible */
+    int32_t latency_ms;         /**< created_at -> estado aplicado (-1 si no hay hora) */
+    uint32_t exec_ms;           /**< Recepción en el gateway -> estado aplicado */
+} command_result_t;
+
+/**
+ * @brief Callback para reportar resultados por un canal rápido (ej: WebSocket)
+ *
+ * @note Se llama desde la tarea del controller o de esp_timer; no debe bloquear
+ */
+typedef void (*command_result_reporter_t)(const command_result_t *result);
+
+/**
+ * @brief Contadores de comandos
+ */
+typedef struct {
+    uint32_t received;          /**< Comandos recibidos (todas las fuentes) */
+    uint32_t executed;          /**< Aplicados por el controller */
+    uint32_t failed;            /**< Desconocidos o no aplicados a tiempo */
+    uint32_t expired;           /**< Descartados por antigüedad */
+    uint32_t duplicates;        /**< Ids repetidos ignorados */
+    uint32_t latency_last_ms;   /**< Latencia del último comando ejecutado */
+    uint32_t latency_avg_ms;    /**< Latencia promedio (EWMA) */
+    uint32_t latency_max_ms;    /**< Latencia máxima */
+    uint32_t polls;             /**< Consultas REST realizadas */
+    uint32_t polls_not_modified; /**< Consultas respondidas con 304 */
+    uint32_t catchups;          /**< Recuperaciones al reconectar Realtime */
+    uint32_t rest_commands;     /**< Comandos recibidos por REST */
+    uint32_t poll_interval_ms;  /**< Intervalo de polling actual (0 = Realtime sano) */
+} command_stats_t;
+
+/**
+ * @brief Indica si Realtime está entregando comandos
+ *
+ * @return true si el canal de comandos está unido
+ */
+typedef bool (*command_health_fn_t)(void);
+
 /**
  * @brief Inicializa el procesador de comandos remotos
  *
- * Crea una tarea que consulta periódicamente Supabase
- * en busca de comandos pendientes.
+ * Crea una tarea que consulta Supabase en busca de comandos pendientes
+ * mientras Realtime no está sano (ver command_processor_set_health_check),
+ * con intervalo adaptativo entre 5 y 60 segundos.
  *
  * @return ESP_OK si se inicializó correctamente
  */
@@ -31,8 +96,60 @@ esp_err_t command_processor_stop(void);
 /**
  * @brief Verifica si hay comandos pendientes manualmente
  *
- * @return ESP_OK si la consulta se realizó correctamente
+ * La consulta se hace en la tarea del procesador.
+ *
+ * @return ESP_OK si la consulta se solicitó
  */
 esp_err_t command_processor_check_now(void);
 
+/**
+ * @brief Registra el chequeo de salud de Realtime
+ *
+ * Con Realtime sano no se consulta la API REST; al pasar a sano se hace
+ * una consulta de recuperación desde el último comando procesado. Sin
+ * chequeo registrado se consulta siempre.
+ *
+ * @param health_fn Función de chequeo (NULL = siempre consultar)
+ * @return ESP_OK
+ */
+esp_err_t command_processor_set_health_check(command_health_fn_t health_fn);
+
+/**
+ * @brief Ejecuta un comando recibido y reporta su resultado
+ *
+ * @param command_id Id del comando (se ignora si ya se procesó)
+ * @param command Comando (ARM, DISARM, TEST, FW_UPDATE, PAIR)
+ * @param created_at created_at ISO 8601 del comando (puede ser NULL)
+ * @param source Origen del comando
+ * @return ESP_OK si se ejecutó o envió al controller
+ * @return ESP_ERR_INVALID_STATE si el id ya se había procesado
+ * @return ESP_ERR_TIMEOUT si el comando expiró o no se pudo enviar al controller
+ * @return ESP_ERR_NOT_SUPPORTED si el comando es desconocido
+ * @return Otro error si no se pudo iniciar FW_UPDATE
+ *
+ * Si el comando no llegó a ejecutarse (ni expiró ni es desconocido) su id
+ * no queda registrado: una nueva entrega del mismo comando se procesa.
+ */
+esp_err_t command_processor_submit(const char *command_id, const char *command,
+                                   const char *created_at, command_source_t source);
+
+/**
+ * @brief Registra el callback que publica los resultados por WebSocket
+ *
+ * Los resultados se registran además como evento "command_result" en
+ * Supabase (en background).
+ *
+ * @param reporter Callback (NULL para quitarlo)
+ * @return ESP_OK
+ */
+esp_err_t command_processor_set_result_reporter(command_result_reporter_t reporter);
+
+/**
+ * @brief Obtiene los contadores de comandos
+ *
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK
+ */
+esp_err_t command_processor_get_stats(command_stats_t *stats);
+
 #endif // COMMAND_PROCESSOR_H
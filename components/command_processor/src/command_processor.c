@@ -1,138 +1,678 @@
 /**
  * @file command_processor.c
  * @brief Implementación del procesador de comandos remotos
+ *
+ * Todos los comandos (WebSocket o REST) pasan por command_processor_submit():
+ *
+ * 1. Se descartan ids ya vistos (un comando re-entregado tras reconectar
+ *    no se ejecuta dos veces) y comandos expirados.
+ * 2. ARM/DISARM se envían al controller y quedan "en vuelo" hasta que el
+ *    controller aplica el estado objetivo (listener de estado) o vence
+ *    COMMAND_APPLY_TIMEOUT_MS.
+ * 3. FW_UPDATE inicia la distribución de la imagen de la partición
+ *    sensor_fw a todos los sensores registrados (comm_fw_dist); el
+ *    resultado indica si la sesión arrancó, no cuándo termina. PAIR abre
+ *    la ventana de emparejamiento de comm: solo mientras está abierta se
+ *    registran sensores nuevos.
+ * 4. El resultado, con la latencia desde created_at hasta el estado
+ *    aplicado, se reporta por el reporter registrado (WebSocket) y como
+ *    evento "command_result" en background (historial).
+ *
+ * Mientras Realtime está sano no se consulta la API REST. Al (re)unirse el
+ * canal de comandos se hace una consulta de recuperación desde el último
+ * comando procesado; con Realtime caído se consulta con intervalo
+ * adaptativo (se duplica mientras no hay comandos).
  */
 
 #include "command_processor.h"
 #include "supabase_client.h"
 #include "controller.h"
+#include "comm.h"
+#include "comm_fw_dist.h"
+#include "device_identity.h"
+#include "sntp_sync.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "cJSON.h"
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
 
 static const char *TAG = "CMD_PROC";
 
 // Configuración
-#define COMMAND_CHECK_INTERVAL_SEC  5  // Consultar cada 5 segundos
+#define COMMAND_POLL_MIN_MS         5000  // Intervalo de consulta REST inicial
+#define COMMAND_POLL_MAX_MS         60000 // Intervalo máximo tras consultas vacías
+#define COMMAND_HEALTH_CHECK_MS     2000  // Chequeo local de Realtime (sin red)
+#define COMMAND_FETCH_LIMIT         5     // Comandos por consulta
+#define COMMAND_RESPONSE_SIZE       768
+#define COMMAND_POLL_TASK_STACK     8192  // TLS en la tarea
+#define COMMAND_POLL_TASK_PRIORITY  3
 #define COMMAND_TIMEOUT_SEC         30 // Comandos de más de 30s se consideran expirados
+#define COMMAND_APPLY_TIMEOUT_MS    3000  // Espera del controller al aplicar el estado
+#define COMMAND_DEDUP_SIZE          16    // Ids recientes recordados
+#define COMMAND_MAX_IN_FLIGHT       4     // ARM/DISARM esperando al controller
 
-// Handle del timer
-static esp_timer_handle_t s_command_timer = NULL;
+/**
+ * @brief Comando enviado al controller, esperando el cambio de estado
+ */
+typedef struct {
+    bool used;
+    char id[COMMAND_ID_LEN];
+    char command[16];
+    system_state_t target;
+    int64_t created_ms;         // created_at en ms epoch (-1 = desconocido)
+    int64_t submitted_us;
+    int64_t deadline_us;
+} command_in_flight_t;
+
+// Tarea de consulta REST
+static TaskHandle_t s_poll_task = NULL;
+static volatile bool s_poll_run = false;
+static volatile bool s_force_fetch = false;
+static command_health_fn_t s_health_fn = NULL;
+
+// created_at del comando más reciente procesado (cursor de recuperación)
+static char s_cursor[40] = "";
+
+// ETag de la última consulta (solo válido para el mismo path)
+static char s_etag[80] = "";
+static uint32_t s_etag_path_hash = 0;
+
+static esp_timer_handle_t s_apply_timer = NULL;
+
+static SemaphoreHandle_t s_mutex = NULL;
+static command_result_reporter_t s_reporter = NULL;
+
+// Ids recientes (anillo)
+static char s_recent_ids[COMMAND_DEDUP_SIZE][COMMAND_ID_LEN];
+static int s_recent_next = 0;
+
+static command_in_flight_t s_in_flight[COMMAND_MAX_IN_FLIGHT];
+static command_stats_t s_stats = {0};
 
 // ============================================================================
 // Funciones privadas
 // ============================================================================
 
 /**
- * @brief Procesa un comando individual
+ * @brief Días desde 1970-01-01 para una fecha del calendario gregoriano
  */
-static esp_err_t process_command(const char *command_id, const char *command_str)
+static int64_t days_from_civil(int y, int m, int d)
 {
-    esp_err_t ret = ESP_OK;
-    bool executed = false;
+    y -= (m <= 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
 
-    ESP_LOGI(TAG, "Procesando comando: %s (%s)", command_str, command_id);
+/**
+ * @brief Convierte un timestamp ISO 8601 de Postgres a ms epoch
+ *
+ * Acepta "2025-01-31T12:34:56.789012+00:00", con "Z" o sin fracción.
+ *
+ * @return ms epoch, o -1 si no se pudo interpretar
+ */
+static int64_t parse_timestamp_ms(const char *ts)
+{
+    int y, mo, d, h, mi, s, consumed = 0;
+    if (!ts || sscanf(ts, "%4d-%2d-%2d%*[T ]%2d:%2d:%2d%n", &y, &mo, &d, &h, &mi, &s, &consumed) != 6) {
+        return -1;
+    }
 
-    if (strcmp(command_str, "ARM") == 0) {
-        // Enviar mensaje de armado al controller
-        controller_message_t msg = {
-            .header = {
-                .version = 1,
-                .src_id = "CMD_PROC",
-                .src_type = DEV_TYPE_GATEWAY
-            },
-            .payload = {
-                .type = MSG_TYPE_ARM_COMMAND
+    const char *p = ts + consumed;
+    int64_t ms = 0;
+    if (*p == '.') {
+        int digits = 0;
+        for (p++; *p >= '0' && *p <= '9'; p++, digits++) {
+            if (digits < 3) {
+                ms = ms * 10 + (*p - '0');
             }
-        };
+        }
+        for (; digits < 3; digits++) {
+            ms *= 10;
+        }
+    }
 
-        if (xQueueSend(gSystemCtx.controller_queue, &msg, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            executed = true;
-            ESP_LOGI(TAG, "Comando ARM enviado al controller");
-        } else {
-            ESP_LOGE(TAG, "Error enviando comando ARM a la cola");
-            ret = ESP_ERR_TIMEOUT;
+    int64_t offset_s = 0;
+    if (*p == '+' || *p == '-') {
+        int oh = 0, om = 0;
+        sscanf(p + 1, "%2d:%2d", &oh, &om);
+        offset_s = (int64_t)(oh * 3600 + om * 60) * (*p == '-' ? -1 : 1);
+    }
+
+    int64_t epoch_s = days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + s - offset_s;
+    return epoch_s * 1000 + ms;
+}
+
+/**
+ * @brief Hora actual en ms epoch, o -1 si el reloj no está sincronizado
+ */
+static int64_t now_epoch_ms(void)
+{
+    if (!sntp_sync_is_synced()) {
+        return -1;
+    }
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/**
+ * @brief Registra el id; devuelve false si ya se había visto
+ * @note Llamar con s_mutex tomado
+ */
+static bool remember_id(const char *command_id)
+{
+    for (int i = 0; i < COMMAND_DEDUP_SIZE; i++) {
+        if (strncmp(s_recent_ids[i], command_id, COMMAND_ID_LEN) == 0) {
+            return false;
         }
+    }
+    strncpy(s_recent_ids[s_recent_next], command_id, COMMAND_ID_LEN - 1);
+    s_recent_ids[s_recent_next][COMMAND_ID_LEN - 1] = '\0';
+    s_recent_next = (s_recent_next + 1) % COMMAND_DEDUP_SIZE;
+    return true;
+}
 
-    } else if (strcmp(command_str, "DISARM") == 0) {
-        // Enviar mensaje de desarmado
-        controller_message_t msg = {
-            .header = {
-                .version = 1,
-                .src_id = "CMD_PROC",
-                .src_type = DEV_TYPE_GATEWAY
-            },
-            .payload = {
-                .type = MSG_TYPE_DISARM_COMMAND
+/**
+ * @brief Olvida un id registrado con remember_id()
+ * @note Llamar con s_mutex tomado
+ *
+ * Para comandos que no llegaron a ejecutarse: si vuelven a llegar (p.ej.
+ * MQTT los reentrega) deben procesarse, no descartarse como repetidos.
+ */
+static void forget_id(const char *command_id)
+{
+    for (int i = 0; i < COMMAND_DEDUP_SIZE; i++) {
+        if (strncmp(s_recent_ids[i], command_id, COMMAND_ID_LEN) == 0) {
+            s_recent_ids[i][0] = '\0';
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Contabiliza y reporta el resultado de un comando
+ *
+ * @param created_ms created_at en ms epoch (-1 = desconocido)
+ * @param submitted_us Momento en que el gateway recibió el comando
+ */
+static void report_result(const char *command_id, const char *command, const char *status,
+                          const char *result, int64_t created_ms, int64_t submitted_us)
+{
+    int64_t now_ms = now_epoch_ms();
+    command_result_t res = {
+        .command_id = command_id,
+        .command = command,
+        .status = status,
+        .result = result,
+        .latency_ms = (created_ms >= 0 && now_ms >= created_ms) ? (int32_t)(now_ms - created_ms) : -1,
+        .exec_ms = (uint32_t)((esp_timer_get_time() - submitted_us) / 1000),
+    };
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (strcmp(status, "executed") == 0) {
+        s_stats.executed++;
+        if (res.latency_ms >= 0) {
+            uint32_t latency = (uint32_t)res.latency_ms;
+            s_stats.latency_last_ms = latency;
+            s_stats.latency_avg_ms = s_stats.latency_avg_ms ?
+                                     (s_stats.latency_avg_ms * 7 + latency) / 8 : latency;
+            if (latency > s_stats.latency_max_ms) {
+                s_stats.latency_max_ms = latency;
             }
-        };
+        }
+    } else if (strcmp(status, "expired") == 0) {
+        s_stats.expired++;
+    } else {
+        s_stats.failed++;
+    }
+    command_result_reporter_t reporter = s_reporter;
+    xSemaphoreGive(s_mutex);
 
-        if (xQueueSend(gSystemCtx.controller_queue, &msg, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            executed = true;
-            ESP_LOGI(TAG, "Comando DISARM enviado al controller");
-        } else {
-            ESP_LOGE(TAG, "Error enviando comando DISARM a la cola");
-            ret = ESP_ERR_TIMEOUT;
+    ESP_LOGI(TAG, "Comando %s (%s): %s - %s (latencia %ld ms, ejecución %lu ms)",
+             command, command_id, status, result, (long)res.latency_ms, (unsigned long)res.exec_ms);
+
+    // Camino rápido: WebSocket
+    if (reporter) {
+        reporter(&res);
+    }
+
+    if (!supabase_is_initialized()) {
+        return;
+    }
+
+    // Estado en system_commands: deja de figurar como pendiente
+    if (supabase_update_command_status_async(command_id, status, result) != ESP_OK) {
+        ESP_LOGW(TAG, "No se pudo encolar el estado de %s", command_id);
+    }
+
+    // Historial: evento en background
+
+    char device_id[DEVICE_ID_LEN];
+    if (device_identity_get_id(device_id) != ESP_OK) {
+        strncpy(device_id, "GATEWAY_UNKNOWN", DEVICE_ID_LEN);
+    }
+
+    cJSON *data = cJSON_CreateObject();
+    cJSON_AddStringToObject(data, "command_id", command_id);
+    cJSON_AddStringToObject(data, "command", command);
+    cJSON_AddStringToObject(data, "status", status);
+    cJSON_AddStringToObject(data, "result", result);
+    cJSON_AddNumberToObject(data, "latency_ms", res.latency_ms);
+    cJSON_AddNumberToObject(data, "exec_ms", res.exec_ms);
+    char *json_str = cJSON_PrintUnformatted(data);
+    cJSON_Delete(data);
+
+    device_event_t event = {
+        .event_type = "command_result",
+        .event_timestamp = NULL,
+        .device_id = device_id,
+        .device_type = "GATEWAY",
+        .presence = false,
+        .distance_cm = 0.0f,
+        .direction = -1,
+        .behavior = -1,
+        .active_zone = -1,
+        .energy_data = json_str
+    };
+    supabase_send_event_async(&event);
+    free(json_str);
+}
+
+/**
+ * @brief Programa el timer de aplicación para el deadline más cercano
+ * @note Llamar con s_mutex tomado
+ */
+static void schedule_apply_timer(void)
+{
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < COMMAND_MAX_IN_FLIGHT; i++) {
+        if (s_in_flight[i].used && s_in_flight[i].deadline_us < next) {
+            next = s_in_flight[i].deadline_us;
         }
+    }
+    esp_timer_stop(s_apply_timer);
+    if (next != INT64_MAX) {
+        int64_t delay = next - esp_timer_get_time();
+        esp_timer_start_once(s_apply_timer, delay > 0 ? (uint64_t)delay : 1);
+    }
+}
+
+/**
+ * @brief Listener de estado del controller: completa el comando en vuelo
+ */
+static void on_state_applied(system_state_t new_state, system_state_t old_state)
+{
+    command_in_flight_t done = {0};
 
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    // El más antiguo con ese estado objetivo
+    int best = -1;
+    for (int i = 0; i < COMMAND_MAX_IN_FLIGHT; i++) {
+        if (s_in_flight[i].used && s_in_flight[i].target == new_state &&
+            (best < 0 || s_in_flight[i].submitted_us < s_in_flight[best].submitted_us)) {
+            best = i;
+        }
+    }
+    if (best >= 0) {
+        done = s_in_flight[best];
+        s_in_flight[best].used = false;
+        schedule_apply_timer();
+    }
+    xSemaphoreGive(s_mutex);
+
+    if (done.used) {
+        report_result(done.id, done.command, "executed", "OK", done.created_ms, done.submitted_us);
+    }
+}
+
+/**
+ * @brief Timer de aplicación: falla los comandos que el controller no aplicó
+ */
+static void apply_timer_callback(void *arg)
+{
+    command_in_flight_t expired[COMMAND_MAX_IN_FLIGHT];
+    int count = 0;
+    int64_t now_us = esp_timer_get_time();
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (int i = 0; i < COMMAND_MAX_IN_FLIGHT; i++) {
+        if (s_in_flight[i].used && s_in_flight[i].deadline_us <= now_us) {
+            expired[count++] = s_in_flight[i];
+            s_in_flight[i].used = false;
+        }
+    }
+    schedule_apply_timer();
+    xSemaphoreGive(s_mutex);
+
+    for (int i = 0; i < count; i++) {
+        report_result(expired[i].id, expired[i].command, "failed", "Estado no aplicado",
+                      expired[i].created_ms, expired[i].submitted_us);
+    }
+}
+
+/**
+ * @brief Inicia la distribución de firmware a todos los sensores registrados
+ *
+ * Con más de un sensor se usa multicast (cada chunk compartido se envía
+ * una vez). El avance se consulta con comm_fw_dist_get_stats().
+ */
+static esp_err_t start_fw_update(const char *command_id, const char *command_str,
+                                 int64_t created_ms, int64_t submitted_us)
+{
+    char ids[COMM_FW_DIST_MAX_TARGETS][DEVICE_ID_MAX_LEN];
+    const char *targets[COMM_FW_DIST_MAX_TARGETS];
+    size_t count = comm_get_registered_sensor_ids(ids, COMM_FW_DIST_MAX_TARGETS);
+    for (size_t i = 0; i < count; i++) {
+        targets[i] = ids[i];
+    }
+
+    esp_err_t err = count > 0 ? comm_fw_dist_start(targets, count,
+                                                   count > 1 ? COMM_FW_DIST_MULTICAST : COMM_FW_DIST_UNICAST)
+                              : ESP_ERR_NOT_FOUND;
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "No se pudo iniciar la distribución de firmware: %s", esp_err_to_name(err));
+        report_result(command_id, command_str, "failed",
+                      count == 0 ? "Sin sensores registrados" : esp_err_to_name(err),
+                      created_ms, submitted_us);
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Distribución de firmware iniciada a %u sensores", (unsigned)count);
+    report_result(command_id, command_str, "executed", "Distribución iniciada", created_ms, submitted_us);
+    return ESP_OK;
+}
+
+/**
+ * @brief Procesa un comando individual
+ */
+static esp_err_t process_command(const char *command_id, const char *command_str,
+                                 int64_t created_ms, int64_t submitted_us)
+{
+    ESP_LOGI(TAG, "Procesando comando: %s (%s)", command_str, command_id);
+
+    message_type_t type;
+    system_state_t target;
+    if (strcmp(command_str, "ARM") == 0) {
+        type = MSG_TYPE_ARM_COMMAND;
+        target = SYS_STATE_ARMED;
+    } else if (strcmp(command_str, "DISARM") == 0) {
+        type = MSG_TYPE_DISARM_COMMAND;
+        target = SYS_STATE_DISARMED;
     } else if (strcmp(command_str, "TEST") == 0) {
         // Comando de prueba - solo log
-        executed = true;
         ESP_LOGI(TAG, "Comando TEST recibido");
+        report_result(command_id, command_str, "executed", "OK", created_ms, submitted_us);
+        return ESP_OK;
+    } else if (strcmp(command_str, "FW_UPDATE") == 0) {
+        return start_fw_update(command_id, command_str, created_ms, submitted_us);
+    } else if (strcmp(command_str, "PAIR") == 0) {
+        comm_pairing_open(COMM_PAIRING_DEFAULT_S);
+        report_result(command_id, command_str, "executed", "Emparejamiento abierto", created_ms, submitted_us);
+        return ESP_OK;
     } else {
         ESP_LOGW(TAG, "Comando desconocido: %s", command_str);
-        ret = ESP_ERR_NOT_SUPPORTED;
+        report_result(command_id, command_str, "failed", "Comando desconocido", created_ms, submitted_us);
+        return ESP_ERR_NOT_SUPPORTED;
     }
 
-    // Actualizar estado del comando en Supabase
-    if (supabase_is_initialized()) {
-        // Crear JSON para actualizar el comando
-        cJSON *update_data = cJSON_CreateObject();
-        cJSON_AddStringToObject(update_data, "status", executed ? "executed" : "failed");
-        cJSON_AddStringToObject(update_data, "result", executed ? "OK" : "Timeout/Error");
+    // Ya en el estado pedido: el controller no cambiará nada
+    if (controller_get_state() == target) {
+        report_result(command_id, command_str, "executed", "Sin cambios", created_ms, submitted_us);
+        return ESP_OK;
+    }
 
-        char *json_str = cJSON_Print(update_data);
+    // Registrar antes de encolar: el listener puede llegar enseguida
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int slot = -1;
+    for (int i = 0; i < COMMAND_MAX_IN_FLIGHT; i++) {
+        if (!s_in_flight[i].used) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot >= 0) {
+        command_in_flight_t *entry = &s_in_flight[slot];
+        *entry = (command_in_flight_t) {
+            .used = true,
+            .target = target,
+            .created_ms = created_ms,
+            .submitted_us = submitted_us,
+            .deadline_us = esp_timer_get_time() + (int64_t)COMMAND_APPLY_TIMEOUT_MS * 1000,
+        };
+        strncpy(entry->id, command_id, COMMAND_ID_LEN - 1);
+        strncpy(entry->command, command_str, sizeof(entry->command) - 1);
+        schedule_apply_timer();
+    }
+    xSemaphoreGive(s_mutex);
 
-        // Llamar a una función de Supabase para actualizar el comando
-        // Por ahora solo logueamos
-        ESP_LOGD(TAG, "Actualizando comando %s: %s", command_id, json_str);
+    controller_message_t msg = {
+        .header = {
+            .version = 1,
+            .src_id = "CMD_PROC",
+            .src_type = DEV_TYPE_GATEWAY
+        },
+        .payload = {
+            .type = type
+        }
+    };
 
-        free(json_str);
-        cJSON_Delete(update_data);
+    if (xQueueSend(gSystemCtx.controller_queue, &msg, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Error enviando comando %s a la cola", command_str);
+        if (slot >= 0) {
+            xSemaphoreTake(s_mutex, portMAX_DELAY);
+            s_in_flight[slot].used = false;
+            schedule_apply_timer();
+            xSemaphoreGive(s_mutex);
+        }
+        report_result(command_id, command_str, "failed", "Timeout/Error", created_ms, submitted_us);
+        return ESP_ERR_TIMEOUT;
     }
 
-    return ret;
+    ESP_LOGI(TAG, "Comando %s enviado al controller", command_str);
+    if (slot < 0) {
+        // Sin lugar para seguirlo: se reporta como enviado, sin latencia de aplicación
+        report_result(command_id, command_str, "executed", "Enviado", created_ms, submitted_us);
+    }
+    return ESP_OK;
+}
+
+static uint32_t path_hash(const char *s)
+{
+    uint32_t hash = 2166136261u;
+    while (*s) {
+        hash = (hash ^ (uint8_t)*s++) * 16777619u;
+    }
+    return hash;
 }
 
 /**
  * @brief Consulta y procesa comandos pendientes
+ *
+ * GET de los comandos pendientes de este dispositivo creados después del
+ * cursor. Sin comandos nuevos la respuesta es "[]" (o 304 si el servidor
+ * entrega ETag), así que una consulta ociosa cuesta muy poco.
+ *
+ * @return Comandos recibidos, o -1 si la consulta falló
  */
-static void check_pending_commands(void)
+static int check_pending_commands(void)
 {
     if (!supabase_is_initialized()) {
         ESP_LOGD(TAG, "Supabase no inicializado, omitiendo consulta de comandos");
-        return;
+        return -1;
     }
 
+    // Sin hora no se puede descartar comandos viejos: no consultar
+    if (!sntp_sync_is_synced()) {
+        ESP_LOGD(TAG, "Hora no sincronizada, omitiendo consulta de comandos");
+        return -1;
+    }
+
+    char device_id[DEVICE_ID_LEN];
+    if (device_identity_get_id(device_id) != ESP_OK) {
+        return -1;
+    }
+
+    char cursor[sizeof(s_cursor)];
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_cursor[0] == '\0') {
+        // Primera consulta: lo que todavía no expiró
+        time_t since = time(NULL) - COMMAND_TIMEOUT_SEC;
+        struct tm tm_utc;
+        gmtime_r(&since, &tm_utc);
+        strftime(s_cursor, sizeof(s_cursor), "%Y-%m-%dT%H:%M:%S+00:00", &tm_utc);
+    }
+    strcpy(cursor, s_cursor);
+    xSemaphoreGive(s_mutex);
+
+    // '+' de la zona horaria debe ir codificado en la query
+    char cursor_enc[64];
+    size_t n = 0;
+    for (const char *p = cursor; *p && n < sizeof(cursor_enc) - 4; p++) {
+        if (*p == '+') {
+            memcpy(&cursor_enc[n], "%2B", 3);
+            n += 3;
+        } else {
+            cursor_enc[n++] = *p;
+        }
+    }
+    cursor_enc[n] = '\0';
+
+    char path[256];
+    snprintf(path, sizeof(path),
+             "/rest/v1/system_commands?select=id,command,created_at&device_id=eq.%s"
+             "&status=eq.pending&created_at=gt.%s&order=created_at.asc&limit=%d",
+             device_id, cursor_enc, COMMAND_FETCH_LIMIT);
+
+    uint32_t hash = path_hash(path);
+    const char *if_none_match = (hash == s_etag_path_hash && s_etag[0]) ? s_etag : NULL;
+
     ESP_LOGD(TAG, "Consultando comandos pendientes...");
 
-    // NOTA: Aquí se debería hacer un GET a system_commands?status=eq.pending&order=created_at.asc
-    // Por ahora, implementamos un placeholder
-    //
-    // En producción:
-    // 1. Hacer GET a /rest/v1/system_commands?status=eq.pending&order=created_at.asc
-    // 2. Para cada comando devuelto, llamar a process_command()
-    // 3. Actualizar el status a 'executed' o 'failed'
+    int http_status = 0;
+    char etag[sizeof(s_etag)];
+    char body[COMMAND_RESPONSE_SIZE];
+    esp_err_t err = supabase_rest_get(path, if_none_match, &http_status, etag, sizeof(etag),
+                                      body, sizeof(body));
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_stats.polls++;
+    if (err == ESP_OK && http_status == 304) {
+        s_stats.polls_not_modified++;
+    }
+    xSemaphoreGive(s_mutex);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error consultando comandos: %s", esp_err_to_name(err));
+        return -1;
+    }
+    if (http_status == 304) {
+        return 0;
+    }
+    if (http_status < 200 || http_status >= 300) {
+        ESP_LOGW(TAG, "Consulta de comandos: HTTP %d", http_status);
+        return -1;
+    }
+
+    if (etag[0]) {
+        strcpy(s_etag, etag);
+        s_etag_path_hash = hash;
+    }
+
+    cJSON *list = cJSON_Parse(body);
+    if (!cJSON_IsArray(list)) {
+        cJSON_Delete(list);
+        return -1;
+    }
+
+    int count = 0;
+    const cJSON *item;
+    cJSON_ArrayForEach(item, list) {
+        const cJSON *id = cJSON_GetObjectItem(item, "id");
+        const cJSON *command = cJSON_GetObjectItem(item, "command");
+        const cJSON *created_at = cJSON_GetObjectItem(item, "created_at");
+        if (!cJSON_IsString(command)) {
+            continue;
+        }
+
+        char id_str[COMMAND_ID_LEN];
+        if (cJSON_IsString(id)) {
+            snprintf(id_str, sizeof(id_str), "%s", id->valuestring);
+        } else if (cJSON_IsNumber(id)) {
+            snprintf(id_str, sizeof(id_str), "%.0f", id->valuedouble);
+        } else {
+            continue;
+        }
+
+        count++;
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        s_stats.rest_commands++;
+        xSemaphoreGive(s_mutex);
+        command_processor_submit(id_str, command->valuestring,
+                                 cJSON_IsString(created_at) ? created_at->valuestring : NULL,
+                                 COMMAND_SOURCE_REST);
+    }
+    cJSON_Delete(list);
+
+    if (count > 0) {
+        ESP_LOGI(TAG, "%d comando(s) recuperado(s) por REST", count);
+    }
+    return count;
 }
 
 /**
- * @brief Callback del timer para verificación periódica
+ * @brief Tarea de consulta: recuperación al reconectar y polling adaptativo
  */
-static void timer_callback(void* arg)
+static void poll_task(void *arg)
 {
-    check_pending_commands();
+    bool was_healthy = false;
+    uint32_t interval_ms = COMMAND_POLL_MIN_MS;
+
+    while (s_poll_run) {
+        bool healthy = s_health_fn && s_health_fn();
+        bool force = s_force_fetch;
+        s_force_fetch = false;
+        uint32_t wait_ms;
+
+        if (healthy) {
+            // Realtime recién (re)establecido: traer lo que llegó sin conexión
+            if (!was_healthy || force) {
+                xSemaphoreTake(s_mutex, portMAX_DELAY);
+                s_stats.catchups++;
+                xSemaphoreGive(s_mutex);
+                if (check_pending_commands() < 0) {
+                    healthy = false;    // Reintentar en el próximo chequeo
+                }
+            }
+            interval_ms = COMMAND_POLL_MIN_MS;
+            wait_ms = COMMAND_HEALTH_CHECK_MS;
+        } else {
+            int found = check_pending_commands();
+            if (found > 0) {
+                interval_ms = COMMAND_POLL_MIN_MS;
+            } else if (interval_ms < COMMAND_POLL_MAX_MS) {
+                interval_ms = (interval_ms * 2 > COMMAND_POLL_MAX_MS) ? COMMAND_POLL_MAX_MS : interval_ms * 2;
+            }
+            wait_ms = interval_ms;
+        }
+
+        was_healthy = healthy;
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        s_stats.poll_interval_ms = healthy ? 0 : interval_ms;
+        xSemaphoreGive(s_mutex);
+
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+    }
+
+    vTaskDelete(NULL);
 }
 
 // ============================================================================
@@ -141,48 +681,154 @@ static void timer_callback(void* arg)
 
 esp_err_t command_processor_init(void)
 {
+    if (s_poll_task) {
+        return ESP_OK;
+    }
+
     ESP_LOGI(TAG, "Inicializando procesador de comandos remotos");
 
-    // Crear timer periódico
-    const esp_timer_create_args_t timer_args = {
-        .callback = &timer_callback,
+    s_mutex = xSemaphoreCreateMutex();
+    if (!s_mutex) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t apply_args = {
+        .callback = &apply_timer_callback,
         .arg = NULL,
         .dispatch_method = ESP_TIMER_TASK,
-        .name = "cmd_timer"
+        .name = "cmd_apply"
     };
-
-    esp_err_t ret = esp_timer_create(&timer_args, &s_command_timer);
+    esp_err_t ret = esp_timer_create(&apply_args, &s_apply_timer);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Error creando timer: %s", esp_err_to_name(ret));
         return ret;
     }
 
-    // Iniciar timer: consulta cada 5 segundos
-    ret = esp_timer_start_periodic(s_command_timer, COMMAND_CHECK_INTERVAL_SEC * 1000000);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Error iniciando timer: %s", esp_err_to_name(ret));
-        esp_timer_delete(s_command_timer);
-        return ret;
+    // Saber cuándo el controller aplicó el estado pedido
+    controller_register_state_listener(on_state_applied);
+
+    // Tarea de consulta REST (recuperación y respaldo de Realtime)
+    s_poll_run = true;
+    if (xTaskCreate(poll_task, "cmd_poll", COMMAND_POLL_TASK_STACK, NULL,
+                    COMMAND_POLL_TASK_PRIORITY, &s_poll_task) != pdPASS) {
+        ESP_LOGE(TAG, "Error creando tarea de consulta");
+        s_poll_run = false;
+        s_poll_task = NULL;
+        return ESP_ERR_NO_MEM;
     }
 
-    ESP_LOGI(TAG, "Procesador de comandos iniciado (chequeo cada %d segundos)",
-             COMMAND_CHECK_INTERVAL_SEC);
+    ESP_LOGI(TAG, "Procesador de comandos iniciado (REST cada %d-%d s sin Realtime)",
+             COMMAND_POLL_MIN_MS / 1000, COMMAND_POLL_MAX_MS / 1000);
 
     return ESP_OK;
 }
 
 esp_err_t command_processor_stop(void)
 {
-    if (s_command_timer) {
-        esp_timer_stop(s_command_timer);
-        esp_timer_delete(s_command_timer);
-        s_command_timer = NULL;
+    if (s_poll_task) {
+        s_poll_run = false;
+        xTaskNotifyGive(s_poll_task);
+        s_poll_task = NULL;
     }
     return ESP_OK;
 }
 
 esp_err_t command_processor_check_now(void)
 {
-    check_pending_commands();
+    if (!s_poll_task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_force_fetch = true;
+    xTaskNotifyGive(s_poll_task);
+    return ESP_OK;
+}
+
+esp_err_t command_processor_set_health_check(command_health_fn_t health_fn)
+{
+    s_health_fn = health_fn;
+    if (s_poll_task) {
+        xTaskNotifyGive(s_poll_task);
+    }
+    return ESP_OK;
+}
+
+esp_err_t command_processor_submit(const char *command_id, const char *command,
+                                   const char *created_at, command_source_t source)
+{
+    if (!command_id || !command) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t submitted_us = esp_timer_get_time();
+
+    // El id se reserva antes de procesar para que otra fuente no lo ejecute
+    // en paralelo; si el comando no llega a entregarse se libera abajo
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_stats.received++;
+    bool fresh = remember_id(command_id);
+    if (!fresh) {
+        s_stats.duplicates++;
+    }
+    xSemaphoreGive(s_mutex);
+
+    if (!fresh) {
+        ESP_LOGI(TAG, "Comando %s repetido (%s), ignorando", command_id,
+                 source == COMMAND_SOURCE_REST ? "REST" : source == COMMAND_SOURCE_MQTT ? "MQTT" : "WebSocket");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Comandos viejos (ej: encolados mientras el gateway estaba apagado)
+    int64_t created_ms = parse_timestamp_ms(created_at);
+    int64_t now_ms = now_epoch_ms();
+    bool expired = created_ms >= 0 && now_ms >= 0 && now_ms - created_ms > (int64_t)COMMAND_TIMEOUT_SEC * 1000;
+    esp_err_t err;
+    if (expired) {
+        report_result(command_id, command, "expired", "Comando expirado", created_ms, submitted_us);
+        err = ESP_ERR_TIMEOUT;
+    } else {
+        err = process_command(command_id, command, created_ms, submitted_us);
+    }
+
+    // Expirado o desconocido es definitivo; cualquier otro error es que no
+    // se pudo entregar (cola del controller llena, distribución ocupada)
+    bool done = expired || err == ESP_OK || err == ESP_ERR_NOT_SUPPORTED;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (!done) {
+        forget_id(command_id);
+    } else if (created_at && strlen(created_at) < sizeof(s_cursor) && strcmp(created_at, s_cursor) > 0) {
+        // Mismo formato ISO 8601 de Postgres: el orden de strings es el temporal
+        strcpy(s_cursor, created_at);
+    }
+    xSemaphoreGive(s_mutex);
+    return err;
+}
+
+esp_err_t command_processor_set_result_reporter(command_result_reporter_t reporter)
+{
+    if (!s_mutex) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    s_reporter = reporter;
+    xSemaphoreGive(s_mutex);
+    return ESP_OK;
+}
+
+esp_err_t command_processor_get_stats(command_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_mutex) {
+        memset(stats, 0, sizeof(*stats));
+        return ESP_OK;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_mutex);
     return ESP_OK;
 }
@@ -5,6 +5,7 @@
 
 #include "controller.h"
 #include "ui.h"
+#include "comm_beacon.h"
 #include "supabase_client.h"
 #include "device_identity.h"
 #include <string.h>
@@ -74,12 +75,14 @@ static void send_state_change_event(system_state_t new_state, system_state_t old
         .energy_data = energy_data
     };
 
-    esp_err_t ret = supabase_send_event(&event);
+    // El insert queda como historial: se envía en background sin bloquear al
+    // controlador (la sincronización rápida va por broadcast, ver listeners)
+    esp_err_t ret = supabase_send_event_async(&event);
     if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "✅ Evento de estado enviado: %s -> %s",
+        ESP_LOGI(TAG, "✅ Evento de estado encolado: %s -> %s",
                  get_state_name(old_state), get_state_name(new_state));
     } else {
-        ESP_LOGW(TAG, "⚠️ Error enviando evento de estado: %s", esp_err_to_name(ret));
+        ESP_LOGW(TAG, "⚠️ Error encolando evento de estado: %s", esp_err_to_name(ret));
     }
 
     free(energy_data);
@@ -96,6 +99,12 @@ system_context_t gSystemCtx;
 /** @brief Handle de la tarea del controlador */
 static TaskHandle_t s_controller_task_handle = NULL;
 
+/** @brief Máximo de callbacks de cambio de estado */
+#define CONTROLLER_MAX_STATE_LISTENERS  4
+
+/** @brief Callbacks de cambio de estado */
+static controller_state_listener_t s_state_listeners[CONTROLLER_MAX_STATE_LISTENERS] = {0};
+
 // ==============================================================================
 // Funciones privadas
 // ==============================================================================
@@ -231,6 +240,10 @@ esp_err_t controller_init(void)
     
     // Determinar estado inicial
     determine_initial_state();
+
+    // Si arranca armado, la conexión precalentada se abre cuando haya red
+    system_state_t initial = gSystemCtx.current_state;
+    supabase_set_warm_connection(initial == SYS_STATE_ARMED || initial == SYS_STATE_ALARM);
     
     // Crear cola de mensajes y asignarla al contexto global
     // La cola almacena estructuras completas, no punteros
@@ -304,12 +317,43 @@ esp_err_t controller_set_state(system_state_t state)
     // Actualizar UI inmediatamente para feedback instantáneo al usuario
     ui_set_system_state(state);
 
+    // Difundir el nuevo estado a los sensores ESP-Now
+    comm_beacon_notify_state(state);
+
+    // Notificar a los interesados (ej: broadcast a otros gateways)
+    for (int i = 0; i < CONTROLLER_MAX_STATE_LISTENERS; i++) {
+        if (s_state_listeners[i]) {
+            s_state_listeners[i](state, old_state);
+        }
+    }
+
+    // Armado o en alarma, el próximo envío importante no debería esperar un
+    // handshake: mantener una conexión lista (y medir el primer evento)
+    supabase_set_warm_connection(state == SYS_STATE_ARMED || state == SYS_STATE_ALARM);
+
     // Enviar evento a Supabase (en background, no bloquea la UI)
     send_state_change_event(state, old_state);
 
     return ESP_OK;
 }
 
+esp_err_t controller_register_state_listener(controller_state_listener_t listener)
+{
+    if (!listener) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < CONTROLLER_MAX_STATE_LISTENERS; i++) {
+        if (s_state_listeners[i] == listener) {
+            return ESP_OK;
+        }
+        if (!s_state_listeners[i]) {
+            s_state_listeners[i] = listener;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
 esp_err_t controller_arm(void)
 {
     system_state_t current = controller_get_state();
@@ -80,6 +80,26 @@ esp_err_t controller_trigger_alarm(void);
  */
 esp_err_t controller_clear_alarm(void);
 
+/**
+ * @brief Callback de cambio de estado del sistema
+ * 
+ * @param new_state Estado nuevo
+ * @param old_state Estado anterior
+ */
+typedef void (*controller_state_listener_t)(system_state_t new_state, system_state_t old_state);
+
+/**
+ * @brief Registra un callback para los cambios de estado
+ * 
+ * Se llama desde controller_set_state() en el contexto de quien cambia el
+ * estado; no debe bloquear.
+ * 
+ * @param listener Callback a registrar
+ * @return ESP_OK si se registró
+ * @return ESP_ERR_NO_MEM si no hay lugar para más callbacks
+ */
+esp_err_t controller_register_state_listener(controller_state_listener_t listener);
+
 // ============================================================================
 // Gestión de sensores
 // ============================================================================
@@ -20,7 +20,15 @@
 #include "esp_timer.h"
 #include "esp_tls_crypto.h"
 #include "esp_system.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_heap_caps.h"
+#endif
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+#include "rom/miniz.h"
+#endif
 #include <errno.h>
+#include <limits.h>
+#include <sys/random.h>
 #include <arpa/inet.h>
 
 static const char *TAG = "websocket_client";
@@ -57,6 +65,17 @@ static const char *TAG = "websocket_client";
         action;                                                                                     \
         }
 
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+#define WS_DEFLATE_WINDOW_SIZE      (1 << CONFIG_ESP_WS_CLIENT_DEFLATE_WINDOW_BITS)
+#define WS_FRAME_FIN                0x80
+#define WS_FRAME_RSV1               0x40
+#define WS_FRAME_MASK               0x80
+#define WS_FRAME_OPCODE_MASK        0x0F
+#define WS_FRAME_CONTROL            0x08
+#define WS_HANDSHAKE_BUFFER_SIZE    1024
+#define WS_GUID                     "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#endif
+
 #define WS_OVER_TCP_SCHEME  "ws"
 #define WS_OVER_TLS_SCHEME  "wss"
 #define WS_HTTP_BASIC_AUTH  "Basic "
@@ -104,6 +123,27 @@ typedef struct {
     esp_transport_handle_t      ext_transport;
 } websocket_config_storage_t;
 
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+/**
+ * Receive side of permessage-deflate (RFC 7692). Messages are inflated into `out`, laid out as
+ * [history | current message]: with context takeover the last window of previous messages stays
+ * in front as the LZ77 dictionary, so no separate wrapping dictionary is needed.
+ */
+typedef struct {
+    tinfl_decompressor  decomp;
+    char                *out;
+    size_t              out_cap;
+    size_t              hist_len;       /*!< Bytes of previous messages kept as dictionary */
+    size_t              msg_len;        /*!< Inflated bytes of the current message */
+    bool                in_message;     /*!< A compressed fragmented message is in progress */
+    bool                stream_done;    /*!< Server closed the deflate stream (BFINAL), restart it */
+    uint8_t             msg_opcode;
+    char                *pending;       /*!< Upgrade response buffer holding bytes received behind it */
+    int                 pending_off;    /*!< Next unread byte in `pending` */
+    int                 pending_len;    /*!< End of the received bytes in `pending` */
+} ws_inflate_t;
+#endif
+
 typedef enum {
     WEBSOCKET_STATE_ERROR = -1,
     WEBSOCKET_STATE_UNKNOW = 0,
@@ -142,6 +182,14 @@ struct esp_websocket_client {
     int                         payload_offset;
     esp_transport_keep_alive_t  keep_alive_cfg;
     struct ifreq                *if_name;
+    esp_transport_handle_t      ws_parent;      /*!< tcp/ssl transport below the ws layer (NULL with ext_transport) */
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+    bool                        deflate_offered;
+    bool                        deflate_negotiated;     /*!< The server accepted the offer in the 101 response */
+    int                         handshake_status;       /*!< HTTP status of the upgrade done by the client */
+    ws_inflate_t                *inflate;
+    esp_websocket_deflate_stats_t deflate_stats;
+#endif
 };
 
 static uint64_t _tick_get_ms(void)
@@ -149,42 +197,165 @@ static uint64_t _tick_get_ms(void)
     return esp_timer_get_time() / 1000;
 }
 
-static esp_err_t esp_websocket_new_buf(esp_websocket_client_handle_t client, bool is_tx)
+#if CONFIG_IDF_TARGET_LINUX
+#define WS_BUF_LOCK()
+#define WS_BUF_UNLOCK()
+#else
+static portMUX_TYPE s_buf_mux = portMUX_INITIALIZER_UNLOCKED;
+#define WS_BUF_LOCK()   taskENTER_CRITICAL(&s_buf_mux)
+#define WS_BUF_UNLOCK() taskEXIT_CRITICAL(&s_buf_mux)
+#endif
+
+static esp_websocket_buffer_stats_t s_buf_stats;
+
+#ifdef CONFIG_ESP_WS_CLIENT_BUFFER_POOL
+typedef struct {
+    char    *ptr;
+    int     size;
+    bool    in_use;
+} ws_pool_slot_t;
+
+static ws_pool_slot_t s_buf_pool[CONFIG_ESP_WS_CLIENT_BUFFER_POOL_SLOTS];
+#endif
+
+static char *ws_buf_alloc(int size)
 {
-#ifdef CONFIG_ESP_WS_CLIENT_ENABLE_DYNAMIC_BUFFER
-    if (is_tx) {
-        if (client->tx_buffer) {
-            free(client->tx_buffer);
+    char *buf = NULL;
+#ifdef CONFIG_ESP_WS_CLIENT_BUFFER_PSRAM
+    buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+    if (buf == NULL) {
+        buf = malloc(size);
+    }
+    if (buf) {
+        WS_BUF_LOCK();
+        s_buf_stats.allocs++;
+        s_buf_stats.bytes_allocated += size;
+        if (s_buf_stats.bytes_allocated > s_buf_stats.bytes_peak) {
+            s_buf_stats.bytes_peak = s_buf_stats.bytes_allocated;
         }
+        WS_BUF_UNLOCK();
+    }
+    return buf;
+}
 
-        client->tx_buffer = calloc(1, client->buffer_size);
-        ESP_WS_CLIENT_MEM_CHECK(TAG, client->tx_buffer, return ESP_ERR_NO_MEM);
+static void ws_buf_release(char *buf, int size)
+{
+    if (buf == NULL) {
+        return;
+    }
+    free(buf);
+    WS_BUF_LOCK();
+    s_buf_stats.frees++;
+    s_buf_stats.bytes_allocated -= size;
+    WS_BUF_UNLOCK();
+}
+
+#ifdef CONFIG_ESP_WS_CLIENT_BUFFER_POOL
+/**
+ * Take a block of at least `size` bytes from the shared pool. Prefers a free block that already
+ * fits, then an empty slot, then regrows a free block that is too small. Heap work is done outside
+ * the critical section with the slot already reserved.
+ */
+static char *ws_pool_take(int size)
+{
+    int fit = -1, empty = -1, small = -1;
+
+    WS_BUF_LOCK();
+    for (int i = 0; i < CONFIG_ESP_WS_CLIENT_BUFFER_POOL_SLOTS; i++) {
+        ws_pool_slot_t *slot = &s_buf_pool[i];
+        if (slot->in_use) {
+            continue;
+        }
+        if (slot->ptr == NULL) {
+            empty = (empty < 0) ? i : empty;
+        } else if (slot->size >= size) {
+            fit = i;
+            break;
+        } else {
+            small = (small < 0) ? i : small;
+        }
+    }
+    int idx = (fit >= 0) ? fit : (empty >= 0) ? empty : small;
+    if (idx >= 0) {
+        s_buf_pool[idx].in_use = true;
+        if (fit >= 0) {
+            s_buf_stats.pool_hits++;
+        }
     } else {
-        if (client->rx_buffer) {
-            free(client->rx_buffer);
+        s_buf_stats.pool_misses++;
+    }
+    WS_BUF_UNLOCK();
+
+    if (idx < 0) {
+        return ws_buf_alloc(size);
+    }
+    ws_pool_slot_t *slot = &s_buf_pool[idx];
+    if (fit < 0) {
+        ws_buf_release(slot->ptr, slot->size);
+        slot->ptr = ws_buf_alloc(size);
+        slot->size = slot->ptr ? size : 0;
+        if (slot->ptr == NULL) {
+            WS_BUF_LOCK();
+            slot->in_use = false;
+            WS_BUF_UNLOCK();
+            return NULL;
         }
+    }
+    return slot->ptr;
+}
 
-        client->rx_buffer = calloc(1, client->buffer_size);
+static void ws_pool_give(char *buf, int size)
+{
+    WS_BUF_LOCK();
+    for (int i = 0; i < CONFIG_ESP_WS_CLIENT_BUFFER_POOL_SLOTS; i++) {
+        if (s_buf_pool[i].ptr == buf && s_buf_pool[i].in_use) {
+            s_buf_pool[i].in_use = false;
+            WS_BUF_UNLOCK();
+            return;
+        }
+    }
+    WS_BUF_UNLOCK();
+    // Not a pool block: overflow allocation made while the pool was exhausted
+    ws_buf_release(buf, size);
+}
+#endif
+
+static esp_err_t esp_websocket_new_buf(esp_websocket_client_handle_t client, bool is_tx)
+{
+#ifdef CONFIG_ESP_WS_CLIENT_ENABLE_DYNAMIC_BUFFER
+    if (is_tx) {
+        ws_buf_release(client->tx_buffer, client->buffer_size);
+        client->tx_buffer = ws_buf_alloc(client->buffer_size);
+        ESP_WS_CLIENT_MEM_CHECK(TAG, client->tx_buffer, return ESP_ERR_NO_MEM);
+    } else {
+        ws_buf_release(client->rx_buffer, client->buffer_size);
+        client->rx_buffer = ws_buf_alloc(client->buffer_size);
         ESP_WS_CLIENT_MEM_CHECK(TAG, client->rx_buffer, return ESP_ERR_NO_MEM);
     }
+#elif defined(CONFIG_ESP_WS_CLIENT_BUFFER_POOL)
+    char **buf = is_tx ? &client->tx_buffer : &client->rx_buffer;
+    if (*buf == NULL) {
+        *buf = ws_pool_take(client->buffer_size);
+        ESP_WS_CLIENT_MEM_CHECK(TAG, *buf, return ESP_ERR_NO_MEM);
+    }
 #endif
     return ESP_OK;
 }
 
 static void esp_websocket_free_buf(esp_websocket_client_handle_t client, bool is_tx)
 {
-#ifdef CONFIG_ESP_WS_CLIENT_ENABLE_DYNAMIC_BUFFER
-    if (is_tx) {
-        if (client->tx_buffer) {
-            free(client->tx_buffer);
-            client->tx_buffer = NULL;
-        }
-    } else {
-        if (client->rx_buffer) {
-            free(client->rx_buffer);
-            client->rx_buffer = NULL;
-        }
+#if defined(CONFIG_ESP_WS_CLIENT_ENABLE_DYNAMIC_BUFFER) || defined(CONFIG_ESP_WS_CLIENT_BUFFER_POOL)
+    char **buf = is_tx ? &client->tx_buffer : &client->rx_buffer;
+    if (*buf == NULL) {
+        return;
     }
+#ifdef CONFIG_ESP_WS_CLIENT_BUFFER_POOL
+    ws_pool_give(*buf, client->buffer_size);
+#else
+    ws_buf_release(*buf, client->buffer_size);
+#endif
+    *buf = NULL;
 #endif
 }
 
@@ -437,12 +608,24 @@ static void destroy_and_free_resources(esp_websocket_client_handle_t client)
         free(client->if_name);
     }
     esp_websocket_client_destroy_config(client);
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+    if (client->inflate) {
+        free(client->inflate->out);
+        free(client->inflate->pending);
+        free(client->inflate);
+    }
+#endif
     if (client->transport_list) {
         esp_transport_list_destroy(client->transport_list);
     }
     vSemaphoreDelete(client->lock);
-    free(client->tx_buffer);
-    free(client->rx_buffer);
+#if !defined(CONFIG_ESP_WS_CLIENT_ENABLE_DYNAMIC_BUFFER) && !defined(CONFIG_ESP_WS_CLIENT_BUFFER_POOL)
+    ws_buf_release(client->tx_buffer, client->buffer_size);
+    ws_buf_release(client->rx_buffer, client->buffer_size);
+#else
+    esp_websocket_free_buf(client, true);
+    esp_websocket_free_buf(client, false);
+#endif
     free(client->errormsg_buffer);
     if (client->status_bits) {
         vEventGroupDelete(client->status_bits);
@@ -512,6 +695,7 @@ static esp_err_t esp_websocket_client_create_transport(esp_websocket_client_hand
 
         esp_transport_handle_t ws = esp_transport_ws_init(tcp);
         ESP_WS_CLIENT_MEM_CHECK(TAG, ws, return ESP_ERR_NO_MEM);
+        client->ws_parent = tcp;
 
         esp_transport_set_default_port(ws, WEBSOCKET_TCP_DEFAULT_PORT);
         esp_transport_list_add(client->transport_list, ws, WS_OVER_TCP_SCHEME);
@@ -576,6 +760,7 @@ static esp_err_t esp_websocket_client_create_transport(esp_websocket_client_hand
 
         esp_transport_handle_t wss = esp_transport_ws_init(ssl);
         ESP_WS_CLIENT_MEM_CHECK(TAG, wss, return ESP_ERR_NO_MEM);
+        client->ws_parent = ssl;
 
         esp_transport_set_default_port(wss, WEBSOCKET_SSL_DEFAULT_PORT);
 
@@ -588,17 +773,79 @@ static esp_err_t esp_websocket_client_create_transport(esp_websocket_client_hand
     return ESP_OK;
 }
 
-static int esp_websocket_client_send_with_exact_opcode(esp_websocket_client_handle_t client, ws_transport_opcodes_t opcode, const uint8_t *data, int len, TickType_t timeout)
+/**
+ * Copy the next `len` bytes of the iovec into `dst`, advancing the cursor (*idx, *off).
+ * This is the only copy on the send path; it is needed anyway because the transport
+ * masks the payload in place.
+ */
+static void esp_websocket_iov_gather(char *dst, int len, const esp_websocket_iov_t *iov, int *idx, size_t *off)
+{
+    while (len > 0) {
+        size_t chunk = iov[*idx].len - *off;
+        if (chunk > (size_t)len) {
+            chunk = len;
+        }
+        if (chunk) {
+            memcpy(dst, (const char *)iov[*idx].base + *off, chunk);
+        }
+        dst += chunk;
+        len -= chunk;
+        *off += chunk;
+        if (*off == iov[*idx].len) {
+            (*idx)++;
+            *off = 0;
+        }
+    }
+}
+
+/**
+ * Move the iovec cursor to byte `pos` of the message.
+ */
+static void esp_websocket_iov_seek(const esp_websocket_iov_t *iov, int iovcnt, int pos, int *idx, size_t *off)
+{
+    *idx = 0;
+    while (*idx < iovcnt && (size_t)pos >= iov[*idx].len) {
+        pos -= iov[*idx].len;
+        (*idx)++;
+    }
+    *off = pos;
+}
+
+static void esp_websocket_client_write_failed(esp_websocket_client_handle_t client, int ret)
+{
+    esp_tls_error_handle_t error_handle = esp_transport_get_error_handle(client->transport);
+    if (error_handle) {
+        esp_websocket_client_error(client, "esp_transport_write() returned %d, transport_error=%s, tls_error_code=%i, tls_flags=%i, errno=%d",
+                                   ret, esp_err_to_name(error_handle->last_error), error_handle->esp_tls_error_code,
+                                   error_handle->esp_tls_flags, errno);
+    } else {
+        esp_websocket_client_error(client, "esp_transport_write() returned %d, errno=%d", ret, errno);
+    }
+    esp_websocket_client_abort_connection(client, WEBSOCKET_ERROR_TYPE_TCP_TRANSPORT);
+}
+
+static int esp_websocket_client_send_iov_with_exact_opcode(esp_websocket_client_handle_t client, ws_transport_opcodes_t opcode,
+                                                           const esp_websocket_iov_t *iov, int iovcnt, TickType_t timeout)
 {
     int ret = -1;
-    int need_write = len;
+    int len = 0;
     int wlen = 0, widx = 0;
+    int iov_idx = 0;
+    size_t iov_off = 0;
     bool contained_fin = opcode & WS_TRANSPORT_OPCODES_FIN;
 
-    if (client == NULL || len < 0 || (data == NULL && len > 0)) {
+    if (client == NULL || iovcnt < 0 || (iov == NULL && iovcnt > 0)) {
         ESP_LOGE(TAG, "Invalid arguments");
         return -1;
     }
+    for (int i = 0; i < iovcnt; i++) {
+        if ((iov[i].base == NULL && iov[i].len > 0) || iov[i].len > (size_t)(INT_MAX - len)) {
+            ESP_LOGE(TAG, "Invalid arguments");
+            return -1;
+        }
+        len += iov[i].len;
+    }
+    int need_write = len;
 
     if (!esp_websocket_client_is_connected(client)) {
         ESP_LOGE(TAG, "Websocket client is not connected");
@@ -627,24 +874,20 @@ static int esp_websocket_client_send_with_exact_opcode(esp_websocket_client_hand
         } else if (contained_fin) {
             opcode = opcode | WS_TRANSPORT_OPCODES_FIN;
         }
-        memcpy(client->tx_buffer, data + widx, need_write);
+        esp_websocket_iov_gather(client->tx_buffer, need_write, iov, &iov_idx, &iov_off);
         // send with ws specific way and specific opcode
         wlen = esp_transport_ws_send_raw(client->transport, opcode, (char *)client->tx_buffer, need_write,
                                          (timeout == portMAX_DELAY) ? -1 : timeout * portTICK_PERIOD_MS);
         if (wlen < 0 || (wlen == 0 && need_write != 0)) {
             ret = wlen;
             esp_websocket_free_buf(client, true);
-            esp_tls_error_handle_t error_handle = esp_transport_get_error_handle(client->transport);
-            if (error_handle) {
-                esp_websocket_client_error(client, "esp_transport_write() returned %d, transport_error=%s, tls_error_code=%i, tls_flags=%i, errno=%d",
-                                           ret, esp_err_to_name(error_handle->last_error), error_handle->esp_tls_error_code,
-                                           error_handle->esp_tls_flags, errno);
-            } else {
-                esp_websocket_client_error(client, "esp_transport_write() returned %d, errno=%d", ret, errno);
-            }
-            esp_websocket_client_abort_connection(client, WEBSOCKET_ERROR_TYPE_TCP_TRANSPORT);
+            esp_websocket_client_write_failed(client, ret);
             goto unlock_and_return;
         }
+        if (wlen < need_write) {
+            // Short write: the gather has already gone past it, resume at the first unwritten byte
+            esp_websocket_iov_seek(iov, iovcnt, widx + wlen, &iov_idx, &iov_off);
+        }
         opcode = 0;
         widx += wlen;
         need_write = len - widx;
@@ -657,6 +900,76 @@ unlock_and_return:
     return ret;
 }
 
+/**
+ * Size of the client frame (header, masking key and payload) carrying a `len` bytes message.
+ */
+static int esp_websocket_frame_size(int len)
+{
+    int header = (len <= 125) ? 2 : (len <= 0xFFFF) ? 4 : 10;
+    return header + 4 + len;
+}
+
+/**
+ * Build a complete masked frame (FIN set) with the message in `iov` at `dst`, which must hold
+ * esp_websocket_frame_size(len) bytes. Returns the frame size.
+ */
+static int esp_websocket_put_frame(char *dst, ws_transport_opcodes_t opcode, const esp_websocket_iov_t *iov, int len)
+{
+    int pos = 0;
+    dst[pos++] = (char)(opcode | WS_TRANSPORT_OPCODES_FIN);
+    if (len <= 125) {
+        dst[pos++] = (char)(0x80 | len);
+    } else if (len <= 0xFFFF) {
+        dst[pos++] = (char)(0x80 | 126);
+        dst[pos++] = (char)(len >> 8);
+        dst[pos++] = (char)len;
+    } else {
+        dst[pos++] = (char)(0x80 | 127);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            dst[pos++] = (char)((uint64_t)len >> shift);
+        }
+    }
+    uint8_t mask[4];
+    getrandom(mask, sizeof(mask), 0);
+    memcpy(dst + pos, mask, sizeof(mask));
+    pos += sizeof(mask);
+
+    int iov_idx = 0;
+    size_t iov_off = 0;
+    esp_websocket_iov_gather(dst + pos, len, iov, &iov_idx, &iov_off);
+    for (int i = 0; i < len; i++) {
+        dst[pos + i] ^= mask[i & 3];
+    }
+    return pos + len;
+}
+
+/**
+ * Write `len` bytes to the transport below the ws layer.
+ */
+static int esp_websocket_write_exact(esp_websocket_client_handle_t client, const char *buf, int len, TickType_t timeout)
+{
+    int timeout_ms = (timeout == portMAX_DELAY) ? -1 : timeout * portTICK_PERIOD_MS;
+    int done = 0;
+    while (done < len) {
+        int wlen = esp_transport_write(client->ws_parent, buf + done, len - done, timeout_ms);
+        if (wlen <= 0) {
+            return wlen < 0 ? wlen : -1;
+        }
+        done += wlen;
+    }
+    return done;
+}
+
+static int esp_websocket_client_send_with_exact_opcode(esp_websocket_client_handle_t client, ws_transport_opcodes_t opcode, const uint8_t *data, int len, TickType_t timeout)
+{
+    if (len < 0 || (data == NULL && len > 0)) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return -1;
+    }
+    esp_websocket_iov_t iov = { .base = data, .len = len };
+    return esp_websocket_client_send_iov_with_exact_opcode(client, opcode, &iov, 1, timeout);
+}
+
 esp_websocket_client_handle_t esp_websocket_client_init(const esp_websocket_client_config_t *config)
 {
     esp_websocket_client_handle_t client = calloc(1, sizeof(struct esp_websocket_client));
@@ -745,6 +1058,31 @@ esp_websocket_client_handle_t esp_websocket_client_init(const esp_websocket_clie
         ESP_WS_CLIENT_MEM_CHECK(TAG, client->config->scheme, goto _websocket_init_fail);
     }
 
+    if (config->permessage_deflate) {
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+        if (config->ext_transport) {
+            ESP_LOGW(TAG, "permessage-deflate is not supported with an external transport");
+        } else {
+            // Only the server compresses: client parameters are not offered
+            char offer[96];
+            snprintf(offer, sizeof(offer), "permessage-deflate; server_max_window_bits=%d%s",
+                     CONFIG_ESP_WS_CLIENT_DEFLATE_WINDOW_BITS,
+#ifdef CONFIG_ESP_WS_CLIENT_DEFLATE_NO_CONTEXT_TAKEOVER
+                     "; server_no_context_takeover"
+#else
+                     ""
+#endif
+                    );
+            if (esp_websocket_client_append_header(client, "Sec-WebSocket-Extensions", offer) != ESP_OK) {
+                goto _websocket_init_fail;
+            }
+            client->deflate_offered = true;
+        }
+#else
+        ESP_LOGW(TAG, "permessage-deflate requested but CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE is disabled");
+#endif
+    }
+
     client->keepalive_tick_ms = _tick_get_ms();
     client->reconnect_tick_ms = _tick_get_ms();
     client->ping_tick_ms = _tick_get_ms();
@@ -757,12 +1095,13 @@ esp_websocket_client_handle_t esp_websocket_client_init(const esp_websocket_clie
     }
     client->errormsg_buffer = NULL;
     client->errormsg_size = 0;
-#ifndef CONFIG_ESP_WS_CLIENT_ENABLE_DYNAMIC_BUFFER
-    client->rx_buffer = malloc(buffer_size);
+    client->buffer_size = buffer_size;
+#if !defined(CONFIG_ESP_WS_CLIENT_ENABLE_DYNAMIC_BUFFER) && !defined(CONFIG_ESP_WS_CLIENT_BUFFER_POOL)
+    client->rx_buffer = ws_buf_alloc(buffer_size);
     ESP_WS_CLIENT_MEM_CHECK(TAG, client->rx_buffer, {
         goto _websocket_init_fail;
     });
-    client->tx_buffer = malloc(buffer_size);
+    client->tx_buffer = ws_buf_alloc(buffer_size);
     ESP_WS_CLIENT_MEM_CHECK(TAG, client->tx_buffer, {
         goto _websocket_init_fail;
     });
@@ -773,7 +1112,6 @@ esp_websocket_client_handle_t esp_websocket_client_init(const esp_websocket_clie
     });
     xEventGroupSetBits(client->status_bits, STOPPED_BIT);
 
-    client->buffer_size = buffer_size;
     return client;
 
 _websocket_init_fail:
@@ -926,9 +1264,543 @@ esp_err_t esp_websocket_client_append_header(esp_websocket_client_handle_t clien
     return ESP_OK;
 }
 
+static void esp_websocket_client_handle_control(esp_websocket_client_handle_t client);
+
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+static esp_err_t esp_websocket_inflate_reset(esp_websocket_client_handle_t client)
+{
+    ws_inflate_t *inf = client->inflate;
+    if (inf == NULL) {
+        inf = calloc(1, sizeof(ws_inflate_t));
+        ESP_WS_CLIENT_MEM_CHECK(TAG, inf, return ESP_ERR_NO_MEM);
+        inf->out_cap = client->buffer_size;
+#ifndef CONFIG_ESP_WS_CLIENT_DEFLATE_NO_CONTEXT_TAKEOVER
+        inf->out_cap += WS_DEFLATE_WINDOW_SIZE;
+#endif
+        inf->out = malloc(inf->out_cap);
+        if (inf->out == NULL) {
+            free(inf);
+            ESP_LOGE(TAG, "%s(%d): %s", __FUNCTION__, __LINE__, "Memory exhausted");
+            return ESP_ERR_NO_MEM;
+        }
+        client->inflate = inf;
+    }
+    tinfl_init(&inf->decomp);
+    inf->hist_len = 0;
+    inf->msg_len = 0;
+    inf->in_message = false;
+    inf->stream_done = false;
+    free(inf->pending);
+    inf->pending = NULL;
+    client->deflate_stats.active = false;
+    client->deflate_stats.negotiated = false;
+    client->deflate_stats.memory_bytes = sizeof(ws_inflate_t) + inf->out_cap;
+    return ESP_OK;
+}
+
+/**
+ * Inflate `len` bytes of the current compressed message, growing the output up to the
+ * configured cap (ESP_WS_CLIENT_DEFLATE_MAX_MESSAGE plus the history window).
+ */
+static esp_err_t esp_websocket_inflate_feed(esp_websocket_client_handle_t client, const uint8_t *in, size_t len)
+{
+    ws_inflate_t *inf = client->inflate;
+    size_t max_cap = CONFIG_ESP_WS_CLIENT_DEFLATE_MAX_MESSAGE;
+#ifndef CONFIG_ESP_WS_CLIENT_DEFLATE_NO_CONTEXT_TAKEOVER
+    max_cap += WS_DEFLATE_WINDOW_SIZE;
+#endif
+
+    tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
+    // Keep going while there is input or pending output (the sync tail can end with a full buffer)
+    while ((len > 0 || status == TINFL_STATUS_HAS_MORE_OUTPUT) && !inf->stream_done) {
+        size_t in_bytes = len;
+        size_t out_pos = inf->hist_len + inf->msg_len;
+        size_t out_bytes = inf->out_cap - out_pos;
+        status = tinfl_decompress(&inf->decomp, in, &in_bytes, (mz_uint8 *)inf->out,
+                                               (mz_uint8 *)inf->out + out_pos, &out_bytes,
+                                               TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+        in += in_bytes;
+        len -= in_bytes;
+        inf->msg_len += out_bytes;
+
+        if (status < TINFL_STATUS_DONE) {
+            client->deflate_stats.errors++;
+            esp_websocket_client_error(client, "permessage-deflate: invalid compressed data (%d)", status);
+            return ESP_FAIL;
+        }
+        if (status == TINFL_STATUS_DONE) {
+            // Final block: the rest of this message is the empty sync tail, next message starts a new stream
+            inf->stream_done = true;
+        } else if (status == TINFL_STATUS_HAS_MORE_OUTPUT) {
+            if (inf->out_cap >= max_cap) {
+                client->deflate_stats.oversize++;
+                esp_websocket_client_error(client, "permessage-deflate: message larger than %d bytes", CONFIG_ESP_WS_CLIENT_DEFLATE_MAX_MESSAGE);
+                return ESP_FAIL;
+            }
+            size_t new_cap = inf->out_cap * 2 < max_cap ? inf->out_cap * 2 : max_cap;
+            char *out = realloc(inf->out, new_cap);
+            ESP_WS_CLIENT_MEM_CHECK(TAG, out, return ESP_ERR_NO_MEM);
+            inf->out = out;
+            inf->out_cap = new_cap;
+            client->deflate_stats.memory_bytes = sizeof(ws_inflate_t) + new_cap;
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * Dispatch a fully inflated message and keep its tail as dictionary for the next one.
+ */
+static void esp_websocket_inflate_finish(esp_websocket_client_handle_t client)
+{
+    ws_inflate_t *inf = client->inflate;
+
+    client->last_opcode = inf->msg_opcode;
+    client->last_fin = true;
+    client->payload_len = inf->msg_len;
+    client->payload_offset = 0;
+
+    client->deflate_stats.messages++;
+    client->deflate_stats.inflated_bytes += inf->msg_len;
+    esp_websocket_client_dispatch_event(client, WEBSOCKET_EVENT_DATA, inf->out + inf->hist_len, inf->msg_len);
+
+#ifndef CONFIG_ESP_WS_CLIENT_DEFLATE_NO_CONTEXT_TAKEOVER
+    if (!inf->stream_done) {
+        size_t total = inf->hist_len + inf->msg_len;
+        size_t keep = total < WS_DEFLATE_WINDOW_SIZE ? total : WS_DEFLATE_WINDOW_SIZE;
+        memmove(inf->out, inf->out + total - keep, keep);
+        inf->hist_len = keep;
+    }
+#endif
+    inf->msg_len = 0;
+    inf->in_message = false;
+}
+
+/**
+ * Read exactly `len` bytes from the transport below the ws layer, starting with the bytes that
+ * arrived together with the upgrade response. Returns 0 only if nothing arrived within the
+ * timeout and `allow_timeout` is set (no frame in progress).
+ */
+static int esp_websocket_read_exact(esp_websocket_client_handle_t client, char *buf, int len, bool allow_timeout)
+{
+    ws_inflate_t *inf = client->inflate;
+    int done = 0;
+    if (inf->pending) {
+        done = inf->pending_len - inf->pending_off;
+        if (done > len) {
+            done = len;
+        }
+        memcpy(buf, inf->pending + inf->pending_off, done);
+        inf->pending_off += done;
+        if (inf->pending_off == inf->pending_len) {
+            free(inf->pending);
+            inf->pending = NULL;
+        }
+    }
+    while (done < len) {
+        int rlen = esp_transport_read(client->ws_parent, buf + done, len - done, client->config->network_timeout_ms);
+        if (rlen < 0) {
+            return rlen;
+        }
+        if (rlen == 0) {
+            return (done == 0 && allow_timeout) ? 0 : -1;
+        }
+        done += rlen;
+    }
+    return done;
+}
+
+/**
+ * Value of header `name` in a NUL-terminated upgrade response, without surrounding blanks.
+ * Returns NULL if the header is absent.
+ */
+static const char *esp_websocket_response_header(const char *resp, const char *name, int *len)
+{
+    size_t name_len = strlen(name);
+    const char *line = strstr(resp, "\r\n");
+    while (line) {
+        line += 2;
+        const char *end = strstr(line, "\r\n");
+        if (end == NULL) {
+            break;
+        }
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char *value = line + name_len + 1;
+            while (value < end && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            while (end > value && (end[-1] == ' ' || end[-1] == '\t')) {
+                end--;
+            }
+            *len = end - value;
+            return value;
+        }
+        line = end;
+    }
+    return NULL;
+}
+
+/**
+ * Check the Sec-WebSocket-Extensions reply against the offer: permessage-deflate alone, a server
+ * window no larger than the one offered and, when it was requested, server_no_context_takeover.
+ * client_* parameters are accepted because the client never compresses.
+ */
+static bool esp_websocket_deflate_reply_valid(const char *value, int len)
+{
+    char ext[128];
+    if (len <= 0 || len >= (int)sizeof(ext)) {
+        return false;
+    }
+    memcpy(ext, value, len);
+    ext[len] = '\0';
+
+    int window_bits = 15;   // Default when the server does not announce its window
+    bool no_takeover = false;
+    char *save = NULL;
+    int index = 0;
+    for (char *param = strtok_r(ext, ";", &save); param; param = strtok_r(NULL, ";", &save), index++) {
+        while (*param == ' ' || *param == '\t') {
+            param++;
+        }
+        char *end = param + strlen(param);
+        while (end > param && (end[-1] == ' ' || end[-1] == '\t')) {
+            *--end = '\0';
+        }
+        char *arg = strchr(param, '=');
+        if (arg) {
+            *arg++ = '\0';
+            if (*arg == '"') {
+                arg++;
+            }
+        }
+
+        if (index == 0) {
+            if (strcmp(param, "permessage-deflate") != 0 || arg) {
+                return false;
+            }
+        } else if (strcmp(param, "server_no_context_takeover") == 0 && !arg) {
+            no_takeover = true;
+        } else if (strcmp(param, "server_max_window_bits") == 0 && arg) {
+            window_bits = atoi(arg);
+            if (window_bits < 8 || window_bits > 15) {
+                return false;
+            }
+        } else if (strcmp(param, "client_no_context_takeover") != 0 &&
+                   strcmp(param, "client_max_window_bits") != 0) {
+            return false;
+        }
+    }
+    if (index == 0 || window_bits > CONFIG_ESP_WS_CLIENT_DEFLATE_WINDOW_BITS) {
+        return false;
+    }
+#ifdef CONFIG_ESP_WS_CLIENT_DEFLATE_NO_CONTEXT_TAKEOVER
+    if (!no_takeover) {
+        return false;
+    }
+#else
+    (void)no_takeover;
+#endif
+    return true;
+}
+
+/**
+ * Connect and run the HTTP upgrade on the tcp/ssl transport instead of the ws transport. The ws
+ * transport keeps whatever it reads past the 101 response in its own buffer, where
+ * esp_websocket_client_recv_deflate() cannot see it, and does not expose the extension reply.
+ * Bytes received behind the response stay in inf->pending and are read before the socket.
+ * The ws transport is only used afterwards to frame outgoing messages.
+ */
+static int esp_websocket_deflate_connect(esp_websocket_client_handle_t client)
+{
+    websocket_config_storage_t *cfg = client->config;
+    ws_inflate_t *inf = client->inflate;
+    int timeout_ms = cfg->network_timeout_ms;
+
+    client->deflate_negotiated = false;
+    client->handshake_status = -1;
+    if (esp_transport_connect(client->ws_parent, cfg->host, cfg->port, timeout_ms) < 0) {
+        return -1;
+    }
+
+    unsigned char nonce[16];
+    unsigned char digest[20];
+    char key[32];
+    char expected[32];
+    char concat[sizeof(key) + sizeof(WS_GUID)];
+    size_t key_len = 0;
+    size_t expected_len = 0;
+    getrandom(nonce, sizeof(nonce), 0);
+    esp_crypto_base64_encode((unsigned char *)key, sizeof(key) - 1, &key_len, nonce, sizeof(nonce));
+    key[key_len] = '\0';
+    int concat_len = snprintf(concat, sizeof(concat), "%s%s", key, WS_GUID);
+    esp_crypto_sha1((const unsigned char *)concat, concat_len, digest);
+    esp_crypto_base64_encode((unsigned char *)expected, sizeof(expected), &expected_len, digest, sizeof(digest));
+
+    char *request = NULL;
+    int len = asprintf(&request, "GET %s HTTP/1.1\r\n"
+                       "Connection: Upgrade\r\n"
+                       "Host: %s:%d\r\n"
+                       "User-Agent: %s\r\n"
+                       "Upgrade: websocket\r\n"
+                       "Sec-WebSocket-Version: 13\r\n"
+                       "Sec-WebSocket-Key: %s\r\n"
+                       "%s%s%s"
+                       "%s%s%s"
+                       "%s\r\n",
+                       cfg->path ? cfg->path : "/", cfg->host, cfg->port,
+                       cfg->user_agent ? cfg->user_agent : "ESP32 Websocket Client", key,
+                       cfg->subprotocol ? "Sec-WebSocket-Protocol: " : "",
+                       cfg->subprotocol ? cfg->subprotocol : "", cfg->subprotocol ? "\r\n" : "",
+                       cfg->auth ? "Authorization: " : "", cfg->auth ? cfg->auth : "", cfg->auth ? "\r\n" : "",
+                       cfg->headers ? cfg->headers : "");
+    if (len < 0) {
+        ESP_LOGE(TAG, "Failed to build the upgrade request");
+        return -1;
+    }
+    int done = 0;
+    while (done < len) {
+        int wlen = esp_transport_write(client->ws_parent, request + done, len - done, timeout_ms);
+        if (wlen <= 0) {
+            break;
+        }
+        done += wlen;
+    }
+    free(request);
+    if (done < len) {
+        ESP_LOGE(TAG, "Failed to send the upgrade request");
+        return -1;
+    }
+
+    char *buf = malloc(WS_HANDSHAKE_BUFFER_SIZE + 1);
+    ESP_WS_CLIENT_MEM_CHECK(TAG, buf, return -1);
+    int total = 0;
+    char *header_end = NULL;
+    while (header_end == NULL) {
+        if (total >= WS_HANDSHAKE_BUFFER_SIZE) {
+            ESP_LOGE(TAG, "Upgrade response larger than %d bytes", WS_HANDSHAKE_BUFFER_SIZE);
+            goto fail;
+        }
+        int rlen = esp_transport_read(client->ws_parent, buf + total, WS_HANDSHAKE_BUFFER_SIZE - total, timeout_ms);
+        if (rlen <= 0) {
+            ESP_LOGE(TAG, "Failed to read the upgrade response (%d)", rlen);
+            goto fail;
+        }
+        total += rlen;
+        buf[total] = '\0';
+        header_end = strstr(buf, "\r\n\r\n");
+    }
+    int body_off = header_end + 4 - buf;
+    header_end[2] = '\0';      // Every header line keeps its CRLF
+
+    int status = -1;
+    if (sscanf(buf, "HTTP/%*d.%*d %d", &status) != 1) {
+        status = -1;
+    }
+    client->handshake_status = status;
+    if (status != 101) {
+        ESP_LOGE(TAG, "Upgrade rejected with HTTP status %d", status);
+        goto fail;
+    }
+
+    int value_len = 0;
+    const char *accept = esp_websocket_response_header(buf, "Sec-WebSocket-Accept", &value_len);
+    if (accept == NULL || value_len != (int)expected_len || memcmp(accept, expected, expected_len) != 0) {
+        ESP_LOGE(TAG, "Invalid Sec-WebSocket-Accept in the upgrade response");
+        goto fail;
+    }
+
+    const char *ext = esp_websocket_response_header(buf, "Sec-WebSocket-Extensions", &value_len);
+    if (ext) {
+        if (!esp_websocket_deflate_reply_valid(ext, value_len)) {
+            ESP_LOGE(TAG, "Unexpected Sec-WebSocket-Extensions reply: %.*s", value_len, ext);
+            goto fail;
+        }
+        client->deflate_negotiated = true;
+    }
+    client->deflate_stats.negotiated = client->deflate_negotiated;
+    ESP_LOGD(TAG, "permessage-deflate %s", client->deflate_negotiated ? "accepted" : "declined by the server");
+
+    if (body_off < total) {
+        inf->pending = buf;
+        inf->pending_off = body_off;
+        inf->pending_len = total;
+    } else {
+        free(buf);
+    }
+    return 0;
+
+fail:
+    free(buf);
+    return -1;
+}
+
+/**
+ * Receive one frame parsing the header here instead of in the ws transport, which does not
+ * expose the RSV1 bit that marks a compressed message. Uncompressed frames are dispatched
+ * exactly like esp_websocket_client_recv() does; compressed messages are dispatched once,
+ * inflated, as a single DATA event.
+ */
+static esp_err_t esp_websocket_client_recv_deflate(esp_websocket_client_handle_t client)
+{
+    static const uint8_t sync_tail[4] = { 0x00, 0x00, 0xff, 0xff };
+    ws_inflate_t *inf = client->inflate;
+    uint8_t hdr[8];
+    int rlen;
+
+    client->payload_offset = 0;
+    if (esp_websocket_new_buf(client, false) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to setup rx buffer");
+        return ESP_FAIL;
+    }
+
+    rlen = esp_websocket_read_exact(client, (char *)hdr, 2, true);
+    if (rlen == 0) {
+        ESP_LOGV(TAG, "esp_transport_read timeouts");
+        esp_websocket_free_buf(client, false);
+        return ESP_OK;
+    }
+    if (rlen < 0) {
+        goto read_error;
+    }
+
+    bool fin = hdr[0] & WS_FRAME_FIN;
+    bool rsv1 = hdr[0] & WS_FRAME_RSV1;
+    uint8_t opcode = hdr[0] & WS_FRAME_OPCODE_MASK;
+    bool control = opcode & WS_FRAME_CONTROL;
+    uint64_t payload_len = hdr[1] & 0x7F;
+    if (hdr[1] & WS_FRAME_MASK) {
+        esp_websocket_client_error(client, "Received a masked frame from the server");
+        goto fail;
+    }
+    if (payload_len >= 126) {
+        int ext = (payload_len == 126) ? 2 : 8;
+        if (esp_websocket_read_exact(client, (char *)hdr, ext, false) != ext) {
+            goto read_error;
+        }
+        payload_len = 0;
+        for (int i = 0; i < ext; i++) {
+            payload_len = (payload_len << 8) | hdr[i];
+        }
+    }
+    if (payload_len > INT_MAX || (control && payload_len > 125)) {
+        esp_websocket_client_error(client, "Invalid frame length %llu", (unsigned long long)payload_len);
+        goto fail;
+    }
+    if (rsv1 && !client->deflate_negotiated) {
+        esp_websocket_client_error(client, "RSV1 set but permessage-deflate was not negotiated");
+        goto fail;
+    }
+    if (rsv1 && (control || opcode == WS_TRANSPORT_OPCODES_CONT)) {
+        esp_websocket_client_error(client, "RSV1 set on a control or continuation frame");
+        goto fail;
+    }
+    if (!control && opcode != WS_TRANSPORT_OPCODES_CONT && inf->in_message) {
+        esp_websocket_client_error(client, "New message before the end of a compressed message");
+        goto fail;
+    }
+
+    client->last_fin = fin;
+    client->last_opcode = opcode;
+    client->payload_len = (int)payload_len;
+    bool compressed = rsv1 || (opcode == WS_TRANSPORT_OPCODES_CONT && inf->in_message);
+
+    if (!compressed) {
+        if (!control && opcode != WS_TRANSPORT_OPCODES_CONT) {
+            client->deflate_stats.plain_messages++;
+        }
+        do {
+            int chunk = client->payload_len - client->payload_offset;
+            if (chunk > client->buffer_size) {
+                chunk = client->buffer_size;
+            }
+            if (chunk > 0 && esp_websocket_read_exact(client, client->rx_buffer, chunk, false) != chunk) {
+                goto read_error;
+            }
+            esp_websocket_client_dispatch_event(client, WEBSOCKET_EVENT_DATA, client->rx_buffer, chunk);
+            client->payload_offset += chunk;
+        } while (client->payload_offset < client->payload_len);
+
+        esp_websocket_client_handle_control(client);
+        esp_websocket_free_buf(client, false);
+        return ESP_OK;
+    }
+
+    if (!inf->in_message) {
+        inf->in_message = true;
+        inf->msg_opcode = opcode;
+        inf->msg_len = 0;
+#ifdef CONFIG_ESP_WS_CLIENT_DEFLATE_NO_CONTEXT_TAKEOVER
+        inf->stream_done = true;    // Every message is an independent deflate stream
+#endif
+        if (inf->stream_done) {
+            tinfl_init(&inf->decomp);
+            inf->hist_len = 0;
+            inf->stream_done = false;
+        }
+        client->deflate_stats.active = true;
+    }
+    client->deflate_stats.wire_bytes += payload_len;
+
+    while (client->payload_offset < client->payload_len) {
+        int chunk = client->payload_len - client->payload_offset;
+        if (chunk > client->buffer_size) {
+            chunk = client->buffer_size;
+        }
+        if (esp_websocket_read_exact(client, client->rx_buffer, chunk, false) != chunk) {
+            goto read_error;
+        }
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t err = esp_websocket_inflate_feed(client, (const uint8_t *)client->rx_buffer, chunk);
+        client->deflate_stats.inflate_us += esp_timer_get_time() - start_us;
+        if (err != ESP_OK) {
+            goto fail;
+        }
+        client->payload_offset += chunk;
+    }
+
+    if (fin) {
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t err = esp_websocket_inflate_feed(client, sync_tail, sizeof(sync_tail));
+        client->deflate_stats.inflate_us += esp_timer_get_time() - start_us;
+        if (err != ESP_OK) {
+            goto fail;
+        }
+        esp_websocket_inflate_finish(client);
+    }
+    esp_websocket_free_buf(client, false);
+    return ESP_OK;
+
+read_error:
+    esp_websocket_client_error(client, "esp_transport_read() failed while reading a frame, errno=%d", errno);
+fail:
+    inf->in_message = false;
+    esp_websocket_free_buf(client, false);
+    return ESP_FAIL;
+}
+#endif
+
+/**
+ * Poll the transport for a frame. Frames that arrived with the upgrade response are already
+ * buffered by the client, so the socket would not report them.
+ */
+static int esp_websocket_client_poll_read(esp_websocket_client_handle_t client, int timeout_ms)
+{
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+    if (client->inflate && client->inflate->pending) {
+        return 1;
+    }
+#endif
+    return esp_transport_poll_read(client->transport, timeout_ms);
+}
+
 static esp_err_t esp_websocket_client_recv(esp_websocket_client_handle_t client)
 {
     int rlen;
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+    if (client->inflate) {
+        return esp_websocket_client_recv_deflate(client);
+    }
+#endif
     client->payload_offset = 0;
     if (esp_websocket_new_buf(client, false) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to setup rx buffer");
@@ -963,6 +1835,13 @@ static esp_err_t esp_websocket_client_recv(esp_websocket_client_handle_t client)
         client->payload_offset += rlen;
     } while (client->payload_offset < client->payload_len);
 
+    esp_websocket_client_handle_control(client);
+    esp_websocket_free_buf(client, false);
+    return ESP_OK;
+}
+
+static void esp_websocket_client_handle_control(esp_websocket_client_handle_t client)
+{
     // if a PING message received -> send out the PONG, this will not work for PING messages with payload longer than buffer len
     if (client->last_opcode == WS_TRANSPORT_OPCODES_PING) {
         const char *data = (client->payload_len == 0) ? NULL : client->rx_buffer;
@@ -975,8 +1854,6 @@ static esp_err_t esp_websocket_client_recv(esp_websocket_client_handle_t client)
         ESP_LOGD(TAG, "Received close frame");
         client->state = WEBSOCKET_STATE_CLOSING;
     }
-    esp_websocket_free_buf(client, false);
-    return ESP_OK;
 }
 
 static int esp_websocket_client_send_close(esp_websocket_client_handle_t client, int code, const char *additional_data, int total_len, TickType_t timeout);
@@ -1018,13 +1895,31 @@ static void esp_websocket_client_task(void *pv)
                 break;
             }
             esp_websocket_client_dispatch_event(client, WEBSOCKET_EVENT_BEFORE_CONNECT, NULL, 0);
-            int result = esp_transport_connect(client->transport,
+            int result;
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+            if (client->deflate_offered) {
+                if (esp_websocket_inflate_reset(client) != ESP_OK) {
+                    esp_websocket_client_error(client, "Failed to allocate the permessage-deflate decompressor");
+                    esp_websocket_client_abort_connection(client, WEBSOCKET_ERROR_TYPE_TCP_TRANSPORT);
+                    break;
+                }
+                result = esp_websocket_deflate_connect(client);
+            } else
+#endif
+            {
+                result = esp_transport_connect(client->transport,
                                                client->config->host,
                                                client->config->port,
                                                client->config->network_timeout_ms);
+            }
             if (result < 0) {
                 esp_tls_error_handle_t error_handle = esp_transport_get_error_handle(client->transport);
                 client->error_handle.esp_ws_handshake_status_code  = esp_transport_ws_get_upgrade_request_status(client->transport);
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+                if (client->deflate_offered) {
+                    client->error_handle.esp_ws_handshake_status_code = client->handshake_status;
+                }
+#endif
                 if (error_handle) {
                     esp_websocket_client_error(client, "esp_transport_connect() failed with %d, "
                                                "transport_error=%s, tls_error_code=%i, tls_flags=%i, esp_ws_handshake_status_code=%d, errno=%d",
@@ -1096,7 +1991,7 @@ static void esp_websocket_client_task(void *pv)
         }
         xSemaphoreGiveRecursive(client->lock);
         if (WEBSOCKET_STATE_CONNECTED == client->state) {
-            read_select = esp_transport_poll_read(client->transport, 1000); //Poll every 1000ms
+            read_select = esp_websocket_client_poll_read(client, 1000); //Poll every 1000ms
             if (read_select < 0) {
                 esp_tls_error_handle_t error_handle = esp_transport_get_error_handle(client->transport);
                 if (error_handle) {
@@ -1150,9 +2045,11 @@ static void esp_websocket_client_task(void *pv)
 
     esp_websocket_client_dispatch_event(client, WEBSOCKET_EVENT_FINISH, NULL, 0);
     esp_transport_close(client->transport);
-    xEventGroupSetBits(client->status_bits, STOPPED_BIT);
     client->state = WEBSOCKET_STATE_UNKNOW;
-    if (client->selected_for_destroying == true) {
+    // Once STOPPED_BIT is set esp_websocket_client_destroy() may free the client
+    bool destroy = client->selected_for_destroying;
+    xEventGroupSetBits(client->status_bits, STOPPED_BIT);
+    if (destroy) {
         destroy_and_free_resources(client);
     }
     vTaskDelete(NULL);
@@ -1300,6 +2197,111 @@ int esp_websocket_client_send_with_opcode(esp_websocket_client_handle_t client,
     return esp_websocket_client_send_with_exact_opcode(client, opcode | WS_TRANSPORT_OPCODES_FIN, data, len, timeout);
 }
 
+int esp_websocket_client_send_iov(esp_websocket_client_handle_t client, ws_transport_opcodes_t opcode, const esp_websocket_iov_t *iov, int iovcnt, TickType_t timeout)
+{
+    return esp_websocket_client_send_iov_with_exact_opcode(client, opcode | WS_TRANSPORT_OPCODES_FIN, iov, iovcnt, timeout);
+}
+
+int esp_websocket_client_send_batch(esp_websocket_client_handle_t client, ws_transport_opcodes_t opcode,
+                                    const esp_websocket_message_t *msgs, int count, TickType_t timeout)
+{
+    if (client == NULL || count < 0 || (msgs == NULL && count > 0)) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        size_t total = 0;
+        if (msgs[i].iovcnt < 0 || (msgs[i].iov == NULL && msgs[i].iovcnt > 0)) {
+            ESP_LOGE(TAG, "Invalid arguments");
+            return -1;
+        }
+        for (int j = 0; j < msgs[i].iovcnt; j++) {
+            if ((msgs[i].iov[j].base == NULL && msgs[i].iov[j].len > 0) || msgs[i].iov[j].len > INT_MAX - 14 - total) {
+                ESP_LOGE(TAG, "Invalid arguments");
+                return -1;
+            }
+            total += msgs[i].iov[j].len;
+        }
+    }
+
+    if (!esp_websocket_client_is_connected(client)) {
+        ESP_LOGE(TAG, "Websocket client is not connected");
+        return -1;
+    }
+
+    int sent = 0;
+    if (client->ws_parent == NULL) {
+        // External transport: the frames can only go through the ws layer, one message at a time
+        for (; sent < count; sent++) {
+            if (esp_websocket_client_send_iov(client, opcode, msgs[sent].iov, msgs[sent].iovcnt, timeout) < 0) {
+                break;
+            }
+        }
+        return sent ? sent : (count ? -1 : 0);
+    }
+
+    if (xSemaphoreTakeRecursive(client->lock, timeout) != pdPASS) {
+        ESP_LOGE(TAG, "Could not lock ws-client within %" PRIu32 " timeout", timeout);
+        return -1;
+    }
+
+    int fill = 0;       // Bytes of complete frames in tx_buffer
+    int buffered = 0;   // Messages in those frames
+    for (int i = 0; i < count; i++) {
+        // Only with an empty buffer: the dynamic strategy reallocates it on every call
+        if (fill == 0 && esp_websocket_new_buf(client, true) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to setup tx buffer");
+            goto done;
+        }
+        int len = 0;
+        for (int j = 0; j < msgs[i].iovcnt; j++) {
+            len += msgs[i].iov[j].len;
+        }
+        int frame_len = esp_websocket_frame_size(len);
+
+        // Flush when the next frame does not fit next to the buffered ones
+        if (fill > 0 && fill + frame_len > client->buffer_size) {
+            int ret = esp_websocket_write_exact(client, client->tx_buffer, fill, timeout);
+            if (ret < 0) {
+                esp_websocket_free_buf(client, true);
+                esp_websocket_client_write_failed(client, ret);
+                goto done;
+            }
+            sent += buffered;
+            fill = 0;
+            buffered = 0;
+        }
+
+        if (frame_len > client->buffer_size) {
+            // Larger than the buffer: fragmented like esp_websocket_client_send_iov() (frees tx_buffer)
+            if (esp_websocket_client_send_iov_with_exact_opcode(client, opcode | WS_TRANSPORT_OPCODES_FIN,
+                                                                msgs[i].iov, msgs[i].iovcnt, timeout) < 0) {
+                goto done;
+            }
+            sent++;
+            continue;
+        }
+
+        fill += esp_websocket_put_frame(client->tx_buffer + fill, opcode, msgs[i].iov, len);
+        buffered++;
+    }
+
+    if (fill > 0) {
+        int ret = esp_websocket_write_exact(client, client->tx_buffer, fill, timeout);
+        if (ret < 0) {
+            esp_websocket_free_buf(client, true);
+            esp_websocket_client_write_failed(client, ret);
+            goto done;
+        }
+        sent += buffered;
+    }
+    esp_websocket_free_buf(client, true);
+
+done:
+    xSemaphoreGiveRecursive(client->lock);
+    return sent ? sent : (count ? -1 : 0);
+}
+
 bool esp_websocket_client_is_connected(esp_websocket_client_handle_t client)
 {
     if (client == NULL) {
@@ -1377,6 +2379,45 @@ esp_err_t esp_websocket_client_set_reconnect_timeout(esp_websocket_client_handle
     return ESP_OK;
 }
 
+esp_err_t esp_websocket_client_get_deflate_stats(esp_websocket_client_handle_t client, esp_websocket_deflate_stats_t *stats)
+{
+    if (client == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+    xSemaphoreTakeRecursive(client->lock, portMAX_DELAY);
+    *stats = client->deflate_stats;
+    xSemaphoreGiveRecursive(client->lock);
+    return ESP_OK;
+#else
+    memset(stats, 0, sizeof(*stats));
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t esp_websocket_client_get_buffer_stats(esp_websocket_buffer_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    WS_BUF_LOCK();
+    *stats = s_buf_stats;
+#ifdef CONFIG_ESP_WS_CLIENT_BUFFER_POOL
+    stats->pool_blocks = 0;
+    stats->pool_in_use = 0;
+    for (int i = 0; i < CONFIG_ESP_WS_CLIENT_BUFFER_POOL_SLOTS; i++) {
+        stats->pool_blocks += (s_buf_pool[i].ptr != NULL);
+        stats->pool_in_use += s_buf_pool[i].in_use;
+    }
+#endif
+    WS_BUF_UNLOCK();
+#if !CONFIG_IDF_TARGET_LINUX
+    stats->heap_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    stats->heap_largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#endif
+    return ESP_OK;
+}
+
 esp_err_t esp_websocket_register_events(esp_websocket_client_handle_t client,
                                         esp_websocket_event_id_t event,
                                         esp_event_handler_t event_handler,
@@ -0,0 +1,368 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Minimal RFC 6455 echo server for the host benchmark: plain POSIX sockets, no TLS, no extensions.
+ * It only needs to be correct and fast enough not to dominate the measured round trip.
+ * Runs in a plain pthread; EINTR is retried because the FreeRTOS POSIX port signals its threads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "echo_server.h"
+
+#define WS_GUID             "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_MAX_HANDSHAKE    2048
+
+static int s_listen_fd = -1;
+static int s_client_fd = -1;
+static volatile bool s_running;
+static volatile int s_fragment_size;
+static pthread_t s_thread;
+
+/* SHA-1 (FIPS 180-1), only used to compute Sec-WebSocket-Accept */
+static void sha1(const uint8_t *data, size_t len, uint8_t out[20])
+{
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint8_t block[64];
+    uint64_t bits = (uint64_t)len * 8;
+    size_t total = ((len + 8) / 64 + 1) * 64;
+
+    for (size_t off = 0; off < total; off += 64) {
+        for (int i = 0; i < 64; i++) {
+            size_t pos = off + i;
+            if (pos < len) {
+                block[i] = data[pos];
+            } else if (pos == len) {
+                block[i] = 0x80;
+            } else if (pos >= total - 8) {
+                block[i] = (uint8_t)(bits >> (8 * (total - 1 - pos)));
+            } else {
+                block[i] = 0;
+            }
+        }
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+                   (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+        }
+        for (int i = 16; i < 80; i++) {
+            uint32_t v = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = (v << 1) | (v >> 31);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = (b << 30) | (b >> 2);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 20; i++) {
+        out[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+static void base64(const uint8_t *in, size_t len, char *out)
+{
+    static const char tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) {
+            v |= (uint32_t)in[i + 1] << 8;
+        }
+        if (i + 2 < len) {
+            v |= in[i + 2];
+        }
+        out[o++] = tbl[(v >> 18) & 0x3F];
+        out[o++] = tbl[(v >> 12) & 0x3F];
+        out[o++] = (i + 1 < len) ? tbl[(v >> 6) & 0x3F] : '=';
+        out[o++] = (i + 2 < len) ? tbl[v & 0x3F] : '=';
+    }
+    out[o] = '\0';
+}
+
+static bool read_exact(int fd, uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t r = recv(fd, buf, len, 0);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return false;
+        }
+        buf += r;
+        len -= r;
+    }
+    return true;
+}
+
+static bool write_exact(int fd, const uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t r = send(fd, buf, len, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return false;
+        }
+        buf += r;
+        len -= r;
+    }
+    return true;
+}
+
+static bool handshake(int fd)
+{
+    char req[WS_MAX_HANDSHAKE + 1];
+    size_t len = 0;
+    while (len < WS_MAX_HANDSHAKE) {
+        ssize_t r = recv(fd, req + len, WS_MAX_HANDSHAKE - len, 0);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return false;
+        }
+        len += r;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n")) {
+            break;
+        }
+    }
+
+    const char *key = strcasestr(req, "Sec-WebSocket-Key:");
+    if (!key) {
+        return false;
+    }
+    key += strlen("Sec-WebSocket-Key:");
+    while (*key == ' ') {
+        key++;
+    }
+    const char *end = strstr(key, "\r\n");
+    if (!end || end - key > 64) {
+        return false;
+    }
+
+    char concat[128];
+    int n = snprintf(concat, sizeof(concat), "%.*s%s", (int)(end - key), key, WS_GUID);
+    uint8_t digest[20];
+    char accept[32];
+    sha1((const uint8_t *)concat, n, digest);
+    base64(digest, sizeof(digest), accept);
+
+    char resp[256];
+    n = snprintf(resp, sizeof(resp),
+                 "HTTP/1.1 101 Switching Protocols\r\n"
+                 "Upgrade: websocket\r\n"
+                 "Connection: Upgrade\r\n"
+                 "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+    return write_exact(fd, (const uint8_t *)resp, n);
+}
+
+static bool send_frame(int fd, uint8_t first_byte, const uint8_t *payload, size_t len)
+{
+    uint8_t hdr[10];
+    size_t hlen = 2;
+    hdr[0] = first_byte;
+    if (len < 126) {
+        hdr[1] = (uint8_t)len;
+    } else if (len <= 0xFFFF) {
+        hdr[1] = 126;
+        hdr[2] = (uint8_t)(len >> 8);
+        hdr[3] = (uint8_t)len;
+        hlen = 4;
+    } else {
+        hdr[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            hdr[2 + i] = (uint8_t)((uint64_t)len >> (56 - 8 * i));
+        }
+        hlen = 10;
+    }
+    return write_exact(fd, hdr, hlen) && (len == 0 || write_exact(fd, payload, len));
+}
+
+/* Echo a data frame, re-fragmenting it when a fragment size is set */
+static bool echo_frame(int fd, uint8_t first_byte, const uint8_t *payload, size_t len)
+{
+    size_t frag = (size_t)s_fragment_size;
+    if (frag == 0 || len <= frag) {
+        return send_frame(fd, first_byte, payload, len);
+    }
+    uint8_t opcode = first_byte & 0x0F;
+    bool fin = first_byte & 0x80;
+    for (size_t off = 0; off < len; off += frag) {
+        size_t chunk = (len - off < frag) ? len - off : frag;
+        bool last = off + chunk >= len;
+        uint8_t b = (off == 0 ? opcode : 0x00) | ((last && fin) ? 0x80 : 0x00);
+        if (!send_frame(fd, b, payload + off, chunk)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void serve(int fd)
+{
+    uint8_t *payload = NULL;
+    size_t cap = 0;
+
+    if (!handshake(fd)) {
+        return;
+    }
+    while (s_running) {
+        uint8_t hdr[2];
+        uint8_t mask[4];
+        if (!read_exact(fd, hdr, 2)) {
+            break;
+        }
+        uint64_t len = hdr[1] & 0x7F;
+        if (len == 126 || len == 127) {
+            uint8_t ext[8];
+            int n = (len == 126) ? 2 : 8;
+            if (!read_exact(fd, ext, n)) {
+                break;
+            }
+            len = 0;
+            for (int i = 0; i < n; i++) {
+                len = (len << 8) | ext[i];
+            }
+        }
+        if ((hdr[1] & 0x80) && !read_exact(fd, mask, 4)) {
+            break;
+        }
+        if (len > cap) {
+            uint8_t *p = realloc(payload, len);
+            if (!p) {
+                break;
+            }
+            payload = p;
+            cap = len;
+        }
+        if (len && !read_exact(fd, payload, len)) {
+            break;
+        }
+        if (hdr[1] & 0x80) {
+            for (uint64_t i = 0; i < len; i++) {
+                payload[i] ^= mask[i & 3];
+            }
+        }
+
+        uint8_t opcode = hdr[0] & 0x0F;
+        bool ok;
+        if (opcode == 0x9) {            // PING
+            ok = send_frame(fd, 0x8A, payload, len);
+        } else if (opcode == 0x8) {     // CLOSE
+            send_frame(fd, 0x88, payload, len);
+            break;
+        } else if (opcode == 0xA) {     // PONG
+            ok = true;
+        } else {
+            ok = echo_frame(fd, hdr[0] & 0x8F, payload, len);
+        }
+        if (!ok) {
+            break;
+        }
+    }
+    free(payload);
+}
+
+static void *server_thread(void *arg)
+{
+    while (s_running) {
+        int fd = accept(s_listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        s_client_fd = fd;
+        serve(fd);
+        s_client_fd = -1;
+        close(fd);
+    }
+    return NULL;
+}
+
+int echo_server_start(uint16_t port)
+{
+    s_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (s_listen_fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(s_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(s_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(s_listen_fd, 1) < 0) {
+        close(s_listen_fd);
+        s_listen_fd = -1;
+        return -1;
+    }
+    s_running = true;
+    if (pthread_create(&s_thread, NULL, server_thread, NULL) != 0) {
+        s_running = false;
+        close(s_listen_fd);
+        s_listen_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void echo_server_set_fragment_size(int frame_size)
+{
+    s_fragment_size = frame_size > 0 ? frame_size : 0;
+}
+
+void echo_server_stop(void)
+{
+    if (!s_running) {
+        return;
+    }
+    s_running = false;
+    shutdown(s_listen_fd, SHUT_RDWR);
+    if (s_client_fd >= 0) {
+        shutdown(s_client_fd, SHUT_RDWR);
+    }
+    pthread_join(s_thread, NULL);
+    close(s_listen_fd);
+    s_listen_fd = -1;
+}
@@ -0,0 +1,37 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start a minimal WebSocket echo server on 127.0.0.1 in its own thread
+ *
+ * Serves one connection at a time. Every data frame is echoed back unmasked with the same opcode
+ * and FIN flag; control frames are answered (PING -> PONG, CLOSE -> CLOSE).
+ *
+ * @param port TCP port to listen on
+ * @return 0 on success, -1 if the socket could not be bound
+ */
+int echo_server_start(uint16_t port);
+
+/**
+ * @brief Split echoed messages into frames of at most `frame_size` bytes (0 = echo frames as received)
+ */
+void echo_server_set_fragment_size(int frame_size);
+
+/**
+ * @brief Stop the server thread and close its sockets
+ */
+void echo_server_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
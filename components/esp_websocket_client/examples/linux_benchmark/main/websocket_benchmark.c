@@ -0,0 +1,281 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Host benchmark of esp_websocket_client against a local echo server.
+ *
+ * For every combination of message size, client buffer_size (which is also the send fragmentation
+ * threshold) and server fragment size, a client connects to ws://127.0.0.1, exchanges
+ * CONFIG_BENCH_MESSAGES sequential binary round trips and reports messages/s, p50/p99 round-trip
+ * latency and the heap calls made per message by the whole process while measuring.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_websocket_client.h"
+#include "echo_server.h"
+
+static const char *TAG = "ws_bench";
+
+#define CONNECT_TIMEOUT_MS      5000
+#define ECHO_TIMEOUT_MS         5000
+
+static const int s_message_sizes[] = { 64, 512, 4096, 16384 };
+static const int s_buffer_sizes[] = { 1024, 4096, 16384 };
+static const int s_server_fragments[] = { 0, 1024 };
+
+/*
+ * Heap call counters. main/CMakeLists.txt links with --wrap for malloc/calloc/realloc/free, so
+ * every call in the process (client, transport, FreeRTOS port, event loop) ends up here.
+ */
+static uint64_t s_alloc_calls;
+static uint64_t s_alloc_bytes;
+static uint64_t s_free_calls;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&s_alloc_calls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s_alloc_bytes, size, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    __atomic_add_fetch(&s_alloc_calls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s_alloc_bytes, n * size, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&s_alloc_calls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s_alloc_bytes, size, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr) {
+        __atomic_add_fetch(&s_free_calls, 1, __ATOMIC_RELAXED);
+    }
+    __real_free(ptr);
+}
+
+typedef struct {
+    SemaphoreHandle_t connected;
+    SemaphoreHandle_t echoed;
+    volatile int expected;
+    volatile int received;
+    volatile uint32_t mismatches;
+} bench_ctx_t;
+
+typedef struct {
+    int message_size;
+    int buffer_size;
+    int server_fragment;
+    int messages;
+    double msgs_per_sec;
+    double mbit_per_sec;
+    int64_t p50_us;
+    int64_t p99_us;
+    double allocs_per_msg;
+    double frees_per_msg;
+    double alloc_bytes_per_msg;
+} bench_result_t;
+
+static void websocket_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    bench_ctx_t *ctx = (bench_ctx_t *)handler_args;
+    esp_websocket_event_data_t *data = (esp_websocket_event_data_t *)event_data;
+
+    switch (event_id) {
+    case WEBSOCKET_EVENT_CONNECTED:
+        xSemaphoreGive(ctx->connected);
+        break;
+    case WEBSOCKET_EVENT_DATA:
+        // Continuation frames (0x0) carry the rest of a message the server fragmented
+        if (data->op_code > 0x2 || data->data_len <= 0) {
+            break;
+        }
+        ctx->received += data->data_len;
+        if (ctx->expected > 0 && ctx->received >= ctx->expected) {
+            if (ctx->received != ctx->expected) {
+                ctx->mismatches++;
+            }
+            ctx->expected = 0;
+            xSemaphoreGive(ctx->echoed);
+        }
+        break;
+    case WEBSOCKET_EVENT_ERROR:
+        ESP_LOGE(TAG, "WEBSOCKET_EVENT_ERROR");
+        break;
+    default:
+        break;
+    }
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static bool round_trip(esp_websocket_client_handle_t client, bench_ctx_t *ctx, const char *payload, int len, int64_t *rtt_us)
+{
+    ctx->received = 0;
+    ctx->expected = len;
+    int64_t start = esp_timer_get_time();
+    if (esp_websocket_client_send_bin(client, payload, len, portMAX_DELAY) != len) {
+        ESP_LOGE(TAG, "Send of %d bytes failed", len);
+        return false;
+    }
+    if (xSemaphoreTake(ctx->echoed, pdMS_TO_TICKS(ECHO_TIMEOUT_MS)) != pdTRUE) {
+        ESP_LOGE(TAG, "No echo for %d bytes (got %d)", len, ctx->received);
+        return false;
+    }
+    if (rtt_us) {
+        *rtt_us = esp_timer_get_time() - start;
+    }
+    return true;
+}
+
+static bool run_scenario(bench_result_t *result)
+{
+    bench_ctx_t ctx = {
+        .connected = xSemaphoreCreateBinary(),
+        .echoed = xSemaphoreCreateBinary(),
+    };
+    char uri[48];
+    snprintf(uri, sizeof(uri), "ws://127.0.0.1:%d", CONFIG_BENCH_SERVER_PORT);
+
+    esp_websocket_client_config_t websocket_cfg = {
+        .uri = uri,
+        .buffer_size = result->buffer_size,
+        .disable_auto_reconnect = true,
+        .network_timeout_ms = ECHO_TIMEOUT_MS,
+    };
+
+    char *payload = malloc(result->message_size);
+    int64_t *rtt = calloc(result->messages, sizeof(int64_t));
+    esp_websocket_client_handle_t client = esp_websocket_client_init(&websocket_cfg);
+    bool ok = payload && rtt && client && ctx.connected && ctx.echoed;
+    if (!ok) {
+        ESP_LOGE(TAG, "Out of memory setting up the scenario");
+        goto cleanup;
+    }
+    for (int i = 0; i < result->message_size; i++) {
+        payload[i] = (char)(i & 0xFF);
+    }
+
+    echo_server_set_fragment_size(result->server_fragment);
+    esp_websocket_register_events(client, WEBSOCKET_EVENT_ANY, websocket_event_handler, &ctx);
+    esp_websocket_client_start(client);
+    if (xSemaphoreTake(ctx.connected, pdMS_TO_TICKS(CONNECT_TIMEOUT_MS)) != pdTRUE) {
+        ESP_LOGE(TAG, "Could not connect to %s", uri);
+        ok = false;
+        goto cleanup;
+    }
+
+    for (int i = 0; i < CONFIG_BENCH_WARMUP_MESSAGES && ok; i++) {
+        ok = round_trip(client, &ctx, payload, result->message_size, NULL);
+    }
+
+    uint64_t allocs = __atomic_load_n(&s_alloc_calls, __ATOMIC_RELAXED);
+    uint64_t alloc_bytes = __atomic_load_n(&s_alloc_bytes, __ATOMIC_RELAXED);
+    uint64_t frees = __atomic_load_n(&s_free_calls, __ATOMIC_RELAXED);
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < result->messages && ok; i++) {
+        ok = round_trip(client, &ctx, payload, result->message_size, &rtt[i]);
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    allocs = __atomic_load_n(&s_alloc_calls, __ATOMIC_RELAXED) - allocs;
+    alloc_bytes = __atomic_load_n(&s_alloc_bytes, __ATOMIC_RELAXED) - alloc_bytes;
+    frees = __atomic_load_n(&s_free_calls, __ATOMIC_RELAXED) - frees;
+
+    if (ok) {
+        qsort(rtt, result->messages, sizeof(int64_t), cmp_int64);
+        result->p50_us = rtt[result->messages / 2];
+        result->p99_us = rtt[(result->messages * 99) / 100];
+        result->msgs_per_sec = elapsed > 0 ? result->messages * 1e6 / elapsed : 0;
+        // Both directions carry the payload
+        result->mbit_per_sec = result->msgs_per_sec * result->message_size * 2 * 8 / 1e6;
+        result->allocs_per_msg = (double)allocs / result->messages;
+        result->frees_per_msg = (double)frees / result->messages;
+        result->alloc_bytes_per_msg = (double)alloc_bytes / result->messages;
+        if (ctx.mismatches) {
+            ESP_LOGW(TAG, "%" PRIu32 " echoes with unexpected length", ctx.mismatches);
+        }
+    }
+
+cleanup:
+    if (client) {
+        esp_websocket_client_close(client, pdMS_TO_TICKS(1000));
+        esp_websocket_client_destroy(client);
+    }
+    if (ctx.connected) {
+        vSemaphoreDelete(ctx.connected);
+    }
+    if (ctx.echoed) {
+        vSemaphoreDelete(ctx.echoed);
+    }
+    free(rtt);
+    free(payload);
+    return ok;
+}
+
+int main(void)
+{
+    if (echo_server_start(CONFIG_BENCH_SERVER_PORT) != 0) {
+        ESP_LOGE(TAG, "Could not start the echo server on port %d", CONFIG_BENCH_SERVER_PORT);
+        return 1;
+    }
+
+    printf("\n%8s %8s %8s | %10s %9s %8s %8s | %10s %9s %12s\n",
+           "msg_size", "buf_size", "srv_frag", "msgs/s", "Mbit/s", "p50_us", "p99_us",
+           "allocs/msg", "frees/msg", "alloc_B/msg");
+
+    int failed = 0;
+    for (size_t m = 0; m < sizeof(s_message_sizes) / sizeof(s_message_sizes[0]); m++) {
+        for (size_t b = 0; b < sizeof(s_buffer_sizes) / sizeof(s_buffer_sizes[0]); b++) {
+            for (size_t f = 0; f < sizeof(s_server_fragments) / sizeof(s_server_fragments[0]); f++) {
+                bench_result_t result = {
+                    .message_size = s_message_sizes[m],
+                    .buffer_size = s_buffer_sizes[b],
+                    .server_fragment = s_server_fragments[f],
+                    .messages = CONFIG_BENCH_MESSAGES,
+                };
+                if (!run_scenario(&result)) {
+                    printf("%8d %8d %8d | failed\n", result.message_size, result.buffer_size, result.server_fragment);
+                    failed++;
+                    continue;
+                }
+                printf("%8d %8d %8d | %10.0f %9.1f %8" PRId64 " %8" PRId64 " | %10.2f %9.2f %12.0f\n",
+                       result.message_size, result.buffer_size, result.server_fragment,
+                       result.msgs_per_sec, result.mbit_per_sec, result.p50_us, result.p99_us,
+                       result.allocs_per_msg, result.frees_per_msg, result.alloc_bytes_per_msg);
+            }
+        }
+    }
+
+    esp_websocket_buffer_stats_t stats;
+    if (esp_websocket_client_get_buffer_stats(&stats) == ESP_OK) {
+        printf("\nClient buffers: %" PRIu32 " allocs, %" PRIu32 " frees, peak %zu bytes\n",
+               stats.allocs, stats.frees, stats.bytes_peak);
+    }
+
+    echo_server_stop();
+    return failed ? 1 : 0;
+}
@@ -82,6 +82,60 @@ typedef struct {
     esp_websocket_error_codes_t error_handle; /*!< esp-websocket error handle including esp-tls errors as well as internal websocket errors */
 } esp_websocket_event_data_t;
 
+/**
+ * @brief Segment of a message sent with esp_websocket_client_send_iov()
+ */
+typedef struct {
+    const void *base;                   /*!< Segment data */
+    size_t len;                         /*!< Segment length */
+} esp_websocket_iov_t;
+
+/**
+ * @brief Message sent with esp_websocket_client_send_batch()
+ */
+typedef struct {
+    const esp_websocket_iov_t *iov;     /*!< Segments of the message, written in order */
+    int iovcnt;                         /*!< Number of segments */
+} esp_websocket_message_t;
+
+/**
+ * @brief permessage-deflate counters of a client
+ *
+ * inflated_bytes / wire_bytes is the compression ratio of the received messages and inflate_us the
+ * CPU time spent decompressing them.
+ */
+typedef struct {
+    bool     negotiated;                /*!< The server accepted the offer on the current connection */
+    bool     active;                    /*!< The server sent compressed messages on the current connection */
+    uint32_t messages;                  /*!< Compressed messages received */
+    uint32_t plain_messages;            /*!< Uncompressed messages received while the extension was offered */
+    uint64_t wire_bytes;                /*!< Compressed payload bytes received */
+    uint64_t inflated_bytes;            /*!< Bytes after inflating */
+    uint64_t inflate_us;                /*!< CPU time spent inflating */
+    uint32_t errors;                    /*!< Messages with invalid compressed data */
+    uint32_t oversize;                  /*!< Messages larger than CONFIG_ESP_WS_CLIENT_DEFLATE_MAX_MESSAGE */
+    size_t   memory_bytes;              /*!< Memory held by the decompressor */
+} esp_websocket_deflate_stats_t;
+
+/**
+ * @brief Send/receive buffer counters, shared by all clients
+ *
+ * Comparing allocs/frees and heap_largest_free_block over a long run shows the heap churn and
+ * fragmentation caused by the selected buffer strategy (see ESP_WS_CLIENT_BUFFER_STRATEGY).
+ */
+typedef struct {
+    uint32_t allocs;                    /*!< Heap allocations made for send/receive buffers */
+    uint32_t frees;                     /*!< Buffers returned to the heap */
+    uint32_t pool_hits;                 /*!< Pool takes served by an existing block (pool strategy) */
+    uint32_t pool_misses;               /*!< Pool takes that overflowed to the heap (pool strategy) */
+    uint8_t  pool_blocks;               /*!< Pool blocks currently allocated (pool strategy) */
+    uint8_t  pool_in_use;               /*!< Pool blocks currently taken (pool strategy) */
+    size_t   bytes_allocated;           /*!< Bytes currently held in send/receive buffers */
+    size_t   bytes_peak;                /*!< Peak of bytes_allocated */
+    size_t   heap_free;                 /*!< Free internal heap at the time of the call (0 on linux) */
+    size_t   heap_largest_free_block;   /*!< Largest free internal block at the time of the call (0 on linux) */
+} esp_websocket_buffer_stats_t;
+
 /**
  * @brief Websocket Client transport
  */
@@ -136,6 +190,7 @@ typedef struct {
     size_t                      ping_interval_sec;          /*!< Websocket ping interval, defaults to 10 seconds if not set */
     struct ifreq                *if_name;                   /*!< The name of interface for data to go through. Use the default interface without setting */
     esp_transport_handle_t      ext_transport;              /*!< External WebSocket tcp_transport handle to the client; or if null, the client will create its own transport handle. */
+    bool                        permessage_deflate;         /*!< Offer the permessage-deflate extension (RFC 7692), requires CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE */
 } esp_websocket_client_config_t;
 
 /**
@@ -359,6 +414,47 @@ int esp_websocket_client_send_fin(esp_websocket_client_handle_t client, TickType
  */
 int esp_websocket_client_send_with_opcode(esp_websocket_client_handle_t client, ws_transport_opcodes_t opcode, const uint8_t *data, int len, TickType_t timeout);
 
+/**
+ * @brief      Write a message made of several segments (scatter-gather) with the given opcode.
+ *
+ * The segments are gathered straight into the client's send buffer and framed as one message
+ * (FIN set), fragmented in buffer_size frames like esp_websocket_client_send_with_opcode(). The
+ * caller does not need to concatenate envelope and payload into an intermediate buffer.
+ *
+ * @param[in]  client  The client
+ * @param[in]  opcode  The opcode (WS_TRANSPORT_OPCODES_TEXT or WS_TRANSPORT_OPCODES_BINARY)
+ * @param[in]  iov     Array of segments, written in order
+ * @param[in]  iovcnt  Number of segments
+ * @param[in]  timeout Write data timeout in RTOS ticks
+ *
+ * @return
+ *     - Number of payload bytes written
+ *     - (-1) if any errors
+ */
+int esp_websocket_client_send_iov(esp_websocket_client_handle_t client, ws_transport_opcodes_t opcode, const esp_websocket_iov_t *iov, int iovcnt, TickType_t timeout);
+
+/**
+ * @brief      Write several complete messages with as few transport writes as possible.
+ *
+ * Each message is one frame (FIN set). The frames, with header and masking key, are built one
+ * after the other in the client's send buffer and written with a single transport write whenever
+ * the next one does not fit, so over TLS a burst of small messages shares one record instead of
+ * taking two records per message (header and payload). A message larger than buffer_size is sent
+ * like esp_websocket_client_send_iov(). With an external transport every message is sent on its own.
+ *
+ * @param[in]  client  The client
+ * @param[in]  opcode  The opcode of every message (WS_TRANSPORT_OPCODES_TEXT or WS_TRANSPORT_OPCODES_BINARY)
+ * @param[in]  msgs    Messages, sent in order
+ * @param[in]  count   Number of messages
+ * @param[in]  timeout Write data timeout in RTOS ticks
+ *
+ * @return
+ *     - Number of messages written; fewer than count if a write failed (the connection is aborted)
+ *     - (-1) if no message could be written
+ */
+int esp_websocket_client_send_batch(esp_websocket_client_handle_t client, ws_transport_opcodes_t opcode,
+                                    const esp_websocket_message_t *msgs, int count, TickType_t timeout);
+
 /**
  * @brief      Close the WebSocket connection in a clean way
  *
@@ -448,6 +544,27 @@ int esp_websocket_client_get_reconnect_timeout(esp_websocket_client_handle_t cli
  */
 esp_err_t esp_websocket_client_set_reconnect_timeout(esp_websocket_client_handle_t client, int reconnect_timeout_ms);
 
+/**
+ * @brief      Get the permessage-deflate counters of a client.
+ *
+ * @param[in]  client             The client
+ * @param[out] stats              Where to copy the counters
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_SUPPORTED if CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE is disabled
+ */
+esp_err_t esp_websocket_client_get_deflate_stats(esp_websocket_client_handle_t client, esp_websocket_deflate_stats_t *stats);
+
+/**
+ * @brief      Get the send/receive buffer counters of all clients.
+ *
+ * @param[out] stats              Where to copy the counters
+ *
+ * @return     esp_err_t
+ */
+esp_err_t esp_websocket_client_get_buffer_stats(esp_websocket_buffer_stats_t *stats);
+
 /**
  * @brief Register the Websocket Events
  *
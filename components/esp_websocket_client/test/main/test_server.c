@@ -0,0 +1,340 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+/*
+ * Minimal RFC 6455 server for the loopback test cases: lwIP sockets, no TLS. There is no
+ * compressor: the Sec-WebSocket-Extensions reply is set by the test case and the compressed
+ * test messages are sent raw with test_server_send_frame().
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include "mbedtls/sha1.h"
+#include "mbedtls/base64.h"
+#include "test_server.h"
+
+#define WS_GUID             "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_MAX_HANDSHAKE    1024
+#define MAX_FRAMES          32
+#define ACCEPT_RETRY_MS     100
+
+static int s_listen_fd = -1;
+static int s_last_fd = -1;
+static SemaphoreHandle_t s_lock;
+static test_server_frame_t s_frames[MAX_FRAMES];
+static int s_frame_count;
+static const char *s_extensions;
+static uint8_t s_greeting_byte;
+static const uint8_t *s_greeting;
+static size_t s_greeting_len;
+
+static bool read_exact(int fd, uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        int r = recv(fd, buf, len, 0);
+        if (r <= 0) {
+            return false;
+        }
+        buf += r;
+        len -= r;
+    }
+    return true;
+}
+
+static bool write_exact(int fd, const uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        int r = send(fd, buf, len, 0);
+        if (r <= 0) {
+            return false;
+        }
+        buf += r;
+        len -= r;
+    }
+    return true;
+}
+
+static bool handshake(int fd)
+{
+    char req[WS_MAX_HANDSHAKE + 1];
+    size_t len = 0;
+    while (len < WS_MAX_HANDSHAKE) {
+        int r = recv(fd, req + len, WS_MAX_HANDSHAKE - len, 0);
+        if (r <= 0) {
+            return false;
+        }
+        len += r;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n")) {
+            break;
+        }
+    }
+
+    const char *key = strcasestr(req, "Sec-WebSocket-Key:");
+    if (!key) {
+        return false;
+    }
+    key += strlen("Sec-WebSocket-Key:");
+    while (*key == ' ') {
+        key++;
+    }
+    const char *end = strstr(key, "\r\n");
+    if (!end || end - key > 64) {
+        return false;
+    }
+
+    char concat[128];
+    int n = snprintf(concat, sizeof(concat), "%.*s%s", (int)(end - key), key, WS_GUID);
+    uint8_t digest[20];
+    unsigned char accept[32];
+    size_t accept_len;
+    mbedtls_sha1((const unsigned char *)concat, n, digest);
+    if (mbedtls_base64_encode(accept, sizeof(accept), &accept_len, digest, sizeof(digest)) != 0) {
+        return false;
+    }
+
+    char resp[384];
+    n = snprintf(resp, sizeof(resp),
+                 "HTTP/1.1 101 Switching Protocols\r\n"
+                 "Upgrade: websocket\r\n"
+                 "Connection: Upgrade\r\n"
+                 "Sec-WebSocket-Accept: %.*s\r\n"
+                 "%s%s%s\r\n", (int)accept_len, accept,
+                 s_extensions ? "Sec-WebSocket-Extensions: " : "", s_extensions ? s_extensions : "",
+                 s_extensions ? "\r\n" : "");
+    if (n >= (int)sizeof(resp) - 2 - (int)s_greeting_len) {
+        return false;
+    }
+    // The greeting frame goes out in the same write, right behind the response
+    if (s_greeting_len > 0) {
+        resp[n++] = (char)s_greeting_byte;
+        resp[n++] = (char)s_greeting_len;
+        memcpy(resp + n, s_greeting, s_greeting_len);
+        n += s_greeting_len;
+    }
+    // Published before the 101 response, so it is set once the client reports CONNECTED
+    s_last_fd = fd;
+    return write_exact(fd, (const uint8_t *)resp, n);
+}
+
+static bool send_frame(int fd, uint8_t first_byte, const uint8_t *payload, size_t len)
+{
+    uint8_t hdr[10];
+    size_t hlen = 2;
+    hdr[0] = first_byte;
+    if (len < 126) {
+        hdr[1] = (uint8_t)len;
+    } else if (len <= 0xFFFF) {
+        hdr[1] = 126;
+        hdr[2] = (uint8_t)(len >> 8);
+        hdr[3] = (uint8_t)len;
+        hlen = 4;
+    } else {
+        hdr[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            hdr[2 + i] = (uint8_t)((uint64_t)len >> (56 - 8 * i));
+        }
+        hlen = 10;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = write_exact(fd, hdr, hlen) && (len == 0 || write_exact(fd, payload, len));
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+static void record_frame(uint8_t first_byte, const uint8_t *payload, size_t len)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_frame_count < MAX_FRAMES) {
+        test_server_frame_t *f = &s_frames[s_frame_count];
+        f->first_byte = first_byte;
+        f->len = len;
+        f->payload = NULL;
+        if (len > 0) {
+            f->payload = malloc(len);
+            if (f->payload) {
+                memcpy(f->payload, payload, len);
+            }
+        }
+        s_frame_count++;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static void serve(int fd)
+{
+    uint8_t *payload = NULL;
+    size_t cap = 0;
+
+    while (true) {
+        uint8_t hdr[2];
+        uint8_t mask[4];
+        if (!read_exact(fd, hdr, 2)) {
+            break;
+        }
+        uint64_t len = hdr[1] & 0x7F;
+        if (len == 126 || len == 127) {
+            uint8_t ext[8];
+            int n = (len == 126) ? 2 : 8;
+            if (!read_exact(fd, ext, n)) {
+                break;
+            }
+            len = 0;
+            for (int i = 0; i < n; i++) {
+                len = (len << 8) | ext[i];
+            }
+        }
+        if ((hdr[1] & 0x80) && !read_exact(fd, mask, 4)) {
+            break;
+        }
+        if (len > cap) {
+            uint8_t *p = realloc(payload, len);
+            if (!p) {
+                break;
+            }
+            payload = p;
+            cap = len;
+        }
+        if (len && !read_exact(fd, payload, len)) {
+            break;
+        }
+        if (hdr[1] & 0x80) {
+            for (uint64_t i = 0; i < len; i++) {
+                payload[i] ^= mask[i & 3];
+            }
+        }
+
+        uint8_t opcode = hdr[0] & 0x0F;
+        bool ok;
+        if (opcode == 0x9) {            // PING
+            ok = send_frame(fd, 0x8A, payload, len);
+        } else if (opcode == 0x8) {     // CLOSE
+            send_frame(fd, 0x88, payload, len);
+            break;
+        } else if (opcode == 0xA) {     // PONG
+            ok = true;
+        } else {
+            record_frame(hdr[0], payload, len);
+            ok = send_frame(fd, hdr[0], payload, len);
+        }
+        if (!ok) {
+            break;
+        }
+    }
+    free(payload);
+}
+
+static void conn_task(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+
+    if (handshake(fd)) {
+        serve(fd);
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_last_fd == fd) {
+        s_last_fd = -1;
+    }
+    xSemaphoreGive(s_lock);
+    close(fd);
+    vTaskDelete(NULL);
+}
+
+static void accept_task(void *arg)
+{
+    while (true) {
+        int fd = accept(s_listen_fd, NULL, NULL);
+        if (fd < 0) {
+            vTaskDelay(pdMS_TO_TICKS(ACCEPT_RETRY_MS));
+            continue;
+        }
+        if (xTaskCreate(conn_task, "ws_test_conn", 4096, (void *)(intptr_t)fd, 5, NULL) != pdPASS) {
+            close(fd);
+        }
+    }
+}
+
+esp_err_t test_server_start(uint16_t port)
+{
+    if (s_listen_fd >= 0) {
+        return ESP_OK;
+    }
+    if (s_lock == NULL) {
+        s_lock = xSemaphoreCreateMutex();
+        if (s_lock == NULL) {
+            return ESP_FAIL;
+        }
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        close(fd);
+        return ESP_FAIL;
+    }
+    s_listen_fd = fd;
+    if (xTaskCreate(accept_task, "ws_test_srv", 3072, NULL, 5, NULL) != pdPASS) {
+        close(fd);
+        s_listen_fd = -1;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void test_server_clear_frames(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < s_frame_count; i++) {
+        free(s_frames[i].payload);
+    }
+    s_frame_count = 0;
+    xSemaphoreGive(s_lock);
+}
+
+int test_server_wait_frames(int count, int timeout_ms)
+{
+    for (int waited = 0; s_frame_count < count && waited < timeout_ms; waited += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return s_frame_count;
+}
+
+const test_server_frame_t *test_server_frame(int index)
+{
+    return (index >= 0 && index < s_frame_count) ? &s_frames[index] : NULL;
+}
+
+void test_server_set_extensions(const char *reply)
+{
+    s_extensions = reply;
+}
+
+void test_server_set_greeting(uint8_t first_byte, const void *payload, size_t len)
+{
+    s_greeting_byte = first_byte;
+    s_greeting = payload;
+    s_greeting_len = len < 126 ? len : 0;
+}
+
+esp_err_t test_server_send_frame(uint8_t first_byte, const void *payload, size_t len)
+{
+    int fd = s_last_fd;
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    return send_frame(fd, first_byte, payload, len) ? ESP_OK : ESP_FAIL;
+}
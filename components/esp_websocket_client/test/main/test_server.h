@@ -0,0 +1,79 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Frame received by the test server, payload already unmasked
+ */
+typedef struct {
+    uint8_t first_byte;     /*!< FIN, RSV and opcode bits as sent by the client */
+    size_t len;             /*!< Payload length */
+    uint8_t *payload;       /*!< Payload (NULL when len is 0) */
+} test_server_frame_t;
+
+/**
+ * @brief Start a WebSocket server on 127.0.0.1 (lwIP loopback), one task per connection
+ *
+ * Every data frame is recorded and echoed back unmasked with the same first byte; control
+ * frames are answered (PING -> PONG, CLOSE -> CLOSE). Calling it again once started is a no-op.
+ *
+ * @param port TCP port to listen on
+ * @return ESP_OK, or ESP_FAIL if the socket could not be bound
+ */
+esp_err_t test_server_start(uint16_t port);
+
+/**
+ * @brief Drop the recorded frames
+ */
+void test_server_clear_frames(void);
+
+/**
+ * @brief Wait until at least `count` data frames were recorded
+ *
+ * @return Number of recorded frames (less than count on timeout)
+ */
+int test_server_wait_frames(int count, int timeout_ms);
+
+/**
+ * @brief Recorded frame `index` (valid until test_server_clear_frames()), NULL if out of range
+ */
+const test_server_frame_t *test_server_frame(int index);
+
+/**
+ * @brief Value of the Sec-WebSocket-Extensions header in the next 101 responses
+ *
+ * @param reply Header value, kept by reference; NULL to decline every extension (default)
+ */
+void test_server_set_extensions(const char *reply);
+
+/**
+ * @brief Frame written in the same segment as the next 101 responses
+ *
+ * @param first_byte FIN, RSV and opcode bits
+ * @param payload Payload, kept by reference
+ * @param len Payload length, below 126; 0 to send nothing behind the response (default)
+ */
+void test_server_set_greeting(uint8_t first_byte, const void *payload, size_t len);
+
+/**
+ * @brief Send a frame with an arbitrary first byte (e.g. RSV1 set) on the last accepted connection
+ *
+ * @return ESP_OK, or ESP_FAIL if there is no connection or the write failed
+ */
+esp_err_t test_server_send_frame(uint8_t first_byte, const void *payload, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -11,11 +11,17 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <esp_websocket_client.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "esp_event.h"
+#include "esp_netif.h"
 #include "unity.h"
 #include "test_utils.h"
+#include "test_server.h"
 
 #include "unity_fixture.h"
 #include "memory_checks.h"
@@ -75,6 +81,510 @@ TEST_GROUP_RUNNER(websocket)
     RUN_TEST_CASE(websocket, websocket_init_deinit)
     RUN_TEST_CASE(websocket, websocket_init_invalid_url)
     RUN_TEST_CASE(websocket, websocket_set_invalid_url)
+    RUN_TEST_GROUP(websocket_loopback)
+}
+
+/*
+ * Loopback cases: the client talks to test_server.c over the lwIP loopback interface.
+ * Pool blocks and lwIP allocations outlive a test case, so this group skips the leak check.
+ */
+#define TEST_SERVER_PORT    8765
+#define TEST_SERVER_URI     "ws://127.0.0.1:8765"
+#define TEST_WAIT_MS        2000
+
+#define CONNECTED_BIT       BIT0
+#define DISCONNECTED_BIT    BIT1
+#define DATA_BIT            BIT2
+#define HELD_BIT            BIT3
+
+typedef struct {
+    EventGroupHandle_t events;
+    SemaphoreHandle_t release;      // When set, the DATA handler blocks on it and keeps the rx buffer
+    int data_events;
+    int opcode;                     // Opcode of the first frame of the last message
+    char data[256];
+    int data_len;
+} test_client_t;
+
+static void test_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    test_client_t *ctx = arg;
+    esp_websocket_event_data_t *data = event_data;
+
+    switch (event_id) {
+    case WEBSOCKET_EVENT_CONNECTED:
+        xEventGroupSetBits(ctx->events, CONNECTED_BIT);
+        break;
+    case WEBSOCKET_EVENT_DISCONNECTED:
+        xEventGroupSetBits(ctx->events, DISCONNECTED_BIT);
+        break;
+    case WEBSOCKET_EVENT_DATA:
+        if (data->op_code > WS_TRANSPORT_OPCODES_BINARY) {
+            break;
+        }
+        if (data->op_code != WS_TRANSPORT_OPCODES_CONT) {
+            ctx->opcode = data->op_code;
+        }
+        ctx->data_events++;
+        if (data->data_len > 0 && ctx->data_len + data->data_len <= (int)sizeof(ctx->data)) {
+            memcpy(ctx->data + ctx->data_len, data->data_ptr, data->data_len);
+            ctx->data_len += data->data_len;
+        }
+        if (data->fin && data->payload_offset + data->data_len >= data->payload_len) {
+            xEventGroupSetBits(ctx->events, DATA_BIT);
+        }
+        if (ctx->release) {
+            xEventGroupSetBits(ctx->events, HELD_BIT);
+            xSemaphoreTake(ctx->release, portMAX_DELAY);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static esp_websocket_client_handle_t test_client_connect(test_client_t *ctx, int buffer_size, bool deflate)
+{
+    const esp_websocket_client_config_t websocket_cfg = {
+        .uri = TEST_SERVER_URI,
+        .buffer_size = buffer_size,
+        .disable_auto_reconnect = true,
+        .permessage_deflate = deflate,
+    };
+    ctx->events = xEventGroupCreate();
+    TEST_ASSERT_NOT_NULL(ctx->events);
+    esp_websocket_client_handle_t client = esp_websocket_client_init(&websocket_cfg);
+    TEST_ASSERT_NOT_NULL(client);
+    TEST_ESP_OK(esp_websocket_register_events(client, WEBSOCKET_EVENT_ANY, test_event_handler, ctx));
+    TEST_ESP_OK(esp_websocket_client_start(client));
+    return client;
+}
+
+static esp_websocket_client_handle_t test_client_start(test_client_t *ctx, int buffer_size, bool deflate)
+{
+    esp_websocket_client_handle_t client = test_client_connect(ctx, buffer_size, deflate);
+    TEST_ASSERT_TRUE(xEventGroupWaitBits(ctx->events, CONNECTED_BIT, pdFALSE, pdTRUE,
+                                         pdMS_TO_TICKS(TEST_WAIT_MS)) & CONNECTED_BIT);
+    return client;
+}
+
+static void test_client_destroy(esp_websocket_client_handle_t client, test_client_t *ctx)
+{
+    esp_websocket_client_destroy(client);
+    vEventGroupDelete(ctx->events);
+}
+
+static void test_client_reset(test_client_t *ctx)
+{
+    xEventGroupClearBits(ctx->events, DATA_BIT | HELD_BIT);
+    ctx->data_events = 0;
+    ctx->opcode = -1;
+    ctx->data_len = 0;
+}
+
+static bool test_client_wait(test_client_t *ctx, EventBits_t bit)
+{
+    return xEventGroupWaitBits(ctx->events, bit, pdFALSE, pdTRUE, pdMS_TO_TICKS(TEST_WAIT_MS)) & bit;
+}
+
+static void fill_pattern(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = 'a' + (i * 7) % 26;
+    }
+}
+
+TEST_GROUP(websocket_loopback);
+
+TEST_SETUP(websocket_loopback)
+{
+    static bool netif_ready;
+    if (!netif_ready) {
+        TEST_ESP_OK(esp_netif_init());
+        netif_ready = true;
+    }
+    TEST_ESP_OK(test_server_start(TEST_SERVER_PORT));
+    test_server_clear_frames();
+}
+
+TEST_TEAR_DOWN(websocket_loopback)
+{
+    test_server_clear_frames();
+    test_server_set_extensions(NULL);
+    test_server_set_greeting(0, NULL, 0);
+}
+
+TEST(websocket_loopback, websocket_send_iov_segments)
+{
+    test_client_t ctx = {};
+    uint8_t msg[131];
+    fill_pattern(msg, sizeof(msg));
+    // Segment boundaries (10, 80, 81) fall inside the 64 byte frames, with empty segments in between
+    const esp_websocket_iov_t iov[] = {
+        { .base = msg, .len = 10 },
+        { .base = NULL, .len = 0 },
+        { .base = msg + 10, .len = 70 },
+        { .base = msg + 80, .len = 1 },
+        { .base = msg + 81, .len = 0 },
+        { .base = msg + 81, .len = 50 },
+    };
+    esp_websocket_client_handle_t client = test_client_start(&ctx, 64, false);
+
+    test_client_reset(&ctx);
+    TEST_ASSERT_EQUAL(sizeof(msg), esp_websocket_client_send_iov(client, WS_TRANSPORT_OPCODES_TEXT, iov,
+                                                                 sizeof(iov) / sizeof(iov[0]), portMAX_DELAY));
+    TEST_ASSERT_EQUAL(3, test_server_wait_frames(3, TEST_WAIT_MS));
+    const uint8_t first_bytes[] = { 0x01, 0x00, 0x80 };    // TEXT, CONT, CONT|FIN
+    const size_t lens[] = { 64, 64, 3 };
+    size_t offset = 0;
+    for (int i = 0; i < 3; i++) {
+        const test_server_frame_t *frame = test_server_frame(i);
+        TEST_ASSERT_EQUAL_HEX8(first_bytes[i], frame->first_byte);
+        TEST_ASSERT_EQUAL(lens[i], frame->len);
+        TEST_ASSERT_EQUAL_MEMORY(msg + offset, frame->payload, frame->len);
+        offset += frame->len;
+    }
+
+    // The echo comes back with the same fragmentation
+    TEST_ASSERT_TRUE(test_client_wait(&ctx, DATA_BIT));
+    TEST_ASSERT_EQUAL(WS_TRANSPORT_OPCODES_TEXT, ctx.opcode);
+    TEST_ASSERT_EQUAL(sizeof(msg), ctx.data_len);
+    TEST_ASSERT_EQUAL_MEMORY(msg, ctx.data, sizeof(msg));
+
+    // Only empty segments: a single empty frame
+    const esp_websocket_iov_t empty[] = {
+        { .base = NULL, .len = 0 },
+        { .base = msg, .len = 0 },
+    };
+    TEST_ASSERT_EQUAL(0, esp_websocket_client_send_iov(client, WS_TRANSPORT_OPCODES_BINARY, empty, 2, portMAX_DELAY));
+    TEST_ASSERT_EQUAL(4, test_server_wait_frames(4, TEST_WAIT_MS));
+    TEST_ASSERT_EQUAL_HEX8(0x82, test_server_frame(3)->first_byte);
+    TEST_ASSERT_EQUAL(0, test_server_frame(3)->len);
+
+    test_client_destroy(client, &ctx);
+}
+
+TEST(websocket_loopback, websocket_send_batch)
+{
+    test_client_t ctx = {};
+    uint8_t msg[100];
+    fill_pattern(msg, sizeof(msg));
+    // Three 20 byte frames (26 bytes on the wire each) share the 64 byte buffer two at a time,
+    // the last message does not fit and is fragmented like send_iov()
+    const esp_websocket_iov_t iov[][2] = {
+        { { .base = msg, .len = 10 }, { .base = msg + 10, .len = 10 } },
+        { { .base = msg + 20, .len = 10 }, { .base = msg + 30, .len = 10 } },
+        { { .base = msg + 40, .len = 20 }, { .base = NULL, .len = 0 } },
+        { { .base = msg, .len = 60 }, { .base = msg + 60, .len = 40 } },
+    };
+    const esp_websocket_message_t msgs[] = {
+        { .iov = iov[0], .iovcnt = 2 },
+        { .iov = iov[1], .iovcnt = 2 },
+        { .iov = iov[2], .iovcnt = 2 },
+        { .iov = iov[3], .iovcnt = 2 },
+    };
+    esp_websocket_client_handle_t client = test_client_start(&ctx, 64, false);
+
+    TEST_ASSERT_EQUAL(4, esp_websocket_client_send_batch(client, WS_TRANSPORT_OPCODES_TEXT, msgs, 4, portMAX_DELAY));
+    TEST_ASSERT_EQUAL(5, test_server_wait_frames(5, TEST_WAIT_MS));
+    for (int i = 0; i < 3; i++) {
+        const test_server_frame_t *frame = test_server_frame(i);
+        TEST_ASSERT_EQUAL_HEX8(0x81, frame->first_byte);
+        TEST_ASSERT_EQUAL(20, frame->len);
+        TEST_ASSERT_EQUAL_MEMORY(msg + 20 * i, frame->payload, 20);
+    }
+    TEST_ASSERT_EQUAL_HEX8(0x01, test_server_frame(3)->first_byte);
+    TEST_ASSERT_EQUAL(64, test_server_frame(3)->len);
+    TEST_ASSERT_EQUAL_MEMORY(msg, test_server_frame(3)->payload, 64);
+    TEST_ASSERT_EQUAL_HEX8(0x80, test_server_frame(4)->first_byte);
+    TEST_ASSERT_EQUAL(36, test_server_frame(4)->len);
+    TEST_ASSERT_EQUAL_MEMORY(msg + 64, test_server_frame(4)->payload, 36);
+
+    test_client_destroy(client, &ctx);
+}
+
+#ifdef CONFIG_ESP_WS_CLIENT_BUFFER_POOL
+#define POOL_CLIENTS    (CONFIG_ESP_WS_CLIENT_BUFFER_POOL_SLOTS + 1)
+
+TEST(websocket_loopback, websocket_buffer_pool_exhaustion)
+{
+    test_client_t ctx[POOL_CLIENTS] = {};
+    esp_websocket_client_handle_t clients[POOL_CLIENTS];
+    esp_websocket_buffer_stats_t before;
+    esp_websocket_buffer_stats_t stats;
+    char msg[16];
+
+    for (int i = 0; i < POOL_CLIENTS; i++) {
+        ctx[i].release = xSemaphoreCreateBinary();
+        TEST_ASSERT_NOT_NULL(ctx[i].release);
+        clients[i] = test_client_start(&ctx[i], 0, false);
+    }
+    TEST_ESP_OK(esp_websocket_client_get_buffer_stats(&before));
+
+    // Every client parks in its DATA handler holding its rx block, the last one finds the pool
+    // exhausted and must still get its data through a heap buffer
+    for (int i = 0; i < POOL_CLIENTS; i++) {
+        int len = snprintf(msg, sizeof(msg), "client %d", i);
+        test_client_reset(&ctx[i]);
+        TEST_ASSERT_EQUAL(len, esp_websocket_client_send_text(clients[i], msg, len, portMAX_DELAY));
+        TEST_ASSERT_TRUE(test_client_wait(&ctx[i], HELD_BIT));
+        TEST_ASSERT_EQUAL(len, ctx[i].data_len);
+        TEST_ASSERT_EQUAL_MEMORY(msg, ctx[i].data, len);
+    }
+    TEST_ESP_OK(esp_websocket_client_get_buffer_stats(&stats));
+    TEST_ASSERT_EQUAL(CONFIG_ESP_WS_CLIENT_BUFFER_POOL_SLOTS, stats.pool_in_use);
+    TEST_ASSERT_EQUAL(CONFIG_ESP_WS_CLIENT_BUFFER_POOL_SLOTS, stats.pool_blocks);
+    TEST_ASSERT_GREATER_THAN(before.pool_misses, stats.pool_misses);
+
+    // Overflow buffers go back to the heap, pool blocks stay allocated
+    for (int i = 0; i < POOL_CLIENTS; i++) {
+        xSemaphoreGive(ctx[i].release);
+    }
+    for (int waited = 0; waited < TEST_WAIT_MS; waited += 10) {
+        TEST_ESP_OK(esp_websocket_client_get_buffer_stats(&stats));
+        if (stats.pool_in_use == 0) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL(0, stats.pool_in_use);
+    TEST_ASSERT_EQUAL(CONFIG_ESP_WS_CLIENT_BUFFER_POOL_SLOTS, stats.pool_blocks);
+    TEST_ASSERT_EQUAL(CONFIG_ESP_WS_CLIENT_BUFFER_POOL_SLOTS * 1024, stats.bytes_allocated);   // default buffer_size
+
+    // With free blocks again the next cycle is served by the pool
+    before = stats;
+    test_client_reset(&ctx[0]);
+    xSemaphoreGive(ctx[0].release);
+    TEST_ASSERT_EQUAL(5, esp_websocket_client_send_text(clients[0], "again", 5, portMAX_DELAY));
+    TEST_ASSERT_TRUE(test_client_wait(&ctx[0], DATA_BIT));
+    TEST_ASSERT_EQUAL_MEMORY("again", ctx[0].data, 5);
+    TEST_ESP_OK(esp_websocket_client_get_buffer_stats(&stats));
+    TEST_ASSERT_GREATER_THAN(before.pool_hits, stats.pool_hits);
+    TEST_ASSERT_EQUAL(before.pool_misses, stats.pool_misses);
+
+    for (int i = 0; i < POOL_CLIENTS; i++) {
+        test_client_destroy(clients[i], &ctx[i]);
+        vSemaphoreDelete(ctx[i].release);
+    }
+}
+#endif
+
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+/*
+ * Raw deflate (window 2^9, sync flush with the 00 00 ff ff tail stripped) of s_msg1 and s_msg2,
+ * made with python zlib: s_msg2_takeover references s_msg1 (same compressor), s_msg2_deflated
+ * does not.
+ */
+static const char s_msg1[] = "{\"topic\":\"realtime:site\",\"event\":\"broadcast\",\"payload\":"
+                             "{\"state\":\"ARMED\",\"source\":\"GW-A1B2C3\",\"seq\":1}}";
+static const char s_msg2[] = "{\"topic\":\"realtime:site\",\"event\":\"broadcast\",\"payload\":"
+                             "{\"state\":\"ARMED\",\"source\":\"GW-A1B2C3\",\"seq\":2}}";
+
+static const uint8_t s_msg1_deflated[] = {
+    0xaa, 0x56, 0x2a, 0xc9, 0x2f, 0xc8, 0x4c, 0x56, 0xb2, 0x52, 0x2a, 0x4a,
+    0x4d, 0xcc, 0x29, 0xc9, 0xcc, 0x4d, 0xb5, 0x2a, 0xce, 0x2c, 0x49, 0x55,
+    0xd2, 0x51, 0x4a, 0x2d, 0x4b, 0xcd, 0x2b, 0x01, 0x8a, 0x27, 0x15, 0xe5,
+    0x27, 0xa6, 0x24, 0x27, 0x16, 0x97, 0x00, 0xc5, 0x0a, 0x12, 0x2b, 0x73,
+    0x80, 0x3c, 0x25, 0xab, 0x6a, 0xa5, 0xe2, 0x92, 0x44, 0xa0, 0x32, 0x2b,
+    0x25, 0xc7, 0x20, 0x5f, 0x57, 0x17, 0xa0, 0x54, 0x71, 0x7e, 0x69, 0x51,
+    0x32, 0x48, 0xc0, 0x3d, 0x5c, 0xd7, 0xd1, 0xd0, 0xc9, 0xc8, 0xd9, 0x18,
+    0x24, 0x98, 0x5a, 0xa8, 0x64, 0x65, 0x58, 0x5b, 0x0b, 0x00,
+};
+
+#ifndef CONFIG_ESP_WS_CLIENT_DEFLATE_NO_CONTEXT_TAKEOVER
+static const uint8_t s_msg2_takeover[] = {
+    0xaa, 0xa6, 0xbd, 0x2d, 0x46, 0xb5, 0xb5, 0x00, 0x00,
+};
+#else
+static const uint8_t s_msg2_deflated[] = {
+    0xaa, 0x56, 0x2a, 0xc9, 0x2f, 0xc8, 0x4c, 0x56, 0xb2, 0x52, 0x2a, 0x4a,
+    0x4d, 0xcc, 0x29, 0xc9, 0xcc, 0x4d, 0xb5, 0x2a, 0xce, 0x2c, 0x49, 0x55,
+    0xd2, 0x51, 0x4a, 0x2d, 0x4b, 0xcd, 0x2b, 0x01, 0x8a, 0x27, 0x15, 0xe5,
+    0x27, 0xa6, 0x24, 0x27, 0x16, 0x97, 0x00, 0xc5, 0x0a, 0x12, 0x2b, 0x73,
+    0x80, 0x3c, 0x25, 0xab, 0x6a, 0xa5, 0xe2, 0x92, 0x44, 0xa0, 0x32, 0x2b,
+    0x25, 0xc7, 0x20, 0x5f, 0x57, 0x17, 0xa0, 0x54, 0x71, 0x7e, 0x69, 0x51,
+    0x32, 0x48, 0xc0, 0x3d, 0x5c, 0xd7, 0xd1, 0xd0, 0xc9, 0xc8, 0xd9, 0x18,
+    0x24, 0x98, 0x5a, 0xa8, 0x64, 0x65, 0x54, 0x5b, 0x0b, 0x00,
+};
+#endif
+
+/*
+ * 300000 'a' deflated: 309 bytes on the wire, above any CONFIG_ESP_WS_CLIENT_DEFLATE_MAX_MESSAGE
+ * once inflated. The middle of the stream is all zero bytes.
+ */
+#define BOMB_DEFLATED_LEN   309
+static const uint8_t s_bomb_head[] = {
+    0xec, 0xc1, 0x01, 0x0d, 0x00, 0x00, 0x00, 0xc2, 0xa0, 0xac, 0xef, 0x5f, 0xc2, 0x1e, 0x0e, 0x28,
+};
+static const uint8_t s_bomb_tail[] = { 0xf8, 0x31, 0x00 };
+
+// The test messages use a 2^9 window, the smallest CONFIG_ESP_WS_CLIENT_DEFLATE_WINDOW_BITS
+#ifdef CONFIG_ESP_WS_CLIENT_DEFLATE_NO_CONTEXT_TAKEOVER
+#define DEFLATE_REPLY   "permessage-deflate; server_no_context_takeover; server_max_window_bits=9"
+#else
+#define DEFLATE_REPLY   "permessage-deflate; server_max_window_bits=9"
+#endif
+
+TEST(websocket_loopback, websocket_deflate_fragmented)
+{
+    test_client_t ctx = {};
+    esp_websocket_deflate_stats_t stats;
+    test_server_set_extensions(DEFLATE_REPLY);
+    esp_websocket_client_handle_t client = test_client_start(&ctx, 64, true);
+
+    // RSV1 only on the first frame; the message is dispatched once, inflated
+    test_client_reset(&ctx);
+    TEST_ESP_OK(test_server_send_frame(0x41, s_msg1_deflated, 30));                     // TEXT|RSV1
+    TEST_ESP_OK(test_server_send_frame(0x00, s_msg1_deflated + 30, 30));                // CONT
+    TEST_ESP_OK(test_server_send_frame(0x80, s_msg1_deflated + 60, sizeof(s_msg1_deflated) - 60));  // CONT|FIN
+    TEST_ASSERT_TRUE(test_client_wait(&ctx, DATA_BIT));
+    TEST_ASSERT_EQUAL(1, ctx.data_events);
+    TEST_ASSERT_EQUAL(WS_TRANSPORT_OPCODES_TEXT, ctx.opcode);
+    TEST_ASSERT_EQUAL(strlen(s_msg1), ctx.data_len);
+    TEST_ASSERT_EQUAL_MEMORY(s_msg1, ctx.data, ctx.data_len);
+
+    // Uncompressed messages still pass through as they are
+    test_client_reset(&ctx);
+    TEST_ESP_OK(test_server_send_frame(0x81, "plain", 5));
+    TEST_ASSERT_TRUE(test_client_wait(&ctx, DATA_BIT));
+    TEST_ASSERT_EQUAL_MEMORY("plain", ctx.data, 5);
+
+    TEST_ESP_OK(esp_websocket_client_get_deflate_stats(client, &stats));
+    TEST_ASSERT_TRUE(stats.negotiated);
+    TEST_ASSERT_TRUE(stats.active);
+    TEST_ASSERT_EQUAL(1, stats.messages);
+    TEST_ASSERT_EQUAL(1, stats.plain_messages);
+    TEST_ASSERT_EQUAL(sizeof(s_msg1_deflated), stats.wire_bytes);
+    TEST_ASSERT_EQUAL(strlen(s_msg1), stats.inflated_bytes);
+    TEST_ASSERT_EQUAL(0, stats.errors);
+
+    test_client_destroy(client, &ctx);
+}
+
+TEST(websocket_loopback, websocket_deflate_context_takeover)
+{
+    test_client_t ctx = {};
+    esp_websocket_deflate_stats_t stats;
+    test_server_set_extensions(DEFLATE_REPLY);
+    esp_websocket_client_handle_t client = test_client_start(&ctx, 0, true);
+
+    test_client_reset(&ctx);
+    TEST_ESP_OK(test_server_send_frame(0xC1, s_msg1_deflated, sizeof(s_msg1_deflated)));   // TEXT|RSV1|FIN
+    TEST_ASSERT_TRUE(test_client_wait(&ctx, DATA_BIT));
+    TEST_ASSERT_EQUAL_MEMORY(s_msg1, ctx.data, strlen(s_msg1));
+
+    // With context takeover the second message is a back reference into the first one
+    test_client_reset(&ctx);
+#ifndef CONFIG_ESP_WS_CLIENT_DEFLATE_NO_CONTEXT_TAKEOVER
+    TEST_ESP_OK(test_server_send_frame(0xC1, s_msg2_takeover, sizeof(s_msg2_takeover)));
+#else
+    TEST_ESP_OK(test_server_send_frame(0xC1, s_msg2_deflated, sizeof(s_msg2_deflated)));
+#endif
+    TEST_ASSERT_TRUE(test_client_wait(&ctx, DATA_BIT));
+    TEST_ASSERT_EQUAL(1, ctx.data_events);
+    TEST_ASSERT_EQUAL(strlen(s_msg2), ctx.data_len);
+    TEST_ASSERT_EQUAL_MEMORY(s_msg2, ctx.data, ctx.data_len);
+
+    TEST_ESP_OK(esp_websocket_client_get_deflate_stats(client, &stats));
+    TEST_ASSERT_EQUAL(2, stats.messages);
+    TEST_ASSERT_EQUAL(0, stats.errors);
+
+    test_client_destroy(client, &ctx);
+}
+
+TEST(websocket_loopback, websocket_deflate_oversize)
+{
+    test_client_t ctx = {};
+    esp_websocket_deflate_stats_t stats;
+    uint8_t *bomb = calloc(1, BOMB_DEFLATED_LEN);
+    TEST_ASSERT_NOT_NULL(bomb);
+    memcpy(bomb, s_bomb_head, sizeof(s_bomb_head));
+    memcpy(bomb + BOMB_DEFLATED_LEN - sizeof(s_bomb_tail), s_bomb_tail, sizeof(s_bomb_tail));
+    test_server_set_extensions(DEFLATE_REPLY);
+    esp_websocket_client_handle_t client = test_client_start(&ctx, 0, true);
+
+    // Inflating beyond the cap is an error: nothing is dispatched and the connection is dropped
+    test_client_reset(&ctx);
+    TEST_ESP_OK(test_server_send_frame(0xC1, bomb, BOMB_DEFLATED_LEN));
+    TEST_ASSERT_TRUE(test_client_wait(&ctx, DISCONNECTED_BIT));
+    TEST_ASSERT_EQUAL(0, ctx.data_events);
+
+    TEST_ESP_OK(esp_websocket_client_get_deflate_stats(client, &stats));
+    TEST_ASSERT_EQUAL(1, stats.oversize);
+    TEST_ASSERT_EQUAL(0, stats.messages);
+
+    test_client_destroy(client, &ctx);
+    free(bomb);
+}
+
+TEST(websocket_loopback, websocket_deflate_frame_with_upgrade)
+{
+    test_client_t ctx = {};
+    test_server_set_extensions(DEFLATE_REPLY);
+    test_server_set_greeting(0xC1, s_msg1_deflated, sizeof(s_msg1_deflated));   // TEXT|RSV1|FIN
+
+    // The frame shares a segment with the 101 response and must not be lost in the handshake
+    esp_websocket_client_handle_t client = test_client_start(&ctx, 0, true);
+    TEST_ASSERT_TRUE(test_client_wait(&ctx, DATA_BIT));
+    TEST_ASSERT_EQUAL(1, ctx.data_events);
+    TEST_ASSERT_EQUAL(strlen(s_msg1), ctx.data_len);
+    TEST_ASSERT_EQUAL_MEMORY(s_msg1, ctx.data, ctx.data_len);
+
+    test_client_destroy(client, &ctx);
+}
+
+TEST(websocket_loopback, websocket_deflate_declined)
+{
+    test_client_t ctx = {};
+    esp_websocket_deflate_stats_t stats;
+    esp_websocket_client_handle_t client = test_client_start(&ctx, 0, true);
+
+    TEST_ESP_OK(esp_websocket_client_get_deflate_stats(client, &stats));
+    TEST_ASSERT_FALSE(stats.negotiated);
+
+    // Without the extension RSV1 is a protocol error
+    test_client_reset(&ctx);
+    TEST_ESP_OK(test_server_send_frame(0xC1, s_msg1_deflated, sizeof(s_msg1_deflated)));
+    TEST_ASSERT_TRUE(test_client_wait(&ctx, DISCONNECTED_BIT));
+    TEST_ASSERT_EQUAL(0, ctx.data_events);
+
+    test_client_destroy(client, &ctx);
+}
+
+TEST(websocket_loopback, websocket_deflate_unexpected_reply)
+{
+    test_client_t ctx = {};
+    // Unknown parameters, an invalid window and an extension that was not offered are refused
+    static const char *replies[] = {
+        "permessage-deflate; server_no_context_takeover; server_max_window_bits=9; x-unknown",
+        "permessage-deflate; server_no_context_takeover; server_max_window_bits=7",
+        "x-webkit-deflate-frame",
+    };
+    for (size_t i = 0; i < sizeof(replies) / sizeof(replies[0]); i++) {
+        test_server_set_extensions(replies[i]);
+        esp_websocket_client_handle_t client = test_client_connect(&ctx, 0, true);
+        TEST_ASSERT_TRUE(test_client_wait(&ctx, DISCONNECTED_BIT));
+        TEST_ASSERT_FALSE(xEventGroupGetBits(ctx.events) & CONNECTED_BIT);
+        test_client_destroy(client, &ctx);
+    }
+}
+#endif
+
+TEST_GROUP_RUNNER(websocket_loopback)
+{
+    RUN_TEST_CASE(websocket_loopback, websocket_send_iov_segments)
+    RUN_TEST_CASE(websocket_loopback, websocket_send_batch)
+#ifdef CONFIG_ESP_WS_CLIENT_BUFFER_POOL
+    RUN_TEST_CASE(websocket_loopback, websocket_buffer_pool_exhaustion)
+#endif
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+    RUN_TEST_CASE(websocket_loopback, websocket_deflate_fragmented)
+    RUN_TEST_CASE(websocket_loopback, websocket_deflate_context_takeover)
+    RUN_TEST_CASE(websocket_loopback, websocket_deflate_oversize)
+    RUN_TEST_CASE(websocket_loopback, websocket_deflate_frame_with_upgrade)
+    RUN_TEST_CASE(websocket_loopback, websocket_deflate_declined)
+    RUN_TEST_CASE(websocket_loopback, websocket_deflate_unexpected_reply)
+#endif
 }
 
 void app_main(void)
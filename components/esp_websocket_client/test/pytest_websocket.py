@@ -1,8 +1,10 @@
 # SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
 # SPDX-License-Identifier: Apache-2.0
 
+import pytest
 from pytest_embedded import Dut
 
 
+@pytest.mark.parametrize('config', ['default', 'pool', 'deflate', 'deflate_no_takeover'], indirect=True)
 def test_websocket(dut: Dut) -> None:
     dut.expect_unity_test_output()
@@ -0,0 +1,654 @@
+/**
+ * @file fakes.c
+ * @brief esp-mqtt, supabase_client, command_processor y device_identity para el target linux
+ *
+ * esp_timer está en host_test_support (sim_clock.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "mqtt_client.h"
+#include "esp_timer.h"
+#include "esp_crt_bundle.h"
+#include "supabase_client.h"
+#include "command_processor.h"
+#include "device_identity.h"
+#include "sim_mqtt.h"
+
+#define SIM_MQTT_DEFAULT_PORT       1883
+#define SIM_MQTT_POLL_MS            50
+#define SIM_MQTT_CONNACK_MS         5000
+#define SIM_MQTT_CLIENT_ID_LEN      64
+#define SIM_MQTT_CREDENTIAL_LEN     64
+#define SIM_MQTT_MAX_HELD_ACKS      16
+
+#define MQTT_CONNECT        0x10
+#define MQTT_CONNACK        0x20
+#define MQTT_PUBLISH        0x30
+#define MQTT_PUBACK         0x40
+#define MQTT_SUBSCRIBE      0x82
+#define MQTT_SUBACK         0x90
+#define MQTT_PINGREQ        0xC0
+#define MQTT_PINGRESP       0xD0
+#define MQTT_DISCONNECT     0xE0
+
+struct esp_mqtt_client {
+    char client_id[SIM_MQTT_CLIENT_ID_LEN];
+    char username[SIM_MQTT_CREDENTIAL_LEN];     // "" = CONNECT sin credenciales
+    char password[SIM_MQTT_CREDENTIAL_LEN];
+    uint16_t port;
+    bool clean_session;
+    int keepalive_s;
+    int reconnect_ms;
+    int buffer_size;
+    esp_event_handler_t handler;
+    void *handler_arg;
+    SemaphoreHandle_t write_lock;
+    SemaphoreHandle_t stopped;
+    volatile bool running;
+    volatile int fd;
+    volatile bool connected;
+    uint16_t next_id;
+    uint32_t subscribes;
+    int64_t last_tx_us;
+    struct esp_mqtt_client *next;
+};
+
+typedef struct {
+    esp_mqtt_client_handle_t client;
+    int msg_id;
+} held_ack_t;
+
+static esp_mqtt_client_handle_t s_clients = NULL;
+static SemaphoreHandle_t s_clients_lock = NULL;
+static volatile bool s_reachable = true;
+static volatile bool s_hold_acks = false;
+static held_ack_t s_held[SIM_MQTT_MAX_HELD_ACKS];
+static int s_held_count = 0;
+
+static supabase_event_sender_t s_sender = NULL;
+static supabase_event_transport_t s_transport = SUPABASE_EVENT_TRANSPORT_HTTPS;
+static char s_commands[SIM_MAX_COMMANDS][SIM_COMMAND_LEN];
+static int s_command_count = 0;
+
+// ============================================================================
+// Paquetes MQTT
+// ============================================================================
+
+static void dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_t *event)
+{
+    event->client = client;
+    if (client->handler) {
+        client->handler(client->handler_arg, "MQTT_EVENTS", event->event_id, event);
+    }
+}
+
+static bool write_all(int fd, const uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = recv(fd, buf, len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static size_t put_len(uint8_t *p, size_t len)
+{
+    size_t n = 0;
+    do {
+        uint8_t byte = len % 128;
+        len /= 128;
+        p[n++] = byte | (len ? 0x80 : 0);
+    } while (len);
+    return n;
+}
+
+static size_t put_str(uint8_t *p, const char *s, size_t len)
+{
+    p[0] = len >> 8;
+    p[1] = len & 0xFF;
+    memcpy(p + 2, s, len);
+    return len + 2;
+}
+
+/**
+ * @brief Envía un paquete (header fijo + cuerpo) con el lock de escritura
+ */
+static bool send_packet(esp_mqtt_client_handle_t client, uint8_t first_byte, const uint8_t *body, size_t len)
+{
+    uint8_t header[5];
+    header[0] = first_byte;
+    size_t header_len = 1 + put_len(header + 1, len);
+
+    xSemaphoreTake(client->write_lock, portMAX_DELAY);
+    int fd = client->fd;
+    bool ok = fd >= 0 && write_all(fd, header, header_len) && (len == 0 || write_all(fd, body, len));
+    client->last_tx_us = esp_timer_get_time();
+    xSemaphoreGive(client->write_lock);
+    return ok;
+}
+
+/**
+ * @brief Lee un paquete completo; el cuerpo queda en *body (liberar con free)
+ */
+static bool read_packet(int fd, uint8_t *first_byte, uint8_t **body, size_t *len)
+{
+    uint8_t byte;
+    if (!read_all(fd, first_byte, 1)) {
+        return false;
+    }
+    size_t total = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+        if (!read_all(fd, &byte, 1)) {
+            return false;
+        }
+        total |= (size_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    *body = malloc(total + 1);
+    if (*body == NULL || !read_all(fd, *body, total)) {
+        free(*body);
+        return false;
+    }
+    *len = total;
+    return true;
+}
+
+static bool wait_readable(int fd, int timeout_ms)
+{
+    struct pollfd p = { .fd = fd, .events = POLLIN };
+    return poll(&p, 1, timeout_ms) > 0;
+}
+
+/**
+ * @brief CONNECT y espera del CONNACK
+ *
+ * @return Código de retorno del CONNACK, o -1 si no llegó
+ */
+static int handshake(esp_mqtt_client_handle_t client, int *session_present)
+{
+    uint8_t body[16 + SIM_MQTT_CLIENT_ID_LEN + 2 * SIM_MQTT_CREDENTIAL_LEN];
+    size_t n = put_str(body, "MQTT", 4);
+    body[n++] = 4;                                          // MQTT 3.1.1
+    body[n++] = (client->clean_session ? 0x02 : 0x00) |
+                (client->username[0] ? 0x80 : 0x00) | (client->password[0] ? 0x40 : 0x00);
+    body[n++] = client->keepalive_s >> 8;
+    body[n++] = client->keepalive_s & 0xFF;
+    n += put_str(body + n, client->client_id, strlen(client->client_id));
+    if (client->username[0]) {
+        n += put_str(body + n, client->username, strlen(client->username));
+    }
+    if (client->password[0]) {
+        n += put_str(body + n, client->password, strlen(client->password));
+    }
+    if (!send_packet(client, MQTT_CONNECT, body, n) || !wait_readable(client->fd, SIM_MQTT_CONNACK_MS)) {
+        return -1;
+    }
+
+    uint8_t first_byte;
+    uint8_t *ack;
+    size_t len;
+    if (!read_packet(client->fd, &first_byte, &ack, &len)) {
+        return -1;
+    }
+    int rc = (first_byte == MQTT_CONNACK && len == 2) ? ack[1] : -1;
+    *session_present = ack[0] & 0x01;
+    free(ack);
+    return rc;
+}
+
+static void handle_publish(esp_mqtt_client_handle_t client, uint8_t first_byte, uint8_t *body, size_t len)
+{
+    int qos = (first_byte >> 1) & 0x03;
+    size_t topic_len = (body[0] << 8) | body[1];
+    size_t pos = 2 + topic_len;
+    int msg_id = 0;
+    if (qos > 0) {
+        msg_id = (body[pos] << 8) | body[pos + 1];
+        pos += 2;
+        send_packet(client, MQTT_PUBACK, body + pos - 2, 2);
+    }
+
+    // Como esp-mqtt: lo que no entra en buffer.size llega en varios eventos,
+    // con el topic solo en el primero
+    size_t total = len - pos;
+    size_t offset = 0;
+    do {
+        size_t chunk = total - offset;
+        if (chunk > (size_t)client->buffer_size) {
+            chunk = client->buffer_size;
+        }
+        esp_mqtt_event_t event = {
+            .event_id = MQTT_EVENT_DATA,
+            .topic = offset == 0 ? (char *)body + 2 : NULL,
+            .topic_len = offset == 0 ? (int)topic_len : 0,
+            .data = (char *)body + pos + offset,
+            .data_len = (int)chunk,
+            .total_data_len = (int)total,
+            .current_data_offset = (int)offset,
+            .msg_id = msg_id,
+            .qos = qos,
+            .dup = (first_byte & 0x08) != 0,
+        };
+        dispatch(client, &event);
+        offset += chunk;
+    } while (offset < total);
+}
+
+static void handle_puback(esp_mqtt_client_handle_t client, int msg_id)
+{
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    bool held = s_hold_acks && s_held_count < SIM_MQTT_MAX_HELD_ACKS;
+    if (held) {
+        s_held[s_held_count].client = client;
+        s_held[s_held_count].msg_id = msg_id;
+        s_held_count++;
+    }
+    xSemaphoreGive(s_clients_lock);
+    if (!held) {
+        esp_mqtt_event_t event = { .event_id = MQTT_EVENT_PUBLISHED, .msg_id = msg_id };
+        dispatch(client, &event);
+    }
+}
+
+/**
+ * @brief Atiende la conexión hasta que se corta o se detiene el cliente
+ */
+static void serve(esp_mqtt_client_handle_t client)
+{
+    while (client->running) {
+        if (!wait_readable(client->fd, SIM_MQTT_POLL_MS)) {
+            if (esp_timer_get_time() - client->last_tx_us >= (int64_t)client->keepalive_s * 1000000) {
+                send_packet(client, MQTT_PINGREQ, NULL, 0);
+            }
+            continue;
+        }
+
+        uint8_t first_byte;
+        uint8_t *body;
+        size_t len;
+        if (!read_packet(client->fd, &first_byte, &body, &len)) {
+            return;
+        }
+        switch (first_byte & 0xF0) {
+            case MQTT_PUBLISH:
+                handle_publish(client, first_byte, body, len);
+                break;
+            case MQTT_PUBACK:
+                handle_puback(client, (body[0] << 8) | body[1]);
+                break;
+            case MQTT_SUBACK & 0xF0: {
+                esp_mqtt_event_t event = { .event_id = MQTT_EVENT_SUBSCRIBED, .msg_id = (body[0] << 8) | body[1] };
+                dispatch(client, &event);
+                break;
+            }
+            default:
+                break;
+        }
+        free(body);
+    }
+
+    // Detenido con esp_mqtt_client_stop(): DISCONNECT, la sesión persistente sigue en el broker
+    send_packet(client, MQTT_DISCONNECT, NULL, 0);
+}
+
+static int open_socket(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (connect(fd, (struct sockaddr *)&to, sizeof(to)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void client_task(void *arg)
+{
+    esp_mqtt_client_handle_t client = arg;
+
+    while (client->running) {
+        int session_present = 0;
+        int fd = s_reachable ? open_socket(client->port) : -1;
+        client->fd = fd;
+        int rc = fd >= 0 ? handshake(client, &session_present) : -1;
+        if (rc == MQTT_CONNECTION_ACCEPTED) {
+            client->connected = true;
+            esp_mqtt_event_t event = { .event_id = MQTT_EVENT_CONNECTED, .session_present = session_present };
+            dispatch(client, &event);
+            serve(client);
+        } else if (rc > 0) {
+            // Como esp-mqtt: CONNACK con error, reintento tras reconnect_timeout_ms
+            esp_mqtt_error_codes_t error = {
+                .error_type = MQTT_ERROR_TYPE_CONNECTION_REFUSED,
+                .connect_return_code = rc,
+            };
+            esp_mqtt_event_t event = { .event_id = MQTT_EVENT_ERROR, .error_handle = &error };
+            dispatch(client, &event);
+        } else {
+            esp_mqtt_error_codes_t error = { .error_type = MQTT_ERROR_TYPE_TCP_TRANSPORT };
+            esp_mqtt_event_t event = { .event_id = MQTT_EVENT_ERROR, .error_handle = &error };
+            dispatch(client, &event);
+        }
+
+        xSemaphoreTake(client->write_lock, portMAX_DELAY);
+        client->fd = -1;
+        client->connected = false;
+        xSemaphoreGive(client->write_lock);
+        if (fd >= 0) {
+            close(fd);
+        }
+        esp_mqtt_event_t event = { .event_id = MQTT_EVENT_DISCONNECTED };
+        dispatch(client, &event);
+
+        for (int waited = 0; client->running && waited < client->reconnect_ms; waited += SIM_MQTT_POLL_MS) {
+            vTaskDelay(pdMS_TO_TICKS(SIM_MQTT_POLL_MS));
+        }
+    }
+
+    xSemaphoreGive(client->stopped);
+    vTaskDelete(NULL);
+}
+
+// ============================================================================
+// esp-mqtt
+// ============================================================================
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    if (s_clients_lock == NULL) {
+        s_clients_lock = xSemaphoreCreateMutex();
+    }
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(*client));
+    if (client == NULL) {
+        return NULL;
+    }
+
+    const char *port = config->broker.address.uri ? strrchr(config->broker.address.uri, ':') : NULL;
+    client->port = (port && port[1] != '/') ? atoi(port + 1) : SIM_MQTT_DEFAULT_PORT;
+    snprintf(client->client_id, sizeof(client->client_id), "%s",
+             config->credentials.client_id ? config->credentials.client_id : "sim-client");
+    snprintf(client->username, sizeof(client->username), "%s",
+             config->credentials.username ? config->credentials.username : "");
+    snprintf(client->password, sizeof(client->password), "%s",
+             config->credentials.authentication.password ? config->credentials.authentication.password : "");
+    client->clean_session = !config->session.disable_clean_session;
+    client->keepalive_s = config->session.keepalive > 0 ? config->session.keepalive : 120;
+    client->reconnect_ms = config->network.reconnect_timeout_ms > 0 ? config->network.reconnect_timeout_ms : 10000;
+    client->buffer_size = config->buffer.size > 0 ? config->buffer.size : 1024;
+    client->fd = -1;
+    client->write_lock = xSemaphoreCreateMutex();
+    client->stopped = xSemaphoreCreateBinary();
+
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    client->next = s_clients;
+    s_clients = client;
+    xSemaphoreGive(s_clients_lock);
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (client->running) {
+        return ESP_FAIL;
+    }
+    client->running = true;
+    if (xTaskCreate(client_task, "sim_mqtt", 6144, client, 5, NULL) != pdPASS) {
+        client->running = false;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    if (!client->running) {
+        return ESP_FAIL;
+    }
+    client->running = false;
+    xSemaphoreTake(client->stopped, portMAX_DELAY);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    if (client->running) {
+        esp_mqtt_client_stop(client);
+    }
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    for (esp_mqtt_client_handle_t *p = &s_clients; *p; p = &(*p)->next) {
+        if (*p == client) {
+            *p = client->next;
+            break;
+        }
+    }
+    for (int i = 0; i < s_held_count; i++) {
+        if (s_held[i].client == client) {
+            s_held[i--] = s_held[--s_held_count];
+        }
+    }
+    xSemaphoreGive(s_clients_lock);
+    vSemaphoreDelete(client->write_lock);
+    vSemaphoreDelete(client->stopped);
+    free(client);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    size_t topic_len = strlen(topic);
+    uint8_t *body = malloc(topic_len + 5);
+    if (body == NULL || !client->connected) {
+        free(body);
+        return -1;
+    }
+    xSemaphoreTake(client->write_lock, portMAX_DELAY);
+    int msg_id = client->next_id = client->next_id % 65535 + 1;
+    xSemaphoreGive(client->write_lock);
+
+    body[0] = msg_id >> 8;
+    body[1] = msg_id & 0xFF;
+    size_t n = 2 + put_str(body + 2, topic, topic_len);
+    body[n++] = qos;
+    bool ok = send_packet(client, MQTT_SUBSCRIBE, body, n);
+    free(body);
+    if (!ok) {
+        return -1;
+    }
+    client->subscribes++;
+    return msg_id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain)
+{
+    if (len == 0 && data) {
+        len = strlen(data);
+    }
+    size_t topic_len = strlen(topic);
+    uint8_t *body = malloc(topic_len + 4 + len);
+    if (body == NULL || !client->connected) {
+        free(body);
+        return -1;
+    }
+
+    int msg_id = 0;
+    size_t n = put_str(body, topic, topic_len);
+    if (qos > 0) {
+        xSemaphoreTake(client->write_lock, portMAX_DELAY);
+        msg_id = client->next_id = client->next_id % 65535 + 1;
+        xSemaphoreGive(client->write_lock);
+        body[n++] = msg_id >> 8;
+        body[n++] = msg_id & 0xFF;
+    }
+    memcpy(body + n, data, len);
+    bool ok = send_packet(client, MQTT_PUBLISH | (qos << 1) | (retain ? 1 : 0), body, n + len);
+    free(body);
+    return ok ? msg_id : -1;
+}
+
+// ============================================================================
+// Simulación
+// ============================================================================
+
+void sim_mqtt_set_reachable(bool reachable)
+{
+    s_reachable = reachable;
+    if (reachable) {
+        return;
+    }
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    for (esp_mqtt_client_handle_t c = s_clients; c; c = c->next) {
+        int fd = c->fd;
+        if (fd >= 0) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    xSemaphoreGive(s_clients_lock);
+}
+
+void sim_mqtt_hold_acks(bool hold)
+{
+    held_ack_t held[SIM_MQTT_MAX_HELD_ACKS];
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    s_hold_acks = hold;
+    int count = hold ? 0 : s_held_count;
+    memcpy(held, s_held, count * sizeof(held_ack_t));
+    if (!hold) {
+        s_held_count = 0;
+    }
+    xSemaphoreGive(s_clients_lock);
+
+    for (int i = 0; i < count; i++) {
+        esp_mqtt_event_t event = { .event_id = MQTT_EVENT_PUBLISHED, .msg_id = held[i].msg_id };
+        dispatch(held[i].client, &event);
+    }
+}
+
+uint32_t sim_mqtt_subscribes(const char *client_id)
+{
+    uint32_t count = 0;
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    for (esp_mqtt_client_handle_t c = s_clients; c; c = c->next) {
+        if (strcmp(c->client_id, client_id) == 0) {
+            count += c->subscribes;
+        }
+    }
+    xSemaphoreGive(s_clients_lock);
+    return count;
+}
+
+supabase_event_sender_t sim_events_sender(void)
+{
+    return s_sender;
+}
+
+supabase_event_transport_t sim_events_transport(void)
+{
+    return s_transport;
+}
+
+int sim_commands_count(void)
+{
+    return s_command_count;
+}
+
+const char *sim_command(int index)
+{
+    return (index >= 0 && index < s_command_count) ? s_commands[index] : NULL;
+}
+
+void sim_commands_clear(void)
+{
+    s_command_count = 0;
+}
+
+// ============================================================================
+// Dependencias de mqtt_backend
+// ============================================================================
+
+esp_err_t esp_crt_bundle_attach(void *conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t supabase_set_event_sender(supabase_event_transport_t transport,
+                                    supabase_event_sender_t sender, void *user_data)
+{
+    s_sender = sender;
+    return ESP_OK;
+}
+
+esp_err_t supabase_set_event_transport(supabase_event_transport_t transport)
+{
+    s_transport = transport;
+    return ESP_OK;
+}
+
+esp_err_t supabase_get_event_stats(supabase_event_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    return ESP_OK;
+}
+
+esp_err_t command_processor_submit(const char *command_id, const char *command,
+                                   const char *created_at, command_source_t source)
+{
+    if (s_command_count < SIM_MAX_COMMANDS) {
+        snprintf(s_commands[s_command_count++], SIM_COMMAND_LEN, "%s:%s:%s:%d",
+                 command_id, command, created_at ? created_at : "-", (int)source);
+    }
+    return ESP_OK;
+}
+
+esp_err_t device_identity_get_id(char *device_id)
+{
+    strcpy(device_id, SIM_DEVICE_ID);
+    return ESP_OK;
+}
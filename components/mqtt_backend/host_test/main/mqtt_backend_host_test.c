@@ -0,0 +1,25 @@
+/**
+ * @file mqtt_backend_host_test.c
+ * @brief Pruebas de host del componente mqtt_backend
+ */
+
+#include <stdlib.h>
+#include "unity.h"
+#include "mqtt_backend_host_test.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    test_broker_run();
+    test_bench_run();
+    int failures = UNITY_END();
+    exit(failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,19 @@
+/**
+ * @file mqtt_backend_host_test.h
+ * @brief Grupos de pruebas de host de mqtt_backend
+ */
+
+#ifndef MQTT_BACKEND_HOST_TEST_H
+#define MQTT_BACKEND_HOST_TEST_H
+
+/**
+ * @brief Contra mqtt_broker.py: suscripción, PUBACK, comandos, sesión persistente
+ */
+void test_broker_run(void);
+
+/**
+ * @brief Latencia y throughput: MQTT de a uno y en lotes contra HTTP por evento
+ */
+void test_bench_run(void);
+
+#endif // MQTT_BACKEND_HOST_TEST_H
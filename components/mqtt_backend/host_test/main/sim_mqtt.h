@@ -0,0 +1,79 @@
+/**
+ * @file sim_mqtt.h
+ * @brief Cliente esp-mqtt, red y dependencias simuladas para las pruebas de mqtt_backend
+ *
+ * mqtt_backend.c se compila sin cambios; fakes.c implementa la API de
+ * esp-mqtt con un cliente MQTT 3.1.1 sobre un socket TCP a 127.0.0.1 (el
+ * host de la URI se ignora, el puerto no, y mqtts:// también va sin
+ * cifrar), con usuario y contraseña en el CONNECT si se configuraron y un
+ * MQTT_EVENT_ERROR de tipo CONNECTION_REFUSED si el CONNACK trae un error.
+ * Hay una tarea por cliente que conecta, atiende los paquetes, manda
+ * PINGREQ y reconecta tras reconnect_timeout_ms. Los mensajes más grandes
+ * que buffer.size se entregan en partes, como esp-mqtt. No tiene outbox: publicar sin
+ * conexión devuelve -1 y un PUBLISH sin PUBACK no se reenvía al reconectar.
+ *
+ * También reemplaza supabase_client (registro del sender), command_processor
+ * (anota los comandos recibidos) y device_identity (SIM_DEVICE_ID).
+ */
+
+#ifndef SIM_MQTT_H
+#define SIM_MQTT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "supabase_client.h"
+
+#define SIM_DEVICE_ID           "GHOST-HOST01"
+#define SIM_BROKER_URI          "mqtts://127.0.0.1:1883"
+#define SIM_BROKER_USERNAME     "ghost"         // Credenciales que exige mqtt_broker.py --auth
+#define SIM_BROKER_PASSWORD     "ghost-host"
+#define SIM_MAX_COMMANDS        16
+#define SIM_COMMAND_LEN         96
+
+/**
+ * @brief Red al broker disponible o no
+ *
+ * Con false se cortan las conexiones abiertas (sin DISCONNECT, como una
+ * caída de la red) y los reintentos fallan hasta volver a true. El broker
+ * conserva las sesiones persistentes mientras tanto.
+ */
+void sim_mqtt_set_reachable(bool reachable);
+
+/**
+ * @brief Retiene los avisos de PUBACK (MQTT_EVENT_PUBLISHED)
+ *
+ * Con false se entregan los retenidos, como PUBACK que llegan tarde.
+ */
+void sim_mqtt_hold_acks(bool hold);
+
+/**
+ * @brief SUBSCRIBE enviados por el cliente con ese client id
+ */
+uint32_t sim_mqtt_subscribes(const char *client_id);
+
+/**
+ * @brief Sender registrado por mqtt_backend en supabase_client (NULL si ninguno)
+ */
+supabase_event_sender_t sim_events_sender(void);
+
+/**
+ * @brief Transporte de eventos elegido con supabase_set_event_transport()
+ */
+supabase_event_transport_t sim_events_transport(void);
+
+/**
+ * @brief Comandos pasados a command_processor_submit()
+ */
+int sim_commands_count(void);
+
+/**
+ * @brief Comando recibido como "id:comando:created_at:fuente" ("-" si no hay created_at)
+ */
+const char *sim_command(int index);
+
+/**
+ * @brief Olvida los comandos recibidos
+ */
+void sim_commands_clear(void);
+
+#endif // SIM_MQTT_H
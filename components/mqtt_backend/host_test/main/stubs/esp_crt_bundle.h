@@ -0,0 +1,13 @@
+/**
+ * @file esp_crt_bundle.h
+ * @brief Declaración de esp_crt_bundle para el target linux
+ *
+ * El cliente simulado conecta sin TLS aunque la URI sea mqtts://; el
+ * callback no se llama.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+
+esp_err_t esp_crt_bundle_attach(void *conf);
@@ -0,0 +1,217 @@
+/**
+ * @file test_bench.c
+ * @brief Latencia y throughput de eventos: MQTT (de a uno y en lotes) contra HTTP por evento
+ *
+ * Los dos caminos van al mismo proceso (mqtt_broker.py) y esperan la misma
+ * ida y vuelta (--rtt-ms), así que la diferencia es la del protocolo:
+ *
+ * - MQTT: mqtt_backend_publish_events() hasta el PUBACK, un evento por
+ *   mensaje y SUPABASE_EVENT_BATCH_MAX por mensaje (como la tarea de envío
+ *   de supabase_client con el transporte MQTT).
+ * - HTTP: un POST por evento al path y con los headers de post_event_json(),
+ *   sobre una conexión reutilizada (la precalentada).
+ *
+ * Es TCP en claro y el retraso solo se aplica a las respuestas: no mide
+ * el handshake TCP ni TLS, así que HTTP queda en su mejor caso (sin
+ * conexión precalentada cada evento suma esos handshakes).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "mqtt_backend.h"
+#include "supabase_client.h"
+#include "mqtt_backend_host_test.h"
+#include "sim_mqtt.h"
+
+#define BENCH_HTTP_PORT     8080
+#define BENCH_EVENTS        64
+#define BENCH_EVENT_LEN     200
+#define BENCH_TIMEOUT_MS    2000
+
+typedef struct {
+    const char *name;
+    int per_message;
+    int64_t total_us;
+    int64_t max_us;
+    int messages;
+} bench_result_t;
+
+static bool s_broker_up = false;
+static char s_event[BENCH_EVENT_LEN + 1];
+static char s_batch[SUPABASE_EVENT_BATCH_MAX * (BENCH_EVENT_LEN + 1) + 2];
+
+/**
+ * @brief Evento de ~BENCH_EVENT_LEN bytes con la forma de los del Gateway
+ */
+static void build_event(void)
+{
+    int n = snprintf(s_event, sizeof(s_event),
+                     "{\"device_id\":\"" SIM_DEVICE_ID "\",\"event_type\":\"ZONE_ALARM\",\"zone\":3,"
+                     "\"timestamp\":\"2026-10-18T10:00:00Z\",\"source\":\"RF\",\"rssi\":-67,\"detail\":\"");
+    memset(s_event + n, 'x', BENCH_EVENT_LEN - n - 2);
+    strcpy(s_event + BENCH_EVENT_LEN - 2, "\"}");
+
+    char *p = s_batch;
+    *p++ = '[';
+    for (int i = 0; i < SUPABASE_EVENT_BATCH_MAX; i++) {
+        p += sprintf(p, "%s%s", i ? "," : "", s_event);
+    }
+    strcpy(p, "]");
+}
+
+static void note(bench_result_t *r, int64_t start_us)
+{
+    int64_t us = esp_timer_get_time() - start_us;
+    r->total_us += us;
+    if (us > r->max_us) {
+        r->max_us = us;
+    }
+    r->messages++;
+}
+
+// ============================================================================
+// HTTP
+// ============================================================================
+
+static int http_connect(void)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(BENCH_HTTP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&to, sizeof(to)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief POST de un evento y lectura de la respuesta (201 sin body)
+ */
+static bool http_post(int fd, const char *json)
+{
+    char request[1024];
+    int len = snprintf(request, sizeof(request),
+                       "POST /functions/v1/ghost-event-public HTTP/1.1\r\n"
+                       "Host: " SUPABASE_HOST "\r\n"
+                       "Content-Type: application/json\r\n"
+                       "X-Device-Key: " DEVICE_KEY "\r\n"
+                       "Content-Length: %d\r\n"
+                       "Connection: keep-alive\r\n"
+                       "\r\n"
+                       "%s",
+                       (int)strlen(json), json);
+    if (len >= (int)sizeof(request) || send(fd, request, len, MSG_NOSIGNAL) != len) {
+        return false;
+    }
+
+    char response[256];
+    size_t got = 0;
+    while (got < sizeof(response) - 1) {
+        ssize_t n = recv(fd, response + got, sizeof(response) - 1 - got, 0);
+        if (n <= 0) {
+            return false;
+        }
+        got += n;
+        response[got] = '\0';
+        if (strstr(response, "\r\n\r\n")) {
+            return strncmp(response, "HTTP/1.1 201", 12) == 0;
+        }
+    }
+    return false;
+}
+
+static void bench_http(bench_result_t *r)
+{
+    int fd = http_connect();
+    TEST_ASSERT_TRUE(fd >= 0);
+    for (int i = 0; i < BENCH_EVENTS; i++) {
+        int64_t start_us = esp_timer_get_time();
+        TEST_ASSERT_TRUE(http_post(fd, s_event));
+        note(r, start_us);
+    }
+    close(fd);
+}
+
+// ============================================================================
+// MQTT
+// ============================================================================
+
+static void bench_mqtt(bench_result_t *r)
+{
+    const char *payload = r->per_message == 1 ? s_event : s_batch;
+    for (int i = 0; i < BENCH_EVENTS / r->per_message; i++) {
+        int64_t start_us = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(ESP_OK, mqtt_backend_publish_events(payload, BENCH_TIMEOUT_MS));
+        note(r, start_us);
+    }
+}
+
+// ============================================================================
+// Pruebas
+// ============================================================================
+
+static void test_mqtt_batches_vs_http(void)
+{
+    if (!s_broker_up) {
+        TEST_FAIL_MESSAGE("mqtt_broker.py no está corriendo (lo inicia test_broker.c)");
+    }
+    build_event();
+    if (!mqtt_backend_is_connected()) {
+        TEST_ASSERT_EQUAL(ESP_OK, mqtt_backend_init(SIM_BROKER_URI, SIM_BROKER_USERNAME, SIM_BROKER_PASSWORD));
+        for (int waited = 0; !mqtt_backend_is_connected() && waited < BENCH_TIMEOUT_MS; waited += 10) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        TEST_ASSERT_TRUE(mqtt_backend_is_connected());
+    }
+
+    bench_result_t results[] = {
+        { .name = "MQTT QoS1", .per_message = 1 },
+        { .name = "MQTT QoS1", .per_message = SUPABASE_EVENT_BATCH_MAX },
+        { .name = "HTTP keep-alive", .per_message = 1 },
+    };
+    bench_mqtt(&results[0]);
+    bench_mqtt(&results[1]);
+    bench_http(&results[2]);
+
+    printf("\n%d eventos de %d bytes:\n", BENCH_EVENTS, BENCH_EVENT_LEN);
+    printf("%-16s %9s %9s %10s %10s %10s\n", "transporte", "ev/msg", "total ms", "eventos/s", "prom ms", "máx ms");
+    for (size_t i = 0; i < sizeof(results) / sizeof(results[0]); i++) {
+        const bench_result_t *r = &results[i];
+        printf("%-16s %9d %9.1f %10.0f %10.2f %10.2f\n", r->name, r->per_message, r->total_us / 1000.0,
+               BENCH_EVENTS * 1e6 / r->total_us, r->total_us / 1000.0 / r->messages, r->max_us / 1000.0);
+    }
+    printf("\n");
+
+    // Con lotes hay un PUBACK cada SUPABASE_EVENT_BATCH_MAX eventos
+    TEST_ASSERT_TRUE(results[1].total_us < results[0].total_us);
+    TEST_ASSERT_TRUE(results[1].total_us < results[2].total_us);
+}
+
+void test_bench_run(void)
+{
+    s_broker_up = mqtt_backend_is_connected();
+    if (!s_broker_up) {
+        int fd = http_connect();
+        s_broker_up = fd >= 0;
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    RUN_TEST(test_mqtt_batches_vs_http);
+}
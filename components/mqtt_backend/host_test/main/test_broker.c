@@ -0,0 +1,387 @@
+/**
+ * @file test_broker.c
+ * @brief mqtt_backend contra mqtt_broker.py (sesión persistente, PUBACK y comandos)
+ *
+ * Un segundo cliente ("operador", sesión limpia) hace de lo que hay del
+ * otro lado del broker: recibe los eventos publicados por el Gateway y
+ * publica comandos en su topic. El Gateway es el cliente que crea
+ * mqtt_backend_init(), con SIM_DEVICE_ID como client id.
+ *
+ * La primera prueba inicia mqtt_broker.py (también lo usa test_bench.c);
+ * si no arranca, las demás fallan.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mqtt_client.h"
+#include "mqtt_backend.h"
+#include "command_processor.h"
+#include "mqtt_backend_host_test.h"
+#include "sim_mqtt.h"
+#include "sim_server.h"
+
+#define EVENTS_TOPIC        MQTT_BACKEND_TOPIC_PREFIX "/" SIM_DEVICE_ID "/events"
+#define COMMANDS_TOPIC      MQTT_BACKEND_TOPIC_PREFIX "/" SIM_DEVICE_ID "/commands"
+#define BROKER_PORT         1883
+#define CONNECT_WAIT_MS     2000
+#define DELIVERY_WAIT_MS    2000
+
+static bool s_broker_up = false;
+static esp_mqtt_client_handle_t s_operator = NULL;
+static volatile bool s_operator_connected = false;
+static char s_received[4096];
+static volatile int s_received_count = 0;
+
+#define REQUIRE_BROKER() \
+    do { \
+        if (!s_broker_up) { \
+            TEST_FAIL_MESSAGE("mqtt_broker.py no arrancó (ver test_broker_started)"); \
+        } \
+    } while (0)
+
+static bool wait_for(volatile bool *flag, bool value, int timeout_ms)
+{
+    for (int waited = 0; *flag != value && waited < timeout_ms; waited += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return *flag == value;
+}
+
+static bool wait_connected(bool value, int timeout_ms)
+{
+    for (int waited = 0; mqtt_backend_is_connected() != value && waited < timeout_ms; waited += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return mqtt_backend_is_connected() == value;
+}
+
+static bool wait_commands(int count, int timeout_ms)
+{
+    for (int waited = 0; sim_commands_count() < count && waited < timeout_ms; waited += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return sim_commands_count() >= count;
+}
+
+static mqtt_backend_stats_t stats(void)
+{
+    mqtt_backend_stats_t st;
+    mqtt_backend_get_stats(&st);
+    return st;
+}
+
+// ============================================================================
+// Operador
+// ============================================================================
+
+/**
+ * @brief Handler de los clientes de prueba; arg apunta a su indicador de conexión
+ */
+static void operator_handler(void *arg, esp_event_base_t base, int32_t event_id, void *data)
+{
+    esp_mqtt_event_handle_t event = data;
+    volatile bool *connected = arg;
+    switch ((esp_mqtt_event_id_t)event_id) {
+        case MQTT_EVENT_CONNECTED:
+            *connected = true;
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            *connected = false;
+            break;
+        case MQTT_EVENT_DATA:
+            if (event->topic_len == (int)strlen(EVENTS_TOPIC) &&
+                strncmp(event->topic, EVENTS_TOPIC, event->topic_len) == 0) {
+                snprintf(s_received, sizeof(s_received), "%.*s", event->data_len, event->data);
+                s_received_count++;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static esp_mqtt_client_handle_t connect_client(const char *client_id, bool clean, volatile bool *connected)
+{
+    const esp_mqtt_client_config_t cfg = {
+        .broker.address.uri = SIM_BROKER_URI,
+        .credentials.client_id = client_id,
+        .credentials.username = SIM_BROKER_USERNAME,
+        .credentials.authentication.password = SIM_BROKER_PASSWORD,
+        .session.disable_clean_session = !clean,
+        .network.reconnect_timeout_ms = 500,
+    };
+    *connected = false;
+    esp_mqtt_client_handle_t client = esp_mqtt_client_init(&cfg);
+    esp_mqtt_client_register_event(client, MQTT_EVENT_ANY, operator_handler, (void *)connected);
+    esp_mqtt_client_start(client);
+    TEST_ASSERT_TRUE(wait_for(connected, true, CONNECT_WAIT_MS));
+    return client;
+}
+
+/**
+ * @brief Publica un comando como lo haría el servidor, con QoS1
+ */
+static void send_command(const char *json)
+{
+    TEST_ASSERT_GREATER_THAN(0, esp_mqtt_client_publish(s_operator, COMMANDS_TOPIC, json, 0, 1, 0));
+}
+
+// ============================================================================
+// Pruebas
+// ============================================================================
+
+/**
+ * mqtt_broker.py (MQTT_BROKER_SCRIPT, definido en main/CMakeLists.txt) con
+ * el retraso del benchmark y las credenciales del Gateway; el operador se
+ * conecta y se suscribe a los eventos de todos los dispositivos.
+ */
+static void test_broker_started(void)
+{
+    static const char *const args[] = {
+        "1883", "8080", "--rtt-ms", "20", "--auth", SIM_BROKER_USERNAME ":" SIM_BROKER_PASSWORD, NULL,
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, sim_server_start(MQTT_BROKER_SCRIPT, args, BROKER_PORT));
+    s_operator = connect_client("sim-operator", true, &s_operator_connected);
+    TEST_ASSERT_GREATER_THAN(0, esp_mqtt_client_subscribe(s_operator, MQTT_BACKEND_TOPIC_PREFIX "/+/events", 1));
+    s_broker_up = true;
+}
+
+/**
+ * Sin TLS o sin credenciales el backend no arranca: no hay cliente, ni
+ * suscripción a comandos, ni sender de eventos.
+ */
+static void test_requires_tls_and_credentials(void)
+{
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+                      mqtt_backend_init("mqtt://127.0.0.1:1883", SIM_BROKER_USERNAME, SIM_BROKER_PASSWORD));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mqtt_backend_init(SIM_BROKER_URI, SIM_BROKER_USERNAME, ""));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, mqtt_backend_init(SIM_BROKER_URI, NULL, SIM_BROKER_PASSWORD));
+
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ASSERT_FALSE(mqtt_backend_is_connected());
+    TEST_ASSERT_NULL(sim_events_sender());
+    TEST_ASSERT_EQUAL(0, sim_mqtt_subscribes(SIM_DEVICE_ID));
+}
+
+/**
+ * Con una contraseña que el broker no acepta el CONNACK trae error: se
+ * cuenta como rechazo y nunca se suscribe a los comandos.
+ */
+static void test_wrong_password_refused(void)
+{
+    REQUIRE_BROKER();
+    mqtt_backend_stats_t before = stats();
+    TEST_ASSERT_EQUAL(ESP_OK, mqtt_backend_init(SIM_BROKER_URI, SIM_BROKER_USERNAME, "otra"));
+
+    for (int waited = 0; stats().connects_refused == before.connects_refused && waited < CONNECT_WAIT_MS;
+         waited += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    mqtt_backend_stats_t after = stats();
+    TEST_ASSERT_EQUAL(1, after.connects_refused - before.connects_refused);
+    TEST_ASSERT_EQUAL(before.connects, after.connects);
+    TEST_ASSERT_FALSE(mqtt_backend_is_connected());
+    TEST_ASSERT_EQUAL(0, sim_mqtt_subscribes(SIM_DEVICE_ID));
+    TEST_ASSERT_EQUAL(ESP_OK, mqtt_backend_stop());
+}
+
+/**
+ * Sin sesión guardada en el broker: el Gateway se suscribe a los comandos
+ * y registra el sender de eventos sin cambiar el transporte elegido.
+ */
+static void test_new_session_subscribes(void)
+{
+    REQUIRE_BROKER();
+
+    // Una conexión con clean session borra la sesión de corridas anteriores
+    volatile bool connected;
+    esp_mqtt_client_destroy(connect_client(SIM_DEVICE_ID, true, &connected));
+
+    mqtt_backend_stats_t before = stats();
+    TEST_ASSERT_EQUAL(ESP_OK, mqtt_backend_init(SIM_BROKER_URI, SIM_BROKER_USERNAME, SIM_BROKER_PASSWORD));
+    TEST_ASSERT_TRUE(wait_connected(true, CONNECT_WAIT_MS));
+
+    mqtt_backend_stats_t after = stats();
+    TEST_ASSERT_EQUAL(1, after.connects - before.connects);
+    TEST_ASSERT_EQUAL(0, after.sessions_resumed - before.sessions_resumed);
+    TEST_ASSERT_EQUAL(1, sim_mqtt_subscribes(SIM_DEVICE_ID));
+    TEST_ASSERT_NOT_NULL(sim_events_sender());
+    TEST_ASSERT_EQUAL(SUPABASE_EVENT_TRANSPORT_HTTPS, sim_events_transport());
+}
+
+/**
+ * Un lote publicado por el sender vuelve con PUBACK y el operador recibe el
+ * mismo arreglo en el topic de eventos.
+ */
+static void test_batch_published_with_puback(void)
+{
+    REQUIRE_BROKER();
+    const char *batch = "[{\"event_type\":\"ALARM\",\"zone\":1},{\"event_type\":\"ARM\",\"zone\":0}]";
+    int received = s_received_count;
+    mqtt_backend_stats_t before = stats();
+
+    TEST_ASSERT_EQUAL(ESP_OK, sim_events_sender()(batch, 1000, NULL));
+
+    for (int waited = 0; s_received_count == received && waited < DELIVERY_WAIT_MS; waited += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    TEST_ASSERT_EQUAL(received + 1, s_received_count);
+    TEST_ASSERT_EQUAL_STRING(batch, s_received);
+    mqtt_backend_stats_t after = stats();
+    TEST_ASSERT_EQUAL(1, after.published - before.published);
+    TEST_ASSERT_EQUAL(strlen(batch), after.bytes_published - before.bytes_published);
+}
+
+/**
+ * Comandos publicados por el operador: objeto, arreglo con uno ya
+ * ejecutado, JSON inválido y comando sin id.
+ */
+static void test_commands_from_broker(void)
+{
+    REQUIRE_BROKER();
+    sim_commands_clear();
+    mqtt_backend_stats_t before = stats();
+
+    send_command("{\"id\":\"u-1\",\"command\":\"ARM\",\"status\":\"pending\",\"created_at\":\"2026-10-18T10:00:00Z\"}");
+    send_command("[{\"id\":7,\"command\":\"DISARM\"},{\"id\":8,\"command\":\"TEST\",\"status\":\"executed\"}]");
+    send_command("no es json");
+    send_command("{\"command\":\"ARM\"}");
+    send_command("{\"id\":9,\"command\":\"SILENCE\"}");
+
+    TEST_ASSERT_TRUE(wait_commands(3, DELIVERY_WAIT_MS));
+    TEST_ASSERT_EQUAL(3, sim_commands_count());
+    char expected[SIM_COMMAND_LEN];
+    snprintf(expected, sizeof(expected), "u-1:ARM:2026-10-18T10:00:00Z:%d", COMMAND_SOURCE_MQTT);
+    TEST_ASSERT_EQUAL_STRING(expected, sim_command(0));
+    snprintf(expected, sizeof(expected), "7:DISARM:-:%d", COMMAND_SOURCE_MQTT);
+    TEST_ASSERT_EQUAL_STRING(expected, sim_command(1));
+    snprintf(expected, sizeof(expected), "9:SILENCE:-:%d", COMMAND_SOURCE_MQTT);
+    TEST_ASSERT_EQUAL_STRING(expected, sim_command(2));
+
+    mqtt_backend_stats_t after = stats();
+    TEST_ASSERT_EQUAL(3, after.commands - before.commands);
+    TEST_ASSERT_EQUAL(2, after.commands_invalid - before.commands_invalid);
+}
+
+/**
+ * Un mensaje de comandos más grande que MQTT_BACKEND_BUFFER_SIZE llega en
+ * partes y se descarta entero.
+ */
+static void test_oversized_command_discarded(void)
+{
+    REQUIRE_BROKER();
+    static char big[MQTT_BACKEND_BUFFER_SIZE * 2];
+    int n = snprintf(big, sizeof(big), "{\"id\":10,\"command\":\"ARM\",\"note\":\"");
+    memset(big + n, 'x', sizeof(big) - n - 3);
+    strcpy(big + sizeof(big) - 3, "\"}");
+    sim_commands_clear();
+    mqtt_backend_stats_t before = stats();
+
+    send_command(big);
+    send_command("{\"id\":11,\"command\":\"ARM\"}");
+
+    TEST_ASSERT_TRUE(wait_commands(1, DELIVERY_WAIT_MS));
+    TEST_ASSERT_EQUAL(1, sim_commands_count());
+    TEST_ASSERT_EQUAL_STRING_LEN("11:ARM", sim_command(0), 6);
+    TEST_ASSERT_EQUAL(1, stats().commands_invalid - before.commands_invalid);
+}
+
+/**
+ * Sin PUBACK a tiempo el sender devuelve ESP_ERR_TIMEOUT (supabase_client
+ * manda el lote por HTTPS); el PUBACK tardío no confirma el envío
+ * siguiente.
+ */
+static void test_puback_timeout_then_late_ack(void)
+{
+    REQUIRE_BROKER();
+    mqtt_backend_stats_t before = stats();
+
+    sim_mqtt_hold_acks(true);
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, mqtt_backend_publish_events("{\"late\":1}", 100));
+    sim_mqtt_hold_acks(false);
+    TEST_ASSERT_EQUAL(ESP_OK, mqtt_backend_publish_events("{\"next\":1}", 1000));
+
+    mqtt_backend_stats_t after = stats();
+    TEST_ASSERT_EQUAL(1, after.publish_failures - before.publish_failures);
+    TEST_ASSERT_EQUAL(1, after.published - before.published);
+}
+
+/**
+ * Con la red al broker caída los eventos van por HTTPS (el sender devuelve
+ * ESP_ERR_INVALID_STATE) y el broker guarda los comandos QoS1; al volver,
+ * la sesión se reanuda sin volver a suscribirse y el comando llega.
+ */
+static void test_broker_unreachable_session_resumed(void)
+{
+    REQUIRE_BROKER();
+    sim_commands_clear();
+    mqtt_backend_stats_t before = stats();
+    uint32_t subscribes = sim_mqtt_subscribes(SIM_DEVICE_ID);
+
+    sim_mqtt_set_reachable(false);
+    TEST_ASSERT_TRUE(wait_connected(false, CONNECT_WAIT_MS));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, sim_events_sender()("{\"offline\":1}", 1000, NULL));
+    // El operador también se cortó: reconecta solo (reconnect_timeout_ms = 500)
+    TEST_ASSERT_TRUE(wait_for(&s_operator_connected, false, CONNECT_WAIT_MS));
+    sim_mqtt_set_reachable(true);
+    TEST_ASSERT_TRUE(wait_for(&s_operator_connected, true, CONNECT_WAIT_MS));
+    TEST_ASSERT_FALSE(mqtt_backend_is_connected());
+    send_command("{\"id\":\"offline-1\",\"command\":\"ARM\"}");
+
+    // El backend reintenta cada MQTT_BACKEND_RECONNECT_MS
+    TEST_ASSERT_TRUE(wait_connected(true, MQTT_BACKEND_RECONNECT_MS + CONNECT_WAIT_MS));
+    TEST_ASSERT_TRUE(wait_commands(1, DELIVERY_WAIT_MS));
+    TEST_ASSERT_EQUAL_STRING_LEN("offline-1:ARM", sim_command(0), 13);
+
+    mqtt_backend_stats_t after = stats();
+    TEST_ASSERT_EQUAL(1, after.disconnects - before.disconnects);
+    TEST_ASSERT_EQUAL(1, after.sessions_resumed - before.sessions_resumed);
+    TEST_ASSERT_EQUAL(subscribes, sim_mqtt_subscribes(SIM_DEVICE_ID));
+}
+
+/**
+ * mqtt_backend_stop() saca el sender y deja la sesión en el broker: lo
+ * publicado mientras estaba detenido llega al volver a iniciar.
+ */
+static void test_stop_keeps_session(void)
+{
+    REQUIRE_BROKER();
+    sim_commands_clear();
+
+    TEST_ASSERT_EQUAL(ESP_OK, mqtt_backend_stop());
+    TEST_ASSERT_NULL(sim_events_sender());
+    TEST_ASSERT_FALSE(mqtt_backend_is_connected());
+    send_command("[{\"id\":21,\"command\":\"ARM\"},{\"id\":22,\"command\":\"DISARM\"}]");
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ASSERT_EQUAL(0, sim_commands_count());
+
+    mqtt_backend_stats_t before = stats();
+    TEST_ASSERT_EQUAL(ESP_OK, mqtt_backend_init(SIM_BROKER_URI, SIM_BROKER_USERNAME, SIM_BROKER_PASSWORD));
+    TEST_ASSERT_TRUE(wait_connected(true, CONNECT_WAIT_MS));
+    TEST_ASSERT_TRUE(wait_commands(2, DELIVERY_WAIT_MS));
+    TEST_ASSERT_EQUAL_STRING_LEN("21:ARM", sim_command(0), 6);
+    TEST_ASSERT_EQUAL_STRING_LEN("22:DISARM", sim_command(1), 9);
+    TEST_ASSERT_EQUAL(1, stats().sessions_resumed - before.sessions_resumed);
+}
+
+void test_broker_run(void)
+{
+    RUN_TEST(test_broker_started);
+    RUN_TEST(test_requires_tls_and_credentials);
+    RUN_TEST(test_wrong_password_refused);
+    RUN_TEST(test_new_session_subscribes);
+    RUN_TEST(test_batch_published_with_puback);
+    RUN_TEST(test_commands_from_broker);
+    RUN_TEST(test_oversized_command_discarded);
+    RUN_TEST(test_puback_timeout_then_late_ack);
+    RUN_TEST(test_broker_unreachable_session_resumed);
+    RUN_TEST(test_stop_keeps_session);
+
+    if (s_operator) {
+        esp_mqtt_client_destroy(s_operator);
+        s_operator = NULL;
+    }
+}
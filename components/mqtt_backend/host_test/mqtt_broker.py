@@ -0,0 +1,276 @@
+# Broker MQTT 3.1.1 de prueba para test_broker.c y test_bench.c
+#
+# Lo mínimo de mosquitto que usa mqtt_backend: CONNECT con sesión
+# persistente (clean session = 0), SUBSCRIBE con + y #, PUBLISH QoS0/QoS1
+# con PUBACK, cola de QoS1 para sesiones desconectadas, reenvío con DUP de
+# lo no confirmado al reanudar la sesión y PINGREQ. Sin retain, will, QoS2
+# ni TLS.
+#
+# --auth USUARIO:CLAVE exige esas credenciales en cada CONNECT: sin ellas
+# responde CONNACK 5 (no autorizado), y con otras CONNACK 4.
+#
+# También atiende HTTP/1.1 en otro puerto (POST con keep-alive, responde
+# 201) para comparar con el envío de un evento por request.
+#
+# --rtt-ms retrasa cada respuesta (CONNACK, SUBACK, PUBACK, PUBLISH
+# entregados y respuestas HTTP) para simular la ida y vuelta de la red.
+#
+# Uso: python3 mqtt_broker.py [puerto_mqtt] [puerto_http] [--rtt-ms N]
+#                             [--auth USUARIO:CLAVE]
+#      (1883, 8080, 0 y sin credenciales por defecto)
+
+import asyncio
+import sys
+
+args = sys.argv[1:]
+RTT_S = 0.0
+if '--rtt-ms' in args:
+    i = args.index('--rtt-ms')
+    RTT_S = int(args[i + 1]) / 1000.0
+    del args[i:i + 2]
+AUTH = None
+if '--auth' in args:
+    i = args.index('--auth')
+    user, _, password = args[i + 1].partition(':')
+    AUTH = (user.encode(), password.encode())
+    del args[i:i + 2]
+MQTT_PORT = int(args[0]) if len(args) > 0 else 1883
+HTTP_PORT = int(args[1]) if len(args) > 1 else 8080
+
+CONNECT, CONNACK, PUBLISH, PUBACK = 1, 2, 3, 4
+SUBSCRIBE, SUBACK, PINGREQ, PINGRESP, DISCONNECT = 8, 9, 12, 13, 14
+
+
+def encode_len(n):
+    out = bytearray()
+    while True:
+        byte = n % 128
+        n //= 128
+        out.append(byte | (0x80 if n else 0))
+        if not n:
+            return bytes(out)
+
+
+def packet(first_byte, body):
+    return bytes([first_byte]) + encode_len(len(body)) + body
+
+
+def utf8(s):
+    b = s.encode()
+    return len(b).to_bytes(2, 'big') + b
+
+
+def topic_matches(filt, topic):
+    f, t = filt.split('/'), topic.split('/')
+    for i, part in enumerate(f):
+        if part == '#':
+            return True
+        if i >= len(t) or (part != '+' and part != t[i]):
+            return False
+    return len(f) == len(t)
+
+
+class Session:
+    def __init__(self, client_id, clean):
+        self.client_id = client_id
+        self.clean = clean
+        self.subs = {}          # filtro -> QoS otorgado
+        self.queue = []         # (topic, payload, qos) pendientes mientras no hay conexión
+        self.inflight = {}      # packet id -> (topic, payload) sin PUBACK
+        self.next_id = 0
+        self.conn = None
+
+    def new_id(self):
+        self.next_id = self.next_id % 65535 + 1
+        return self.next_id
+
+
+sessions = {}
+
+
+class Conn:
+    def __init__(self, reader, writer):
+        self.reader = reader
+        self.writer = writer
+        self.session = None
+
+    def send(self, data):
+        # Retraso fijo por conexión: se conserva el orden de las respuestas
+        if RTT_S:
+            asyncio.get_running_loop().call_later(RTT_S, self.write, data)
+        else:
+            self.write(data)
+
+    def write(self, data):
+        if not self.writer.is_closing():
+            self.writer.write(data)
+
+    def deliver(self, topic, payload, qos, dup=False, packet_id=None):
+        body = utf8(topic)
+        if qos:
+            if packet_id is None:
+                packet_id = self.session.new_id()
+                self.session.inflight[packet_id] = (topic, payload)
+            body += packet_id.to_bytes(2, 'big')
+        self.send(packet((PUBLISH << 4) | (0x08 if dup else 0) | (qos << 1), body + payload))
+
+
+def route(topic, payload, qos):
+    for s in sessions.values():
+        granted = [q for f, q in s.subs.items() if topic_matches(f, topic)]
+        if not granted:
+            continue
+        q = min(qos, max(granted))
+        if s.conn:
+            s.conn.deliver(topic, payload, q)
+        elif q and not s.clean:
+            s.queue.append((topic, payload, q))
+
+
+async def read_packet(reader):
+    first = (await reader.readexactly(1))[0]
+    n, mult = 0, 1
+    while True:
+        b = (await reader.readexactly(1))[0]
+        n += (b & 0x7F) * mult
+        mult *= 128
+        if not b & 0x80:
+            break
+    return first, await reader.readexactly(n)
+
+
+def on_connect(conn, body):
+    name_len = int.from_bytes(body[0:2], 'big')
+    p = 2 + name_len
+    level, flags = body[p], body[p + 1]
+    p += 4          # nivel, flags, keepalive
+    id_len = int.from_bytes(body[p:p + 2], 'big')
+    client_id = body[p + 2:p + 2 + id_len].decode()
+    p += 2 + id_len
+    clean = bool(flags & 0x02)
+    if level != 4:
+        conn.send(packet(CONNACK << 4, b'\x00\x01'))
+        return False
+
+    fields = []
+    for flag in (0x04, 0x04, 0x80, 0x40):      # will topic, will message, usuario, clave
+        if flags & flag:
+            n = int.from_bytes(body[p:p + 2], 'big')
+            fields.append(body[p + 2:p + 2 + n])
+            p += 2 + n
+        else:
+            fields.append(None)
+    if AUTH and (fields[2] is None or fields[3] is None):
+        conn.send(packet(CONNACK << 4, b'\x00\x05'))
+        return False
+    if AUTH and (fields[2], fields[3]) != AUTH:
+        conn.send(packet(CONNACK << 4, b'\x00\x04'))
+        return False
+
+    old = sessions.get(client_id)
+    if old and old.conn:
+        old.conn.writer.close()         # Toma de sesión: el cliente anterior se desconecta
+        old.conn = None
+    if clean or old is None:
+        present = 0
+        sessions[client_id] = Session(client_id, clean)
+    else:
+        present = 1
+    s = sessions[client_id]
+    s.clean = clean
+    s.conn = conn
+    conn.session = s
+    conn.send(packet(CONNACK << 4, bytes([present, 0])))
+
+    # Reanudación: primero lo que quedó sin PUBACK (con DUP), después la cola
+    for packet_id, (topic, payload) in s.inflight.items():
+        conn.deliver(topic, payload, 1, dup=True, packet_id=packet_id)
+    queued, s.queue = s.queue, []
+    for topic, payload, qos in queued:
+        conn.deliver(topic, payload, qos)
+    return True
+
+
+def on_publish(conn, first, body):
+    qos = (first >> 1) & 0x03
+    topic_len = int.from_bytes(body[0:2], 'big')
+    topic = body[2:2 + topic_len].decode()
+    p = 2 + topic_len
+    if qos:
+        packet_id = body[p:p + 2]
+        p += 2
+        conn.send(packet(PUBACK << 4, packet_id))
+    route(topic, body[p:], min(qos, 1))
+
+
+def on_subscribe(conn, body):
+    packet_id = body[0:2]
+    p, granted = 2, bytearray()
+    while p < len(body):
+        n = int.from_bytes(body[p:p + 2], 'big')
+        filt = body[p + 2:p + 2 + n].decode()
+        qos = min(body[p + 2 + n], 1)
+        conn.session.subs[filt] = qos
+        granted.append(qos)
+        p += 3 + n
+    conn.send(packet(SUBACK << 4, packet_id + bytes(granted)))
+
+
+async def mqtt_client(reader, writer):
+    conn = Conn(reader, writer)
+    try:
+        first, body = await read_packet(reader)
+        if first >> 4 != CONNECT or not on_connect(conn, body):
+            await asyncio.sleep(RTT_S)      # Que salga el CONNACK con el error antes de cerrar
+            return
+        while True:
+            first, body = await read_packet(reader)
+            kind = first >> 4
+            if kind == PUBLISH:
+                on_publish(conn, first, body)
+            elif kind == PUBACK:
+                conn.session.inflight.pop(int.from_bytes(body[0:2], 'big'), None)
+            elif kind == SUBSCRIBE:
+                on_subscribe(conn, body)
+            elif kind == PINGREQ:
+                conn.send(packet(PINGRESP << 4, b''))
+            elif kind == DISCONNECT:
+                break
+    except (asyncio.IncompleteReadError, ConnectionError):
+        pass
+    finally:
+        s = conn.session
+        if s and s.conn is conn:
+            s.conn = None
+            if s.clean:
+                del sessions[s.client_id]
+        writer.close()
+
+
+async def http_client(reader, writer):
+    conn = Conn(reader, writer)
+    try:
+        while True:
+            head = await reader.readuntil(b'\r\n\r\n')
+            length = 0
+            for line in head.split(b'\r\n'):
+                if line.lower().startswith(b'content-length:'):
+                    length = int(line.split(b':')[1])
+            await reader.readexactly(length)
+            conn.send(b'HTTP/1.1 201 Created\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n')
+    except (asyncio.IncompleteReadError, asyncio.LimitOverrunError, ConnectionError):
+        pass
+    finally:
+        writer.close()
+
+
+async def main():
+    mqtt = await asyncio.start_server(mqtt_client, '127.0.0.1', MQTT_PORT)
+    http = await asyncio.start_server(http_client, '127.0.0.1', HTTP_PORT)
+    print(f'Broker MQTT en {MQTT_PORT}, HTTP en {HTTP_PORT}, RTT {int(RTT_S * 1000)} ms, '
+          f'{"con" if AUTH else "sin"} credenciales', flush=True)
+    async with mqtt, http:
+        await asyncio.gather(mqtt.serve_forever(), http.serve_forever())
+
+
+asyncio.run(main())
@@ -0,0 +1,148 @@
+/**
+ * @file mqtt_backend.h
+ * @brief Backend MQTT para eventos y comandos, alternativo a Supabase
+ *
+ * Para sitios con un broker propio (en la LAN o en el mismo host). Se
+ * conecta al broker y se registra en supabase_client y command_processor,
+ * así que el resto del firmware sigue usando la misma API:
+ *
+ * - Eventos: con SUPABASE_EVENT_TRANSPORT_MQTT (supabase_client.h),
+ *   supabase_send_event()/supabase_send_event_async() publican en
+ *   <prefijo>/<device_id>/events con QoS1. La tarea de envío junta los
+ *   eventos encolados en un arreglo JSON (un PUBACK por lote). Sin broker o
+ *   sin PUBACK a tiempo, el evento sigue por HTTPS.
+ * - Comandos: suscripción QoS1 a <prefijo>/<device_id>/commands. Cada
+ *   mensaje es un comando con el formato de system_commands
+ *   ({"id":..,"command":"ARM","created_at":..}) o un arreglo de ellos, y se
+ *   ejecuta con command_processor_submit().
+ *
+ * La sesión es persistente (clean session = 0, client id fijo por
+ * dispositivo): el broker guarda la suscripción y los comandos QoS1
+ * publicados mientras el Gateway estaba desconectado, y los entrega al
+ * reconectar. Los PUBLISH sin PUBACK se reenvían también al reconectar,
+ * por lo que quien consume los eventos debe tolerar duplicados.
+ *
+ * Modelo de confianza: quien puede publicar en el topic de comandos puede
+ * desarmar el sistema, así que el broker decide quién manda comandos. Por
+ * eso solo se acepta un broker con TLS (mqtts:// o wss://, verificado con
+ * MQTT_BACKEND_BROKER_CA o el bundle de CAs) y con usuario y contraseña del
+ * Gateway; con mqtt:// o sin credenciales mqtt_backend_init() falla y no
+ * se suscribe. El broker tiene que completar esto con ACL: el Gateway solo
+ * lee <prefijo>/<device_id>/commands y solo escribe sus eventos, y solo el
+ * operador escribe en los topics de comandos (en mosquitto, "pattern read
+ * ghost/%c/commands" y "pattern write ghost/%c/events"). Los mensajes no
+ * van firmados: un cliente con permiso de escritura en el topic de
+ * comandos es de confianza, y command_processor solo filtra duplicados.
+ */
+
+#ifndef MQTT_BACKEND_H
+#define MQTT_BACKEND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// === CONFIGURACIÓN ===
+#define MQTT_BACKEND_ENABLED        false                       // Comandos por el broker y sender de eventos MQTT
+#define MQTT_BACKEND_BROKER_URI     "mqtts://192.168.1.10:8883" // Broker del sitio (mqtts:// o wss://)
+#define MQTT_BACKEND_BROKER_CA      NULL    // CA del broker en PEM; NULL = bundle de CAs públicas
+#define MQTT_BACKEND_USERNAME       ""      // Credenciales del Gateway en el broker (obligatorias)
+#define MQTT_BACKEND_PASSWORD       ""
+#define MQTT_BACKEND_TOPIC_PREFIX   "ghost"
+#define MQTT_BACKEND_KEEPALIVE_S    30
+#define MQTT_BACKEND_RECONNECT_MS   5000
+#define MQTT_BACKEND_BUFFER_SIZE    2048    // Mensaje de comandos más grande que se acepta
+
+// === ESTRUCTURAS ===
+
+/**
+ * @brief Estadísticas del backend
+ *
+ * La comparación con HTTPS (latencia y eventos/s por transporte) está en
+ * supabase_print_event_stats(); acá quedan los detalles del broker.
+ */
+typedef struct {
+    bool connected;             /**< Conectado al broker */
+    uint32_t connects;          /**< Conexiones establecidas */
+    uint32_t connects_refused;  /**< CONNECT rechazados por el broker (credenciales o ACL) */
+    uint32_t sessions_resumed;  /**< Conexiones en las que el broker conservaba la sesión */
+    uint32_t disconnects;       /**< Desconexiones */
+    uint32_t published;         /**< Mensajes confirmados con PUBACK */
+    uint32_t publish_failures;  /**< Mensajes sin PUBACK a tiempo */
+    uint32_t bytes_published;   /**< Bytes de payload confirmados */
+    uint32_t puback_avg_ms;     /**< Espera promedio del PUBACK */
+    uint32_t puback_max_ms;     /**< Espera máxima del PUBACK */
+    uint32_t commands;          /**< Comandos recibidos */
+    uint32_t commands_invalid;  /**< Mensajes de comandos descartados */
+} mqtt_backend_stats_t;
+
+// === FUNCIONES PÚBLICAS ===
+
+/**
+ * @brief Conecta al broker y registra el transporte MQTT de eventos
+ *
+ * Requiere supabase_client y command_processor ya inicializados. La
+ * conexión se establece en background y se reintenta sola; mientras no
+ * haya broker los eventos van por HTTPS.
+ *
+ * @param broker_uri URI del broker (mqtts://host:puerto o wss://...)
+ * @param username Usuario del Gateway en el broker
+ * @param password Contraseña del Gateway en el broker
+ * @return ESP_OK, ESP_ERR_INVALID_STATE si no hay device_id
+ * @return ESP_ERR_INVALID_ARG si la URI no usa TLS o faltan las credenciales
+ * @return ESP_ERR_NO_MEM si no se pudo crear el cliente
+ */
+esp_err_t mqtt_backend_init(const char *broker_uri, const char *username, const char *password);
+
+/**
+ * @brief Desconecta del broker y vuelve los eventos a HTTPS
+ *
+ * La sesión queda en el broker: al volver a iniciar se reciben los
+ * comandos publicados mientras tanto.
+ *
+ * @return ESP_OK
+ */
+esp_err_t mqtt_backend_stop(void);
+
+/**
+ * @brief Publica un payload en el topic de eventos y espera el PUBACK
+ *
+ * Es el sender que se registra en supabase_client; puede llamarse desde
+ * varias tareas (los envíos se serializan).
+ *
+ * @param json Evento o arreglo de eventos
+ * @param timeout_ms Espera máxima del PUBACK
+ * @return ESP_OK si el broker confirmó
+ * @return ESP_ERR_INVALID_STATE si no hay conexión al broker
+ * @return ESP_ERR_TIMEOUT si el PUBACK no llegó a tiempo
+ * @return ESP_FAIL si no se pudo publicar
+ */
+esp_err_t mqtt_backend_publish_events(const char *json, uint32_t timeout_ms);
+
+/**
+ * @brief Indica si hay conexión al broker
+ */
+bool mqtt_backend_is_connected(void);
+
+/**
+ * @brief Obtiene las estadísticas
+ *
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK, ESP_ERR_INVALID_ARG si stats es NULL
+ */
+esp_err_t mqtt_backend_get_stats(mqtt_backend_stats_t *stats);
+
+/**
+ * @brief Imprime las estadísticas del broker y la comparación con HTTPS (para debug)
+ */
+void mqtt_backend_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MQTT_BACKEND_H
@@ -0,0 +1,422 @@
+/**
+ * @file mqtt_backend.c
+ * @brief Implementación del backend MQTT (eventos QoS1 en lote y comandos)
+ *
+ * Usa el cliente esp-mqtt de ESP-IDF, que tiene su propia tarea: la
+ * conexión, los reintentos, el keepalive y el reenvío de los PUBLISH sin
+ * PUBACK quedan a su cargo. Este módulo solo espera los PUBACK de los
+ * envíos de supabase_client y pasa los comandos a command_processor.
+ */
+
+#include "mqtt_backend.h"
+#include "supabase_client.h"
+#include "command_processor.h"
+#include "device_identity.h"
+#include "mqtt_client.h"
+#include "esp_crt_bundle.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "cJSON.h"
+#include <string.h>
+
+static const char *TAG = "MQTT_BACKEND";
+
+#define MQTT_BACKEND_TOPIC_LEN  (sizeof(MQTT_BACKEND_TOPIC_PREFIX) + DEVICE_ID_LEN + 16)
+
+// === VARIABLES PRIVADAS ===
+static esp_mqtt_client_handle_t s_client = NULL;
+static volatile bool s_connected = false;
+static char s_client_id[DEVICE_ID_LEN] = "";
+static char s_events_topic[MQTT_BACKEND_TOPIC_LEN] = "";
+static char s_commands_topic[MQTT_BACKEND_TOPIC_LEN] = "";
+
+// Espera de PUBACK: un PUBLISH pendiente a la vez
+static SemaphoreHandle_t s_publish_mutex = NULL;
+static SemaphoreHandle_t s_puback_sem = NULL;
+static volatile int s_acked_msg_id = -1;
+
+static mqtt_backend_stats_t s_stats = {0};
+static uint64_t s_puback_total_ms = 0;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// === FUNCIONES PRIVADAS ===
+
+/**
+ * @brief Ejecuta un comando recibido por el topic de comandos
+ *
+ * Mismo formato que un registro de system_commands; los que no están
+ * pendientes se ignoran.
+ *
+ * @return true si el comando tenía el formato esperado
+ */
+static bool handle_command(const cJSON *record)
+{
+    const cJSON *command = cJSON_GetObjectItem(record, "command");
+    const cJSON *status = cJSON_GetObjectItem(record, "status");
+    const cJSON *id = cJSON_GetObjectItem(record, "id");
+    const cJSON *created_at = cJSON_GetObjectItem(record, "created_at");
+
+    if (!cJSON_IsString(command)) {
+        return false;
+    }
+    if (cJSON_IsString(status) && strcmp(status->valuestring, "pending") != 0) {
+        return true;
+    }
+
+    // El id puede llegar como UUID (string) o como entero
+    char id_str[COMMAND_ID_LEN];
+    if (cJSON_IsString(id)) {
+        snprintf(id_str, sizeof(id_str), "%s", id->valuestring);
+    } else if (cJSON_IsNumber(id)) {
+        snprintf(id_str, sizeof(id_str), "%.0f", id->valuedouble);
+    } else {
+        ESP_LOGW(TAG, "Comando %s sin id, ignorando", command->valuestring);
+        return false;
+    }
+
+    ESP_LOGI(TAG, "🎯 Comando recibido por MQTT: %s (id: %s)", command->valuestring, id_str);
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.commands++;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    // Ejecución, dedup y reporte del resultado en command_processor
+    command_processor_submit(id_str, command->valuestring,
+                             cJSON_IsString(created_at) ? created_at->valuestring : NULL,
+                             COMMAND_SOURCE_MQTT);
+    return true;
+}
+
+/**
+ * @brief Procesa un mensaje del topic de comandos (objeto o arreglo)
+ */
+static void handle_commands_message(const esp_mqtt_event_handle_t event)
+{
+    // Con buffer.size = MQTT_BACKEND_BUFFER_SIZE un mensaje más grande llega en partes
+    if (event->current_data_offset != 0 || event->data_len != event->total_data_len) {
+        if (event->current_data_offset == 0) {
+            ESP_LOGW(TAG, "Mensaje de comandos de %d bytes descartado (máximo %d)",
+                     event->total_data_len, MQTT_BACKEND_BUFFER_SIZE);
+            portENTER_CRITICAL(&s_stats_lock);
+            s_stats.commands_invalid++;
+            portEXIT_CRITICAL(&s_stats_lock);
+        }
+        return;
+    }
+
+    cJSON *root = cJSON_ParseWithLength(event->data, event->data_len);
+    bool valid = root != NULL;
+    if (cJSON_IsArray(root)) {
+        const cJSON *item;
+        cJSON_ArrayForEach(item, root) {
+            valid = handle_command(item) && valid;
+        }
+    } else if (cJSON_IsObject(root)) {
+        valid = handle_command(root);
+    } else {
+        valid = false;
+    }
+    cJSON_Delete(root);
+
+    if (!valid) {
+        ESP_LOGW(TAG, "Mensaje de comandos inválido");
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.commands_invalid++;
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+}
+
+/**
+ * @brief Handler de eventos de esp-mqtt (corre en la tarea del cliente)
+ */
+static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+        case MQTT_EVENT_CONNECTED:
+            s_connected = true;
+            portENTER_CRITICAL(&s_stats_lock);
+            s_stats.connects++;
+            if (event->session_present) {
+                s_stats.sessions_resumed++;
+            }
+            portEXIT_CRITICAL(&s_stats_lock);
+
+            // Con la sesión conservada la suscripción sigue vigente y el
+            // broker ya está entregando lo que guardó; si no, suscribirse
+            if (event->session_present) {
+                ESP_LOGI(TAG, "✅ Conectado al broker (sesión conservada)");
+            } else {
+                ESP_LOGI(TAG, "✅ Conectado al broker (sesión nueva), suscribiendo a %s", s_commands_topic);
+                if (esp_mqtt_client_subscribe(s_client, s_commands_topic, 1) < 0) {
+                    ESP_LOGE(TAG, "Error suscribiendo a %s", s_commands_topic);
+                }
+            }
+            break;
+
+        case MQTT_EVENT_DISCONNECTED:
+            if (s_connected) {
+                ESP_LOGW(TAG, "Desconectado del broker");
+                portENTER_CRITICAL(&s_stats_lock);
+                s_stats.disconnects++;
+                portEXIT_CRITICAL(&s_stats_lock);
+            }
+            s_connected = false;
+            break;
+
+        case MQTT_EVENT_SUBSCRIBED:
+            ESP_LOGI(TAG, "Suscripto a comandos (msg_id=%d)", event->msg_id);
+            break;
+
+        case MQTT_EVENT_PUBLISHED:
+            s_acked_msg_id = event->msg_id;
+            xSemaphoreGive(s_puback_sem);
+            break;
+
+        case MQTT_EVENT_DATA:
+            if (event->topic_len == (int)strlen(s_commands_topic) &&
+                strncmp(event->topic, s_commands_topic, event->topic_len) == 0) {
+                handle_commands_message(event);
+            } else if (event->current_data_offset == 0) {
+                ESP_LOGD(TAG, "Mensaje en topic inesperado: %.*s", event->topic_len, event->topic);
+            }
+            break;
+
+        case MQTT_EVENT_ERROR:
+            if (event->error_handle && event->error_handle->error_type == MQTT_ERROR_TYPE_CONNECTION_REFUSED) {
+                ESP_LOGE(TAG, "El broker rechazó la conexión (código %d): revisar usuario, contraseña y ACL",
+                         (int)event->error_handle->connect_return_code);
+                portENTER_CRITICAL(&s_stats_lock);
+                s_stats.connects_refused++;
+                portEXIT_CRITICAL(&s_stats_lock);
+            } else {
+                ESP_LOGW(TAG, "Error MQTT (tipo %d)", event->error_handle ? (int)event->error_handle->error_type : -1);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Indica si la URI del broker usa TLS
+ */
+static bool uri_uses_tls(const char *uri)
+{
+    return strncmp(uri, "mqtts://", 8) == 0 || strncmp(uri, "wss://", 6) == 0;
+}
+
+/**
+ * @brief Sender registrado en supabase_client
+ */
+static esp_err_t send_events(const char *json, uint32_t timeout_ms, void *user_data)
+{
+    return mqtt_backend_publish_events(json, timeout_ms);
+}
+
+// ============================================================================
+// Funciones públicas
+// ============================================================================
+
+esp_err_t mqtt_backend_init(const char *broker_uri, const char *username, const char *password)
+{
+    if (s_client != NULL) {
+        ESP_LOGW(TAG, "Backend MQTT ya iniciado");
+        return ESP_OK;
+    }
+    if (broker_uri == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Quien publica en el topic de comandos puede desarmar: sin TLS ni
+    // credenciales no se conecta ni se suscribe (ver mqtt_backend.h)
+    if (!uri_uses_tls(broker_uri)) {
+        ESP_LOGE(TAG, "El broker tiene que usar mqtts:// o wss:// (%s)", broker_uri);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (username == NULL || username[0] == '\0' || password == NULL || password[0] == '\0') {
+        ESP_LOGE(TAG, "Faltan el usuario o la contraseña del broker");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Client id fijo: es lo que identifica la sesión persistente en el broker
+    char device_id[DEVICE_ID_LEN];
+    if (device_identity_get_id(device_id) != ESP_OK) {
+        ESP_LOGE(TAG, "Sin device_id, no se puede identificar la sesión");
+        return ESP_ERR_INVALID_STATE;
+    }
+    snprintf(s_client_id, sizeof(s_client_id), "%s", device_id);
+    snprintf(s_events_topic, sizeof(s_events_topic), MQTT_BACKEND_TOPIC_PREFIX "/%s/events", device_id);
+    snprintf(s_commands_topic, sizeof(s_commands_topic), MQTT_BACKEND_TOPIC_PREFIX "/%s/commands", device_id);
+
+    if (s_publish_mutex == NULL) {
+        s_publish_mutex = xSemaphoreCreateMutex();
+        s_puback_sem = xSemaphoreCreateBinary();
+        if (s_publish_mutex == NULL || s_puback_sem == NULL) {
+            ESP_LOGE(TAG, "Error al crear semáforos");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    const esp_mqtt_client_config_t cfg = {
+        .broker.address.uri = broker_uri,
+        .broker.verification.certificate = MQTT_BACKEND_BROKER_CA,
+        .broker.verification.crt_bundle_attach = MQTT_BACKEND_BROKER_CA ? NULL : esp_crt_bundle_attach,
+        .credentials.client_id = s_client_id,
+        .credentials.username = username,
+        .credentials.authentication.password = password,
+        .session.disable_clean_session = true,
+        .session.keepalive = MQTT_BACKEND_KEEPALIVE_S,
+        .network.reconnect_timeout_ms = MQTT_BACKEND_RECONNECT_MS,
+        .buffer.size = MQTT_BACKEND_BUFFER_SIZE,
+    };
+
+    s_client = esp_mqtt_client_init(&cfg);
+    if (s_client == NULL) {
+        ESP_LOGE(TAG, "Error al crear el cliente MQTT");
+        return ESP_ERR_NO_MEM;
+    }
+    esp_mqtt_client_register_event(s_client, MQTT_EVENT_ANY, mqtt_event_handler, NULL);
+
+    esp_err_t err = esp_mqtt_client_start(s_client);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error al iniciar el cliente MQTT: %s", esp_err_to_name(err));
+        esp_mqtt_client_destroy(s_client);
+        s_client = NULL;
+        return err;
+    }
+
+    // Se usa si SUPABASE_EVENT_TRANSPORT es MQTT. Mientras no haya conexión el
+    // sender devuelve ESP_ERR_INVALID_STATE y supabase_client usa HTTPS
+    supabase_set_event_sender(SUPABASE_EVENT_TRANSPORT_MQTT, send_events, NULL);
+
+    ESP_LOGI(TAG, "Backend MQTT iniciado");
+    ESP_LOGI(TAG, "  Broker: %s (usuario %s)", broker_uri, username);
+    ESP_LOGI(TAG, "  Eventos: %s (QoS1, hasta %d por mensaje)", s_events_topic, SUPABASE_EVENT_BATCH_MAX);
+    ESP_LOGI(TAG, "  Comandos: %s (QoS1, sesión persistente)", s_commands_topic);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_backend_stop(void)
+{
+    if (s_client == NULL) {
+        return ESP_OK;
+    }
+
+    supabase_set_event_sender(SUPABASE_EVENT_TRANSPORT_MQTT, NULL, NULL);
+
+    // Sin DISCONNECT con clean session: la sesión sigue en el broker
+    esp_mqtt_client_stop(s_client);
+    esp_mqtt_client_destroy(s_client);
+    s_client = NULL;
+    s_connected = false;
+    ESP_LOGI(TAG, "Backend MQTT detenido, eventos por HTTPS");
+    return ESP_OK;
+}
+
+esp_err_t mqtt_backend_publish_events(const char *json, uint32_t timeout_ms)
+{
+    if (json == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Sin conexión no se encola en el outbox: el evento va por HTTPS ya
+    if (s_client == NULL || !s_connected) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xSemaphoreTake(s_publish_mutex, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Descartar avisos de PUBACK que llegaron tarde a un envío anterior
+    xSemaphoreTake(s_puback_sem, 0);
+    s_acked_msg_id = -1;
+
+    int64_t start_us = esp_timer_get_time();
+    size_t len = strlen(json);
+    int msg_id = esp_mqtt_client_publish(s_client, s_events_topic, json, (int)len, 1, 0);
+    esp_err_t err = ESP_OK;
+    if (msg_id < 0) {
+        err = ESP_FAIL;
+    } else {
+        int64_t deadline_us = start_us + (int64_t)timeout_ms * 1000;
+        while (s_acked_msg_id != msg_id) {
+            int64_t remaining_us = deadline_us - esp_timer_get_time();
+            if (remaining_us <= 0 ||
+                xSemaphoreTake(s_puback_sem, pdMS_TO_TICKS(remaining_us / 1000) + 1) != pdTRUE) {
+                err = s_acked_msg_id == msg_id ? ESP_OK : ESP_ERR_TIMEOUT;
+                break;
+            }
+        }
+    }
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    xSemaphoreGive(s_publish_mutex);
+
+    portENTER_CRITICAL(&s_stats_lock);
+    if (err == ESP_OK) {
+        s_stats.published++;
+        s_stats.bytes_published += len;
+        s_puback_total_ms += elapsed_ms;
+        s_stats.puback_avg_ms = (uint32_t)(s_puback_total_ms / s_stats.published);
+        if (elapsed_ms > s_stats.puback_max_ms) {
+            s_stats.puback_max_ms = elapsed_ms;
+        }
+    } else {
+        s_stats.publish_failures++;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    if (err != ESP_OK) {
+        // Con timeout el mensaje sigue en el outbox y puede llegar duplicado
+        ESP_LOGW(TAG, "Publicación sin PUBACK (msg_id=%d): %s", msg_id, esp_err_to_name(err));
+    }
+    return err;
+}
+
+bool mqtt_backend_is_connected(void)
+{
+    return s_connected;
+}
+
+esp_err_t mqtt_backend_get_stats(mqtt_backend_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+    stats->connected = s_connected;
+    return ESP_OK;
+}
+
+void mqtt_backend_print_stats(void)
+{
+    mqtt_backend_stats_t stats;
+    mqtt_backend_get_stats(&stats);
+
+    ESP_LOGI(TAG, "Broker (%s): %lu conexiones (%lu con sesión conservada), %lu rechazadas, %lu desconexiones",
+             stats.connected ? "conectado" : "desconectado", (unsigned long)stats.connects,
+             (unsigned long)stats.sessions_resumed, (unsigned long)stats.connects_refused,
+             (unsigned long)stats.disconnects);
+    ESP_LOGI(TAG, "  - Publicaciones: %lu con PUBACK (%lu bytes), %lu sin PUBACK, espera %lu ms prom / %lu ms máx",
+             (unsigned long)stats.published, (unsigned long)stats.bytes_published,
+             (unsigned long)stats.publish_failures, (unsigned long)stats.puback_avg_ms,
+             (unsigned long)stats.puback_max_ms);
+    ESP_LOGI(TAG, "  - Comandos: %lu recibidos, %lu mensajes inválidos",
+             (unsigned long)stats.commands, (unsigned long)stats.commands_invalid);
+
+    // Mismo tráfico por los dos caminos: latencia y throughput lado a lado
+    supabase_event_stats_t events;
+    supabase_get_event_stats(&events);
+    const supabase_transport_stats_t *mqtt = &events.transports[SUPABASE_EVENT_TRANSPORT_MQTT];
+    const supabase_transport_stats_t *https = &events.transports[SUPABASE_EVENT_TRANSPORT_HTTPS];
+    ESP_LOGI(TAG, "  - MQTT:  %lu eventos en %lu mensajes, %lu ms prom / %lu ms máx, %lu eventos/s",
+             (unsigned long)mqtt->sent, (unsigned long)mqtt->messages, (unsigned long)mqtt->latency_avg_ms,
+             (unsigned long)mqtt->latency_max_ms, (unsigned long)mqtt->events_per_s);
+    ESP_LOGI(TAG, "  - HTTPS: %lu eventos en %lu mensajes, %lu ms prom / %lu ms máx, %lu eventos/s",
+             (unsigned long)https->sent, (unsigned long)https->messages, (unsigned long)https->latency_avg_ms,
+             (unsigned long)https->latency_max_ms, (unsigned long)https->events_per_s);
+}
@@ -0,0 +1,140 @@
+/**
+ * @file codec_benchmark.c
+ * @brief Comparación de los serializadores vsn 1.0.0 (objeto) y 2.0.0 (arreglo)
+ *
+ * Cada mensaje típico del Gateway se serializa y se parsea con ambas
+ * versiones: bytes por mensaje y tiempo de create_phoenix_message() y de
+ * process_message() (parseo y despacho). Los bytes no dependen del host;
+ * los tiempos sirven para comparar las dos versiones entre sí.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "codec_benchmark.h"
+
+#define BENCH_ITERATIONS    20000
+#define BENCH_MSG_MAX       1024
+
+/**
+ * @brief Mensaje de la mezcla de tráfico
+ */
+typedef struct {
+    const char *name;
+    const char *topic;
+    const char *event;
+    const char *broadcast_event;    /**< Evento de phoenix_broadcast() (envuelve el payload) */
+    const char *payload;
+    uint32_t ref;
+    uint32_t join_ref;
+} bench_msg_t;
+
+static const bench_msg_t s_messages[] = {
+    {
+        .name = "heartbeat",
+        .topic = "phoenix",
+        .event = "heartbeat",
+        .payload = NULL,
+        .ref = 1842,
+    },
+    {
+        .name = "phx_reply",
+        .topic = "phoenix",
+        .event = "phx_reply",
+        .payload = "{\"status\":\"ok\",\"response\":{}}",
+        .ref = 1842,
+    },
+    {
+        .name = "phx_join",
+        .topic = "realtime:public:system_commands:device_id=eq.GW-A1B2C3",
+        .event = "phx_join",
+        .payload = "{\"config\":{\"postgres_changes\":[{\"event\":\"INSERT\",\"schema\":\"public\","
+                   "\"table\":\"system_commands\",\"filter\":\"device_id=eq.GW-A1B2C3\"}]}}",
+        .ref = 3,
+        .join_ref = 3,
+    },
+    {
+        .name = "broadcast",
+        .topic = "realtime:site-7f3a",
+        .event = "broadcast",
+        .broadcast_event = "state",
+        .payload = "{\"state\":\"ARMED\",\"source\":\"GW-A1B2C3\",\"ts\":1760771234}",
+        .ref = 1843,
+        .join_ref = 5,
+    },
+    {
+        .name = "postgres_changes",
+        .topic = "realtime:public:system_commands:device_id=eq.GW-A1B2C3",
+        .event = "postgres_changes",
+        .payload = "{\"ids\":[48213],\"data\":{\"schema\":\"public\",\"table\":\"system_commands\","
+                   "\"commit_timestamp\":\"2026-10-18T07:10:01.123Z\",\"eventType\":\"INSERT\","
+                   "\"new\":{\"id\":\"6f1c2a9e-0b7d-4c1e-9f3a-2d5e8b7c4a10\",\"device_id\":\"GW-A1B2C3\","
+                   "\"command\":\"ARM\",\"created_at\":\"2026-10-18T07:10:01.101Z\"},\"errors\":null}}",
+        .join_ref = 3,
+    },
+};
+
+#define BENCH_MSG_COUNT (sizeof(s_messages) / sizeof(s_messages[0]))
+
+/**
+ * @brief Resultado de una versión para un mensaje
+ */
+typedef struct {
+    size_t bytes;
+    double encode_ns;
+    double decode_ns;
+} bench_result_t;
+
+static bool bench_version(const bench_msg_t *m, phoenix_vsn_t vsn, bench_result_t *result)
+{
+    static char text[BENCH_MSG_MAX];
+    result->bytes = phoenix_bench_encode(vsn, m->topic, m->event, m->broadcast_event, m->payload,
+                                         m->ref, m->join_ref, text, sizeof(text));
+    if (result->bytes == 0) {
+        return false;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        phoenix_bench_encode(vsn, m->topic, m->event, m->broadcast_event, m->payload,
+                             m->ref, m->join_ref, NULL, 0);
+    }
+    result->encode_ns = (double)(esp_timer_get_time() - start_us) * 1000.0 / BENCH_ITERATIONS;
+
+    // El servidor usa el mismo formato que el cliente para la versión pedida
+    start_us = esp_timer_get_time();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        phoenix_bench_decode(text, result->bytes);
+    }
+    result->decode_ns = (double)(esp_timer_get_time() - start_us) * 1000.0 / BENCH_ITERATIONS;
+    return true;
+}
+
+void app_main(void)
+{
+    phoenix_bench_init();
+
+    printf("%-17s | %8s %8s %7s | %11s %11s | %11s %11s\n", "mensaje",
+           "B 1.0.0", "B 2.0.0", "ahorro", "enc ns 1.0", "enc ns 2.0", "dec ns 1.0", "dec ns 2.0");
+
+    size_t total_v1 = 0;
+    size_t total_v2 = 0;
+    for (size_t i = 0; i < BENCH_MSG_COUNT; i++) {
+        const bench_msg_t *m = &s_messages[i];
+        bench_result_t v1;
+        bench_result_t v2;
+        if (!bench_version(m, PHOENIX_VSN_1_0_0, &v1) || !bench_version(m, PHOENIX_VSN_2_0_0, &v2)) {
+            printf("%-17s | failed\n", m->name);
+            exit(1);
+        }
+        total_v1 += v1.bytes;
+        total_v2 += v2.bytes;
+        printf("%-17s | %8u %8u %6.1f%% | %11.0f %11.0f | %11.0f %11.0f\n", m->name,
+               (unsigned)v1.bytes, (unsigned)v2.bytes, 100.0 * (1.0 - (double)v2.bytes / v1.bytes),
+               v1.encode_ns, v2.encode_ns, v1.decode_ns, v2.decode_ns);
+    }
+    printf("%-17s | %8u %8u %6.1f%% |\n", "total", (unsigned)total_v1, (unsigned)total_v2,
+           100.0 * (1.0 - (double)total_v2 / total_v1));
+    exit(0);
+}
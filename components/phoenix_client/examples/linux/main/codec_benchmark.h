@@ -0,0 +1,32 @@
+/**
+ * @file codec_benchmark.h
+ * @brief Acceso a los serializadores de phoenix_client.c (phoenix_under_test.c)
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "phoenix_client.h"
+
+/**
+ * @brief Prepara el contexto de phoenix_client sin conectar
+ */
+void phoenix_bench_init(void);
+
+/**
+ * @brief Serializa un mensaje con la versión indicada
+ *
+ * @param broadcast_event Evento de broadcast (como phoenix_broadcast), o NULL
+ * @param out Destino del mensaje (NULL para solo medir)
+ * @param cap Tamaño de out
+ * @return Largo del mensaje, 0 si no hubo memoria o no entra en out
+ */
+size_t phoenix_bench_encode(phoenix_vsn_t vsn, const char *topic, const char *event,
+                            const char *broadcast_event, const char *payload,
+                            uint32_t ref, uint32_t join_ref, char *out, size_t cap);
+
+/**
+ * @brief Parsea y despacha un mensaje recibido (process_message)
+ */
+void phoenix_bench_decode(const char *message, size_t len);
@@ -0,0 +1,55 @@
+/**
+ * @file fakes.c
+ * @brief Cliente WebSocket y tls_manager para el target linux
+ *
+ * El benchmark no conecta: alcanza con que phoenix_client.c enlace.
+ * esp_timer está en host_test_support (sim_clock.h).
+ */
+
+#include "esp_websocket_client.h"
+#include "tls_manager.h"
+
+// ============================================================================
+// tls_manager
+// ============================================================================
+
+esp_err_t tls_manager_init(void) { return ESP_OK; }
+void tls_manager_note_verify_failure(const char *host, int verify_flags) { }
+void tls_manager_note_external(const char *host, bool open) { }
+
+esp_err_t tls_manager_get_trust(const char *host, tls_manager_trust_t *trust)
+{
+    *trust = (tls_manager_trust_t) {0};
+    return ESP_OK;
+}
+
+// ============================================================================
+// Cliente WebSocket (sin conexión)
+// ============================================================================
+
+esp_websocket_client_handle_t esp_websocket_client_init(const esp_websocket_client_config_t *config)
+{
+    return NULL;
+}
+
+esp_err_t esp_websocket_register_events(esp_websocket_client_handle_t client, esp_websocket_event_id_t event,
+                                        esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_websocket_client_start(esp_websocket_client_handle_t client) { return ESP_ERR_NOT_SUPPORTED; }
+esp_err_t esp_websocket_client_stop(esp_websocket_client_handle_t client) { return ESP_OK; }
+esp_err_t esp_websocket_client_destroy(esp_websocket_client_handle_t client) { return ESP_OK; }
+
+int esp_websocket_client_send_batch(esp_websocket_client_handle_t client, ws_transport_opcodes_t opcode,
+                                    const esp_websocket_message_t *msgs, int count, TickType_t timeout)
+{
+    return -1;
+}
+
+esp_err_t esp_websocket_client_get_deflate_stats(esp_websocket_client_handle_t client,
+                                                 esp_websocket_deflate_stats_t *stats)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file phoenix_under_test.c
+ * @brief phoenix_client.c con acceso a los serializadores para el benchmark
+ *
+ * create_phoenix_message() y process_message() son los mismos caminos que
+ * recorren los mensajes en el Gateway; acá se llaman sin conexión.
+ */
+
+#include "../../../src/phoenix_client.c"
+#include "codec_benchmark.h"
+
+// ============================================================================
+// Acceso para el benchmark
+// ============================================================================
+
+void phoenix_bench_init(void)
+{
+    if (!s_ctx.lock) {
+        s_ctx.lock = xSemaphoreCreateMutex();
+    }
+}
+
+size_t phoenix_bench_encode(phoenix_vsn_t vsn, const char *topic, const char *event,
+                            const char *broadcast_event, const char *payload,
+                            uint32_t ref, uint32_t join_ref, char *out, size_t cap)
+{
+    s_ctx.vsn = vsn;
+    phoenix_tx_msg_t *msg = create_phoenix_message(topic, event, broadcast_event, payload, false, ref, join_ref);
+    if (!msg) {
+        return 0;
+    }
+
+    size_t len = msg->len;
+    if (out) {
+        if (len >= cap) {
+            tx_free(msg);
+            return 0;
+        }
+        memcpy(out, msg->data, msg->head_len);
+        memcpy(out + msg->head_len, msg->payload, msg->payload_len);
+        memcpy(out + msg->head_len + msg->payload_len, msg->tail, msg->tail_len);
+        out[len] = '\0';
+    }
+    tx_free(msg);
+    return len;
+}
+
+void phoenix_bench_decode(const char *message, size_t len)
+{
+    process_message(message, len);
+}
@@ -12,12 +12,16 @@
 #define PHOENIX_CLIENT_H
 
 #include "esp_err.h"
+#include "cJSON.h"
 #include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/** @brief Largo máximo de un topic de Postgres Changes, con el terminador */
+#define PHOENIX_TOPIC_MAX_LEN   160
+
 /**
  * @brief Callback para eventos recibidos del canal
  *
@@ -27,6 +31,127 @@ extern "C" {
  */
 typedef void (*phoenix_event_callback_t)(const char *event, const char *payload, void *user_data);
 
+/**
+ * @brief Callback para eventos recibidos del canal, con el payload ya parseado
+ *
+ * El mensaje se parsea una sola vez al recibirlo y el callback recibe el nodo
+ * del payload dentro de ese árbol, sin re-serializar ni copiar. El nodo
+ * pertenece al cliente y solo es válido durante la llamada; no modificarlo
+ * ni liberarlo, y copiar (cJSON_Duplicate) lo que deba conservarse.
+ *
+ * @param event Nombre del evento (ej: "INSERT", "UPDATE")
+ * @param payload Nodo JSON del payload del evento
+ * @param user_data Datos de usuario pasados en la suscripción
+ */
+typedef void (*phoenix_json_callback_t)(const char *event, const cJSON *payload, void *user_data);
+
+/**
+ * @brief Callback de finalización de un request con respuesta
+ *
+ * @param result ESP_OK si el servidor respondió status "ok", ESP_FAIL si
+ *               respondió con error, ESP_ERR_TIMEOUT si venció el deadline
+ *               o ESP_ERR_INVALID_STATE si se perdió la conexión
+ * @param response Objeto "response" del phx_reply (NULL si no hubo respuesta),
+ *                 válido solo durante la llamada
+ * @param user_data Datos de usuario pasados al enviar
+ */
+typedef void (*phoenix_reply_callback_t)(esp_err_t result, const cJSON *response, void *user_data);
+
+/**
+ * @brief Versión del protocolo (serializador) de Phoenix
+ *
+ * 2.0.0 codifica cada mensaje como arreglo [join_ref, ref, topic, event, payload]
+ * en lugar de un objeto con claves repetidas: menos bytes por mensaje y
+ * menos trabajo de parseo.
+ */
+typedef enum {
+    PHOENIX_VSN_1_0_0 = 0,      /**< Mensajes objeto (por defecto) */
+    PHOENIX_VSN_2_0_0,          /**< Mensajes arreglo */
+} phoenix_vsn_t;
+
+/**
+ * @brief Costo de serialización de mensajes
+ *
+ * Comparando dos conexiones con distinta versión se obtiene la diferencia
+ * de bytes y de tiempo de codificación/decodificación por mensaje sobre el
+ * tráfico real; examples/linux compara ambas versiones en el host.
+ *
+ * Con permessage-deflate (CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE)
+ * rx_inflated_bytes / rx_wire_bytes es la razón de compresión y inflate_us
+ * el costo de CPU de descomprimir.
+ */
+typedef struct {
+    phoenix_vsn_t vsn;          /**< Versión de la conexión actual */
+    uint32_t encoded;           /**< Mensajes serializados */
+    uint32_t decoded;           /**< Mensajes parseados */
+    uint64_t tx_bytes;          /**< Bytes serializados */
+    uint64_t rx_bytes;          /**< Bytes parseados */
+    uint64_t encode_us;         /**< Tiempo total de serialización */
+    uint64_t decode_us;         /**< Tiempo total de parseo */
+    uint32_t rx_compressed;     /**< Mensajes recibidos comprimidos */
+    uint64_t rx_wire_bytes;     /**< Bytes comprimidos recibidos */
+    uint64_t rx_inflated_bytes; /**< Bytes tras descomprimir */
+    uint64_t inflate_us;        /**< Tiempo total de descompresión */
+} phoenix_codec_stats_t;
+
+/**
+ * @brief Clase de un mensaje saliente
+ *
+ * Los mensajes se encolan y los envía una tarea dedicada; la cola tiene
+ * memoria acotada y la clase decide qué pasa cuando se llena.
+ */
+typedef enum {
+    PHOENIX_TX_RELIABLE = 0,    /**< Nunca se descarta; si no hay lugar el envío falla con ESP_ERR_NO_MEM */
+    PHOENIX_TX_BEST_EFFORT,     /**< Se descarta (el más antiguo primero) para hacer lugar */
+    PHOENIX_TX_LATEST,          /**< Como BEST_EFFORT, y reemplaza al encolado con igual topic+event */
+} phoenix_tx_class_t;
+
+/**
+ * @brief Estadísticas de la cola de salida
+ */
+typedef struct {
+    uint32_t queued;            /**< Mensajes encolados */
+    uint32_t sent;              /**< Mensajes escritos en el socket */
+    uint32_t writes;            /**< Escrituras al socket (varios mensajes por registro TLS) */
+    uint32_t send_errors;       /**< Escrituras fallidas */
+    uint32_t dropped;           /**< Descartados por política o desconexión */
+    uint32_t coalesced;         /**< Reemplazados por uno más reciente */
+    uint32_t rejected;          /**< Envíos fiables rechazados por cola llena */
+    uint32_t bytes_queued;      /**< Bytes encolados ahora */
+    uint32_t bytes_peak;        /**< Máximo de bytes encolados */
+} phoenix_tx_stats_t;
+
+/**
+ * @brief Estadísticas de recepción
+ */
+typedef struct {
+    uint32_t messages;          /**< Mensajes de texto completos procesados */
+    uint32_t reassembled;       /**< Mensajes que llegaron en varios trozos o frames */
+    uint32_t overflows;         /**< Mensajes descartados por superar el tamaño máximo */
+    uint32_t incomplete;        /**< Mensajes abandonados sin FIN */
+    uint32_t largest_message;   /**< Mayor mensaje reensamblado (bytes) */
+} phoenix_rx_stats_t;
+
+/**
+ * @brief Estadísticas del heartbeat
+ *
+ * Cada heartbeat espera su phx_reply; tras PHOENIX_HEARTBEAT_MAX_MISSED
+ * respuestas perdidas seguidas se fuerza la reconexión. El intervalo baja a
+ * la mitad cuando se pierde la conexión (típico de un NAT que expiró la
+ * entrada) y vuelve a subir gradualmente hasta el configurado mientras el
+ * enlace responde.
+ */
+typedef struct {
+    uint32_t sent;              /**< Heartbeats enviados */
+    uint32_t replies;           /**< Respuestas recibidas */
+    uint32_t missed;            /**< Respuestas que no llegaron a tiempo */
+    uint32_t reconnects;        /**< Reconexiones forzadas por el watchdog */
+    uint32_t rtt_last_ms;       /**< RTT del último heartbeat */
+    uint32_t rtt_avg_ms;        /**< RTT promedio (EWMA) */
+    uint32_t rtt_max_ms;        /**< RTT máximo observado */
+    uint32_t interval_ms;       /**< Intervalo de heartbeat en uso */
+} phoenix_heartbeat_stats_t;
+
 /**
  * @brief Inicializa el cliente Phoenix
  *
@@ -36,6 +161,18 @@ typedef void (*phoenix_event_callback_t)(const char *event, const char *payload,
  */
 esp_err_t phoenix_init(const char *supabase_url, const char *anon_key);
 
+/**
+ * @brief Selecciona la versión de protocolo para la próxima conexión
+ *
+ * La versión se envía en la URL (vsn) y fija el formato de los mensajes
+ * salientes. Los entrantes se aceptan en ambos formatos.
+ *
+ * @param vsn Versión a usar
+ * @return ESP_OK si se configuró
+ * @return ESP_ERR_INVALID_STATE si ya hay una conexión (llamar antes de phoenix_connect)
+ */
+esp_err_t phoenix_set_protocol_version(phoenix_vsn_t vsn);
+
 /**
  * @brief Conecta a Supabase Realtime via WebSocket
  *
@@ -73,16 +210,236 @@ esp_err_t phoenix_subscribe(const char *topic, phoenix_event_callback_t callback
 esp_err_t phoenix_subscribe_postgres(const char *schema, const char *table, const char *event,
                                       phoenix_event_callback_t callback, void *user_data);
 
+/**
+ * @brief Suscribe a un canal Phoenix recibiendo el payload ya parseado
+ *
+ * Igual que phoenix_subscribe() pero evita serializar el payload para el
+ * callback y que el callback lo vuelva a parsear.
+ *
+ * @param topic Nombre del topic (ej: "realtime:system_commands")
+ * @param callback Callback para eventos del canal
+ * @param user_data Datos de usuario para el callback
+ * @return ESP_OK si la suscripción se inició correctamente
+ */
+esp_err_t phoenix_subscribe_json(const char *topic, phoenix_json_callback_t callback, void *user_data);
+
+/**
+ * @brief Suscribe a Postgres Changes recibiendo el payload ya parseado
+ *
+ * Igual que phoenix_subscribe_postgres() pero con phoenix_json_callback_t.
+ *
+ * @param schema Nombre del schema (ej: "public")
+ * @param table Nombre de la tabla (ej: "system_commands")
+ * @param event Tipo de evento (ej: "INSERT", "UPDATE", "*")
+ * @param callback Callback para eventos del canal
+ * @param user_data Datos de usuario para el callback
+ * @return ESP_OK si la suscripción se inició correctamente
+ */
+esp_err_t phoenix_subscribe_postgres_json(const char *schema, const char *table, const char *event,
+                                           phoenix_json_callback_t callback, void *user_data);
+
+/**
+ * @brief Suscribe a Postgres Changes con un filtro evaluado en el servidor
+ *
+ * Supabase Realtime solo envía las filas que cumplen el filtro, en formato
+ * "columna=operador.valor" (operadores eq, neq, lt, lte, gt, gte, in).
+ * Ejemplo: "device_id=eq.GHOST-0A1B2C".
+ *
+ * @param schema Nombre del schema (ej: "public")
+ * @param table Nombre de la tabla (ej: "system_commands")
+ * @param event Tipo de evento (ej: "INSERT", "UPDATE", "*")
+ * @param filter Filtro (NULL o "" = sin filtro)
+ * @param callback Callback para eventos del canal
+ * @param user_data Datos de usuario para el callback
+ * @param[out] topic Topic de la suscripción, para phoenix_is_joined()
+ *                   (PHOENIX_TOPIC_MAX_LEN bytes, puede ser NULL)
+ * @return ESP_OK si la suscripción se inició correctamente
+ * @return ESP_ERR_INVALID_SIZE si el filtro es demasiado largo
+ */
+esp_err_t phoenix_subscribe_postgres_filtered(const char *schema, const char *table, const char *event,
+                                              const char *filter, phoenix_json_callback_t callback,
+                                              void *user_data, char *topic);
+
+/**
+ * @brief Suscribe a un canal de Broadcast de Supabase Realtime
+ *
+ * Los mensajes de broadcast viajan entre clientes por el WebSocket sin pasar
+ * por la base de datos. El callback recibe el evento y el payload enviados
+ * con phoenix_broadcast() (ya desenvueltos).
+ *
+ * @param channel Nombre del canal (el topic es "realtime:<channel>")
+ * @param callback Callback para los mensajes del canal
+ * @param user_data Datos de usuario para el callback
+ * @return ESP_OK si la suscripción se inició correctamente
+ */
+esp_err_t phoenix_subscribe_broadcast(const char *channel, phoenix_json_callback_t callback, void *user_data);
+
+/**
+ * @brief Une un canal de Broadcast pidiendo confirmación de cada envío
+ *
+ * Con ack el servidor responde un phx_reply a cada broadcast del cliente,
+ * que se recibe con phoenix_broadcast_with_reply(). Útil para canales donde
+ * el Gateway publica datos que no deben perderse.
+ *
+ * @param channel Nombre del canal (el topic es "realtime:<channel>")
+ * @param callback Callback para los mensajes del canal (puede ser NULL si solo se publica)
+ * @param user_data Datos de usuario para el callback
+ * @return ESP_OK si la suscripción se inició correctamente
+ */
+esp_err_t phoenix_subscribe_broadcast_ack(const char *channel, phoenix_json_callback_t callback, void *user_data);
+
+/**
+ * @brief Envía un mensaje a un canal de Broadcast
+ *
+ * El emisor no recibe su propio mensaje. El mensaje
+ * {"type":"broadcast","event":..,"payload":..} se escribe directamente en
+ * la entrada de la cola de salida (el evento se escapa como string JSON).
+ *
+ * @param channel Nombre del canal (suscrito con phoenix_subscribe_broadcast)
+ * @param event Nombre del evento
+ * @param payload Payload JSON (puede ser NULL)
+ * @param tx_class Política si la cola de salida está llena
+ * @return ESP_OK si se encoló correctamente
+ * @return ESP_ERR_INVALID_STATE si el canal no está unido
+ */
+esp_err_t phoenix_broadcast(const char *channel, const char *event, const char *payload,
+                            phoenix_tx_class_t tx_class);
+
+/**
+ * @brief Envía un broadcast cediendo el payload (ver phoenix_send_owned)
+ *
+ * @param channel Nombre del canal (suscrito con phoenix_subscribe_broadcast)
+ * @param event Nombre del evento
+ * @param payload Payload JSON de malloc (ej: cJSON_PrintUnformatted); se
+ *                libera siempre, también si la función falla
+ * @param tx_class Política si la cola de salida está llena
+ * @return Igual que phoenix_broadcast()
+ */
+esp_err_t phoenix_broadcast_owned(const char *channel, const char *event, char *payload,
+                                  phoenix_tx_class_t tx_class);
+
+/**
+ * @brief Envía un broadcast y notifica la confirmación del servidor
+ *
+ * El canal debe estar unido con phoenix_subscribe_broadcast_ack(); si no,
+ * el servidor no responde y el callback recibe ESP_ERR_TIMEOUT. Igual que
+ * phoenix_send_with_reply(), el callback se llama exactamente una vez.
+ *
+ * @param channel Nombre del canal
+ * @param event Nombre del evento
+ * @param payload Payload JSON (puede ser NULL)
+ * @param timeout_ms Deadline de la confirmación
+ * @param callback Callback de finalización
+ * @param user_data Datos de usuario para el callback
+ * @return ESP_OK si se encoló (el resultado llega por el callback)
+ * @return ESP_ERR_INVALID_STATE si el canal no está unido
+ */
+esp_err_t phoenix_broadcast_with_reply(const char *channel, const char *event, const char *payload,
+                                       uint32_t timeout_ms, phoenix_reply_callback_t callback, void *user_data);
+
 /**
  * @brief Envia un evento al canal
  *
+ * El mensaje se encola como PHOENIX_TX_RELIABLE; no bloquea esperando al
+ * socket.
+ *
  * @param topic Topic del canal
  * @param event Nombre del evento
  * @param payload Payload JSON (puede ser NULL)
- * @return ESP_OK si se envió correctamente
+ * @return ESP_OK si se encoló correctamente
  */
 esp_err_t phoenix_send(const char *topic, const char *event, const char *payload);
 
+/**
+ * @brief Envia un evento al canal con una clase de descarte
+ *
+ * @param topic Topic del canal
+ * @param event Nombre del evento
+ * @param payload Payload JSON (puede ser NULL)
+ * @param tx_class Política si la cola de salida está llena
+ * @return ESP_OK si se encoló correctamente
+ * @return ESP_ERR_NO_MEM si no hubo lugar
+ */
+esp_err_t phoenix_send_with_class(const char *topic, const char *event, const char *payload,
+                                  phoenix_tx_class_t tx_class);
+
+/**
+ * @brief Envia un evento al canal cediendo el payload
+ *
+ * Las demás funciones de envío copian el payload en la entrada de la cola
+ * de salida (una reserva por mensaje: sobre + copia). Con esta el payload
+ * ya serializado (ej: el resultado de cJSON_PrintUnformatted) pasa a la
+ * entrada sin copiarse y se libera cuando el mensaje se envía o se
+ * descarta; la reserva de la entrada queda solo para el sobre. Un payload
+ * que no es JSON (objeto o arreglo) se escribe como string y se libera al
+ * encolarlo.
+ *
+ * @param topic Topic del canal
+ * @param event Nombre del evento
+ * @param payload Payload de malloc; se libera siempre, también si la
+ *                función falla
+ * @param tx_class Política si la cola de salida está llena
+ * @return ESP_OK si se encoló correctamente
+ * @return ESP_ERR_NO_MEM si no hubo lugar
+ */
+esp_err_t phoenix_send_owned(const char *topic, const char *event, char *payload, phoenix_tx_class_t tx_class);
+
+/**
+ * @brief Envia un evento al canal y notifica la respuesta del servidor
+ *
+ * El phx_reply se asocia al envío por su ref. El callback se llama
+ * exactamente una vez: con la respuesta, al vencer timeout_ms o al
+ * desconectarse. Se ejecuta en la tarea del WebSocket o del timer, no debe
+ * bloquear.
+ *
+ * @param topic Topic del canal
+ * @param event Nombre del evento
+ * @param payload Payload JSON (puede ser NULL)
+ * @param timeout_ms Deadline de la respuesta
+ * @param callback Callback de finalización
+ * @param user_data Datos de usuario para el callback
+ * @return ESP_OK si se envió (el resultado llega por el callback)
+ * @return ESP_ERR_NO_MEM si hay demasiados requests pendientes
+ */
+esp_err_t phoenix_send_with_reply(const char *topic, const char *event, const char *payload,
+                                  uint32_t timeout_ms, phoenix_reply_callback_t callback, void *user_data);
+
+/**
+ * @brief Envia un evento al canal y espera la respuesta del servidor
+ *
+ * @note No llamar desde callbacks de phoenix_client
+ *
+ * @param topic Topic del canal
+ * @param event Nombre del evento
+ * @param payload Payload JSON (puede ser NULL)
+ * @param timeout_ms Tiempo máximo de espera de la respuesta
+ * @return ESP_OK si el servidor confirmó, ESP_FAIL si respondió con error,
+ *         ESP_ERR_TIMEOUT sin respuesta a tiempo
+ */
+esp_err_t phoenix_send_sync(const char *topic, const char *event, const char *payload, uint32_t timeout_ms);
+
+/**
+ * @brief Envía un broadcast y espera la confirmación del servidor
+ *
+ * @note No llamar desde callbacks de phoenix_client
+ *
+ * @param channel Nombre del canal (unido con phoenix_subscribe_broadcast_ack)
+ * @param event Nombre del evento
+ * @param payload Payload JSON (puede ser NULL)
+ * @param timeout_ms Tiempo máximo de espera de la confirmación
+ * @return ESP_OK si el servidor confirmó, ESP_ERR_TIMEOUT sin confirmación a tiempo,
+ *         ESP_ERR_INVALID_STATE si el canal no está unido o se perdió la conexión
+ */
+esp_err_t phoenix_broadcast_sync(const char *channel, const char *event, const char *payload, uint32_t timeout_ms);
+
+/**
+ * @brief Obtiene las estadísticas de recepción
+ *
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK
+ */
+esp_err_t phoenix_get_rx_stats(phoenix_rx_stats_t *stats);
+
 /**
  * @brief Verifica si está conectado
  *
@@ -90,14 +447,49 @@ esp_err_t phoenix_send(const char *topic, const char *event, const char *payload
  */
 bool phoenix_is_connected(void);
 
+/**
+ * @brief Verifica si un canal está unido en la conexión actual
+ *
+ * @param topic Topic del canal (Postgres Changes: "realtime:schema:table[:filter]")
+ * @return true si está conectado y el phx_join del canal fue aceptado
+ */
+bool phoenix_is_joined(const char *topic);
+
 /**
  * @brief Configura intervalo de heartbeat (ping)
  *
+ * Es el intervalo máximo: el cliente puede acortarlo si detecta que la red
+ * corta conexiones inactivas antes.
+ *
  * @param interval_ms Intervalo en milisegundos (default: 30000)
  * @return ESP_OK
  */
 esp_err_t phoenix_set_heartbeat_interval(uint32_t interval_ms);
 
+/**
+ * @brief Obtiene el costo acumulado de serialización
+ *
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK
+ */
+esp_err_t phoenix_get_codec_stats(phoenix_codec_stats_t *stats);
+
+/**
+ * @brief Obtiene las estadísticas de la cola de salida
+ *
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK
+ */
+esp_err_t phoenix_get_tx_stats(phoenix_tx_stats_t *stats);
+
+/**
+ * @brief Obtiene las estadísticas del heartbeat (RTT, pérdidas, reconexiones)
+ *
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK
+ */
+esp_err_t phoenix_get_heartbeat_stats(phoenix_heartbeat_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
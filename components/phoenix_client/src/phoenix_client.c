@@ -6,10 +6,12 @@
 
 #include "phoenix_client.h"
 #include "esp_websocket_client.h"
-#include "esp_crt_bundle.h"
+#include "tls_manager.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "cJSON.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -19,13 +21,43 @@ static const char *TAG = "PHOENIX";
 // Constantes
 // ============================================================================
 
-#define PHOENIX_VERSION            "1.0.0"
 #define PHOENIX_HEARTBEAT_INTERVAL  30000  // 30 segundos
+#define PHOENIX_HEARTBEAT_MIN_MS    10000  // Intervalo mínimo al adaptarse a NAT
+#define PHOENIX_HEARTBEAT_TIMEOUT   10000  // Deadline de la respuesta a un heartbeat
+#define PHOENIX_HEARTBEAT_MAX_MISSED 2     // Respuestas perdidas seguidas antes de reconectar
+#define PHOENIX_HEARTBEAT_PROBE_OK  20     // Respuestas seguidas antes de probar un intervalo mayor
+#define PHOENIX_HEARTBEAT_STEP_MS   5000   // Incremento del intervalo al probar
 #define PHOENIX_RECONNECT_DELAY     5000   // 5 segundos
 #define PHOENIX_MAX_REFS           1000000  // Counter para ref
 
 #define WS_BUFFER_SIZE             4096
 
+// Ofrecer compresión solo si el cliente WebSocket la soporta (si no, lo avisa en cada init)
+#ifdef CONFIG_ESP_WS_CLIENT_PERMESSAGE_DEFLATE
+#define PHOENIX_PERMESSAGE_DEFLATE  true
+#else
+#define PHOENIX_PERMESSAGE_DEFLATE  false
+#endif
+
+// Reensamblado de mensajes que llegan en varios trozos o frames
+#define PHOENIX_RX_INITIAL_SIZE     8192   // Capacidad inicial del buffer de reensamblado
+#define PHOENIX_RX_RETAIN_SIZE      16384  // Por encima se libera tras cada mensaje
+#define PHOENIX_RX_MAX_MESSAGE      65536  // Mensajes más grandes se descartan
+
+// Ruteo por topic y respuestas pendientes
+#define PHOENIX_TOPIC_BUCKETS       16     // Potencia de 2
+#define PHOENIX_MAX_PENDING         16     // Requests esperando phx_reply
+#define PHOENIX_PENDING_SWEEP_MS    500    // Resolución de los deadlines
+#define PHOENIX_JOIN_TIMEOUT_MS     10000  // Timeout de phx_join (se reintenta)
+
+// Cola de salida
+#define PHOENIX_TX_MAX_BYTES        16384  // Memoria máxima de mensajes encolados
+#define PHOENIX_TX_CONTROL_RESERVE  2048   // Margen extra para join/heartbeat
+#define PHOENIX_TX_SEND_TIMEOUT_MS  5000   // Timeout de escritura en el socket
+#define PHOENIX_TX_BATCH_MAX        8      // Mensajes por escritura al socket
+#define PHOENIX_TX_TASK_STACK       4096
+#define PHOENIX_TX_TASK_PRIORITY    5
+
 // ============================================================================
 // Estructuras
 // ============================================================================
@@ -37,11 +69,86 @@ typedef struct phoenix_subscription {
     char *topic;
     char *join_payload;  // Payload para el mensaje phx_join (NULL = empty object)
     phoenix_event_callback_t callback;
+    phoenix_json_callback_t json_callback;  // Alternativa a callback: recibe el payload parseado
     void *user_data;
     bool joined;
-    struct phoenix_subscription *next;
+    bool broadcast;      // Canal de broadcast: se desenvuelve {type, event, payload}
+    uint32_t join_ref;   // ref del último phx_join (vsn 2.0.0 lo envía en cada mensaje)
+    uint32_t topic_hash;
+    struct phoenix_subscription *next;          // Lista de todas las suscripciones
+    struct phoenix_subscription *bucket_next;   // Cadena dentro del bucket de la tabla hash
 } phoenix_subscription_t;
 
+/**
+ * @brief Tipo de request que espera phx_reply
+ */
+typedef enum {
+    PHOENIX_PENDING_JOIN = 0,
+    PHOENIX_PENDING_SEND,
+    PHOENIX_PENDING_HEARTBEAT,
+} phoenix_pending_kind_t;
+
+/**
+ * @brief Request enviado que espera phx_reply con el mismo ref
+ */
+typedef struct {
+    bool in_use;
+    phoenix_pending_kind_t kind;
+    uint32_t ref;
+    int64_t sent_us;
+    int64_t deadline_us;
+    phoenix_reply_callback_t callback;
+    void *user_data;
+    phoenix_subscription_t *sub;    // Solo JOIN
+} phoenix_pending_t;
+
+/**
+ * @brief Clase interna para mensajes de protocolo (join, heartbeat)
+ *
+ * No se descartan para hacer lugar: usan PHOENIX_TX_CONTROL_RESERVE.
+ */
+#define PHOENIX_TX_CONTROL          ((phoenix_tx_class_t)0xFF)
+
+/**
+ * @brief Mensaje serializado esperando en la cola de salida
+ *
+ * Una sola reserva contiene la estructura, el sobre (head) y la copia del
+ * payload (o solo el sobre, si el llamador cedió el payload con
+ * phoenix_send_owned()); el cierre del sobre es constante. La tarea de envío los pasa
+ * como segmentos a esp_websocket_client_send_iov() sin concatenarlos. En
+ * un broadcast el head incluye también el inicio del mensaje
+ * {type, event, payload} y el cierre suma su llave.
+ */
+typedef struct phoenix_tx_msg {
+    struct phoenix_tx_msg *next;
+    phoenix_tx_class_t tx_class;
+    uint32_t coalesce_key;      // 0 = no se combina con otros
+    uint32_t ref;
+    size_t len;                 // Longitud total del mensaje
+    size_t head_len;
+    size_t payload_len;
+    size_t tail_len;
+    const char *payload;        // Apunta a data, a un literal o a owned
+    char *owned;                // Payload cedido por el llamador (se libera con el mensaje)
+    const char *tail;           // "}" (vsn 1.0.0) o "]" (vsn 2.0.0), precedido de "}" en broadcast
+    char data[];                // head seguido del payload
+} phoenix_tx_msg_t;
+
+/**
+ * @brief Buffer de reensamblado de mensajes entrantes
+ *
+ * esp_websocket_client entrega un evento DATA por cada bloque de buffer_size
+ * bytes de un frame, y un mensaje puede además venir en varios frames
+ * (continuación, op=0). Los trozos se acumulan aquí hasta el FIN.
+ */
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool active;        // Hay un mensaje en curso
+    bool discarding;    // El mensaje en curso superó el máximo
+} phoenix_rx_buffer_t;
+
 /**
  * @brief Contexto global del cliente Phoenix
  */
@@ -51,10 +158,32 @@ typedef struct {
     char *anon_key;
     bool connected;
     uint32_t ref_counter;
-    uint32_t heartbeat_interval_ms;
+    uint32_t heartbeat_interval_ms;     // Intervalo configurado (máximo)
+    uint32_t heartbeat_current_ms;      // Intervalo en uso, adaptado a la red
+    uint32_t heartbeat_missed;          // Respuestas perdidas consecutivas
+    uint32_t heartbeat_ok_streak;       // Respuestas consecutivas al intervalo actual
+    phoenix_heartbeat_stats_t heartbeat_stats;
     esp_timer_handle_t heartbeat_timer;
+    esp_timer_handle_t pending_timer;
     phoenix_subscription_t *subscriptions;
+    phoenix_subscription_t *topic_buckets[PHOENIX_TOPIC_BUCKETS];
+    phoenix_pending_t pending[PHOENIX_MAX_PENDING];
+    SemaphoreHandle_t lock;     // Protege ref_counter, pending y la cola de salida
+    phoenix_tx_msg_t *tx_head;
+    phoenix_tx_msg_t *tx_tail;
+    size_t tx_bytes;
+    TaskHandle_t tx_task;
+    SemaphoreHandle_t tx_stopped;
+    volatile bool tx_run;
+    volatile bool reconnect_requested;  // Reconexión forzada pedida, la hace tx_task
+    phoenix_tx_stats_t tx_stats;
     bool reconnect_pending;
+    phoenix_rx_buffer_t rx;
+    phoenix_rx_stats_t rx_stats;
+    phoenix_vsn_t vsn_requested;        // Versión a usar en la próxima conexión
+    phoenix_vsn_t vsn;                  // Versión de la conexión actual
+    phoenix_codec_stats_t codec_stats;
+    bool tls_registered;                // Sesión TLS registrada en tls_manager
 } phoenix_context_t;
 
 // ============================================================================
@@ -68,57 +197,816 @@ static phoenix_context_t s_ctx = {0};
 // ============================================================================
 
 /**
- * @brief Crea un mensaje Phoenix JSON
+ * @brief Nombre de la versión de protocolo para la URL (parámetro vsn)
  */
-static char* create_phoenix_message(const char *topic, const char *event, const char *payload, uint64_t ref)
+static const char *vsn_name(phoenix_vsn_t vsn)
 {
-    cJSON *msg = cJSON_CreateObject();
-    cJSON_AddStringToObject(msg, "topic", topic ? topic : "phoenix");
-    cJSON_AddStringToObject(msg, "event", event ? event : "phx_reply");
+    return (vsn == PHOENIX_VSN_2_0_0) ? "2.0.0" : "1.0.0";
+}
 
-    // El ref en Phoenix es un string (ej: "1", "2")
-    if (ref > 0) {
-        char ref_str[32];
-        snprintf(ref_str, sizeof(ref_str), "%llu", ref);
-        cJSON_AddStringToObject(msg, "ref", ref_str);
+/**
+ * @brief Escribe un string JSON (con comillas y escapes)
+ *
+ * @param dst Destino, o NULL para solo calcular la longitud
+ * @return Longitud escrita (o necesaria)
+ */
+static size_t put_json_string(char *dst, const char *str)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t len = 0;
+
+#define PUT(c) do { if (dst) { dst[len] = (c); } len++; } while (0)
+    PUT('"');
+    for (const uint8_t *p = (const uint8_t *)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            PUT('\\');
+            PUT(*p);
+        } else if (*p < 0x20) {
+            PUT('\\');
+            PUT('u');
+            PUT('0');
+            PUT('0');
+            PUT(hex[*p >> 4]);
+            PUT(hex[*p & 0x0F]);
+        } else {
+            PUT(*p);
+        }
+    }
+    PUT('"');
+#undef PUT
+    return len;
+}
+
+/**
+ * @brief Escribe un ref de Phoenix (string, ej: "1"), o null si es 0
+ */
+static size_t put_ref(char *dst, uint64_t ref)
+{
+    char ref_str[24];
+    int len;
+    if (ref == 0) {
+        len = snprintf(ref_str, sizeof(ref_str), "null");
+    } else {
+        len = snprintf(ref_str, sizeof(ref_str), "\"%llu\"", (unsigned long long)ref);
+    }
+    if (dst) {
+        memcpy(dst, ref_str, len);
+    }
+    return (size_t)len;
+}
+
+/**
+ * @brief Escribe el sobre de un mensaje Phoenix, hasta el payload
+ *
+ * - vsn 1.0.0: {"topic":..,"event":..,"ref":..,"payload":  ...  }
+ * - vsn 2.0.0: [join_ref, ref, topic, event,  ...  ]
+ *
+ * Con broadcast_event se agrega el inicio del mensaje de broadcast de
+ * Supabase, {"type":"broadcast","event":..,"payload":  ...  }, que el
+ * llamador cierra con una llave más.
+ *
+ * @param dst Destino, o NULL para solo calcular la longitud
+ * @return Longitud escrita (o necesaria)
+ */
+static size_t put_envelope(char *dst, const char *topic, const char *event, const char *broadcast_event,
+                           uint64_t ref, uint64_t join_ref)
+{
+    size_t len = 0;
+
+#define PUT_LIT(s) do { if (dst) { memcpy(dst + len, (s), sizeof(s) - 1); } len += sizeof(s) - 1; } while (0)
+    if (s_ctx.vsn == PHOENIX_VSN_2_0_0) {
+        PUT_LIT("[");
+        len += put_ref(dst ? dst + len : NULL, join_ref);
+        PUT_LIT(",");
+        len += put_ref(dst ? dst + len : NULL, ref);
+        PUT_LIT(",");
+        len += put_json_string(dst ? dst + len : NULL, topic);
+        PUT_LIT(",");
+        len += put_json_string(dst ? dst + len : NULL, event);
+        PUT_LIT(",");
     } else {
-        cJSON_AddNullToObject(msg, "ref");
+        PUT_LIT("{\"topic\":");
+        len += put_json_string(dst ? dst + len : NULL, topic);
+        PUT_LIT(",\"event\":");
+        len += put_json_string(dst ? dst + len : NULL, event);
+        PUT_LIT(",\"ref\":");
+        len += put_ref(dst ? dst + len : NULL, ref);
+        PUT_LIT(",\"payload\":");
+    }
+    if (broadcast_event) {
+        PUT_LIT("{\"type\":\"broadcast\",\"event\":");
+        len += put_json_string(dst ? dst + len : NULL, broadcast_event);
+        PUT_LIT(",\"payload\":");
     }
+#undef PUT_LIT
+    return len;
+}
+
+/**
+ * @brief Crea un mensaje Phoenix listo para encolar
+ *
+ * El payload se copia tal cual si parece JSON (objeto o arreglo); si no,
+ * se escribe como string JSON. Sin payload se usa un objeto vacío. Un
+ * payload JSON cedido (owned) no se copia: el mensaje lo referencia y lo
+ * libera tx_free().
+ *
+ * @param broadcast_event Evento de broadcast de Supabase, o NULL: el
+ *                        payload se envuelve en {type, event, payload}
+ * @param owned true si payload es un buffer de malloc que pasa al mensaje
+ *              (se libera también si falla)
+ */
+static phoenix_tx_msg_t *create_phoenix_message(const char *topic, const char *event, const char *broadcast_event,
+                                                const char *payload, bool owned, uint64_t ref, uint64_t join_ref)
+{
+    topic = topic ? topic : "phoenix";
+    event = event ? event : "phx_reply";
 
+    const char *body = "{}";
+    size_t body_len = 2;
+    bool quote = false;
     if (payload) {
-        cJSON *payload_obj = cJSON_Parse(payload);
-        if (payload_obj) {
-            cJSON_AddItemToObject(msg, "payload", payload_obj);
+        const char *p = payload;
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            p++;
+        }
+        if (*p == '{' || *p == '[') {
+            body = payload;
+            body_len = strlen(payload);
         } else {
-            cJSON_AddStringToObject(msg, "payload", payload);
+            body_len = put_json_string(NULL, payload);
+            quote = true;
         }
+    }
+    // Solo se referencia sin copiar un payload JSON cedido
+    bool keep = owned && payload && !quote;
+    bool copy = payload && !keep;
+
+    size_t head_len = put_envelope(NULL, topic, event, broadcast_event, ref, join_ref);
+    phoenix_tx_msg_t *msg = malloc(sizeof(phoenix_tx_msg_t) + head_len + (copy ? body_len : 0));
+    if (!msg) {
+        if (owned) {
+            free((void *)payload);
+        }
+        return NULL;
+    }
+    const char *tail;
+    if (s_ctx.vsn == PHOENIX_VSN_2_0_0) {
+        tail = broadcast_event ? "}]" : "]";
     } else {
-        cJSON_AddItemToObject(msg, "payload", cJSON_CreateObject());
+        tail = broadcast_event ? "}}" : "}";
+    }
+    size_t tail_len = broadcast_event ? 2 : 1;
+    *msg = (phoenix_tx_msg_t) {
+        .len = head_len + body_len + tail_len,
+        .head_len = head_len,
+        .payload_len = body_len,
+        .tail_len = tail_len,
+        .payload = body,
+        .owned = keep ? (char *)payload : NULL,
+        .tail = tail,
+    };
+    put_envelope(msg->data, topic, event, broadcast_event, ref, join_ref);
+    if (quote) {
+        put_json_string(msg->data + head_len, payload);
+        msg->payload = msg->data + head_len;
+    } else if (copy) {
+        memcpy(msg->data + head_len, body, body_len);
+        msg->payload = msg->data + head_len;
+    }
+    if (owned && !keep) {
+        free((void *)payload);
     }
+    return msg;
+}
 
-    char *json_str = cJSON_PrintUnformatted(msg);
-    cJSON_Delete(msg);
-    return json_str;
+/**
+ * @brief Hash FNV-1a de un topic
+ */
+static uint32_t topic_hash(const char *topic)
+{
+    uint32_t hash = 2166136261u;
+    while (*topic) {
+        hash ^= (uint8_t)*topic++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Busca la suscripción de un topic en la tabla hash
+ */
+static phoenix_subscription_t *find_subscription(const char *topic)
+{
+    uint32_t hash = topic_hash(topic);
+    phoenix_subscription_t *sub = s_ctx.topic_buckets[hash & (PHOENIX_TOPIC_BUCKETS - 1)];
+    while (sub) {
+        if (sub->topic_hash == hash && strcmp(sub->topic, topic) == 0) {
+            return sub;
+        }
+        sub = sub->bucket_next;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Retira un mensaje de la cola de salida
+ * @note Llamar con s_ctx.lock tomado
+ */
+static void tx_unlink(phoenix_tx_msg_t *prev, phoenix_tx_msg_t *entry)
+{
+    if (prev) {
+        prev->next = entry->next;
+    } else {
+        s_ctx.tx_head = entry->next;
+    }
+    if (s_ctx.tx_tail == entry) {
+        s_ctx.tx_tail = prev;
+    }
+    s_ctx.tx_bytes -= entry->len + sizeof(phoenix_tx_msg_t);
+}
+
+static void tx_free(phoenix_tx_msg_t *entry)
+{
+    free(entry->owned);
+    free(entry);
+}
+
+/**
+ * @brief Descarta el mensaje descartable más antiguo para hacer lugar
+ * @note Llamar con s_ctx.lock tomado
+ *
+ * @return false si no hay mensajes descartables
+ */
+static bool tx_evict_one(void)
+{
+    phoenix_tx_msg_t *prev = NULL;
+    for (phoenix_tx_msg_t *entry = s_ctx.tx_head; entry; prev = entry, entry = entry->next) {
+        if (entry->tx_class == PHOENIX_TX_BEST_EFFORT || entry->tx_class == PHOENIX_TX_LATEST) {
+            tx_unlink(prev, entry);
+            tx_free(entry);
+            s_ctx.tx_stats.dropped++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Olvida el request de un heartbeat reemplazado en la cola
+ * @note Llamar con s_ctx.lock tomado
+ *
+ * El heartbeat reemplazado nunca se envía: su ref no debe vencer ni contar
+ * como heartbeat perdido.
+ */
+static void pending_drop_heartbeat(uint32_t ref)
+{
+    for (int i = 0; i < PHOENIX_MAX_PENDING; i++) {
+        phoenix_pending_t *entry = &s_ctx.pending[i];
+        if (entry->in_use && entry->ref == ref && entry->kind == PHOENIX_PENDING_HEARTBEAT) {
+            entry->in_use = false;
+            s_ctx.heartbeat_stats.sent--;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Encola un mensaje serializado para la tarea de envío
+ *
+ * Toma posesión de msg (se libera al enviarlo o descartarlo).
+ */
+static esp_err_t tx_enqueue(phoenix_tx_class_t tx_class, uint32_t coalesce_key, phoenix_tx_msg_t *msg)
+{
+    msg->tx_class = tx_class;
+    msg->coalesce_key = coalesce_key;
+    size_t needed = msg->len + sizeof(phoenix_tx_msg_t);
+    size_t limit = PHOENIX_TX_MAX_BYTES + (tx_class == PHOENIX_TX_CONTROL ? PHOENIX_TX_CONTROL_RESERVE : 0);
+
+    xSemaphoreTake(s_ctx.lock, portMAX_DELAY);
+
+    // Un mensaje nuevo reemplaza al encolado con la misma clave (solo importa el último)
+    if (coalesce_key) {
+        phoenix_tx_msg_t *prev = NULL;
+        for (phoenix_tx_msg_t *entry = s_ctx.tx_head; entry; prev = entry, entry = entry->next) {
+            if (entry->coalesce_key == coalesce_key && entry->tx_class == tx_class) {
+                if (tx_class == PHOENIX_TX_CONTROL) {
+                    pending_drop_heartbeat(entry->ref);
+                }
+                tx_unlink(prev, entry);
+                tx_free(entry);
+                s_ctx.tx_stats.coalesced++;
+                break;
+            }
+        }
+    }
+
+    // Sin lugar: descartar primero los descartables más antiguos
+    while (s_ctx.tx_bytes + needed > limit) {
+        if (tx_evict_one()) {
+            continue;
+        }
+        if (tx_class == PHOENIX_TX_BEST_EFFORT || tx_class == PHOENIX_TX_LATEST) {
+            s_ctx.tx_stats.dropped++;
+        } else {
+            s_ctx.tx_stats.rejected++;
+        }
+        xSemaphoreGive(s_ctx.lock);
+        tx_free(msg);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (s_ctx.tx_tail) {
+        s_ctx.tx_tail->next = msg;
+    } else {
+        s_ctx.tx_head = msg;
+    }
+    s_ctx.tx_tail = msg;
+    s_ctx.tx_bytes += needed;
+    s_ctx.tx_stats.queued++;
+    if (s_ctx.tx_bytes > s_ctx.tx_stats.bytes_peak) {
+        s_ctx.tx_stats.bytes_peak = s_ctx.tx_bytes;
+    }
+
+    xSemaphoreGive(s_ctx.lock);
+
+    if (s_ctx.tx_task) {
+        xTaskNotifyGive(s_ctx.tx_task);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Descarta todo lo encolado (al perder la conexión)
+ */
+static void tx_flush(void)
+{
+    xSemaphoreTake(s_ctx.lock, portMAX_DELAY);
+    phoenix_tx_msg_t *entry = s_ctx.tx_head;
+    s_ctx.tx_head = NULL;
+    s_ctx.tx_tail = NULL;
+    s_ctx.tx_bytes = 0;
+    xSemaphoreGive(s_ctx.lock);
+
+    while (entry) {
+        phoenix_tx_msg_t *next = entry->next;
+        s_ctx.tx_stats.dropped++;
+        tx_free(entry);
+        entry = next;
+    }
+}
+
+static void force_reconnect(void);
+
+/**
+ * @brief Escribe en el socket varios mensajes retirados de la cola
+ *
+ * Los frames se arman uno detrás del otro en el buffer del cliente y salen
+ * en una sola escritura: una ráfaga de mensajes chicos va en un registro
+ * TLS, en lugar de dos por mensaje (encabezado y payload).
+ */
+static void tx_send_batch(phoenix_tx_msg_t *const *batch, int count)
+{
+    if (!s_ctx.connected || !s_ctx.ws_client) {
+        s_ctx.tx_stats.dropped += count;
+        return;
+    }
+
+    esp_websocket_iov_t iov[PHOENIX_TX_BATCH_MAX][3];
+    esp_websocket_message_t msgs[PHOENIX_TX_BATCH_MAX];
+    for (int i = 0; i < count; i++) {
+        const phoenix_tx_msg_t *entry = batch[i];
+        iov[i][0] = (esp_websocket_iov_t) { .base = entry->data, .len = entry->head_len };
+        iov[i][1] = (esp_websocket_iov_t) { .base = entry->payload, .len = entry->payload_len };
+        iov[i][2] = (esp_websocket_iov_t) { .base = entry->tail, .len = entry->tail_len };
+        msgs[i] = (esp_websocket_message_t) { .iov = iov[i], .iovcnt = 3 };
+        ESP_LOGD(TAG, "Enviando: %.*s%.*s%s", (int)entry->head_len, entry->data,
+                 (int)entry->payload_len, entry->payload, entry->tail);
+    }
+
+    int sent = esp_websocket_client_send_batch(s_ctx.ws_client, WS_TRANSPORT_OPCODES_TEXT, msgs, count,
+                                               pdMS_TO_TICKS(PHOENIX_TX_SEND_TIMEOUT_MS));
+    if (sent < 0) {
+        sent = 0;
+    }
+    s_ctx.tx_stats.writes++;
+    s_ctx.tx_stats.sent += sent;
+    if (sent < count) {
+        // Los requests con respuesta vencerán por su deadline
+        s_ctx.tx_stats.send_errors += count - sent;
+        ESP_LOGW(TAG, "Error enviando %d mensajes encolados", count - sent);
+    }
+}
+
+/**
+ * @brief Tarea que vacía la cola de salida en el WebSocket
+ *
+ * Es la única que escribe en el socket: un socket bloqueado solo la
+ * detiene a ella, no al timer de esp_timer ni a quien llama phoenix_send().
+ * También hace las reconexiones forzadas, que bloquean hasta que termina
+ * la tarea del cliente.
+ */
+static void tx_task(void *arg)
+{
+    while (s_ctx.tx_run) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (s_ctx.reconnect_requested && s_ctx.tx_run) {
+            s_ctx.reconnect_requested = false;
+            force_reconnect();
+        }
+
+        while (s_ctx.tx_run) {
+            // Lo que se juntó mientras se escribía lo anterior sale en una escritura
+            phoenix_tx_msg_t *batch[PHOENIX_TX_BATCH_MAX];
+            int count = 0;
+            xSemaphoreTake(s_ctx.lock, portMAX_DELAY);
+            while (count < PHOENIX_TX_BATCH_MAX && s_ctx.tx_head) {
+                batch[count] = s_ctx.tx_head;
+                tx_unlink(NULL, batch[count++]);
+            }
+            xSemaphoreGive(s_ctx.lock);
+
+            if (count == 0) {
+                break;
+            }
+
+            tx_send_batch(batch, count);
+            for (int i = 0; i < count; i++) {
+                tx_free(batch[i]);
+            }
+        }
+    }
+
+    xSemaphoreGive(s_ctx.tx_stopped);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Serializa un mensaje Phoenix y lo encola para envío
+ *
+ * Los heartbeats y los mensajes PHOENIX_TX_LATEST reemplazan a uno igual
+ * (topic+event, o topic+evento de broadcast) que aún no se haya enviado.
+ */
+static esp_err_t send_phoenix_message(const char *topic, const char *event, const char *broadcast_event,
+                                      const char *payload, bool owned, uint32_t ref, phoenix_tx_class_t tx_class)
+{
+    // vsn 2.0.0: los mensajes de un canal llevan el ref de su join
+    uint32_t join_ref = 0;
+    if (s_ctx.vsn == PHOENIX_VSN_2_0_0) {
+        if (strcmp(event, "phx_join") == 0) {
+            join_ref = ref;
+        } else {
+            phoenix_subscription_t *sub = find_subscription(topic);
+            join_ref = sub ? sub->join_ref : 0;
+        }
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    phoenix_tx_msg_t *msg = create_phoenix_message(topic, event, broadcast_event, payload, owned, ref, join_ref);
+    if (!msg) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_ctx.codec_stats.encoded++;
+    s_ctx.codec_stats.encode_us += (uint32_t)(esp_timer_get_time() - start_us);
+    s_ctx.codec_stats.tx_bytes += msg->len;
+    msg->ref = ref;
+
+    uint32_t coalesce_key = 0;
+    if (tx_class == PHOENIX_TX_LATEST || strcmp(event, "heartbeat") == 0) {
+        coalesce_key = topic_hash(topic) ^ (topic_hash(broadcast_event ? broadcast_event : event) * 31u);
+        if (coalesce_key == 0) {
+            coalesce_key = 1;
+        }
+    }
+    return tx_enqueue(tx_class, coalesce_key, msg);
+}
+
+/**
+ * @brief Asigna un ref para un mensaje sin seguimiento de respuesta
+ */
+static uint32_t next_ref(void)
+{
+    xSemaphoreTake(s_ctx.lock, portMAX_DELAY);
+    uint32_t ref = ++s_ctx.ref_counter;
+    xSemaphoreGive(s_ctx.lock);
+    return ref;
+}
+
+/**
+ * @brief Registra un request pendiente y le asigna un ref
+ *
+ * @return ref asignado, o 0 si la tabla está llena
+ */
+static uint32_t pending_add(phoenix_pending_kind_t kind, uint32_t timeout_ms,
+                            phoenix_reply_callback_t callback, void *user_data,
+                            phoenix_subscription_t *sub)
+{
+    uint32_t ref = 0;
+    int64_t now_us = esp_timer_get_time();
+
+    xSemaphoreTake(s_ctx.lock, portMAX_DELAY);
+    for (int i = 0; i < PHOENIX_MAX_PENDING; i++) {
+        phoenix_pending_t *entry = &s_ctx.pending[i];
+        if (!entry->in_use) {
+            ref = ++s_ctx.ref_counter;
+            *entry = (phoenix_pending_t) {
+                .in_use = true,
+                .kind = kind,
+                .ref = ref,
+                .sent_us = now_us,
+                .deadline_us = now_us + (int64_t)timeout_ms * 1000,
+                .callback = callback,
+                .user_data = user_data,
+                .sub = sub,
+            };
+            break;
+        }
+    }
+    xSemaphoreGive(s_ctx.lock);
+    return ref;
+}
+
+/**
+ * @brief Retira un request pendiente por su ref
+ *
+ * @return true si existía (y se copió en out)
+ */
+static bool pending_take(uint32_t ref, phoenix_pending_t *out)
+{
+    bool found = false;
+    xSemaphoreTake(s_ctx.lock, portMAX_DELAY);
+    for (int i = 0; i < PHOENIX_MAX_PENDING; i++) {
+        if (s_ctx.pending[i].in_use && s_ctx.pending[i].ref == ref) {
+            *out = s_ctx.pending[i];
+            s_ctx.pending[i].in_use = false;
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(s_ctx.lock);
+    return found;
+}
+
+/**
+ * @brief Envía phx_join de una suscripción
+ */
+static void send_join(phoenix_subscription_t *sub)
+{
+    sub->joined = false;
+    uint32_t ref = pending_add(PHOENIX_PENDING_JOIN, PHOENIX_JOIN_TIMEOUT_MS, NULL, NULL, sub);
+    if (ref == 0) {
+        ESP_LOGW(TAG, "Tabla de requests llena, JOIN a %s sin seguimiento", sub->topic);
+        ref = next_ref();
+    }
+    sub->join_ref = ref;
+    ESP_LOGI(TAG, "Enviando JOIN a %s (ref %lu)", sub->topic, (unsigned long)ref);
+    if (send_phoenix_message(sub->topic, "phx_join", NULL, sub->join_payload, false, ref, PHOENIX_TX_CONTROL) != ESP_OK) {
+        ESP_LOGW(TAG, "No se pudo encolar JOIN a %s", sub->topic);
+    }
+}
+
+static void pending_expire(bool all);
+static void rx_buffer_reset(void);
+
+/**
+ * @brief Aplica un nuevo intervalo de heartbeat
+ */
+static void heartbeat_apply_interval(uint32_t interval_ms)
+{
+    if (interval_ms == s_ctx.heartbeat_current_ms) {
+        return;
+    }
+    ESP_LOGI(TAG, "Intervalo de heartbeat: %lu -> %lu ms",
+             (unsigned long)s_ctx.heartbeat_current_ms, (unsigned long)interval_ms);
+    s_ctx.heartbeat_current_ms = interval_ms;
+    s_ctx.heartbeat_stats.interval_ms = interval_ms;
+    if (s_ctx.heartbeat_timer) {
+        esp_timer_stop(s_ctx.heartbeat_timer);
+        esp_timer_start_periodic(s_ctx.heartbeat_timer, (uint64_t)interval_ms * 1000);
+    }
+}
+
+/**
+ * @brief Registra una respuesta de heartbeat: RTT y aumento gradual del intervalo
+ */
+static void heartbeat_on_reply(int64_t sent_us)
+{
+    uint32_t rtt_ms = (uint32_t)((esp_timer_get_time() - sent_us) / 1000);
+    phoenix_heartbeat_stats_t *stats = &s_ctx.heartbeat_stats;
+
+    stats->replies++;
+    stats->rtt_last_ms = rtt_ms;
+    stats->rtt_avg_ms = stats->rtt_avg_ms ? (7 * stats->rtt_avg_ms + rtt_ms) / 8 : rtt_ms;
+    if (rtt_ms > stats->rtt_max_ms) {
+        stats->rtt_max_ms = rtt_ms;
+    }
+    ESP_LOGD(TAG, "Heartbeat respondido en %lu ms", (unsigned long)rtt_ms);
+
+    s_ctx.heartbeat_missed = 0;
+
+    // Enlace estable: probar un intervalo mayor hasta el configurado
+    if (++s_ctx.heartbeat_ok_streak >= PHOENIX_HEARTBEAT_PROBE_OK &&
+        s_ctx.heartbeat_current_ms < s_ctx.heartbeat_interval_ms) {
+        s_ctx.heartbeat_ok_streak = 0;
+        uint32_t next = s_ctx.heartbeat_current_ms + PHOENIX_HEARTBEAT_STEP_MS;
+        heartbeat_apply_interval(next < s_ctx.heartbeat_interval_ms ? next : s_ctx.heartbeat_interval_ms);
+    }
+}
+
+/**
+ * @brief Reduce el intervalo tras perder la conexión
+ *
+ * Una conexión que muere estando inactiva suele ser un NAT que expiró la
+ * entrada antes del siguiente heartbeat: acortar el intervalo a la mitad.
+ */
+static void heartbeat_adapt_down(void)
+{
+    s_ctx.heartbeat_ok_streak = 0;
+    uint32_t next = s_ctx.heartbeat_current_ms / 2;
+    heartbeat_apply_interval(next > PHOENIX_HEARTBEAT_MIN_MS ? next : PHOENIX_HEARTBEAT_MIN_MS);
+}
+
+/**
+ * @brief Pide la reconexión de un WebSocket que dejó de responder
+ *
+ * Se llama desde el timer de deadlines: solo marca la conexión como caída
+ * y despierta a tx_task, que hace la reconexión (ver force_reconnect()).
+ */
+static void request_reconnect(void)
+{
+    ESP_LOGW(TAG, "⚠️ %lu heartbeats sin respuesta, forzando reconexión",
+             (unsigned long)s_ctx.heartbeat_missed);
+    s_ctx.heartbeat_stats.reconnects++;
+    s_ctx.heartbeat_missed = 0;
+    heartbeat_adapt_down();
+
+    s_ctx.connected = false;
+    s_ctx.reconnect_pending = true;
+    s_ctx.reconnect_requested = true;
+    if (s_ctx.tx_task) {
+        xTaskNotifyGive(s_ctx.tx_task);
+    }
+}
+
+/**
+ * @brief Reconecta el WebSocket (desde tx_task)
+ *
+ * Una conexión TCP semiabierta puede seguir "conectada" durante minutos;
+ * cerrar el transporte y volver a iniciar el cliente la recupera.
+ */
+static void force_reconnect(void)
+{
+    esp_websocket_client_stop(s_ctx.ws_client);
+    // La tarea del WebSocket terminó: limpiar su estado aquí
+    rx_buffer_reset();
+    tx_flush();
+    pending_expire(true);
+    esp_websocket_client_start(s_ctx.ws_client);
+}
+
+/**
+ * @brief Completa un request pendiente
+ *
+ * @param response Objeto "response" del phx_reply (NULL si no hubo respuesta)
+ */
+static void pending_complete(const phoenix_pending_t *entry, esp_err_t result, const cJSON *response)
+{
+    switch (entry->kind) {
+        case PHOENIX_PENDING_JOIN:
+            if (result == ESP_OK) {
+                entry->sub->joined = true;
+                ESP_LOGI(TAG, "✅ Suscrito a %s", entry->sub->topic);
+            } else if (result == ESP_ERR_TIMEOUT && s_ctx.connected) {
+                ESP_LOGW(TAG, "JOIN a %s sin respuesta, reintentando", entry->sub->topic);
+                send_join(entry->sub);
+            } else if (result == ESP_FAIL) {
+                ESP_LOGE(TAG, "JOIN a %s rechazado", entry->sub->topic);
+            }
+            break;
+
+        case PHOENIX_PENDING_HEARTBEAT:
+            if (result == ESP_OK || result == ESP_FAIL) {
+                // Cualquier respuesta demuestra que la conexión está viva
+                heartbeat_on_reply(entry->sent_us);
+            } else if (result == ESP_ERR_TIMEOUT) {
+                s_ctx.heartbeat_stats.missed++;
+                s_ctx.heartbeat_missed++;
+                ESP_LOGW(TAG, "Heartbeat sin respuesta (ref %lu)", (unsigned long)entry->ref);
+                if (s_ctx.heartbeat_missed >= PHOENIX_HEARTBEAT_MAX_MISSED && s_ctx.ws_client) {
+                    request_reconnect();
+                }
+            }
+            break;
+
+        case PHOENIX_PENDING_SEND:
+            break;
+    }
+
+    if (entry->callback) {
+        entry->callback(result, response, entry->user_data);
+    }
+}
+
+/**
+ * @brief Completa con error todos los requests cuyo deadline venció
+ *
+ * @param all true para completar todos (desconexión) con ESP_ERR_INVALID_STATE
+ */
+static void pending_expire(bool all)
+{
+    phoenix_pending_t expired[PHOENIX_MAX_PENDING];
+    int count = 0;
+    int64_t now_us = esp_timer_get_time();
+
+    xSemaphoreTake(s_ctx.lock, portMAX_DELAY);
+    for (int i = 0; i < PHOENIX_MAX_PENDING; i++) {
+        phoenix_pending_t *entry = &s_ctx.pending[i];
+        if (entry->in_use && (all || now_us >= entry->deadline_us)) {
+            expired[count++] = *entry;
+            entry->in_use = false;
+        }
+    }
+    xSemaphoreGive(s_ctx.lock);
+
+    // Los callbacks se llaman sin el lock: pueden volver a enviar
+    for (int i = 0; i < count; i++) {
+        pending_complete(&expired[i], all ? ESP_ERR_INVALID_STATE : ESP_ERR_TIMEOUT, NULL);
+    }
+}
+
+/**
+ * @brief Callback del timer de deadlines
+ */
+static void pending_timer_callback(void *arg)
+{
+    pending_expire(false);
+}
+
+/**
+ * @brief Procesa un phx_reply: lo asocia a su request por ref
+ */
+static void handle_reply(const cJSON *ref, const cJSON *payload)
+{
+    if (!cJSON_IsString(ref)) {
+        return;
+    }
+
+    phoenix_pending_t entry;
+    if (!pending_take((uint32_t)strtoul(ref->valuestring, NULL, 10), &entry)) {
+        ESP_LOGD(TAG, "phx_reply sin request pendiente (ref %s)", ref->valuestring);
+        return;
+    }
+
+    const cJSON *status = cJSON_GetObjectItem(payload, "status");
+    bool ok = cJSON_IsString(status) && strcmp(status->valuestring, "ok") == 0;
+    pending_complete(&entry, ok ? ESP_OK : ESP_FAIL, cJSON_GetObjectItem(payload, "response"));
 }
 
 /**
  * @brief Procesa un mensaje recibido del WebSocket
+ *
+ * El mensaje se parsea una sola vez directamente desde el buffer recibido
+ * (no necesita terminar en '\0'); los callbacks JSON reciben el nodo del
+ * payload dentro de ese mismo árbol. Se aceptan ambos formatos (objeto de
+ * vsn 1.0.0 y arreglo de vsn 2.0.0) según el tipo JSON recibido.
  */
-static void process_message(const char *message)
+static void process_message(const char *message, size_t len)
 {
-    ESP_LOGD(TAG, "Mensaje recibido: %s", message);
+    ESP_LOGD(TAG, "Mensaje recibido: %.*s", (int)len, message);
 
-    cJSON *msg = cJSON_Parse(message);
+    int64_t start_us = esp_timer_get_time();
+    cJSON *msg = cJSON_ParseWithLength(message, len);
     if (!msg) {
-        ESP_LOGW(TAG, "No se pudo parsear mensaje JSON: %s", message);
+        ESP_LOGW(TAG, "No se pudo parsear mensaje JSON: %.*s", (int)len, message);
         return;
     }
 
-    cJSON *topic = cJSON_GetObjectItem(msg, "topic");
-    cJSON *event = cJSON_GetObjectItem(msg, "event");
-    cJSON *payload = cJSON_GetObjectItem(msg, "payload");
+    const cJSON *ref;
+    const cJSON *topic;
+    const cJSON *event;
+    const cJSON *payload;
+    if (cJSON_IsArray(msg)) {
+        // [join_ref, ref, topic, event, payload]: recorrer la lista una vez
+        const cJSON *field = msg->child;
+        const cJSON *fields[5] = {0};
+        for (int i = 0; i < 5 && field; i++, field = field->next) {
+            fields[i] = field;
+        }
+        ref = fields[1];
+        topic = fields[2];
+        event = fields[3];
+        payload = fields[4];
+    } else {
+        ref = cJSON_GetObjectItem(msg, "ref");
+        topic = cJSON_GetObjectItem(msg, "topic");
+        event = cJSON_GetObjectItem(msg, "event");
+        payload = cJSON_GetObjectItem(msg, "payload");
+    }
+    s_ctx.codec_stats.decoded++;
+    s_ctx.codec_stats.decode_us += (uint32_t)(esp_timer_get_time() - start_us);
+    s_ctx.codec_stats.rx_bytes += len;
 
-    if (!topic || !event || !payload) {
+    if (!cJSON_IsString(topic) || !cJSON_IsString(event) || !payload) {
         cJSON_Delete(msg);
         return;
     }
@@ -128,40 +1016,162 @@ static void process_message(const char *message)
 
     ESP_LOGD(TAG, "Mensaje: topic=%s, event=%s", topic_str, event_str);
 
-    // Respuesta de join (phx_reply)
+    // Respuestas (join, send, heartbeat): se distinguen por ref, no por topic
     if (strcmp(event_str, "phx_reply") == 0) {
-        cJSON *status = cJSON_GetObjectItem(payload, "status");
-        if (status && strcmp(status->valuestring, "ok") == 0) {
-            // Buscar suscripción y marcar como joined
-            phoenix_subscription_t *sub = s_ctx.subscriptions;
-            while (sub) {
-                if (strcmp(sub->topic, topic_str) == 0) {
-                    sub->joined = true;
-                    ESP_LOGI(TAG, "✅ Suscrito a %s", topic_str);
-                    break;
-                }
-                sub = sub->next;
-            }
-        }
+        handle_reply(ref, payload);
         cJSON_Delete(msg);
         return;
     }
 
     // Buscar suscripción y llamar callback
-    phoenix_subscription_t *sub = s_ctx.subscriptions;
-    while (sub) {
-        if (strcmp(sub->topic, topic_str) == 0 && sub->joined && sub->callback) {
+    phoenix_subscription_t *sub = find_subscription(topic_str);
+    if (sub && sub->joined && sub->broadcast) {
+        // Broadcast de Supabase: {"type":"broadcast","event":..,"payload":..}
+        if (strcmp(event_str, "broadcast") != 0) {
+            cJSON_Delete(msg);
+            return;
+        }
+        const cJSON *inner_event = cJSON_GetObjectItem(payload, "event");
+        const cJSON *inner_payload = cJSON_GetObjectItem(payload, "payload");
+        if (!cJSON_IsString(inner_event) || !inner_payload) {
+            cJSON_Delete(msg);
+            return;
+        }
+        event_str = inner_event->valuestring;
+        payload = inner_payload;
+    }
+    if (sub && sub->joined) {
+        if (sub->json_callback) {
+            sub->json_callback(event_str, payload, sub->user_data);
+        } else if (sub->callback) {
+            // Callback de texto: requiere serializar el payload
             char *payload_str = cJSON_PrintUnformatted(payload);
-            sub->callback(event_str, payload_str, sub->user_data);
-            free(payload_str);
-            break;
+            if (payload_str) {
+                sub->callback(event_str, payload_str, sub->user_data);
+                free(payload_str);
+            }
         }
-        sub = sub->next;
     }
 
     cJSON_Delete(msg);
 }
 
+/**
+ * @brief Libera el buffer de reensamblado si creció por encima de lo retenido
+ */
+static void rx_buffer_reset(void)
+{
+    s_ctx.rx.len = 0;
+    s_ctx.rx.active = false;
+    s_ctx.rx.discarding = false;
+    if (s_ctx.rx.cap > PHOENIX_RX_RETAIN_SIZE) {
+        free(s_ctx.rx.buf);
+        s_ctx.rx.buf = NULL;
+        s_ctx.rx.cap = 0;
+    }
+}
+
+/**
+ * @brief Agrega un trozo al mensaje en curso
+ *
+ * @return false si el mensaje supera PHOENIX_RX_MAX_MESSAGE o no hay memoria
+ */
+static bool rx_buffer_append(const char *data, size_t len)
+{
+    size_t needed = s_ctx.rx.len + len;
+    if (needed > PHOENIX_RX_MAX_MESSAGE) {
+        return false;
+    }
+
+    if (needed > s_ctx.rx.cap) {
+        size_t new_cap = s_ctx.rx.cap ? s_ctx.rx.cap : PHOENIX_RX_INITIAL_SIZE;
+        while (new_cap < needed) {
+            new_cap *= 2;
+        }
+        if (new_cap > PHOENIX_RX_MAX_MESSAGE) {
+            new_cap = PHOENIX_RX_MAX_MESSAGE;
+        }
+        char *new_buf = realloc(s_ctx.rx.buf, new_cap);
+        if (!new_buf) {
+            return false;
+        }
+        s_ctx.rx.buf = new_buf;
+        s_ctx.rx.cap = new_cap;
+    }
+
+    if (len > 0) {
+        memcpy(s_ctx.rx.buf + s_ctx.rx.len, data, len);
+        s_ctx.rx.len += len;
+    }
+    return true;
+}
+
+/**
+ * @brief Procesa un evento DATA de texto o continuación
+ *
+ * Un mensaje que llega entero en un solo evento se procesa directamente
+ * desde el buffer del cliente. Si no, se acumula y se procesa una vez al
+ * recibir el último trozo del frame con FIN.
+ */
+static void handle_data_chunk(const esp_websocket_event_data_t *data)
+{
+    bool first_chunk = (data->payload_offset == 0);
+    bool frame_done = (data->payload_offset + data->data_len >= data->payload_len);
+    bool message_done = data->fin && frame_done;
+
+    if (data->op_code == WS_TRANSPORT_OPCODES_TEXT && first_chunk) {
+        if (s_ctx.rx.active) {
+            // Llegó un mensaje nuevo sin terminar el anterior
+            s_ctx.rx_stats.incomplete++;
+            rx_buffer_reset();
+        }
+        if (message_done) {
+            s_ctx.rx_stats.messages++;
+            process_message(data->data_ptr, data->data_len);
+            return;
+        }
+        s_ctx.rx.active = true;
+    } else if (!s_ctx.rx.active) {
+        // Continuación sin inicio (p.ej. se perdió el comienzo en un reconnect)
+        return;
+    }
+
+    if (!s_ctx.rx.discarding && !rx_buffer_append(data->data_ptr, data->data_len)) {
+        s_ctx.rx.discarding = true;
+        s_ctx.rx_stats.overflows++;
+        ESP_LOGW(TAG, "Mensaje de más de %d bytes descartado", PHOENIX_RX_MAX_MESSAGE);
+    }
+
+    if (!message_done) {
+        return;
+    }
+
+    if (!s_ctx.rx.discarding) {
+        s_ctx.rx_stats.messages++;
+        s_ctx.rx_stats.reassembled++;
+        if (s_ctx.rx.len > s_ctx.rx_stats.largest_message) {
+            s_ctx.rx_stats.largest_message = s_ctx.rx.len;
+        }
+        ESP_LOGD(TAG, "Mensaje reensamblado: %u bytes", (unsigned)s_ctx.rx.len);
+        process_message(s_ctx.rx.buf, s_ctx.rx.len);
+    }
+    rx_buffer_reset();
+}
+
+/**
+ * @brief Registra en tls_manager la apertura o cierre de la sesión TLS del WebSocket
+ *
+ * DISCONNECTED y CLOSED pueden llegar ambos; solo se descuenta una vez.
+ */
+static void tls_session_note(bool open)
+{
+    if (s_ctx.tls_registered == open || !s_ctx.supabase_url) {
+        return;
+    }
+    s_ctx.tls_registered = open;
+    tls_manager_note_external(s_ctx.supabase_url, open);
+}
+
 /**
  * @brief Handler de eventos WebSocket
  */
@@ -177,16 +1187,13 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base, i
         case WEBSOCKET_EVENT_CONNECTED:
             ESP_LOGI(TAG, "✅ WebSocket conectado");
             s_ctx.connected = true;
+            tls_session_note(true);
             s_ctx.reconnect_pending = false;
 
             // Re-suscribir a todos los canales después de reconnect
             phoenix_subscription_t *sub = s_ctx.subscriptions;
             while (sub) {
-                sub->joined = false; // Resetear estado
-                char *msg = create_phoenix_message(sub->topic, "phx_join", sub->join_payload, ++s_ctx.ref_counter);
-                ESP_LOGI(TAG, "Enviando JOIN: %s", msg);
-                esp_websocket_client_send_text(s_ctx.ws_client, msg, strlen(msg), portMAX_DELAY);
-                free(msg);
+                send_join(sub);
                 sub = sub->next;
             }
             break;
@@ -194,53 +1201,156 @@ static void websocket_event_handler(void *handler_args, esp_event_base_t base, i
         case WEBSOCKET_EVENT_DISCONNECTED:
             ESP_LOGW(TAG, "WebSocket desconectado");
             s_ctx.connected = false;
+            tls_session_note(false);
             s_ctx.reconnect_pending = true;
+            rx_buffer_reset();
+            // Lo encolado y las respuestas pertenecen a la conexión anterior
+            tx_flush();
+            pending_expire(true);
             break;
 
         case WEBSOCKET_EVENT_DATA:
             ESP_LOGD(TAG, "Datos recibidos: %d bytes (op=%d)", data->data_len, data->op_code);
-            // Solo procesar mensajes de texto (op=1), ignorar control frames
-            if (data->op_code == 1 && data->data_len > 0) {
-                if (data->data_ptr[data->data_len - 1] == 0) {
-                    // Ya está null-terminated
-                    process_message((char *)data->data_ptr);
-                } else {
-                    // Crear buffer y null-terminate
-                    char *buffer = malloc(data->data_len + 1);
-                    memcpy(buffer, data->data_ptr, data->data_len);
-                    buffer[data->data_len] = '\0';
-                    process_message(buffer);
-                    free(buffer);
-                }
+            // Solo procesar mensajes de texto (op=1) y sus continuaciones (op=0),
+            // ignorar control frames. Un frame vacío también cuenta: puede ser
+            // la continuación con FIN que cierra el mensaje.
+            if (data->op_code == WS_TRANSPORT_OPCODES_TEXT || data->op_code == WS_TRANSPORT_OPCODES_CONT) {
+                handle_data_chunk(data);
             }
             // op=8 (Close), op=9 (Ping), op=10 (Pong) se ignoran
             break;
 
         case WEBSOCKET_EVENT_ERROR:
             ESP_LOGE(TAG, "WebSocket error");
+            // Si la cadena no terminó en los pins, la reconexión usa el bundle
+            if (s_ctx.supabase_url && data->error_handle.esp_tls_cert_verify_flags) {
+                tls_manager_note_verify_failure(s_ctx.supabase_url,
+                                                data->error_handle.esp_tls_cert_verify_flags);
+            }
             break;
 
         case WEBSOCKET_EVENT_CLOSED:
             ESP_LOGW(TAG, "WebSocket cerrado");
             s_ctx.connected = false;
+            tls_session_note(false);
+            break;
+
+        default:
             break;
+    }
+}
+
+/**
+ * @brief Callback del timer de heartbeat
+ */
+static void heartbeat_timer_callback(void* arg)
+{
+    if (s_ctx.connected && s_ctx.ws_client) {
+        // Deadline corto para detectar conexiones muertas antes del siguiente heartbeat
+        uint32_t timeout_ms = s_ctx.heartbeat_current_ms < PHOENIX_HEARTBEAT_TIMEOUT ?
+                              s_ctx.heartbeat_current_ms : PHOENIX_HEARTBEAT_TIMEOUT;
+        uint32_t ref = pending_add(PHOENIX_PENDING_HEARTBEAT, timeout_ms, NULL, NULL, NULL);
+        s_ctx.heartbeat_stats.sent++;
+        send_phoenix_message("phoenix", "heartbeat", NULL, NULL, false, ref, PHOENIX_TX_CONTROL);
+        ESP_LOGI(TAG, "💓 Heartbeat enviado (ref %lu)", (unsigned long)ref);
+    }
+}
+
+/**
+ * @brief Agrega una suscripción y envía el join si ya hay conexión
+ *
+ * @param join_payload Payload del phx_join (NULL = objeto vacío), se copia
+ */
+static esp_err_t add_subscription(const char *topic, const char *join_payload, bool broadcast,
+                                  phoenix_event_callback_t callback,
+                                  phoenix_json_callback_t json_callback, void *user_data)
+{
+    phoenix_subscription_t *sub = calloc(1, sizeof(phoenix_subscription_t));
+    if (!sub) {
+        return ESP_ERR_NO_MEM;
+    }
+    sub->topic = strdup(topic);
+    sub->join_payload = join_payload ? strdup(join_payload) : NULL;  // Guardar payload para JOINs posteriores
+    if (!sub->topic || (join_payload && !sub->join_payload)) {
+        free(sub->topic);
+        free(sub->join_payload);
+        free(sub);
+        return ESP_ERR_NO_MEM;
+    }
+    sub->callback = callback;
+    sub->json_callback = json_callback;
+    sub->user_data = user_data;
+    sub->joined = false;
+    sub->broadcast = broadcast;
+    sub->topic_hash = topic_hash(topic);
+    sub->next = s_ctx.subscriptions;
+    s_ctx.subscriptions = sub;
+
+    phoenix_subscription_t **bucket = &s_ctx.topic_buckets[sub->topic_hash & (PHOENIX_TOPIC_BUCKETS - 1)];
+    sub->bucket_next = *bucket;
+    *bucket = sub;
+
+    ESP_LOGI(TAG, "Suscripción agregada a %s", topic);
+
+    // Si ya está conectado, enviar join inmediatamente
+    if (s_ctx.connected && s_ctx.ws_client) {
+        send_join(sub);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Agrega una suscripción a Postgres Changes (topic realtime:schema:table)
+ *
+ * @param filter Filtro de Supabase Realtime (ej: "device_id=eq.GHOST-0A1B2C"), o NULL
+ */
+static esp_err_t add_postgres_subscription(const char *schema, const char *table, const char *event,
+                                           const char *filter, phoenix_event_callback_t callback,
+                                           phoenix_json_callback_t json_callback, void *user_data,
+                                           char *topic_out)
+{
+    // Crear topic en formato: realtime:schema:table[:filter]
+    // (con filtro el topic distingue varias suscripciones a la misma tabla)
+    char topic[PHOENIX_TOPIC_MAX_LEN];
+    int len;
+    if (filter && filter[0]) {
+        len = snprintf(topic, sizeof(topic), "realtime:%s:%s:%s", schema, table, filter);
+    } else {
+        len = snprintf(topic, sizeof(topic), "realtime:%s:%s", schema, table);
+    }
+    if (len < 0 || len >= (int)sizeof(topic)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Crear payload de configuración para Supabase Realtime
+    cJSON *config = cJSON_CreateObject();
+    cJSON *postgres_changes = cJSON_CreateArray();
+    cJSON *change = cJSON_CreateObject();
+    cJSON_AddStringToObject(change, "event", event ? event : "*");
+    cJSON_AddStringToObject(change, "schema", schema);
+    cJSON_AddStringToObject(change, "table", table);
+    if (filter && filter[0]) {
+        // El servidor solo reenvía las filas que cumplen el filtro
+        cJSON_AddStringToObject(change, "filter", filter);
+    }
+    cJSON_AddItemToArray(postgres_changes, change);
+    cJSON_AddItemToObject(config, "postgres_changes", postgres_changes);
 
-        default:
-            break;
+    char *payload_str = cJSON_PrintUnformatted(config);
+    cJSON_Delete(config);
+    if (!payload_str) {
+        return ESP_ERR_NO_MEM;
     }
-}
 
-/**
- * @brief Callback del timer de heartbeat
- */
-static void heartbeat_timer_callback(void* arg)
-{
-    if (s_ctx.connected && s_ctx.ws_client) {
-        char *msg = create_phoenix_message("phoenix", "heartbeat", NULL, 0);
-        esp_websocket_client_send_text(s_ctx.ws_client, msg, strlen(msg), portMAX_DELAY);
-        free(msg);
-        ESP_LOGI(TAG, "💓 Heartbeat enviado");
+    ESP_LOGI(TAG, "Suscripción postgres a %s (event=%s, filter=%s)", topic, event ? event : "*",
+             (filter && filter[0]) ? filter : "-");
+    esp_err_t err = add_subscription(topic, payload_str, false, callback, json_callback, user_data);
+    free(payload_str);
+    if (err == ESP_OK && topic_out) {
+        memcpy(topic_out, topic, len + 1);
     }
+    return err;
 }
 
 // ============================================================================
@@ -256,11 +1366,27 @@ esp_err_t phoenix_init(const char *supabase_url, const char *anon_key)
     s_ctx.supabase_url = strdup(supabase_url);
     s_ctx.anon_key = strdup(anon_key);
     s_ctx.heartbeat_interval_ms = PHOENIX_HEARTBEAT_INTERVAL;
+    s_ctx.heartbeat_current_ms = PHOENIX_HEARTBEAT_INTERVAL;
+    s_ctx.heartbeat_stats.interval_ms = PHOENIX_HEARTBEAT_INTERVAL;
     s_ctx.ref_counter = 0;
     s_ctx.connected = false;
     s_ctx.subscriptions = NULL;
     s_ctx.reconnect_pending = false;
 
+    if (!s_ctx.lock) {
+        s_ctx.lock = xSemaphoreCreateMutex();
+        s_ctx.tx_stopped = xSemaphoreCreateBinary();
+        if (!s_ctx.lock || !s_ctx.tx_stopped) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    // La sesión TLS del WebSocket se registra en el gestor compartido
+    esp_err_t err = tls_manager_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+
     ESP_LOGI(TAG, "Cliente Phoenix inicializado para %s", supabase_url);
     return ESP_OK;
 }
@@ -273,14 +1399,15 @@ esp_err_t phoenix_connect(void)
     }
 
     // Construir URL WebSocket de Supabase Realtime
-    // Formato v1.0.0: wss://[project-ref].supabase.co/realtime/v1/websocket?apikey=[key]&vsn=1.0.0
+    // Formato: wss://[project-ref].supabase.co/realtime/v1/websocket?apikey=[key]&vsn=[1.0.0|2.0.0]
     // Nota: Authorization se envía en el payload del JOIN, no en la URL
+    s_ctx.vsn = s_ctx.vsn_requested;
     char ws_url[512];
     int len = snprintf(ws_url, sizeof(ws_url),
              "wss://%s/realtime/v1/websocket?apikey=%s&vsn=%s",
              s_ctx.supabase_url,
              s_ctx.anon_key,
-             PHOENIX_VERSION);
+             vsn_name(s_ctx.vsn));
 
     if (len >= sizeof(ws_url)) {
         ESP_LOGE(TAG, "URL WebSocket muy larga, truncada!");
@@ -289,6 +1416,21 @@ esp_err_t phoenix_connect(void)
 
     ESP_LOGI(TAG, "Conectando a: %s", ws_url);
 
+    // Tarea de envío: única escritora del socket
+    if (!s_ctx.tx_task) {
+        s_ctx.tx_run = true;
+        if (xTaskCreate(tx_task, "phoenix_tx", PHOENIX_TX_TASK_STACK, NULL,
+                        PHOENIX_TX_TASK_PRIORITY, &s_ctx.tx_task) != pdPASS) {
+            s_ctx.tx_task = NULL;
+            ESP_LOGE(TAG, "Error creando tarea de envío");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    // Misma configuración de confianza que las sesiones HTTPS
+    tls_manager_trust_t trust;
+    tls_manager_get_trust(s_ctx.supabase_url, &trust);
+
     // Configurar cliente WebSocket
     const esp_websocket_client_config_t ws_cfg = {
         .uri = ws_url,
@@ -296,12 +1438,15 @@ esp_err_t phoenix_connect(void)
         .network_timeout_ms = 10000,           // Timeout de red 10s
         .buffer_size = 8192,                   // Buffer más grande para mensajes grandes
         .user_agent = "ESP32-Ghost-Gateway/1.0",
-        .cert_pem = NULL,                      // Sin cert PEM específico
-        .crt_bundle_attach = esp_crt_bundle_attach,  // Usar cert bundle del sistema
+        .cert_pem = trust.cert_pem,            // Confianza compartida (tls_manager)
+        .cert_len = trust.cert_len,
+        .crt_bundle_attach = trust.crt_bundle_attach,
+        .cert_common_name = trust.common_name,
         .keep_alive_enable = true,             // Mantener conexión activa
         .keep_alive_idle = 30,                 // 30 segundos idle
         .keep_alive_interval = 5,              // Keep-alive cada 5 segundos
         .keep_alive_count = 3,                 // 3 reintentos
+        .permessage_deflate = PHOENIX_PERMESSAGE_DEFLATE,
     };
 
     s_ctx.ws_client = esp_websocket_client_init(&ws_cfg);
@@ -334,12 +1479,32 @@ esp_err_t phoenix_connect(void)
         return err;
     }
 
-    err = esp_timer_start_periodic(s_ctx.heartbeat_timer, s_ctx.heartbeat_interval_ms * 1000);
+    err = esp_timer_start_periodic(s_ctx.heartbeat_timer, (uint64_t)s_ctx.heartbeat_current_ms * 1000);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error iniciando timer de heartbeat: %s", esp_err_to_name(err));
         return err;
     }
 
+    // Timer de deadlines de requests pendientes
+    const esp_timer_create_args_t pending_timer_args = {
+        .callback = &pending_timer_callback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "phoenix_pending"
+    };
+
+    err = esp_timer_create(&pending_timer_args, &s_ctx.pending_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error creando timer de requests: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = esp_timer_start_periodic(s_ctx.pending_timer, PHOENIX_PENDING_SWEEP_MS * 1000);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error iniciando timer de requests: %s", esp_err_to_name(err));
+        return err;
+    }
+
     return ESP_OK;
 }
 
@@ -351,11 +1516,33 @@ esp_err_t phoenix_disconnect(void)
         s_ctx.heartbeat_timer = NULL;
     }
 
+    if (s_ctx.pending_timer) {
+        esp_timer_stop(s_ctx.pending_timer);
+        esp_timer_delete(s_ctx.pending_timer);
+        s_ctx.pending_timer = NULL;
+    }
+
+    // Detener la tarea de envío antes de destruir el cliente. Si estaba
+    // reconectando, esperar a que termine: no debe usar el cliente destruido.
+    s_ctx.connected = false;
+    s_ctx.reconnect_requested = false;
+    if (s_ctx.tx_task) {
+        s_ctx.tx_run = false;
+        xTaskNotifyGive(s_ctx.tx_task);
+        xSemaphoreTake(s_ctx.tx_stopped, portMAX_DELAY);
+        s_ctx.tx_task = NULL;
+    }
+    tx_flush();
+
     if (s_ctx.ws_client) {
         esp_websocket_client_stop(s_ctx.ws_client);
         esp_websocket_client_destroy(s_ctx.ws_client);
         s_ctx.ws_client = NULL;
     }
+    tls_session_note(false);
+
+    // Completar requests pendientes antes de liberar las suscripciones
+    pending_expire(true);
 
     // Limpiar suscripciones
     phoenix_subscription_t *sub = s_ctx.subscriptions;
@@ -369,6 +1556,12 @@ esp_err_t phoenix_disconnect(void)
         sub = next;
     }
     s_ctx.subscriptions = NULL;
+    memset(s_ctx.topic_buckets, 0, sizeof(s_ctx.topic_buckets));
+
+    rx_buffer_reset();
+    free(s_ctx.rx.buf);
+    s_ctx.rx.buf = NULL;
+    s_ctx.rx.cap = 0;
 
     s_ctx.connected = false;
     return ESP_OK;
@@ -379,28 +1572,15 @@ esp_err_t phoenix_subscribe(const char *topic, phoenix_event_callback_t callback
     if (!topic || !callback) {
         return ESP_ERR_INVALID_ARG;
     }
+    return add_subscription(topic, NULL, false, callback, NULL, user_data);
+}
 
-    // Crear nueva suscripción
-    phoenix_subscription_t *sub = malloc(sizeof(phoenix_subscription_t));
-    sub->topic = strdup(topic);
-    sub->join_payload = NULL;  // Sin payload personalizado
-    sub->callback = callback;
-    sub->user_data = user_data;
-    sub->joined = false;
-    sub->next = s_ctx.subscriptions;
-    s_ctx.subscriptions = sub;
-
-    ESP_LOGI(TAG, "Suscripción agregada a %s", topic);
-
-    // Si ya está conectado, enviar join inmediatamente
-    if (s_ctx.connected && s_ctx.ws_client) {
-        char *msg = create_phoenix_message(topic, "phx_join", NULL, ++s_ctx.ref_counter);
-        esp_websocket_client_send_text(s_ctx.ws_client, msg, strlen(msg), portMAX_DELAY);
-        free(msg);
-        ESP_LOGI(TAG, "Enviando phx_join a %s", topic);
+esp_err_t phoenix_subscribe_json(const char *topic, phoenix_json_callback_t callback, void *user_data)
+{
+    if (!topic || !callback) {
+        return ESP_ERR_INVALID_ARG;
     }
-
-    return ESP_OK;
+    return add_subscription(topic, NULL, false, NULL, callback, user_data);
 }
 
 esp_err_t phoenix_subscribe_postgres(const char *schema, const char *table, const char *event,
@@ -409,79 +1589,356 @@ esp_err_t phoenix_subscribe_postgres(const char *schema, const char *table, cons
     if (!schema || !table || !callback) {
         return ESP_ERR_INVALID_ARG;
     }
+    return add_postgres_subscription(schema, table, event, NULL, callback, NULL, user_data, NULL);
+}
 
-    // Crear topic en formato: realtime:schema:table
-    char topic[128];
-    snprintf(topic, sizeof(topic), "realtime:%s:%s", schema, table);
+esp_err_t phoenix_subscribe_postgres_json(const char *schema, const char *table, const char *event,
+                                           phoenix_json_callback_t callback, void *user_data)
+{
+    if (!schema || !table || !callback) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return add_postgres_subscription(schema, table, event, NULL, NULL, callback, user_data, NULL);
+}
 
-    // Crear payload de configuración para Supabase Realtime
-    cJSON *config = cJSON_CreateObject();
-    cJSON *postgres_changes = cJSON_CreateArray();
-    cJSON *change = cJSON_CreateObject();
-    cJSON_AddStringToObject(change, "event", event ? event : "*");
-    cJSON_AddStringToObject(change, "schema", schema);
-    cJSON_AddStringToObject(change, "table", table);
-    cJSON_AddItemToArray(postgres_changes, change);
-    cJSON_AddItemToObject(config, "postgres_changes", postgres_changes);
+esp_err_t phoenix_subscribe_postgres_filtered(const char *schema, const char *table, const char *event,
+                                              const char *filter, phoenix_json_callback_t callback,
+                                              void *user_data, char *topic)
+{
+    if (!schema || !table || !callback) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return add_postgres_subscription(schema, table, event, filter, NULL, callback, user_data, topic);
+}
 
-    char *payload_str = cJSON_PrintUnformatted(config);
+/**
+ * @brief Une un canal de broadcast
+ *
+ * @param ack true para que el servidor confirme cada broadcast con un phx_reply
+ */
+static esp_err_t subscribe_broadcast(const char *channel, bool ack, phoenix_json_callback_t callback,
+                                     void *user_data)
+{
+    char topic[128];
+    int len = snprintf(topic, sizeof(topic), "realtime:%s", channel);
+    if (len < 0 || len >= (int)sizeof(topic)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
 
-    // Crear suscripción
-    phoenix_subscription_t *sub = malloc(sizeof(phoenix_subscription_t));
-    sub->topic = strdup(topic);
-    sub->join_payload = strdup(payload_str);  // Guardar payload para JOINs posteriores
-    sub->callback = callback;
-    sub->user_data = user_data;
-    sub->joined = false;
-    sub->next = s_ctx.subscriptions;
-    s_ctx.subscriptions = sub;
+    // self=false: el servidor no devuelve al emisor sus propios mensajes
+    static const char *join_payload =
+        "{\"config\":{\"broadcast\":{\"self\":false,\"ack\":false},\"presence\":{\"key\":\"\"}}}";
+    static const char *join_payload_ack =
+        "{\"config\":{\"broadcast\":{\"self\":false,\"ack\":true},\"presence\":{\"key\":\"\"}}}";
 
-    ESP_LOGI(TAG, "Suscripción postgres agregada a %s (event=%s)", topic, event ? event : "*");
+    ESP_LOGI(TAG, "Suscripción broadcast a %s%s", topic, ack ? " (con ack)" : "");
+    return add_subscription(topic, ack ? join_payload_ack : join_payload, true, NULL, callback, user_data);
+}
 
-    // Si ya está conectado, enviar join con payload
-    if (s_ctx.connected && s_ctx.ws_client) {
-        char *msg = create_phoenix_message(topic, "phx_join", payload_str, ++s_ctx.ref_counter);
-        ESP_LOGI(TAG, "Enviando JOIN: %s", msg);
-        esp_websocket_client_send_text(s_ctx.ws_client, msg, strlen(msg), portMAX_DELAY);
-        free(msg);
+/**
+ * @brief Arma el topic de un broadcast y verifica que el canal esté unido
+ *
+ * @param[out] topic Topic del canal (128 bytes)
+ * @return ESP_ERR_INVALID_STATE si el canal no está unido
+ */
+static esp_err_t broadcast_topic(const char *channel, char *topic)
+{
+    int len = snprintf(topic, 128, "realtime:%s", channel);
+    if (len < 0 || len >= 128) {
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    free(payload_str);
-    cJSON_Delete(config);
+    // Supabase solo reenvía broadcasts de clientes unidos al canal
+    phoenix_subscription_t *sub = find_subscription(topic);
+    if (!sub || !sub->broadcast || !sub->joined) {
+        return ESP_ERR_INVALID_STATE;
+    }
     return ESP_OK;
 }
 
-esp_err_t phoenix_send(const char *topic, const char *event, const char *payload)
+/**
+ * @brief Encola un mensaje sin seguimiento de respuesta
+ *
+ * @param broadcast_event Evento de broadcast (el payload se envuelve), o NULL
+ * @param owned true si el payload pasa al mensaje (se libera también si falla)
+ */
+static esp_err_t send_with_class(const char *topic, const char *event, const char *broadcast_event,
+                                 const char *payload, bool owned, phoenix_tx_class_t tx_class)
+{
+    if (!s_ctx.connected || !s_ctx.ws_client) {
+        ESP_LOGW(TAG, "No conectado, no se puede enviar mensaje");
+        if (owned) {
+            free((void *)payload);
+        }
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = send_phoenix_message(topic, event, broadcast_event, payload, owned, next_ref(), tx_class);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Mensaje no encolado: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+/**
+ * @brief Encola un mensaje y registra el callback de su phx_reply
+ *
+ * @param broadcast_event Evento de broadcast (el payload se envuelve), o NULL
+ */
+static esp_err_t send_with_reply(const char *topic, const char *event, const char *broadcast_event,
+                                 const char *payload, uint32_t timeout_ms,
+                                 phoenix_reply_callback_t callback, void *user_data)
 {
     if (!s_ctx.connected || !s_ctx.ws_client) {
         ESP_LOGW(TAG, "No conectado, no se puede enviar mensaje");
         return ESP_ERR_INVALID_STATE;
     }
 
-    char *msg = create_phoenix_message(topic, event, payload, ++s_ctx.ref_counter);
-    esp_err_t err = esp_websocket_client_send_text(s_ctx.ws_client, msg, strlen(msg), portMAX_DELAY);
-    free(msg);
+    uint32_t ref = pending_add(PHOENIX_PENDING_SEND, timeout_ms, callback, user_data, NULL);
+    if (ref == 0) {
+        ESP_LOGW(TAG, "Tabla de requests llena");
+        return ESP_ERR_NO_MEM;
+    }
 
+    esp_err_t err = send_phoenix_message(topic, event, broadcast_event, payload, false, ref, PHOENIX_TX_RELIABLE);
     if (err != ESP_OK) {
+        // No se encoló: retirar sin llamar al callback
+        phoenix_pending_t entry;
+        pending_take(ref, &entry);
         ESP_LOGE(TAG, "Error enviando mensaje: %s", esp_err_to_name(err));
     }
-
     return err;
 }
 
+esp_err_t phoenix_subscribe_broadcast(const char *channel, phoenix_json_callback_t callback, void *user_data)
+{
+    if (!channel || !callback) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return subscribe_broadcast(channel, false, callback, user_data);
+}
+
+esp_err_t phoenix_subscribe_broadcast_ack(const char *channel, phoenix_json_callback_t callback, void *user_data)
+{
+    if (!channel) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return subscribe_broadcast(channel, true, callback, user_data);
+}
+
+esp_err_t phoenix_broadcast(const char *channel, const char *event, const char *payload,
+                            phoenix_tx_class_t tx_class)
+{
+    if (!channel || !event) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char topic[128];
+    esp_err_t err = broadcast_topic(channel, topic);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return send_with_class(topic, "broadcast", event, payload, false, tx_class);
+}
+
+esp_err_t phoenix_broadcast_owned(const char *channel, const char *event, char *payload,
+                                  phoenix_tx_class_t tx_class)
+{
+    if (!channel || !event) {
+        free(payload);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char topic[128];
+    esp_err_t err = broadcast_topic(channel, topic);
+    if (err != ESP_OK) {
+        free(payload);
+        return err;
+    }
+    return send_with_class(topic, "broadcast", event, payload, true, tx_class);
+}
+
+esp_err_t phoenix_broadcast_with_reply(const char *channel, const char *event, const char *payload,
+                                       uint32_t timeout_ms, phoenix_reply_callback_t callback, void *user_data)
+{
+    if (!channel || !event || !callback) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char topic[128];
+    esp_err_t err = broadcast_topic(channel, topic);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return send_with_reply(topic, "broadcast", event, payload, timeout_ms, callback, user_data);
+}
+
+esp_err_t phoenix_send(const char *topic, const char *event, const char *payload)
+{
+    return phoenix_send_with_class(topic, event, payload, PHOENIX_TX_RELIABLE);
+}
+
+esp_err_t phoenix_send_with_class(const char *topic, const char *event, const char *payload,
+                                  phoenix_tx_class_t tx_class)
+{
+    if (!topic || !event) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return send_with_class(topic, event, NULL, payload, false, tx_class);
+}
+
+esp_err_t phoenix_send_owned(const char *topic, const char *event, char *payload, phoenix_tx_class_t tx_class)
+{
+    if (!topic || !event) {
+        free(payload);
+        return ESP_ERR_INVALID_ARG;
+    }
+    return send_with_class(topic, event, NULL, payload, true, tx_class);
+}
+
+esp_err_t phoenix_send_with_reply(const char *topic, const char *event, const char *payload,
+                                  uint32_t timeout_ms, phoenix_reply_callback_t callback, void *user_data)
+{
+    if (!topic || !event || !callback) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return send_with_reply(topic, event, NULL, payload, timeout_ms, callback, user_data);
+}
+
+/**
+ * @brief Estado de una espera de phoenix_send_sync
+ */
+typedef struct {
+    SemaphoreHandle_t done;
+    esp_err_t result;
+} phoenix_sync_wait_t;
+
+static void sync_reply_callback(esp_err_t result, const cJSON *response, void *user_data)
+{
+    phoenix_sync_wait_t *wait = (phoenix_sync_wait_t *)user_data;
+    wait->result = result;
+    xSemaphoreGive(wait->done);
+}
+
+esp_err_t phoenix_send_sync(const char *topic, const char *event, const char *payload, uint32_t timeout_ms)
+{
+    StaticSemaphore_t done_buffer;
+    phoenix_sync_wait_t wait = {
+        .done = xSemaphoreCreateBinaryStatic(&done_buffer),
+        .result = ESP_ERR_TIMEOUT,
+    };
+
+    esp_err_t err = phoenix_send_with_reply(topic, event, payload, timeout_ms, sync_reply_callback, &wait);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // El callback siempre llega: respuesta, deadline o desconexión
+    xSemaphoreTake(wait.done, portMAX_DELAY);
+    return wait.result;
+}
+
+esp_err_t phoenix_broadcast_sync(const char *channel, const char *event, const char *payload, uint32_t timeout_ms)
+{
+    StaticSemaphore_t done_buffer;
+    phoenix_sync_wait_t wait = {
+        .done = xSemaphoreCreateBinaryStatic(&done_buffer),
+        .result = ESP_ERR_TIMEOUT,
+    };
+
+    esp_err_t err = phoenix_broadcast_with_reply(channel, event, payload, timeout_ms, sync_reply_callback, &wait);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    xSemaphoreTake(wait.done, portMAX_DELAY);
+    return wait.result;
+}
+
+esp_err_t phoenix_get_rx_stats(phoenix_rx_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = s_ctx.rx_stats;
+    return ESP_OK;
+}
+
 bool phoenix_is_connected(void)
 {
     return s_ctx.connected;
 }
 
+bool phoenix_is_joined(const char *topic)
+{
+    if (!topic || !s_ctx.connected) {
+        return false;
+    }
+    phoenix_subscription_t *sub = find_subscription(topic);
+    return sub && sub->joined;
+}
+
 esp_err_t phoenix_set_heartbeat_interval(uint32_t interval_ms)
 {
+    if (interval_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
     s_ctx.heartbeat_interval_ms = interval_ms;
+    s_ctx.heartbeat_ok_streak = 0;
+    heartbeat_apply_interval(interval_ms);
 
-    if (s_ctx.heartbeat_timer) {
-        esp_timer_stop(s_ctx.heartbeat_timer);
-        esp_timer_start_periodic(s_ctx.heartbeat_timer, interval_ms * 1000);
+    return ESP_OK;
+}
+
+esp_err_t phoenix_set_protocol_version(phoenix_vsn_t vsn)
+{
+    if (vsn != PHOENIX_VSN_1_0_0 && vsn != PHOENIX_VSN_2_0_0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_ctx.ws_client) {
+        // El serializador no puede cambiar con la conexión abierta
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_ctx.vsn_requested = vsn;
+    return ESP_OK;
+}
+
+esp_err_t phoenix_get_codec_stats(phoenix_codec_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = s_ctx.codec_stats;
+    stats->vsn = s_ctx.vsn;
+
+    esp_websocket_deflate_stats_t deflate;
+    if (s_ctx.ws_client && esp_websocket_client_get_deflate_stats(s_ctx.ws_client, &deflate) == ESP_OK) {
+        stats->rx_compressed = deflate.messages;
+        stats->rx_wire_bytes = deflate.wire_bytes;
+        stats->rx_inflated_bytes = deflate.inflated_bytes;
+        stats->inflate_us = deflate.inflate_us;
+    }
+    return ESP_OK;
+}
+
+esp_err_t phoenix_get_tx_stats(phoenix_tx_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
     }
+    xSemaphoreTake(s_ctx.lock, portMAX_DELAY);
+    *stats = s_ctx.tx_stats;
+    stats->bytes_queued = s_ctx.tx_bytes;
+    xSemaphoreGive(s_ctx.lock);
+    return ESP_OK;
+}
 
+esp_err_t phoenix_get_heartbeat_stats(phoenix_heartbeat_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = s_ctx.heartbeat_stats;
     return ESP_OK;
 }
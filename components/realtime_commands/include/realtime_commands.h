@@ -4,6 +4,15 @@
  *
  * Reemplaza al command_processor que usa polling.
  * Ahora los comandos llegan instantáneamente via WebSocket.
+ *
+ * Los cambios de estado se publican además por un canal de Broadcast del
+ * sitio (gateway_state:<user_id>) para que otros gateways y la webapp los
+ * reciban sin esperar al insert en system_events.
+ *
+ * Con SUPABASE_EVENT_TRANSPORT_REALTIME (opt-in en supabase_client.h) los
+ * eventos de supabase_client se envían como broadcast con ack por el canal
+ * device_events:<device_id>, sobre la conexión ya abierta; HTTPS queda como
+ * respaldo cuando el socket no está disponible.
  */
 
 #ifndef REALTIME_COMMANDS_H
@@ -0,0 +1,104 @@
+# Servidor HTTP/2 de prueba para test_h2.c (h2 en claro, conocimiento previo)
+#
+# Requiere la biblioteca h2: pip install h2
+# Uso: python3 h2_server.py [puerto]   (8443 por defecto)
+
+import socket
+import sys
+import threading
+import time
+
+import h2.config
+import h2.connection
+import h2.errors
+import h2.events
+import h2.settings
+
+PORT = int(sys.argv[1]) if len(sys.argv) > 1 else 8443
+DATA_CHUNK = 700            # Bodies largos en varios DATA
+SLOW_RESPONSE_S = 1.5       # ghost-token-create: el request lento
+
+
+def handle(sock):
+    conn = h2.connection.H2Connection(config=h2.config.H2Configuration(client_side=False))
+    lock = threading.Lock()
+    conn.initiate_connection()
+    conn.update_settings({h2.settings.SettingCodes.MAX_CONCURRENT_STREAMS: 8})
+    sock.sendall(conn.data_to_send())
+    requests = {}
+
+    def respond(stream_id, status, body, extra=(), pad=None):
+        with lock:
+            # Headers de respuesta típicos de Supabase detrás de Cloudflare
+            headers = [(':status', str(status)), ('content-type', 'application/json'),
+                       ('server', 'cloudflare'), ('cf-ray', '8f1e2d3c4b5a6978-EZE'),
+                       ('access-control-allow-origin', '*'), ('sb-gateway-version', '1'),
+                       ('content-length', str(len(body)))] + list(extra)
+            conn.send_headers(stream_id, headers, end_stream=not body)
+            if body:
+                chunks = [body[i:i + DATA_CHUNK] for i in range(0, len(body), DATA_CHUNK)]
+                for i, chunk in enumerate(chunks):
+                    conn.send_data(stream_id, chunk, end_stream=(i == len(chunks) - 1),
+                                   pad_length=(pad if i == 0 else None))
+            sock.sendall(conn.data_to_send())
+
+    while True:
+        data = sock.recv(65535)
+        if not data:
+            break
+        with lock:
+            events = conn.receive_data(data)
+        for ev in events:
+            if isinstance(ev, h2.events.RequestReceived):
+                requests[ev.stream_id] = {'headers': dict(ev.headers), 'body': b''}
+            elif isinstance(ev, h2.events.DataReceived):
+                requests[ev.stream_id]['body'] += ev.data
+                with lock:
+                    conn.acknowledge_received_data(ev.flow_controlled_length, ev.stream_id)
+            elif isinstance(ev, h2.events.StreamEnded):
+                req = requests.pop(ev.stream_id)
+                headers = req['headers']
+                path = headers[b':path'].decode()
+                sid = ev.stream_id
+                if path.endswith('ghost-token-create'):
+                    threading.Timer(SLOW_RESPONSE_S, respond, (sid, 200, b'{"link_code":"123456"}')).start()
+                elif path.startswith('/rest/'):
+                    if headers.get(b'if-none-match') == b'"v1"':
+                        respond(sid, 304, b'', [('etag', '"v1"')])
+                    else:
+                        body = b'[' + b','.join(b'{"id":%d}' % i for i in range(300)) + b']'
+                        respond(sid, 200, body, [('etag', '"v1"')], pad=10)
+                elif path.endswith('refused'):
+                    with lock:
+                        conn.reset_stream(sid, h2.errors.ErrorCodes.REFUSED_STREAM)
+                        sock.sendall(conn.data_to_send())
+                elif path.endswith('goaway'):
+                    # El stream queda sobre el último ID procesado: el cliente lo reintenta
+                    with lock:
+                        conn.close_connection(last_stream_id=sid - 2)
+                        sock.sendall(conn.data_to_send())
+                    time.sleep(0.2)
+                    sock.close()
+                    return
+                else:
+                    respond(sid, 201, b'{"ok":true,"len":%d}' % len(req['body']))
+        with lock:
+            out = conn.data_to_send()
+            if out:
+                sock.sendall(out)
+    sock.close()
+
+
+def main():
+    srv = socket.socket()
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(('127.0.0.1', PORT))
+    srv.listen()
+    print('h2_server escuchando en 127.0.0.1:%d' % PORT, flush=True)
+    while True:
+        client, _ = srv.accept()
+        threading.Thread(target=handle, args=(client,), daemon=True).start()
+
+
+if __name__ == '__main__':
+    main()
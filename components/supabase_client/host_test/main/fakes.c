@@ -0,0 +1,324 @@
+/**
+ * @file fakes.c
+ * @brief tls_manager, esp_tls y DNS para el target linux
+ *
+ * esp_timer está en host_test_support (sim_clock.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_tls.h"
+#include "tls_manager.h"
+#include "mbedtls/ssl.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "lwip/dns.h"
+#include "sim_net.h"
+
+#define SIM_DNS_PORT        53
+#define SIM_DNS_PACKET_MAX  512
+
+struct esp_tls {
+    int fd;
+};
+
+static uint16_t s_server_port = 0;
+static const char *s_alpn = "h2";
+static int s_open_sessions = 0;
+static char s_last_addr[16];
+static const char *s_refused_addr = NULL;
+
+static int s_dns_fd = -1;
+static uint16_t s_dns_port = 0;
+static ip_addr_t s_dns_server;
+static volatile uint32_t s_dns_answer = 0;      // Orden de red; 0 = no responder
+static volatile uint32_t s_dns_ttl_s = 0;
+static volatile uint32_t s_dns_queries = 0;
+static volatile sim_dns_flaw_t s_dns_flaw = SIM_DNS_FLAW_NONE;
+static const char *s_fallback_ip = NULL;
+static uint32_t s_fallback_queries = 0;
+
+int __real_connect(int fd, const struct sockaddr *addr, socklen_t len);
+int __real_getaddrinfo(const char *node, const char *service, const struct addrinfo *hints,
+                       struct addrinfo **res);
+
+// ============================================================================
+// Simulación
+// ============================================================================
+
+void sim_net_set_server_port(uint16_t port)
+{
+    s_server_port = port;
+}
+
+void sim_net_set_alpn(const char *proto)
+{
+    s_alpn = proto;
+}
+
+int sim_net_open_sessions(void)
+{
+    return s_open_sessions;
+}
+
+const char *sim_net_last_addr(void)
+{
+    return s_last_addr;
+}
+
+void sim_net_refuse_addr(const char *addr)
+{
+    s_refused_addr = addr;
+}
+
+// ============================================================================
+// Resolver simulado
+// ============================================================================
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, v >> 16);
+    put_u16(p + 2, v & 0xFFFF);
+}
+
+/**
+ * @brief Respuesta: pregunta, CNAME a cdn.example.test y registro A de ese nombre
+ */
+static size_t build_answer(uint8_t *buf, size_t query_len)
+{
+    static const uint8_t target[] = "\3cdn\7example\4test";
+    size_t target_len = sizeof(target);             // Incluye la etiqueta raíz
+    size_t pos = query_len;
+    if (pos + 12 + target_len + 16 > SIM_DNS_PACKET_MAX) {
+        return 0;
+    }
+
+    buf[2] = 0x81;                  // Respuesta, RD
+    buf[3] = 0x80;                  // RA, sin error
+    if (s_dns_flaw == SIM_DNS_FLAW_TRUNCATED) {
+        buf[2] |= 0x02;             // TC
+    } else if (s_dns_flaw == SIM_DNS_FLAW_OTHER_QUESTION) {
+        buf[13] ^= 0x01;            // Primera letra del nombre preguntado
+    }
+    put_u16(buf + 6, 2);            // Dos respuestas
+    put_u16(buf + 8, 0);
+    put_u16(buf + 10, 0);
+
+    put_u16(buf + pos, 0xC000 | 12);        // Nombre de la pregunta
+    put_u16(buf + pos + 2, 5);              // CNAME
+    put_u16(buf + pos + 4, 1);
+    put_u32(buf + pos + 6, SIM_DNS_CNAME_TTL_S);
+    put_u16(buf + pos + 10, target_len);
+    pos += 12;
+    size_t target_pos = pos;
+    memcpy(buf + pos, target, target_len);
+    pos += target_len;
+
+    put_u16(buf + pos, 0xC000 | target_pos);
+    put_u16(buf + pos + 2, 1);              // A
+    put_u16(buf + pos + 4, 1);
+    put_u32(buf + pos + 6, s_dns_ttl_s);
+    put_u16(buf + pos + 10, 4);
+    uint32_t answer = s_dns_answer;
+    memcpy(buf + pos + 12, &answer, 4);
+    return pos + 16;
+}
+
+static void dns_task(void *arg)
+{
+    uint8_t buf[SIM_DNS_PACKET_MAX];
+    while (true) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(s_dns_fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (len < 12) {
+            continue;
+        }
+        s_dns_queries++;
+        if (s_dns_answer == 0) {
+            continue;
+        }
+        size_t out = build_answer(buf, len);
+        if (out > 0) {
+            sendto(s_dns_fd, buf, out, 0, (struct sockaddr *)&from, from_len);
+        }
+    }
+}
+
+void sim_dns_start(void)
+{
+    if (s_dns_fd >= 0) {
+        return;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) != 0) {
+        abort();
+    }
+    s_dns_fd = fd;
+    s_dns_port = ntohs(addr.sin_port);
+    s_dns_server.type = IPADDR_TYPE_V4;
+    s_dns_server.u_addr.ip4.addr = htonl(INADDR_LOOPBACK);
+    xTaskCreate(dns_task, "sim_dns", 4096, NULL, 5, NULL);
+}
+
+void sim_dns_set_answer(const char *ip, uint32_t ttl_s)
+{
+    s_dns_ttl_s = ttl_s;
+    s_dns_answer = ip ? inet_addr(ip) : 0;
+}
+
+void sim_dns_set_flaw(sim_dns_flaw_t flaw)
+{
+    s_dns_flaw = flaw;
+}
+
+void sim_dns_set_fallback(const char *ip)
+{
+    s_fallback_ip = ip;
+}
+
+uint32_t sim_dns_queries(void)
+{
+    return s_dns_queries;
+}
+
+uint32_t sim_dns_fallback_queries(void)
+{
+    return s_fallback_queries;
+}
+
+const ip_addr_t *dns_getserver(uint8_t numdns)
+{
+    return s_dns_fd >= 0 ? &s_dns_server : NULL;
+}
+
+// La consulta de supabase_dns va al puerto 53: se redirige al resolver simulado
+int __wrap_connect(int fd, const struct sockaddr *addr, socklen_t len)
+{
+    const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+    if (s_dns_fd >= 0 && addr->sa_family == AF_INET && ntohs(in->sin_port) == SIM_DNS_PORT) {
+        struct sockaddr_in to = *in;
+        to.sin_port = htons(s_dns_port);
+        return __real_connect(fd, (struct sockaddr *)&to, sizeof(to));
+    }
+    return __real_connect(fd, addr, len);
+}
+
+int __wrap_getaddrinfo(const char *node, const char *service, const struct addrinfo *hints,
+                       struct addrinfo **res)
+{
+    if (s_dns_fd < 0) {
+        return __real_getaddrinfo(node, service, hints, res);
+    }
+    s_fallback_queries++;
+    if (s_fallback_ip == NULL) {
+        return EAI_NONAME;
+    }
+    return __real_getaddrinfo(s_fallback_ip, service, hints, res);
+}
+
+// ============================================================================
+// tls_manager (sin cifrar, siempre al servidor de prueba)
+// ============================================================================
+
+esp_err_t tls_manager_acquire_at(const char *host, const char *addr, uint16_t port,
+                                 const char **alpn_protos, uint32_t timeout_ms, esp_tls_t **tls)
+{
+    strncpy(s_last_addr, addr ? addr : "", sizeof(s_last_addr) - 1);
+    if (addr != NULL && s_refused_addr != NULL && strcmp(addr, s_refused_addr) == 0) {
+        return ESP_FAIL;
+    }
+    // Sin puerto (pruebas de DNS) la sesión no abre socket
+    int fd = -1;
+    if (s_server_port != 0) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in to = {
+            .sin_family = AF_INET,
+            .sin_port = htons(s_server_port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        if (fd < 0 || connect(fd, (struct sockaddr *)&to, sizeof(to)) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return ESP_FAIL;
+        }
+    }
+    *tls = malloc(sizeof(**tls));
+    if (*tls == NULL) {
+        close(fd);
+        return ESP_ERR_NO_MEM;
+    }
+    (*tls)->fd = fd;
+    s_open_sessions++;
+    return ESP_OK;
+}
+
+esp_err_t tls_manager_acquire(const char *host, uint16_t port, const char **alpn_protos,
+                              uint32_t timeout_ms, esp_tls_t **tls)
+{
+    return tls_manager_acquire_at(host, NULL, port, alpn_protos, timeout_ms, tls);
+}
+
+void tls_manager_release(esp_tls_t *tls)
+{
+    if (tls == NULL) {
+        return;
+    }
+    if (tls->fd >= 0) {
+        close(tls->fd);
+    }
+    free(tls);
+    s_open_sessions--;
+}
+
+// ============================================================================
+// esp_tls y mbedTLS
+// ============================================================================
+
+ssize_t esp_tls_conn_write(esp_tls_t *tls, const void *data, size_t datalen)
+{
+    ssize_t ret = send(tls->fd, data, datalen, MSG_NOSIGNAL);
+    return ret < 0 ? -1 : ret;
+}
+
+ssize_t esp_tls_conn_read(esp_tls_t *tls, void *data, size_t datalen)
+{
+    ssize_t ret = recv(tls->fd, data, datalen, 0);
+    return ret < 0 ? -1 : ret;
+}
+
+esp_err_t esp_tls_get_conn_sockfd(esp_tls_t *tls, int *sockfd)
+{
+    *sockfd = tls->fd;
+    return ESP_OK;
+}
+
+ssize_t esp_tls_get_bytes_avail(esp_tls_t *tls)
+{
+    return 0;               // Sin TLS no hay datos descifrados pendientes
+}
+
+void *esp_tls_get_ssl_context(esp_tls_t *tls)
+{
+    return tls;
+}
+
+const char *mbedtls_ssl_get_alpn_protocol(const mbedtls_ssl_context *ssl)
+{
+    return s_alpn;
+}
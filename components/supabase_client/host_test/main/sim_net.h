@@ -0,0 +1,98 @@
+/**
+ * @file sim_net.h
+ * @brief Sesiones TLS y DNS simulados para las pruebas de supabase_client
+ *
+ * Las fuentes de supabase_client se compilan sin cambios; fakes.c
+ * reemplaza tls_manager y esp_tls, y esp_timer es el de host_test_support
+ * (timers y reloj en sim_clock.h). Cada sesión es un socket TCP
+ * sin cifrar a 127.0.0.1, al puerto del servidor de prueba, sea cual sea
+ * el host o la IP pedidos.
+ *
+ * Una vez iniciado el resolver simulado, dns_getserver() lo devuelve, la
+ * consulta UDP de supabase_dns al puerto 53 se redirige a él y
+ * getaddrinfo() responde lo configurado con sim_dns_set_fallback()
+ * (main/CMakeLists.txt usa --wrap).
+ */
+
+#ifndef SIM_NET_H
+#define SIM_NET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief TTL del CNAME de las respuestas del resolver (mayor que el del registro A) */
+#define SIM_DNS_CNAME_TTL_S     300
+
+/**
+ * @brief Defecto que el resolver introduce en sus respuestas
+ */
+typedef enum {
+    SIM_DNS_FLAW_NONE = 0,
+    SIM_DNS_FLAW_TRUNCATED,         // Bit TC encendido
+    SIM_DNS_FLAW_OTHER_QUESTION,    // La pregunta no es la consultada
+} sim_dns_flaw_t;
+
+/**
+ * @brief Puerto local al que se conectan las sesiones
+ */
+void sim_net_set_server_port(uint16_t port);
+
+/**
+ * @brief Protocolo que "negocia" cada sesión por ALPN (por defecto "h2")
+ */
+void sim_net_set_alpn(const char *proto);
+
+/**
+ * @brief Sesiones abiertas con tls_manager_acquire() y todavía sin liberar
+ */
+int sim_net_open_sessions(void);
+
+/**
+ * @brief IP pedida en el último tls_manager_acquire_at() ("" si fue por nombre)
+ */
+const char *sim_net_last_addr(void);
+
+/**
+ * @brief Hace fallar la conexión a esa IP, como un servidor que cambió de dirección
+ *
+ * @param addr IP en formato texto (NULL = ninguna)
+ */
+void sim_net_refuse_addr(const char *addr);
+
+/**
+ * @brief Inicia el resolver simulado (idempotente)
+ *
+ * Responde cada consulta A con un CNAME (TTL SIM_DNS_CNAME_TTL_S) y el
+ * registro A configurado con sim_dns_set_answer().
+ */
+void sim_dns_start(void);
+
+/**
+ * @brief Respuesta del resolver
+ *
+ * @param ip IP del registro A (NULL = el resolver no responde)
+ * @param ttl_s TTL del registro A
+ */
+void sim_dns_set_answer(const char *ip, uint32_t ttl_s);
+
+/**
+ * @brief Defecto de las respuestas siguientes (SIM_DNS_FLAW_NONE = ninguno)
+ */
+void sim_dns_set_flaw(sim_dns_flaw_t flaw);
+
+/**
+ * @brief Resultado de getaddrinfo() (NULL = falla)
+ */
+void sim_dns_set_fallback(const char *ip);
+
+/**
+ * @brief Consultas recibidas por el resolver
+ */
+uint32_t sim_dns_queries(void);
+
+/**
+ * @brief Llamadas a getaddrinfo() con el resolver iniciado
+ */
+uint32_t sim_dns_fallback_queries(void);
+
+#endif // SIM_NET_H
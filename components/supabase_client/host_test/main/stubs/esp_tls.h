@@ -0,0 +1,24 @@
+/**
+ * @file esp_tls.h
+ * @brief Declaraciones mínimas de esp_tls para el target linux
+ *
+ * Las sesiones las abre la tls_manager falsa de fakes.c sobre un socket
+ * TCP sin cifrar: el servidor de prueba habla h2 en claro.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "esp_err.h"
+
+#define ESP_TLS_ERR_SSL_WANT_READ   -0x6900
+#define ESP_TLS_ERR_SSL_WANT_WRITE  -0x6880
+
+typedef struct esp_tls esp_tls_t;
+
+ssize_t esp_tls_conn_write(esp_tls_t *tls, const void *data, size_t datalen);
+ssize_t esp_tls_conn_read(esp_tls_t *tls, void *data, size_t datalen);
+esp_err_t esp_tls_get_conn_sockfd(esp_tls_t *tls, int *sockfd);
+ssize_t esp_tls_get_bytes_avail(esp_tls_t *tls);
+void *esp_tls_get_ssl_context(esp_tls_t *tls);
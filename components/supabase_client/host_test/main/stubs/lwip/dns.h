@@ -0,0 +1,29 @@
+/**
+ * @file dns.h
+ * @brief Servidor DNS configurado, para la consulta propia de supabase_dns
+ *
+ * fakes.c implementa dns_getserver().
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t addr;
+} ip4_addr_t;
+
+typedef struct {
+    union {
+        ip4_addr_t ip4;
+    } u_addr;
+    uint8_t type;
+} ip_addr_t;
+
+#define IPADDR_TYPE_V4          0
+#define IP_IS_V4(ipaddr)        ((ipaddr)->type == IPADDR_TYPE_V4)
+#define ip_addr_isany(ipaddr)   ((ipaddr)->u_addr.ip4.addr == 0)
+#define ip_2_ip4(ipaddr)        (&(ipaddr)->u_addr.ip4)
+#define ip4_addr_get_u32(ip4)   ((ip4)->addr)
+
+const ip_addr_t *dns_getserver(uint8_t numdns);
@@ -0,0 +1,8 @@
+/**
+ * @file netdb.h
+ * @brief getaddrinfo() del host
+ */
+
+#pragma once
+
+#include <netdb.h>
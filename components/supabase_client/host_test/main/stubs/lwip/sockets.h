@@ -0,0 +1,13 @@
+/**
+ * @file sockets.h
+ * @brief Sockets de lwIP sobre los sockets POSIX del host
+ */
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
@@ -0,0 +1,12 @@
+/**
+ * @file ssl.h
+ * @brief Consulta de ALPN de mbedTLS para el target linux
+ *
+ * fakes.c devuelve el protocolo configurado con sim_net_set_alpn().
+ */
+
+#pragma once
+
+typedef struct mbedtls_ssl_context mbedtls_ssl_context;
+
+const char *mbedtls_ssl_get_alpn_protocol(const mbedtls_ssl_context *ssl);
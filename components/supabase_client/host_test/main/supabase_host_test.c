@@ -0,0 +1,25 @@
+/**
+ * @file supabase_host_test.c
+ * @brief Pruebas de host del componente supabase_client
+ */
+
+#include <stdlib.h>
+#include "unity.h"
+#include "supabase_host_test.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    test_h2_run();
+    test_dns_run();
+    int failures = UNITY_END();
+    exit(failures == 0 ? 0 : 1);
+}
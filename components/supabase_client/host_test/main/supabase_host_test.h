@@ -0,0 +1,19 @@
+/**
+ * @file supabase_host_test.h
+ * @brief Grupos de pruebas de host de supabase_client
+ */
+
+#ifndef SUPABASE_HOST_TEST_H
+#define SUPABASE_HOST_TEST_H
+
+/**
+ * @brief HTTP/2: streams concurrentes, HPACK, ETag, reintentos, GOAWAY y ALPN
+ */
+void test_h2_run(void);
+
+/**
+ * @brief Caché DNS: TTL, vencimiento, fallos, IP vencida y reconexión
+ */
+void test_dns_run(void);
+
+#endif // SUPABASE_HOST_TEST_H
@@ -0,0 +1,278 @@
+/**
+ * @file test_dns.c
+ * @brief Caché DNS de supabase_dns contra un resolver simulado
+ *
+ * El resolver de fakes.c responde cada consulta con un CNAME y el registro
+ * A configurado, o no responde (DNS caído). getaddrinfo() responde lo que
+ * indique sim_dns_set_fallback(). El reloj de esp_timer se adelanta para
+ * vencer las entradas sin esperar el TTL real.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "supabase_dns.h"
+#include "tls_manager.h"
+#include "supabase_host_test.h"
+#include "sim_net.h"
+#include "sim_clock.h"
+
+#define DNS_TEST_HOST       "db.example.test"
+#define DNS_TEST_DOWN_HOST  "down.example.test"
+#define DNS_TEST_TTL_S      45
+#define DNS_TEST_FAST_US    100000      // Respuesta sin consultar la red
+
+static supabase_dns_stats_t s_before;
+static SemaphoreHandle_t s_down_done;
+
+static void dns_reset(void)
+{
+    supabase_dns_invalidate(DNS_TEST_HOST);
+    sim_dns_set_answer("10.0.0.1", DNS_TEST_TTL_S);
+    sim_dns_set_flaw(SIM_DNS_FLAW_NONE);
+    sim_dns_set_fallback(NULL);
+    sim_net_refuse_addr(NULL);
+    supabase_dns_get_stats(&s_before);
+}
+
+static supabase_dns_stats_t dns_stats(void)
+{
+    supabase_dns_stats_t st;
+    supabase_dns_get_stats(&st);
+    return st;
+}
+
+static void assert_resolves(const char *expected)
+{
+    char ip[16];
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_dns_resolve(DNS_TEST_HOST, ip, sizeof(ip)));
+    TEST_ASSERT_EQUAL_STRING(expected, ip);
+}
+
+static void resolve_down_task(void *arg)
+{
+    char ip[16];
+    supabase_dns_resolve(DNS_TEST_DOWN_HOST, ip, sizeof(ip));
+    xSemaphoreGive(s_down_done);
+    vTaskDelete(NULL);
+}
+
+// ============================================================================
+// Pruebas
+// ============================================================================
+
+/**
+ * El TTL es el menor de la cadena (A de 45 s bajo un CNAME de 300 s) y la
+ * segunda resolución no consulta la red.
+ */
+static void test_ttl_from_answer_chain(void)
+{
+    dns_reset();
+    uint32_t queries = sim_dns_queries();
+    assert_resolves("10.0.0.1");
+    assert_resolves("10.0.0.1");
+
+    supabase_dns_stats_t st = dns_stats();
+    TEST_ASSERT_EQUAL(queries + 1, sim_dns_queries());
+    TEST_ASSERT_EQUAL(s_before.misses + 1, st.misses);
+    TEST_ASSERT_EQUAL(s_before.hits + 1, st.hits);
+    TEST_ASSERT_EQUAL(DNS_TEST_TTL_S, st.ttl_last_s);
+}
+
+static void test_entry_expires_after_ttl(void)
+{
+    dns_reset();
+    assert_resolves("10.0.0.1");
+    sim_dns_set_answer("10.0.0.2", DNS_TEST_TTL_S);
+    uint32_t queries = sim_dns_queries();
+
+    sim_clock_advance_ms((DNS_TEST_TTL_S - 1) * 1000);
+    assert_resolves("10.0.0.1");
+    TEST_ASSERT_EQUAL(queries, sim_dns_queries());
+
+    sim_clock_advance_ms(2000);
+    assert_resolves("10.0.0.2");
+    TEST_ASSERT_EQUAL(queries + 1, sim_dns_queries());
+}
+
+/**
+ * Un TTL corto se lleva al mínimo; uno largo queda acotado por el CNAME.
+ */
+static void test_ttl_bounds(void)
+{
+    dns_reset();
+    sim_dns_set_answer("10.0.0.1", 5);
+    assert_resolves("10.0.0.1");
+    TEST_ASSERT_EQUAL(SUPABASE_DNS_MIN_TTL_S, dns_stats().ttl_last_s);
+
+    supabase_dns_invalidate(DNS_TEST_HOST);
+    sim_dns_set_answer("10.0.0.1", 86400);
+    assert_resolves("10.0.0.1");
+    TEST_ASSERT_EQUAL(SIM_DNS_CNAME_TTL_S, dns_stats().ttl_last_s);
+}
+
+static void test_fallback_to_getaddrinfo(void)
+{
+    dns_reset();
+    sim_dns_set_answer(NULL, 0);
+    sim_dns_set_fallback("10.0.0.9");
+    uint32_t fallbacks = sim_dns_fallback_queries();
+
+    assert_resolves("10.0.0.9");
+    TEST_ASSERT_EQUAL(fallbacks + 1, sim_dns_fallback_queries());
+    TEST_ASSERT_EQUAL(SUPABASE_DNS_DEFAULT_TTL_S, dns_stats().ttl_last_s);
+}
+
+/**
+ * Una respuesta truncada o a otra pregunta no se usa aunque traiga un
+ * registro A: se resuelve con getaddrinfo().
+ */
+static void test_rejects_truncated_and_foreign_answers(void)
+{
+    static const sim_dns_flaw_t flaws[] = { SIM_DNS_FLAW_TRUNCATED, SIM_DNS_FLAW_OTHER_QUESTION };
+    for (size_t i = 0; i < sizeof(flaws) / sizeof(flaws[0]); i++) {
+        dns_reset();
+        sim_dns_set_flaw(flaws[i]);
+        sim_dns_set_fallback("10.0.0.9");
+        uint32_t fallbacks = sim_dns_fallback_queries();
+
+        assert_resolves("10.0.0.9");
+        TEST_ASSERT_EQUAL(fallbacks + 1, sim_dns_fallback_queries());
+    }
+}
+
+/**
+ * Mientras un host espera al DNS caído, otro que está en caché se resuelve
+ * sin esperar: la consulta no retiene la caché.
+ */
+static void test_lookup_does_not_block_cache(void)
+{
+    dns_reset();
+    assert_resolves("10.0.0.1");
+    sim_dns_set_answer(NULL, 0);
+    s_down_done = xSemaphoreCreateBinary();
+    TEST_ASSERT_NOT_NULL(s_down_done);
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(resolve_down_task, "dns_down", 4096, NULL, 5, NULL));
+    vTaskDelay(pdMS_TO_TICKS(200));
+
+    int64_t start_us = esp_timer_get_time();
+    assert_resolves("10.0.0.1");
+    supabase_dns_stats_t st = dns_stats();
+    TEST_ASSERT_LESS_THAN(DNS_TEST_FAST_US, esp_timer_get_time() - start_us);
+    TEST_ASSERT_EQUAL(s_before.hits + 1, st.hits);
+
+    TEST_ASSERT_TRUE(xSemaphoreTake(s_down_done, pdMS_TO_TICKS(SUPABASE_DNS_TIMEOUT_MS * 2)));
+    vSemaphoreDelete(s_down_done);
+    supabase_dns_invalidate(DNS_TEST_DOWN_HOST);
+}
+
+/**
+ * Sin resultado y sin IP anterior: los requests siguientes fallan sin
+ * consultar hasta que pasa SUPABASE_DNS_NEGATIVE_S, aunque el DNS ya
+ * responda.
+ */
+static void test_negative_caching(void)
+{
+    dns_reset();
+    sim_dns_set_answer(NULL, 0);
+    char ip[16];
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, supabase_dns_resolve(DNS_TEST_HOST, ip, sizeof(ip)));
+    TEST_ASSERT_EQUAL(s_before.failures + 1, dns_stats().failures);
+
+    uint32_t queries = sim_dns_queries();
+    uint32_t fallbacks = sim_dns_fallback_queries();
+    sim_dns_set_answer("10.0.0.3", DNS_TEST_TTL_S);
+    int64_t start_us = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, supabase_dns_resolve(DNS_TEST_HOST, ip, sizeof(ip)));
+    TEST_ASSERT_LESS_THAN(DNS_TEST_FAST_US, esp_timer_get_time() - start_us);
+    sim_clock_advance_ms((SUPABASE_DNS_NEGATIVE_S - 1) * 1000);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, supabase_dns_resolve(DNS_TEST_HOST, ip, sizeof(ip)));
+
+    supabase_dns_stats_t st = dns_stats();
+    TEST_ASSERT_EQUAL(queries, sim_dns_queries());
+    TEST_ASSERT_EQUAL(fallbacks, sim_dns_fallback_queries());
+    TEST_ASSERT_EQUAL(s_before.negative_hits + 2, st.negative_hits);
+    TEST_ASSERT_EQUAL(s_before.failures + 1, st.failures);
+
+    sim_clock_advance_ms(2000);
+    assert_resolves("10.0.0.3");
+    TEST_ASSERT_EQUAL(queries + 1, sim_dns_queries());
+}
+
+/**
+ * Con el DNS caído se sigue usando la IP vencida, consultando a lo sumo
+ * una vez por SUPABASE_DNS_NEGATIVE_S, hasta SUPABASE_DNS_STALE_S.
+ */
+static void test_stale_ip_while_dns_down(void)
+{
+    dns_reset();
+    assert_resolves("10.0.0.1");
+    sim_dns_set_answer(NULL, 0);
+    sim_clock_advance_ms((DNS_TEST_TTL_S + 1) * 1000);
+
+    uint32_t queries = sim_dns_queries();
+    assert_resolves("10.0.0.1");
+    assert_resolves("10.0.0.1");
+    TEST_ASSERT_EQUAL(queries + 1, sim_dns_queries());
+    TEST_ASSERT_EQUAL(s_before.stale_hits + 2, dns_stats().stale_hits);
+
+    sim_clock_advance_ms((SUPABASE_DNS_NEGATIVE_S + 1) * 1000);
+    assert_resolves("10.0.0.1");
+    TEST_ASSERT_EQUAL(queries + 2, sim_dns_queries());
+
+    char ip[16];
+    sim_clock_advance_ms(SUPABASE_DNS_STALE_S * 1000);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, supabase_dns_resolve(DNS_TEST_HOST, ip, sizeof(ip)));
+    TEST_ASSERT_EQUAL(s_before.failures + 1, dns_stats().failures);
+}
+
+/**
+ * Mientras el sistema está armado la conexión precalentada se reabre con
+ * supabase_dns_connect() cada SUPABASE_WARM_MAX_AGE_MS o al usarse: la
+ * reapertura después del TTL toma la IP nueva, y si la IP en caché deja de
+ * responder antes de vencer se descarta y se reintenta con la nueva.
+ */
+static void test_warm_reconnect_refreshes_address(void)
+{
+    static const char *alpn[] = { "http/1.1", NULL };
+    dns_reset();
+    esp_tls_t *tls = NULL;
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_dns_connect(DNS_TEST_HOST, 443, alpn, 1000, &tls));
+    TEST_ASSERT_EQUAL_STRING("10.0.0.1", sim_net_last_addr());
+    tls_manager_release(tls);
+
+    sim_dns_set_answer("10.0.0.2", DNS_TEST_TTL_S);
+    sim_clock_advance_ms((DNS_TEST_TTL_S + 1) * 1000);
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_dns_connect(DNS_TEST_HOST, 443, alpn, 1000, &tls));
+    TEST_ASSERT_EQUAL_STRING("10.0.0.2", sim_net_last_addr());
+    tls_manager_release(tls);
+
+    sim_dns_set_answer("10.0.0.3", DNS_TEST_TTL_S);
+    sim_net_refuse_addr("10.0.0.2");
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_dns_connect(DNS_TEST_HOST, 443, alpn, 1000, &tls));
+    TEST_ASSERT_EQUAL_STRING("10.0.0.3", sim_net_last_addr());
+    TEST_ASSERT_EQUAL(s_before.invalidations + 1, dns_stats().invalidations);
+    tls_manager_release(tls);
+    TEST_ASSERT_EQUAL(0, sim_net_open_sessions());
+}
+
+void test_dns_run(void)
+{
+    sim_net_set_server_port(0);
+    sim_dns_start();
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_dns_init());
+
+    RUN_TEST(test_ttl_from_answer_chain);
+    RUN_TEST(test_entry_expires_after_ttl);
+    RUN_TEST(test_ttl_bounds);
+    RUN_TEST(test_fallback_to_getaddrinfo);
+    RUN_TEST(test_rejects_truncated_and_foreign_answers);
+    RUN_TEST(test_lookup_does_not_block_cache);
+    RUN_TEST(test_negative_caching);
+    RUN_TEST(test_stale_ip_while_dns_down);
+    RUN_TEST(test_warm_reconnect_refreshes_address);
+}
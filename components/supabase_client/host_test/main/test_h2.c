@@ -0,0 +1,350 @@
+/**
+ * @file test_h2.c
+ * @brief supabase_h2 contra un servidor HTTP/2 de prueba
+ *
+ * h2_server.py (biblioteca h2 de Python) atiende h2 en claro con
+ * conocimiento previo y emula las respuestas de Supabase:
+ *
+ * - ghost-token-create responde a los 1,5 s (el request lento);
+ * - /rest/ responde 300 registros en varios DATA, el primero con padding,
+ *   con ETag "v1" y 304 si llega If-None-Match;
+ * - refused responde RST_STREAM(REFUSED_STREAM);
+ * - goaway envía GOAWAY sin procesar el stream y cierra la conexión;
+ * - el resto responde 201 con la longitud del body recibido.
+ *
+ * La primera prueba inicia el servidor en H2_TEST_PORT; si no arranca,
+ * las demás fallan.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "supabase_h2.h"
+#include "supabase_host_test.h"
+#include "sim_net.h"
+#include "sim_clock.h"
+#include "sim_server.h"
+
+#define H2_TEST_PORT        8443
+#define H2_TEST_PORT_STR    "8443"
+#define H2_TEST_HOST        "localhost"
+#define H2_TEST_TIMEOUT_MS  5000
+#define H2_TEST_EVENTS      5
+#define H2_EVENT_MAX_US     500000      // Un evento no espera al request lento (1,5 s)
+
+static const supabase_h2_header_t s_post_headers[] = {
+    { "content-type", "application/json", true },
+    { "x-device-key", "c46c68ca4bfcc991795424f41c5cc887", true },
+};
+
+static const supabase_h2_header_t s_get_headers[] = {
+    { "apikey", "anon-key", true },
+    { "authorization", "Bearer anon-key", true },
+    { "accept", "application/json", true },
+};
+
+static bool s_server_up = false;
+static volatile int s_idle_notified = 0;    // Avisos del timer de inactividad
+static char s_resp[4096];
+
+static esp_err_t post(const char *path, const char *body, int *status)
+{
+    supabase_h2_request_t req = {
+        .method = "POST",
+        .path = path,
+        .headers = s_post_headers,
+        .header_count = 2,
+        .body = body,
+        .body_len = strlen(body),
+        .resp_body = s_resp,
+        .resp_size = sizeof(s_resp),
+    };
+    esp_err_t err = supabase_h2_request(H2_TEST_HOST, &req, H2_TEST_TIMEOUT_MS);
+    *status = req.status;
+    return err;
+}
+
+static void on_idle(void)
+{
+    s_idle_notified++;
+}
+
+#define REQUIRE_SERVER() \
+    do { \
+        if (!s_server_up) { \
+            TEST_FAIL_MESSAGE("h2_server.py no arrancó (ver test_h2_server_started)"); \
+        } \
+    } while (0)
+
+// ============================================================================
+// Request lento en otra tarea
+// ============================================================================
+
+static SemaphoreHandle_t s_slow_done;
+static esp_err_t s_slow_err;
+static int s_slow_status;
+static char s_slow_resp[128];
+static int64_t s_slow_done_us;
+
+static void slow_request_task(void *arg)
+{
+    supabase_h2_request_t req = {
+        .method = "POST",
+        .path = "/functions/v1/ghost-token-create",
+        .headers = s_post_headers,
+        .header_count = 2,
+        .body = "{\"device_id\":\"abc\"}",
+        .body_len = strlen("{\"device_id\":\"abc\"}"),
+        .resp_body = s_slow_resp,
+        .resp_size = sizeof(s_slow_resp),
+    };
+    s_slow_err = supabase_h2_request(H2_TEST_HOST, &req, H2_TEST_TIMEOUT_MS);
+    s_slow_status = req.status;
+    s_slow_done_us = esp_timer_get_time();
+    xSemaphoreGive(s_slow_done);
+    vTaskDelete(NULL);
+}
+
+// ============================================================================
+// Pruebas
+// ============================================================================
+
+/**
+ * h2_server.py (H2_SERVER_SCRIPT, definido en main/CMakeLists.txt) escucha
+ * en H2_TEST_PORT. Falla si falta la biblioteca h2 o el puerto está ocupado.
+ */
+static void test_h2_server_started(void)
+{
+    static const char *const args[] = { H2_TEST_PORT_STR, NULL };
+    TEST_ASSERT_EQUAL(ESP_OK, sim_server_start(H2_SERVER_SCRIPT, args, H2_TEST_PORT));
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_h2_init(on_idle));
+    s_server_up = true;
+}
+
+/**
+ * Los eventos van en streams propios mientras el request lento espera, por
+ * la misma conexión, y la tabla HPACK reduce los headers repetidos.
+ */
+static void test_slow_request_does_not_block_events(void)
+{
+    REQUIRE_SERVER();
+    s_slow_done = xSemaphoreCreateBinary();
+    TEST_ASSERT_NOT_NULL(s_slow_done);
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(slow_request_task, "h2_slow", 4096, NULL, 5, NULL));
+    vTaskDelay(pdMS_TO_TICKS(200));
+
+    int64_t last_event_us = 0;
+    for (int i = 0; i < H2_TEST_EVENTS; i++) {
+        char body[64];
+        snprintf(body, sizeof(body), "{\"event_type\":\"presence_start\",\"n\":%d}", i);
+        int64_t start_us = esp_timer_get_time();
+        int status = 0;
+        TEST_ASSERT_EQUAL(ESP_OK, post("/functions/v1/ghost-event-public", body, &status));
+        last_event_us = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(201, status);
+        TEST_ASSERT_LESS_THAN(H2_EVENT_MAX_US, last_event_us - start_us);
+    }
+
+    TEST_ASSERT_TRUE(xSemaphoreTake(s_slow_done, pdMS_TO_TICKS(H2_TEST_TIMEOUT_MS)));
+    vSemaphoreDelete(s_slow_done);
+    TEST_ASSERT_EQUAL(ESP_OK, s_slow_err);
+    TEST_ASSERT_EQUAL(200, s_slow_status);
+    TEST_ASSERT_NOT_NULL(strstr(s_slow_resp, "123456"));
+    TEST_ASSERT_TRUE(s_slow_done_us > last_event_us);
+
+    supabase_h2_stats_t st;
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_h2_get_stats(&st));
+    printf("headers: %lu B en HTTP/1.1, %lu B con HPACK (%d streams)\n",
+           (unsigned long)st.header_bytes_plain, (unsigned long)st.header_bytes_hpack, H2_TEST_EVENTS + 1);
+    TEST_ASSERT_EQUAL(1, st.connections);
+    TEST_ASSERT_EQUAL(2, st.streams_peak);
+    TEST_ASSERT_LESS_THAN(st.header_bytes_plain, st.header_bytes_hpack * 3);
+}
+
+/**
+ * Body en varios DATA (el primero con padding), ETag y 304 sin body.
+ */
+static void test_rest_etag_and_not_modified(void)
+{
+    REQUIRE_SERVER();
+    char etag[32];
+    supabase_h2_request_t get = {
+        .method = "GET",
+        .path = "/rest/v1/system_commands?select=id",
+        .headers = s_get_headers,
+        .header_count = 3,
+        .resp_body = s_resp,
+        .resp_size = sizeof(s_resp),
+        .etag = etag,
+        .etag_size = sizeof(etag),
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_h2_request(H2_TEST_HOST, &get, H2_TEST_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL(200, get.status);
+    TEST_ASSERT_EQUAL_STRING("\"v1\"", etag);
+    TEST_ASSERT_EQUAL_STRING_LEN("[{\"id\":0},", s_resp, 10);
+    TEST_ASSERT_NOT_NULL(strstr(s_resp, "{\"id\":299}]"));
+
+    const supabase_h2_header_t conditional[] = {
+        s_get_headers[0], s_get_headers[1], s_get_headers[2],
+        { "if-none-match", "\"v1\"", false },
+    };
+    get.headers = conditional;
+    get.header_count = 4;
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_h2_request(H2_TEST_HOST, &get, H2_TEST_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL(304, get.status);
+    TEST_ASSERT_EQUAL_STRING("", s_resp);
+    TEST_ASSERT_EQUAL_STRING("\"v1\"", etag);
+}
+
+static void test_response_truncated_to_buffer(void)
+{
+    REQUIRE_SERVER();
+    char small[16];
+    supabase_h2_request_t get = {
+        .method = "GET",
+        .path = "/rest/v1/system_commands?select=id",
+        .headers = s_get_headers,
+        .header_count = 3,
+        .resp_body = small,
+        .resp_size = sizeof(small),
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_h2_request(H2_TEST_HOST, &get, H2_TEST_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL(sizeof(small) - 1, strlen(small));
+}
+
+static void test_refused_stream_retried_once(void)
+{
+    REQUIRE_SERVER();
+    supabase_h2_stats_t st;
+    supabase_h2_get_stats(&st);
+    uint32_t retries = st.retries;
+
+    int status = 0;
+    TEST_ASSERT_EQUAL(ESP_FAIL, post("/functions/v1/refused", "{}", &status));
+    supabase_h2_get_stats(&st);
+    TEST_ASSERT_EQUAL(retries + 1, st.retries);
+}
+
+/**
+ * El stream que queda sobre el último ID del GOAWAY se reintenta en una
+ * conexión nueva (que también recibe GOAWAY); el request siguiente abre
+ * otra.
+ */
+static void test_goaway_retries_on_new_connection(void)
+{
+    REQUIRE_SERVER();
+    supabase_h2_stats_t st;
+    supabase_h2_get_stats(&st);
+    uint32_t connections = st.connections;
+    uint32_t goaways = st.goaways;
+
+    int status = 0;
+    TEST_ASSERT_EQUAL(ESP_FAIL, post("/functions/v1/goaway", "{}", &status));
+    TEST_ASSERT_EQUAL(ESP_OK, post("/functions/v1/ghost-event-public", "{\"a\":1}", &status));
+    TEST_ASSERT_EQUAL(201, status);
+
+    supabase_h2_get_stats(&st);
+    TEST_ASSERT_EQUAL(goaways + 2, st.goaways);
+    TEST_ASSERT_EQUAL(connections + 2, st.connections);
+}
+
+static void test_body_larger_than_frame(void)
+{
+    REQUIRE_SERVER();
+    static char big[6000];
+    memset(big, 'x', sizeof(big) - 1);
+    int status = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, post("/functions/v1/ghost-event-public", big, &status));
+    TEST_ASSERT_EQUAL(201, status);
+    TEST_ASSERT_NOT_NULL(strstr(s_resp, "\"len\":5999"));
+}
+
+/**
+ * El timer de inactividad solo avisa; la sesión se devuelve cuando la tarea
+ * avisada llama a supabase_h2_close_idle().
+ */
+static void test_idle_close_releases_session(void)
+{
+    REQUIRE_SERVER();
+    TEST_ASSERT_EQUAL(1, sim_net_open_sessions());
+    int notified = s_idle_notified;
+    TEST_ASSERT_TRUE(sim_timer_fire("h2_idle"));
+    TEST_ASSERT_EQUAL(notified + 1, s_idle_notified);
+    TEST_ASSERT_EQUAL(1, sim_net_open_sessions());
+    supabase_h2_close_idle();
+    TEST_ASSERT_EQUAL(0, sim_net_open_sessions());
+}
+
+/**
+ * Sin h2 en ALPN la sesión se devuelve y el llamador usa HTTP/1.1, sin
+ * volver a intentar h2 en cada request.
+ */
+static void test_alpn_without_h2_not_supported(void)
+{
+    REQUIRE_SERVER();
+    int status = 0;
+    sim_net_set_alpn("http/1.1");
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, post("/functions/v1/ghost-event-public", "{}", &status));
+    TEST_ASSERT_EQUAL(0, sim_net_open_sessions());
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, post("/functions/v1/ghost-event-public", "{}", &status));
+
+    sim_net_set_alpn("h2");
+    supabase_h2_close();
+    TEST_ASSERT_EQUAL(ESP_OK, post("/functions/v1/ghost-event-public", "{}", &status));
+    TEST_ASSERT_EQUAL(201, status);
+    supabase_h2_close();
+    TEST_ASSERT_EQUAL(0, sim_net_open_sessions());
+}
+
+/**
+ * Armado: la conexión precalentada no se cierra por inactividad y el
+ * próximo request la reutiliza; al desarmar se devuelve la sesión.
+ */
+static void test_warm_connection_kept_while_armed(void)
+{
+    REQUIRE_SERVER();
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_h2_set_warm(H2_TEST_HOST, true, H2_TEST_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL(1, sim_net_open_sessions());
+    TEST_ASSERT_TRUE(sim_timer_fire("h2_idle"));
+    supabase_h2_close_idle();
+    TEST_ASSERT_EQUAL(1, sim_net_open_sessions());
+
+    supabase_h2_request_t req = {
+        .method = "POST",
+        .path = "/functions/v1/ghost-event-public",
+        .headers = s_post_headers,
+        .header_count = 2,
+        .body = "{}",
+        .body_len = 2,
+        .resp_body = s_resp,
+        .resp_size = sizeof(s_resp),
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_h2_request(H2_TEST_HOST, &req, H2_TEST_TIMEOUT_MS));
+    TEST_ASSERT_TRUE(req.reused);
+    TEST_ASSERT_TRUE(sim_timer_fire("h2_idle"));
+    supabase_h2_close_idle();
+    TEST_ASSERT_EQUAL(1, sim_net_open_sessions());
+
+    TEST_ASSERT_EQUAL(ESP_OK, supabase_h2_set_warm(H2_TEST_HOST, false, H2_TEST_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL(0, sim_net_open_sessions());
+}
+
+void test_h2_run(void)
+{
+    sim_net_set_server_port(H2_TEST_PORT);
+
+    RUN_TEST(test_h2_server_started);
+    RUN_TEST(test_slow_request_does_not_block_events);
+    RUN_TEST(test_rest_etag_and_not_modified);
+    RUN_TEST(test_response_truncated_to_buffer);
+    RUN_TEST(test_refused_stream_retried_once);
+    RUN_TEST(test_goaway_retries_on_new_connection);
+    RUN_TEST(test_body_larger_than_frame);
+    RUN_TEST(test_idle_close_releases_session);
+    RUN_TEST(test_alpn_without_h2_not_supported);
+    RUN_TEST(test_warm_connection_kept_while_armed);
+}
@@ -0,0 +1,112 @@
+/**
+ * @file supabase_dns.h
+ * @brief Caché DNS con TTL para las conexiones a Supabase
+ *
+ * getaddrinfo() no informa el TTL de la respuesta, así que la dirección del
+ * host se obtiene con una consulta A propia al servidor DNS de la red y se
+ * guarda el tiempo que indica el registro (acotado entre
+ * SUPABASE_DNS_MIN_TTL_S y SUPABASE_DNS_MAX_TTL_S). Mientras la entrada está
+ * vigente las conexiones se abren contra la IP sin consultar la red; el
+ * certificado y el SNI se siguen validando contra el nombre del host.
+ *
+ * Si la consulta falla se usa getaddrinfo() con SUPABASE_DNS_DEFAULT_TTL_S, y
+ * si tampoco responde se sigue usando la última IP conocida durante
+ * SUPABASE_DNS_STALE_S: una alarma no debería depender de que el DNS
+ * conteste justo en ese momento. Tras un fallo el host no se vuelve a
+ * consultar durante SUPABASE_DNS_NEGATIVE_S.
+ */
+
+#ifndef SUPABASE_DNS_H
+#define SUPABASE_DNS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_tls.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// === CONFIGURACIÓN ===
+#define SUPABASE_DNS_CACHE_SIZE     2       // Hosts en caché
+#define SUPABASE_DNS_TIMEOUT_MS     2000    // Espera de la respuesta a la consulta propia
+#define SUPABASE_DNS_MIN_TTL_S      30      // TTL mínimo (evita consultar en cada request)
+#define SUPABASE_DNS_MAX_TTL_S      3600    // TTL máximo
+#define SUPABASE_DNS_DEFAULT_TTL_S  60      // TTL cuando se resolvió con getaddrinfo()
+#define SUPABASE_DNS_STALE_S        600     // Uso de una entrada vencida si no se puede resolver
+#define SUPABASE_DNS_NEGATIVE_S     10      // Sin nuevas consultas tras un fallo
+
+// === ESTRUCTURAS ===
+
+/**
+ * @brief Estadísticas de la caché
+ */
+typedef struct {
+    uint32_t hits;              /**< Resoluciones servidas desde la caché */
+    uint32_t misses;            /**< Resoluciones que consultaron la red */
+    uint32_t stale_hits;        /**< Entradas vencidas usadas porque el DNS no respondió */
+    uint32_t failures;          /**< Resoluciones sin resultado */
+    uint32_t negative_hits;     /**< Fallos respondidos sin consultar (fallo reciente) */
+    uint32_t invalidations;     /**< Entradas descartadas porque la IP no respondió */
+    uint32_t lookup_avg_ms;     /**< Duración promedio de una consulta a la red */
+    uint32_t lookup_max_ms;     /**< Duración máxima de una consulta a la red */
+    uint32_t ttl_last_s;        /**< TTL de la última respuesta (ya acotado) */
+} supabase_dns_stats_t;
+
+// === FUNCIONES PÚBLICAS ===
+
+/**
+ * @brief Inicializa la caché (idempotente)
+ * @return ESP_OK, ESP_ERR_NO_MEM si no se pudo crear el mutex
+ */
+esp_err_t supabase_dns_init(void);
+
+/**
+ * @brief Resuelve un host a IPv4, usando la caché si la entrada está vigente
+ *
+ * @param host Nombre del host
+ * @param[out] ip IP en formato texto
+ * @param ip_size Tamaño de ip (al menos 16)
+ * @return ESP_OK, ESP_ERR_NOT_FOUND si no se pudo resolver
+ */
+esp_err_t supabase_dns_resolve(const char *host, char *ip, size_t ip_size);
+
+/**
+ * @brief Descarta la entrada de un host (por ejemplo, si su IP no respondió)
+ *
+ * @param host Nombre del host
+ */
+void supabase_dns_invalidate(const char *host);
+
+/**
+ * @brief Abre una sesión TLS con tls_manager contra la IP en caché del host
+ *
+ * Si la conexión a la IP falla, la entrada se descarta y se reintenta una
+ * vez resolviendo de nuevo. Sin IP en caché ni resolución posible se deja
+ * resolver a esp_tls.
+ *
+ * @param host Host (también usado para SNI y la verificación del certificado)
+ * @param port Puerto
+ * @param alpn_protos Lista ALPN terminada en NULL
+ * @param timeout_ms Espera máxima por lugar y timeout de conexión
+ * @param[out] tls Sesión abierta; devolver con tls_manager_release()
+ * @return Los mismos códigos que tls_manager_acquire()
+ */
+esp_err_t supabase_dns_connect(const char *host, uint16_t port, const char **alpn_protos,
+                               uint32_t timeout_ms, esp_tls_t **tls);
+
+/**
+ * @brief Obtiene las estadísticas
+ *
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK, ESP_ERR_INVALID_ARG si stats es NULL
+ */
+esp_err_t supabase_dns_get_stats(supabase_dns_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SUPABASE_DNS_H
@@ -0,0 +1,158 @@
+/**
+ * @file supabase_h2.h
+ * @brief Transporte HTTP/2 para las llamadas a Supabase
+ *
+ * Mantiene una única conexión TLS con ALPN "h2" hacia el host de Supabase y
+ * multiplexa sobre ella los requests de supabase_client: cada llamada es un
+ * stream, de modo que un request lento (link_code) no retiene a los POST de
+ * eventos como pasa con HTTP/1.1.
+ *
+ * Los headers se comprimen con HPACK. Los que se repiten en cada request
+ * (:authority, X-Device-Key, Content-Type, apikey...) se agregan a la tabla
+ * dinámica la primera vez y después viajan como un índice de un byte.
+ *
+ * No hay tarea propia: quien espera una respuesta lee la conexión y reparte
+ * los frames a todos los streams abiertos. La conexión se cierra tras
+ * SUPABASE_H2_IDLE_MS sin streams para devolver la sesión a tls_manager,
+ * salvo que se pida mantenerla abierta (supabase_h2_set_warm). El timer solo
+ * avisa: el cierre (GOAWAY y TLS) lo hace la tarea que llama a
+ * supabase_h2_close_idle().
+ */
+
+#ifndef SUPABASE_H2_H
+#define SUPABASE_H2_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// === CONFIGURACIÓN ===
+#define SUPABASE_H2_MAX_STREAMS     4       // Streams propios simultáneos
+#define SUPABASE_H2_IDLE_MS         20000   // Sin streams, se cierra la conexión
+
+// === ESTRUCTURAS ===
+
+/**
+ * @brief Header de un request (el nombre va en minúsculas, como exige HTTP/2)
+ */
+typedef struct {
+    const char *name;
+    const char *value;
+    bool index;             /**< Agregar a la tabla HPACK: solo valores que se repiten */
+} supabase_h2_header_t;
+
+/**
+ * @brief Request y respuesta de un stream
+ */
+typedef struct {
+    const char *method;                     /**< "GET" o "POST" */
+    const char *path;                       /**< Path con query */
+    const supabase_h2_header_t *headers;    /**< Headers adicionales */
+    size_t header_count;
+    const char *body;                       /**< Body (NULL = sin body) */
+    size_t body_len;
+    int status;                             /**< [out] Status HTTP */
+    char *resp_body;                        /**< [out] Body recibido (terminado en NUL, se trunca) */
+    size_t resp_size;
+    char *etag;                             /**< [out] ETag (puede ser NULL) */
+    size_t etag_size;
+    bool reused;                            /**< [out] El stream usó una conexión ya abierta */
+} supabase_h2_request_t;
+
+/**
+ * @brief Estadísticas del transporte
+ */
+typedef struct {
+    uint32_t connections;       /**< Conexiones h2 abiertas */
+    uint32_t not_negotiated;    /**< Conexiones donde el servidor no eligió h2 */
+    uint32_t requests;          /**< Streams con respuesta */
+    uint32_t failures;          /**< Streams sin respuesta */
+    uint32_t retries;           /**< Streams reintentados (rechazados o no procesados) */
+    uint32_t goaways;           /**< GOAWAY recibidos */
+    uint8_t  streams_peak;      /**< Máximo de streams simultáneos */
+    uint32_t header_bytes_plain;/**< Lo que ocuparían los headers en HTTP/1.1 */
+    uint32_t header_bytes_hpack;/**< Bytes de headers enviados tras HPACK */
+} supabase_h2_stats_t;
+
+/**
+ * @brief Aviso de que venció el plazo de inactividad
+ *
+ * Corre en la tarea de esp_timer: solo debe despertar a la tarea que llama
+ * a supabase_h2_close_idle().
+ */
+typedef void (*supabase_h2_idle_notify_t)(void);
+
+// === FUNCIONES PÚBLICAS ===
+
+/**
+ * @brief Inicializa el transporte (idempotente)
+ * @param idle_notify Aviso del cierre por inactividad (NULL = nadie cierra la conexión inactiva)
+ * @return ESP_OK, ESP_ERR_NO_MEM si no se pudieron crear los recursos
+ */
+esp_err_t supabase_h2_init(supabase_h2_idle_notify_t idle_notify);
+
+/**
+ * @brief Ejecuta un request como stream de la conexión compartida
+ *
+ * Abre la conexión si hace falta. Puede llamarse desde varias tareas a la
+ * vez; los requests avanzan en paralelo sobre la misma sesión TLS.
+ *
+ * @param host Host de Supabase
+ * @param req Request; los campos [out] se completan al volver
+ * @param timeout_ms Tiempo máximo total (conexión + respuesta)
+ * @return ESP_OK si se recibió una respuesta (ver req->status)
+ * @return ESP_ERR_NOT_SUPPORTED si el servidor no negoció h2 (usar HTTP/1.1)
+ * @return ESP_ERR_TIMEOUT si no hubo respuesta a tiempo
+ * @return ESP_FAIL si la conexión o el stream fallaron
+ */
+esp_err_t supabase_h2_request(const char *host, supabase_h2_request_t *req, uint32_t timeout_ms);
+
+/**
+ * @brief Mantiene la conexión abierta y lista, o deja de hacerlo
+ *
+ * Con warm = true abre la conexión si no lo está (o si el servidor la
+ * cerró) y desactiva el cierre por inactividad; conviene llamarla de nuevo
+ * cada tanto para atender PING y detectar un GOAWAY. Con warm = false
+ * vuelve el cierre por inactividad y, si no hay streams, cierra ya.
+ *
+ * @param host Host de Supabase
+ * @param warm Mantener la conexión abierta
+ * @param timeout_ms Tiempo máximo para abrirla
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED si el servidor no negocia h2
+ * @return ESP_ERR_TIMEOUT si la conexión estaba ocupada o no se abrió a tiempo
+ */
+esp_err_t supabase_h2_set_warm(const char *host, bool warm, uint32_t timeout_ms);
+
+/**
+ * @brief Cierra la conexión si venció el plazo de inactividad
+ *
+ * Llamarla desde una tarea tras el aviso de idle_notify. No hace nada si
+ * no venció, si hay streams o si se pidió mantenerla abierta.
+ */
+void supabase_h2_close_idle(void);
+
+/**
+ * @brief Cierra la conexión (los streams abiertos fallan)
+ *
+ * También vuelve a permitir negociar h2 si antes el servidor no lo eligió.
+ */
+void supabase_h2_close(void);
+
+/**
+ * @brief Obtiene las estadísticas
+ *
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK, ESP_ERR_INVALID_ARG si stats es NULL
+ */
+esp_err_t supabase_h2_get_stats(supabase_h2_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SUPABASE_H2_H
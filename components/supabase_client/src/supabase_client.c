@@ -6,7 +6,20 @@
  * a la Edge Function ghost-event-public.
  *
  * Usa esp_tls directamente para control total sobre ALPN, SNI y
- * Certificate Bundle, requeridos por Cloudflare/Supabase.
+ * Certificate Bundle, requeridos por Cloudflare/Supabase. Las sesiones se
+ * piden a tls_manager, que comparte la configuración de confianza con el
+ * WebSocket de Realtime y limita las sesiones TLS simultáneas.
+ *
+ * Con HTTP/2 habilitado (supabase_set_http2) los requests van por
+ * supabase_h2 y solo vuelven a HTTP/1.1 si el servidor no negocia h2.
+ *
+ * Las conexiones se abren contra la IP en caché de supabase_dns. Mientras
+ * el sistema está armado, la tarea de envío deja una conexión ya negociada
+ * para el próximo request (ver supabase_set_warm_connection).
+ *
+ * Con SUPABASE_PINNED_TRUST el certificado se verifica contra las pocas
+ * raíces de certs/supabase_roots.pem en lugar del bundle completo; si la
+ * cadena termina en otra CA, tls_manager vuelve al bundle.
  */
 
 #include "supabase_client.h"
@@ -14,10 +27,16 @@
 #include "sntp_sync.h"
 #include "esp_log.h"
 #include "esp_tls.h"
-#include "esp_crt_bundle.h"
+#include "tls_manager.h"
+#include "supabase_h2.h"
+#include "supabase_dns.h"
 #include "esp_netif.h"
+#include "lwip/sockets.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
 #include "cJSON.h"
 #include <string.h>
 #include <time.h>
@@ -26,10 +45,54 @@ static const char *TAG = "SUPABASE_CLIENT";
 
 // === CONFIGURACIÓN ===
 #define SUPABASE_CONNECT_TIMEOUT_MS 10000  // 10s timeout de conexión
+#define SUPABASE_ASYNC_QUEUE_LEN    8      // Eventos en espera de envío en background
+#define SUPABASE_ASYNC_RETRIES      3      // Intentos por evento
+#define SUPABASE_ASYNC_RETRY_MS     2000   // Espera entre intentos (se multiplica por intento)
+#define SUPABASE_ASYNC_TASK_STACK   8192   // TLS + buffers de respuesta en stack
+#define SUPABASE_ASYNC_TASK_PRIORITY 3
+#define SUPABASE_REALTIME_ACK_MS    5000   // Espera del ack de un evento enviado por Realtime
+#define SUPABASE_MQTT_ACK_MS        5000   // Espera del PUBACK de un lote enviado por MQTT
+#define SUPABASE_ACTIVE_POWER_MW    330    // Radio + CPU activos (~100 mA a 3.3 V), para estimar energía
+#define SUPABASE_WARM_CHECK_MS      30000  // Revisión de la conexión precalentada
+#define SUPABASE_WARM_MAX_AGE_MS    240000 // Se renueva antes de que la olvide un NAT o el servidor
+#define SUPABASE_WARM_WAIT_MS       10     // Sondeo mientras se negocia la conexión precalentada
 
 // Mutex para proteger las conexiones TLS
 static SemaphoreHandle_t s_tls_mutex = NULL;
 
+// Cola de supabase_send_event_async(); json == NULL solo despierta a la tarea
+typedef struct {
+    char *json;
+    int64_t queued_us;
+    bool first;                 // Primer evento tras supabase_set_warm_connection()
+    bool command_status;        // Estado de un comando (supabase_update_command_status_async)
+} async_item_t;
+static QueueHandle_t s_async_queue = NULL;
+
+// Transporte de eventos y contadores por transporte
+static supabase_event_transport_t s_event_transport = SUPABASE_EVENT_TRANSPORT;
+static supabase_event_sender_t s_event_senders[SUPABASE_EVENT_TRANSPORT_COUNT] = {0};
+static void *s_event_sender_ctx[SUPABASE_EVENT_TRANSPORT_COUNT] = {0};
+static supabase_event_stats_t s_event_stats = {0};
+static uint64_t s_latency_total_ms[SUPABASE_EVENT_TRANSPORT_COUNT] = {0};
+static uint64_t s_busy_total_ms[SUPABASE_EVENT_TRANSPORT_COUNT] = {0};     // Tiempo enviando (por mensaje)
+static const char *s_transport_names[SUPABASE_EVENT_TRANSPORT_COUNT] = { "HTTPS", "Realtime", "MQTT" };
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Transporte HTTP/2 (HTTP/1.1 si está deshabilitado o no se negocia)
+static bool s_http2 = SUPABASE_USE_HTTP2;
+
+// Conexión precalentada: la abre la tarea de envío, la toma el próximo request
+static volatile bool s_warm_wanted = false;
+static volatile bool s_warm_opening = false;
+static bool s_warm_applied = false;         // Último valor aplicado por la tarea
+static bool s_mark_first = false;
+static esp_tls_t *s_warm_tls = NULL;        // Protegido por s_stats_lock
+static int64_t s_warm_opened_us = 0;
+static supabase_warm_stats_t s_warm_stats = {0};
+static uint64_t s_warm_total_ms = 0;
+static uint64_t s_cold_total_ms = 0;
+
 // === FUNCIÓN PRIVADA: Generar timestamp ISO 8601 ===
 /**
  * @brief Generar timestamp en formato ISO 8601 usando SNTP
@@ -158,6 +221,7 @@ char *create_event_json(const device_event_t *event)
 #define SUPABASE_PORT 443
 #define SUPABASE_PATH "/functions/v1/ghost-event-public"
 #define SUPABASE_TOKEN_PATH "/functions/v1/ghost-token-create"
+#define SUPABASE_COMMAND_STATUS_PATH "/functions/v1/ghost-command-status"
 #define SUPABASE_RESPONSE_BUF_SIZE 1024
 
 // === FUNCIONES PRIVADAS ===
@@ -269,7 +333,8 @@ static esp_err_t send_http_request(esp_tls_t *tls, const char *host, const char
 /**
  * @brief Lee la respuesta HTTP del servidor con Content-Length
  */
-static esp_err_t read_http_response(esp_tls_t *tls, int *http_status, char *body, size_t body_size)
+static esp_err_t read_http_response(esp_tls_t *tls, int *http_status, char *body, size_t body_size,
+                                    char *etag, size_t etag_size)
 {
     char buffer[SUPABASE_RESPONSE_BUF_SIZE];
     int total_read = 0;
@@ -378,6 +443,26 @@ static esp_err_t read_http_response(esp_tls_t *tls, int *http_status, char *body
         return ESP_FAIL;
     }
 
+    // ETag (si el servidor lo envía) para requests condicionales
+    if (etag && etag_size > 0) {
+        etag[0] = '\0';
+        char *etag_hdr = strstr(buffer, "\r\nETag:");
+        if (!etag_hdr) {
+            etag_hdr = strstr(buffer, "\r\netag:");
+        }
+        if (etag_hdr) {
+            etag_hdr += 7;
+            while (*etag_hdr == ' ') {
+                etag_hdr++;
+            }
+            size_t etag_len = strcspn(etag_hdr, "\r\n");
+            if (etag_len < etag_size) {
+                memcpy(etag, etag_hdr, etag_len);
+                etag[etag_len] = '\0';
+            }
+        }
+    }
+
     // Buscar el body (después de \r\n\r\n)
     char *headers_end = strstr(buffer, "\r\n\r\n");
     if (headers_end && body) {
@@ -414,41 +499,461 @@ static supabase_context_t s_ctx = {
 
 // === FUNCIÓN PRIVADA: Crear conexión TLS ===
 /**
- * @brief Crear nueva conexión TLS para cada request
- * @return Puntero a la conexión TLS o NULL si error
+ * @brief Pide a tls_manager una nueva conexión TLS para cada request
+ * @return Puntero a la conexión TLS (cerrar con tls_manager_release) o NULL si error
  *
  * NOTA: No usamos keep-alive porque Supabase envía datos residuales
  * con ~10s de delay que causan problemas al reusar la conexión.
  */
 static esp_tls_t *create_connection(void)
 {
-    const char *alpn_protos[] = { "http/1.1", NULL };
-
-    esp_tls_cfg_t tls_cfg = {
-        .crt_bundle_attach = esp_crt_bundle_attach,
-        .common_name = SUPABASE_HOST,
-        .alpn_protos = alpn_protos,
-        .timeout_ms = SUPABASE_CONNECT_TIMEOUT_MS,
-    };
+    static const char *alpn_protos[] = { "http/1.1", NULL };
 
-    esp_tls_t *tls = esp_tls_init();
-    if (tls == NULL) {
-        ESP_LOGE(TAG, "Error al inicializar TLS");
+    esp_tls_t *tls = NULL;
+    esp_err_t err = supabase_dns_connect(s_ctx.host, SUPABASE_PORT, alpn_protos,
+                                         SUPABASE_CONNECT_TIMEOUT_MS, &tls);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error en conexión TLS: %s", esp_err_to_name(err));
         return NULL;
     }
 
-    int ret = esp_tls_conn_new_sync(s_ctx.host, strlen(s_ctx.host),
-                                     SUPABASE_PORT, &tls_cfg, tls);
-    if (ret != 1) {
-        ESP_LOGE(TAG, "Error en conexión TLS: %d", ret);
-        esp_tls_conn_destroy(tls);
+    return tls;
+}
+
+// === FUNCIÓN PRIVADA: Verificar una conexión precalentada ===
+/**
+ * @brief Indica si la conexión sigue sirviendo para un request
+ *
+ * Sin haber pedido nada, cualquier dato legible es un close_notify o el
+ * cierre TCP del servidor.
+ */
+static bool warm_usable(esp_tls_t *tls, int64_t opened_us)
+{
+    if (esp_timer_get_time() - opened_us > (int64_t)SUPABASE_WARM_MAX_AGE_MS * 1000) {
+        return false;
+    }
+    if (esp_tls_get_bytes_avail(tls) > 0) {
+        return false;
+    }
+    int fd = -1;
+    if (esp_tls_get_conn_sockfd(tls, &fd) != ESP_OK || fd < 0) {
+        return false;
+    }
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+    struct timeval tv = { 0 };
+    return select(fd + 1, &rfds, NULL, NULL, &tv) == 0;
+}
+
+// === FUNCIÓN PRIVADA: Despertar a la tarea de envío ===
+static void wake_async_task(void)
+{
+    async_item_t item = { 0 };
+    if (s_async_queue != NULL) {
+        xQueueSend(s_async_queue, &item, 0);
+    }
+}
+
+// === FUNCIÓN PRIVADA: Conexión para un request HTTP/1.1 ===
+/**
+ * @brief Usa la conexión precalentada si hay una lista; si no, abre otra
+ *
+ * Si la tarea de envío está negociando la precalentada se la espera: es
+ * el mismo handshake, ya empezado.
+ *
+ * @param[out] warm true si se usó la conexión precalentada
+ * @note Llamar con s_tls_mutex tomado
+ */
+static esp_tls_t *take_connection(bool *warm)
+{
+    for (int waited = 0; s_warm_opening && waited < SUPABASE_CONNECT_TIMEOUT_MS;
+         waited += SUPABASE_WARM_WAIT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(SUPABASE_WARM_WAIT_MS));
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    esp_tls_t *tls = s_warm_tls;
+    int64_t opened_us = s_warm_opened_us;
+    s_warm_tls = NULL;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    *warm = false;
+    if (tls != NULL) {
+        bool usable = warm_usable(tls, opened_us);
+        portENTER_CRITICAL(&s_stats_lock);
+        if (usable) {
+            s_warm_stats.used++;
+        } else {
+            s_warm_stats.discarded++;
+        }
+        portEXIT_CRITICAL(&s_stats_lock);
+        if (usable) {
+            *warm = true;
+            wake_async_task();      // Preparar la siguiente
+            return tls;
+        }
+        tls_manager_release(tls);
+    }
+    return create_connection();
+}
+
+// === FUNCIÓN PRIVADA: Mantener la conexión precalentada ===
+/**
+ * @brief Abre, renueva o cierra la conexión precalentada según s_warm_wanted
+ *
+ * Corre en la tarea de envío. El handshake se hace sin s_tls_mutex: un
+ * request que llegue mientras tanto espera este handshake en lugar de
+ * abrir otro.
+ */
+static void warm_maintain(void)
+{
+    bool wanted = SUPABASE_WARM_CONNECTION && s_warm_wanted;
+    bool changed = wanted != s_warm_applied;
+    if (!changed && !wanted) {
+        return;
+    }
+    // Con eventos en cola, primero enviarlos (abren su propia conexión)
+    if (wanted && uxQueueMessagesWaiting(s_async_queue) > 0) {
+        return;
+    }
+    s_warm_applied = wanted;
+
+    // Con HTTP/2 la conexión lista es la propia conexión h2
+    bool h1_wanted = wanted;
+    if (s_http2 || changed) {
+        esp_err_t err = supabase_h2_set_warm(s_ctx.host, wanted && s_http2, SUPABASE_CONNECT_TIMEOUT_MS);
+        h1_wanted = wanted && (!s_http2 || err == ESP_ERR_NOT_SUPPORTED);
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    esp_tls_t *stale = s_warm_tls;
+    int64_t opened_us = s_warm_opened_us;
+    s_warm_tls = NULL;
+    portEXIT_CRITICAL(&s_stats_lock);
+    if (stale != NULL && h1_wanted && warm_usable(stale, opened_us)) {
+        portENTER_CRITICAL(&s_stats_lock);
+        s_warm_tls = stale;
+        portEXIT_CRITICAL(&s_stats_lock);
+        return;
+    }
+    if (stale != NULL) {
+        tls_manager_release(stale);
+        portENTER_CRITICAL(&s_stats_lock);
+        s_warm_stats.discarded++;
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+    if (!h1_wanted) {
+        return;
+    }
+
+    s_warm_opening = true;
+    esp_tls_t *tls = create_connection();
+    if (tls != NULL) {
+        portENTER_CRITICAL(&s_stats_lock);
+        s_warm_tls = tls;
+        s_warm_opened_us = esp_timer_get_time();
+        s_warm_stats.opened++;
+        portEXIT_CRITICAL(&s_stats_lock);
+        ESP_LOGI(TAG, "Conexión precalentada lista");
+    }
+    s_warm_opening = false;
+}
+
+// === FUNCIÓN PRIVADA: Contabilizar el tiempo de subida de un evento ===
+static void note_upload(bool warm, int64_t queued_us, bool first)
+{
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - queued_us) / 1000);
+
+    portENTER_CRITICAL(&s_stats_lock);
+    if (warm) {
+        s_warm_stats.warm_uploads++;
+        s_warm_total_ms += elapsed_ms;
+        s_warm_stats.warm_upload_avg_ms = (uint32_t)(s_warm_total_ms / s_warm_stats.warm_uploads);
+        if (first) {
+            s_warm_stats.first_warm_ms = elapsed_ms;
+        }
+    } else {
+        s_warm_stats.cold_uploads++;
+        s_cold_total_ms += elapsed_ms;
+        s_warm_stats.cold_upload_avg_ms = (uint32_t)(s_cold_total_ms / s_warm_stats.cold_uploads);
+        if (first) {
+            s_warm_stats.first_cold_ms = elapsed_ms;
+        }
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    if (first) {
+        ESP_LOGI(TAG, "Primer evento tras cambio de estado subido en %lu ms (%s)",
+                 (unsigned long)elapsed_ms, warm ? "conexión lista" : "conexión nueva");
+    }
+}
+
+// === FUNCIÓN PRIVADA: Marca de primer evento ===
+static bool take_first_mark(void)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    bool first = s_mark_first;
+    s_mark_first = false;
+    portEXIT_CRITICAL(&s_stats_lock);
+    return first;
+}
+
+static esp_err_t post_event_json(const char *json_str, bool *warm);
+static esp_err_t post_command_status(const char *json_str);
+
+// === FUNCIÓN PRIVADA: Contabilizar un intento de entrega ===
+/**
+ * @param events Eventos incluidos en el mensaje (todos con la misma latencia)
+ */
+static void note_delivery(supabase_event_transport_t transport, esp_err_t err, int64_t start_us,
+                          uint32_t events)
+{
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    supabase_transport_stats_t *t = &s_event_stats.transports[transport];
+
+    portENTER_CRITICAL(&s_stats_lock);
+    if (err == ESP_OK) {
+        t->sent += events;
+        t->messages++;
+        s_latency_total_ms[transport] += (uint64_t)elapsed_ms * events;
+        s_busy_total_ms[transport] += elapsed_ms;
+        t->latency_avg_ms = (uint32_t)(s_latency_total_ms[transport] / t->sent);
+        if (elapsed_ms > t->latency_max_ms) {
+            t->latency_max_ms = elapsed_ms;
+        }
+        // ms * mW = µJ; un lote reparte el tiempo activo entre sus eventos
+        t->energy_avg_uj = (uint32_t)(s_busy_total_ms[transport] * SUPABASE_ACTIVE_POWER_MW / t->sent);
+        t->events_per_s = s_busy_total_ms[transport] ?
+                          (uint32_t)((uint64_t)t->sent * 1000 / s_busy_total_ms[transport]) : t->sent * 1000;
+    } else {
+        t->failed++;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+// === FUNCIÓN PRIVADA: Entregar por Realtime o MQTT ===
+/**
+ * @brief Envía un evento (o un lote, con MQTT) por el transporte alternativo
+ *
+ * @param payload JSON del evento o arreglo de eventos
+ * @param events Eventos incluidos en payload
+ * @return ESP_OK si se confirmó
+ * @return ESP_ERR_NOT_SUPPORTED si el modo es HTTPS o no hay sender registrado
+ * @return otro error si hay que enviar por HTTPS (se cuenta como fallback)
+ */
+static esp_err_t deliver_alternate(const char *payload, uint32_t events)
+{
+    supabase_event_transport_t transport = s_event_transport;
+    supabase_event_sender_t sender = s_event_senders[transport];
+    if (transport == SUPABASE_EVENT_TRANSPORT_HTTPS || sender == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint32_t timeout_ms = transport == SUPABASE_EVENT_TRANSPORT_MQTT ? SUPABASE_MQTT_ACK_MS
+                                                                      : SUPABASE_REALTIME_ACK_MS;
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = sender(payload, timeout_ms, s_event_sender_ctx[transport]);
+    if (err == ESP_OK) {
+        note_delivery(transport, err, start_us, events);
+        ESP_LOGI(TAG, "✅ %lu evento(s) enviados por %s", (unsigned long)events, s_transport_names[transport]);
+        return ESP_OK;
+    }
+    // Conexión caída: no es una falla del transporte, solo no estaba disponible
+    if (err != ESP_ERR_INVALID_STATE) {
+        note_delivery(transport, err, start_us, events);
+    }
+    portENTER_CRITICAL(&s_stats_lock);
+    s_event_stats.fallbacks += events;
+    portEXIT_CRITICAL(&s_stats_lock);
+    ESP_LOGW(TAG, "%lu evento(s) no confirmados por %s (%s), usando HTTPS",
+             (unsigned long)events, s_transport_names[transport], esp_err_to_name(err));
+    return err;
+}
+
+// === FUNCIÓN PRIVADA: Entregar un evento por el transporte configurado ===
+/**
+ * @brief Envía el JSON de un evento por Realtime, MQTT o HTTPS
+ *
+ * Por Realtime el evento viaja por la sesión TLS ya abierta del WebSocket y
+ * por MQTT por la conexión al broker; si no hay confirmación se envía por
+ * HTTPS. Un ack perdido puede producir un duplicado, que es preferible a
+ * perder el evento.
+ *
+ * @param alternate Probar antes Realtime o MQTT (false si el lote ya falló)
+ */
+static esp_err_t deliver_event_json(const char *json_str, int64_t queued_us, bool first, bool alternate)
+{
+    if (alternate && deliver_alternate(json_str, 1) == ESP_OK) {
+        return ESP_OK;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    bool warm = false;
+    esp_err_t err = post_event_json(json_str, &warm);
+    note_delivery(SUPABASE_EVENT_TRANSPORT_HTTPS, err, start_us, 1);
+    if (err == ESP_OK) {
+        note_upload(warm, queued_us, first);
+    }
+    return err;
+}
+
+// === FUNCIÓN PRIVADA: Lote de eventos para MQTT ===
+/**
+ * @brief Junta los eventos ya encolados detrás de batch[0]
+ *
+ * Solo con el transporte MQTT: un mensaje QoS1 con varios eventos cuesta
+ * un PUBACK en lugar de uno por evento. No espera a que lleguen más.
+ *
+ * @param[out] status Estado de comando que cortó el lote (json NULL si no hubo)
+ * @return Eventos en batch
+ */
+static size_t collect_batch(async_item_t *batch, async_item_t *status)
+{
+    size_t count = 1;
+    status->json = NULL;
+    if (s_event_transport != SUPABASE_EVENT_TRANSPORT_MQTT ||
+        s_event_senders[SUPABASE_EVENT_TRANSPORT_MQTT] == NULL) {
+        return count;
+    }
+    while (count < SUPABASE_EVENT_BATCH_MAX && xQueueReceive(s_async_queue, &batch[count], 0) == pdTRUE) {
+        if (batch[count].command_status) {  // Va a otro endpoint: se envía después del lote
+            *status = batch[count];
+            break;
+        }
+        if (batch[count].json != NULL) {    // Los avisos de cambio no forman parte del lote
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Arma el arreglo JSON "[e1,e2,...]" de un lote
+ * @return String a liberar con free(), NULL si no hay memoria
+ */
+static char *join_batch(const async_item_t *batch, size_t count)
+{
+    size_t len = 2 + count;     // Corchetes, comas y NUL
+    for (size_t i = 0; i < count; i++) {
+        len += strlen(batch[i].json);
+    }
+    char *payload = malloc(len);
+    if (payload == NULL) {
         return NULL;
     }
 
-    ESP_LOGI(TAG, "✅ Conexión TLS establecida");
-    return tls;
+    char *p = payload;
+    *p++ = '[';
+    for (size_t i = 0; i < count; i++) {
+        size_t n = strlen(batch[i].json);
+        memcpy(p, batch[i].json, n);
+        p += n;
+        *p++ = (i + 1 < count) ? ',' : ']';
+    }
+    *p = '\0';
+    return payload;
+}
+
+// === FUNCIÓN PRIVADA: Enviar un estado de comando encolado ===
+/**
+ * @brief Envía un estado de comando con reintentos y libera su JSON
+ */
+static void deliver_command_status(async_item_t *item)
+{
+    esp_err_t err = ESP_FAIL;
+    for (int attempt = 1; attempt <= SUPABASE_ASYNC_RETRIES; attempt++) {
+        err = post_command_status(item->json);
+        if (err == ESP_OK || err == ESP_ERR_NOT_FOUND) {
+            break;
+        }
+        ESP_LOGW(TAG, "Estado de comando no enviado (intento %d/%d): %s",
+                 attempt, SUPABASE_ASYNC_RETRIES, esp_err_to_name(err));
+        if (attempt < SUPABASE_ASYNC_RETRIES) {
+            vTaskDelay(pdMS_TO_TICKS(SUPABASE_ASYNC_RETRY_MS * attempt));
+        }
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Estado de comando descartado: %s", esp_err_to_name(err));
+    }
+    free(item->json);
+    item->json = NULL;
+}
+
+// === FUNCIÓN PRIVADA: Tarea de envío en background ===
+/**
+ * @brief Envía los eventos encolados por supabase_send_event_async()
+ *
+ * Reintenta con espera creciente; un evento que agota los intentos se
+ * descarta para no bloquear a los siguientes. Entre eventos mantiene la
+ * conexión precalentada. Con MQTT los eventos encolados viajan en un solo
+ * mensaje; si el lote no se confirma, cada evento sigue por HTTPS. Los
+ * estados de comando van siempre por HTTPS a su propio endpoint.
+ */
+static void async_send_task(void *arg)
+{
+    async_item_t batch[SUPABASE_EVENT_BATCH_MAX];
+    async_item_t status;
+    while (true) {
+        warm_maintain();
+        supabase_h2_close_idle();
+        TickType_t wait = s_warm_applied ? pdMS_TO_TICKS(SUPABASE_WARM_CHECK_MS) : portMAX_DELAY;
+        if (xQueueReceive(s_async_queue, &batch[0], wait) != pdTRUE || batch[0].json == NULL) {
+            continue;   // Revisión periódica o aviso de cambio
+        }
+        if (batch[0].command_status) {
+            deliver_command_status(&batch[0]);
+            continue;
+        }
+        size_t count = collect_batch(batch, &status);
+
+        bool alternate = true;
+        if (count > 1) {
+            char *payload = join_batch(batch, count);
+            esp_err_t err = payload ? deliver_alternate(payload, count) : ESP_ERR_NO_MEM;
+            free(payload);
+            if (err == ESP_OK) {
+                for (size_t i = 0; i < count; i++) {
+                    free(batch[i].json);
+                }
+                if (status.json != NULL) {
+                    deliver_command_status(&status);
+                }
+                continue;
+            }
+            alternate = false;  // El broker ya tuvo su oportunidad
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            esp_err_t err = ESP_FAIL;
+            for (int attempt = 1; attempt <= SUPABASE_ASYNC_RETRIES; attempt++) {
+                err = deliver_event_json(batch[i].json, batch[i].queued_us, batch[i].first, alternate);
+                if (err == ESP_OK) {
+                    break;
+                }
+                ESP_LOGW(TAG, "Evento no enviado (intento %d/%d): %s",
+                         attempt, SUPABASE_ASYNC_RETRIES, esp_err_to_name(err));
+                if (attempt < SUPABASE_ASYNC_RETRIES) {
+                    vTaskDelay(pdMS_TO_TICKS(SUPABASE_ASYNC_RETRY_MS * attempt));
+                }
+            }
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Evento descartado tras %d intentos", SUPABASE_ASYNC_RETRIES);
+            }
+            free(batch[i].json);
+        }
+        if (status.json != NULL) {
+            deliver_command_status(&status);
+        }
+    }
 }
 
+#if SUPABASE_PINNED_TRUST
+// Raíces embebidas por EMBED_TXTFILES (terminadas en NUL)
+extern const char s_pins_start[] asm("_binary_supabase_roots_pem_start");
+extern const char s_pins_end[] asm("_binary_supabase_roots_pem_end");
+#endif
+
 // === FUNCIÓN PÚBLICA: Inicializar cliente ===
 esp_err_t supabase_client_init(void)
 {
@@ -457,6 +962,22 @@ esp_err_t supabase_client_init(void)
         return ESP_OK;
     }
 
+    esp_err_t err = tls_manager_init();
+#if SUPABASE_PINNED_TRUST
+    if (err == ESP_OK && tls_manager_set_pins(s_ctx.host, s_pins_start, s_pins_end - s_pins_start) != ESP_OK) {
+        ESP_LOGW(TAG, "Pins no disponibles, se verifica con el bundle completo");
+    }
+#endif
+    if (err == ESP_OK) {
+        err = supabase_dns_init();
+    }
+    if (err == ESP_OK) {
+        err = supabase_h2_init(wake_async_task);     // La tarea de envío cierra la conexión inactiva
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
     // Crear mutex para proteger las conexiones TLS
     s_tls_mutex = xSemaphoreCreateMutex();
     if (s_tls_mutex == NULL) {
@@ -464,6 +985,15 @@ esp_err_t supabase_client_init(void)
         return ESP_ERR_NO_MEM;
     }
 
+    // Cola y tarea para envíos en background
+    s_async_queue = xQueueCreate(SUPABASE_ASYNC_QUEUE_LEN, sizeof(async_item_t));
+    if (s_async_queue == NULL ||
+        xTaskCreate(async_send_task, "supabase_tx", SUPABASE_ASYNC_TASK_STACK, NULL,
+                    SUPABASE_ASYNC_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Error al crear tarea de envío en background");
+        return ESP_ERR_NO_MEM;
+    }
+
     // Marcar como inicializado
     s_ctx.initialized = true;
 
@@ -471,7 +1001,10 @@ esp_err_t supabase_client_init(void)
     ESP_LOGI(TAG, "  Host: %s:%d", s_ctx.host, SUPABASE_PORT);
     ESP_LOGI(TAG, "  Path: %s", SUPABASE_PATH);
     ESP_LOGI(TAG, "  Device Key: %s", DEVICE_KEY);
-    ESP_LOGI(TAG, "  Mode: Connection close (no keep-alive)");
+    ESP_LOGI(TAG, "  Mode: %s", s_http2 ? "HTTP/2 (streams sobre una conexión)"
+                                        : "Connection close (no keep-alive)");
+    ESP_LOGI(TAG, "  Conexión precalentada: %s", SUPABASE_WARM_CONNECTION ? "con el sistema armado" : "no");
+    ESP_LOGI(TAG, "  Transporte de eventos: %s", s_transport_names[s_event_transport]);
 
     return ESP_OK;
 }
@@ -510,43 +1043,200 @@ esp_err_t supabase_send_event(const device_event_t *event)
         return ESP_ERR_NO_MEM;
     }
 
-    ESP_LOGI(TAG, "JSON body: %s", json_str);
+    esp_err_t err = deliver_event_json(json_str, esp_timer_get_time(), take_first_mark(), true);
+    free(json_str);
+    return err;
+}
+
+// === FUNCIÓN PÚBLICA: Enviar evento en background ===
+esp_err_t supabase_send_event_async(const device_event_t *event)
+{
+    if (!s_ctx.initialized || s_async_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (event == NULL || event->event_type == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // El JSON (con su timestamp) se genera ahora, no cuando se envíe
+    char *json_str = create_event_json(event);
+    if (json_str == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    async_item_t item = {
+        .json = json_str,
+        .queued_us = esp_timer_get_time(),
+        .first = take_first_mark(),
+    };
+    if (xQueueSend(s_async_queue, &item, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Cola de eventos llena, descartando %s", event->event_type);
+        free(json_str);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+// === FUNCIÓN PÚBLICA: Encolar el estado de un comando ===
+esp_err_t supabase_update_command_status_async(const char *command_id, const char *status,
+                                               const char *result)
+{
+    if (!s_ctx.initialized || s_async_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (command_id == NULL || command_id[0] == '\0' || status == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cJSON *json = cJSON_CreateObject();
+    if (json == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    cJSON_AddStringToObject(json, "command_id", command_id);
+    cJSON_AddStringToObject(json, "status", status);
+    if (result != NULL) {
+        cJSON_AddStringToObject(json, "result", result);
+    }
+    char *json_str = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    if (json_str == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    async_item_t item = {
+        .json = json_str,
+        .queued_us = esp_timer_get_time(),
+        .command_status = true,
+    };
+    if (xQueueSend(s_async_queue, &item, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Cola de eventos llena, descartando estado de %s", command_id);
+        free(json_str);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+// === FUNCIÓN PRIVADA: POST a una Edge Function ===
+/**
+ * @brief POST de un JSON con X-Device-Key
+ *
+ * Por HTTP/2 no se toma s_tls_mutex: los streams avanzan en paralelo.
+ *
+ * @param[out] warm true si el request usó una conexión ya abierta (puede ser NULL)
+ */
+static esp_err_t post_json(const char *path, const char *json_str, int *http_status,
+                           char *body, size_t body_size, bool *warm)
+{
+    bool reused = false;
+    if (warm == NULL) {
+        warm = &reused;
+    }
+
+    if (s_http2) {
+        static const supabase_h2_header_t headers[] = {
+            { "content-type", "application/json", true },
+            { "x-device-key", DEVICE_KEY, true },
+        };
+        supabase_h2_request_t req = {
+            .method = "POST",
+            .path = path,
+            .headers = headers,
+            .header_count = sizeof(headers) / sizeof(headers[0]),
+            .body = json_str,
+            .body_len = strlen(json_str),
+            .resp_body = body,
+            .resp_size = body_size,
+        };
+        esp_err_t err = supabase_h2_request(s_ctx.host, &req, SUPABASE_TIMEOUT_MS);
+        if (err != ESP_ERR_NOT_SUPPORTED) {
+            *http_status = req.status;
+            *warm = req.reused;
+            return err;
+        }
+    }
 
     // Tomar mutex para acceso exclusivo
     if (xSemaphoreTake(s_tls_mutex, pdMS_TO_TICKS(5000)) != pdTRUE) {
         ESP_LOGE(TAG, "Timeout esperando mutex TLS");
-        free(json_str);
         return ESP_ERR_TIMEOUT;
     }
 
-    // Crear nueva conexión TLS para cada request
-    esp_tls_t *tls = create_connection();
+    // Conexión precalentada o una nueva para este request
+    esp_tls_t *tls = take_connection(warm);
     if (tls == NULL) {
         xSemaphoreGive(s_tls_mutex);
-        free(json_str);
         return ESP_FAIL;
     }
 
     // Enviar petición HTTP
-    esp_err_t err = send_http_request(tls, s_ctx.host, SUPABASE_PATH,
-                                       DEVICE_KEY, json_str);
-    free(json_str);
-
-    if (err != ESP_OK) {
-        esp_tls_conn_destroy(tls);
-        xSemaphoreGive(s_tls_mutex);
-        return err;
+    esp_err_t err = send_http_request(tls, s_ctx.host, path, DEVICE_KEY, json_str);
+    if (err == ESP_FAIL && *warm) {
+        // El servidor cerró la precalentada sin que se notara: nada fue procesado
+        tls_manager_release(tls);
+        *warm = false;
+        tls = create_connection();
+        if (tls == NULL) {
+            xSemaphoreGive(s_tls_mutex);
+            return ESP_FAIL;
+        }
+        err = send_http_request(tls, s_ctx.host, path, DEVICE_KEY, json_str);
     }
 
     // Leer respuesta
-    int http_status = 0;
-    char response_body[SUPABASE_RESPONSE_BUF_SIZE] = {0};
-    err = read_http_response(tls, &http_status, response_body, sizeof(response_body));
+    if (err == ESP_OK) {
+        err = read_http_response(tls, http_status, body, body_size, NULL, 0);
+    }
 
     // Cerrar conexión
-    esp_tls_conn_destroy(tls);
+    tls_manager_release(tls);
     xSemaphoreGive(s_tls_mutex);
+    return err;
+}
 
+// === FUNCIÓN PRIVADA: POST del estado de un comando ===
+/**
+ * @brief Actualiza system_commands.status por la Edge Function
+ *
+ * La función valida X-Device-Key y solo modifica comandos dirigidos a ese
+ * dispositivo: el anon key no puede escribir system_commands.
+ *
+ * @return ESP_ERR_NOT_FOUND si el comando no existe o no es de este dispositivo
+ */
+static esp_err_t post_command_status(const char *json_str)
+{
+    int http_status = 0;
+    char response_body[SUPABASE_RESPONSE_BUF_SIZE] = {0};
+    esp_err_t err = post_json(SUPABASE_COMMAND_STATUS_PATH, json_str, &http_status,
+                              response_body, sizeof(response_body), NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (http_status >= 200 && http_status < 300) {
+        ESP_LOGD(TAG, "Estado de comando actualizado: %s", json_str);
+        return ESP_OK;
+    }
+    ESP_LOGW(TAG, "⚠️ Estado de comando rechazado: HTTP %d %s", http_status, response_body);
+    // 404/403: reintentar no cambia nada
+    return (http_status == 404 || http_status == 403) ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+}
+
+// === FUNCIÓN PRIVADA: POST de un evento ya serializado ===
+/**
+ * @brief Envía el JSON de un evento a la Edge Function
+ */
+static esp_err_t post_event_json(const char *json_str, bool *warm)
+{
+    ESP_LOGI(TAG, "JSON body: %s", json_str);
+
+    int http_status = 0;
+    char response_body[SUPABASE_RESPONSE_BUF_SIZE] = {0};
+    esp_err_t err = post_json(SUPABASE_PATH, json_str, &http_status,
+                              response_body, sizeof(response_body), warm);
     if (err != ESP_OK) {
         return err;
     }
@@ -566,6 +1256,223 @@ esp_err_t supabase_send_event(const device_event_t *event)
     }
 }
 
+// === FUNCIÓN PÚBLICA: GET a la API REST ===
+esp_err_t supabase_rest_get(const char *path, const char *if_none_match,
+                            int *http_status, char *etag, size_t etag_size,
+                            char *body, size_t body_size)
+{
+    if (!s_ctx.initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (path == NULL || http_status == NULL || body == NULL || body_size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_http2) {
+        supabase_h2_header_t headers[] = {
+            { "apikey", SUPABASE_ANON_KEY, true },
+            { "authorization", "Bearer " SUPABASE_ANON_KEY, true },
+            { "accept", "application/json", true },
+            { "if-none-match", if_none_match, false },
+        };
+        bool conditional = if_none_match != NULL && if_none_match[0] != '\0';
+        supabase_h2_request_t req = {
+            .method = "GET",
+            .path = path,
+            .headers = headers,
+            .header_count = conditional ? 4 : 3,
+            .resp_body = body,
+            .resp_size = body_size,
+            .etag = etag,
+            .etag_size = etag_size,
+        };
+        esp_err_t err = supabase_h2_request(s_ctx.host, &req, SUPABASE_TIMEOUT_MS);
+        if (err != ESP_ERR_NOT_SUPPORTED) {
+            *http_status = req.status;
+            return err;
+        }
+    }
+
+    char conditional[96] = "";
+    if (if_none_match != NULL && if_none_match[0] != '\0') {
+        snprintf(conditional, sizeof(conditional), "If-None-Match: %s\r\n", if_none_match);
+    }
+
+    char request[1024];
+    int request_len = snprintf(request, sizeof(request),
+        "GET %s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "apikey: %s\r\n"
+        "Authorization: Bearer %s\r\n"
+        "Accept: application/json\r\n"
+        "%s"
+        "Connection: close\r\n"
+        "\r\n",
+        path, s_ctx.host, SUPABASE_ANON_KEY, SUPABASE_ANON_KEY, conditional);
+
+    if (request_len >= sizeof(request)) {
+        ESP_LOGE(TAG, "Petición HTTP demasiado grande");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGD(TAG, "GET %s", path);
+
+    // Tomar mutex para acceso exclusivo
+    if (xSemaphoreTake(s_tls_mutex, pdMS_TO_TICKS(5000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Timeout esperando mutex TLS");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    bool warm = false;
+    esp_tls_t *tls = take_connection(&warm);
+    if (tls == NULL) {
+        xSemaphoreGive(s_tls_mutex);
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = ESP_OK;
+    int written = esp_tls_conn_write(tls, request, request_len);
+    if (written < 0 && warm) {
+        tls_manager_release(tls);
+        tls = create_connection();
+        if (tls == NULL) {
+            xSemaphoreGive(s_tls_mutex);
+            return ESP_FAIL;
+        }
+        written = esp_tls_conn_write(tls, request, request_len);
+    }
+    if (written < 0) {
+        ESP_LOGE(TAG, "Error al escribir en conexión TLS: %d", written);
+        err = ESP_FAIL;
+    } else {
+        err = read_http_response(tls, http_status, body, body_size, etag, etag_size);
+    }
+
+    tls_manager_release(tls);
+    xSemaphoreGive(s_tls_mutex);
+    return err;
+}
+
+// === FUNCIÓN PÚBLICA: Transporte de eventos ===
+esp_err_t supabase_set_event_sender(supabase_event_transport_t transport,
+                                    supabase_event_sender_t sender, void *user_data)
+{
+    if (transport == SUPABASE_EVENT_TRANSPORT_HTTPS || transport >= SUPABASE_EVENT_TRANSPORT_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_event_sender_ctx[transport] = user_data;
+    s_event_senders[transport] = sender;
+    return ESP_OK;
+}
+
+esp_err_t supabase_set_event_transport(supabase_event_transport_t transport)
+{
+    if (transport >= SUPABASE_EVENT_TRANSPORT_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_event_transport = transport;
+    ESP_LOGI(TAG, "Transporte de eventos: %s%s", s_transport_names[transport],
+             transport == SUPABASE_EVENT_TRANSPORT_HTTPS ? "" : " (HTTPS de respaldo)");
+    return ESP_OK;
+}
+
+esp_err_t supabase_set_http2(bool enable)
+{
+    if (enable != s_http2) {
+        s_http2 = enable;
+        // Libera la sesión al deshabilitar; al habilitar vuelve a negociar ALPN
+        supabase_h2_close();
+    }
+    ESP_LOGI(TAG, "Transporte HTTP: %s", enable ? "HTTP/2 (HTTP/1.1 si no se negocia)" : "HTTP/1.1");
+    return ESP_OK;
+}
+
+esp_err_t supabase_set_warm_connection(bool enable)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_mark_first = true;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    if (enable != s_warm_wanted) {
+        s_warm_wanted = enable;
+        ESP_LOGI(TAG, "Conexión precalentada: %s", enable ? "mantener" : "liberar");
+        wake_async_task();
+    }
+    return ESP_OK;
+}
+
+esp_err_t supabase_get_warm_stats(supabase_warm_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_warm_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+    stats->enabled = SUPABASE_WARM_CONNECTION && s_warm_wanted;
+    return ESP_OK;
+}
+
+esp_err_t supabase_get_event_stats(supabase_event_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_event_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+    stats->mode = s_event_transport;
+    return ESP_OK;
+}
+
+void supabase_print_event_stats(void)
+{
+    supabase_event_stats_t stats;
+    supabase_get_event_stats(&stats);
+
+    ESP_LOGI(TAG, "Eventos (modo %s): %lu pasaron a HTTPS",
+             s_transport_names[stats.mode], (unsigned long)stats.fallbacks);
+    for (int i = 0; i < SUPABASE_EVENT_TRANSPORT_COUNT; i++) {
+        const supabase_transport_stats_t *t = &stats.transports[i];
+        ESP_LOGI(TAG, "  - %s: %lu ok en %lu mensajes, %lu fallos, latencia %lu ms prom / %lu ms máx, "
+                 "%lu eventos/s, ~%lu µJ por evento",
+                 s_transport_names[i], (unsigned long)t->sent, (unsigned long)t->messages,
+                 (unsigned long)t->failed, (unsigned long)t->latency_avg_ms,
+                 (unsigned long)t->latency_max_ms, (unsigned long)t->events_per_s,
+                 (unsigned long)t->energy_avg_uj);
+    }
+
+    if (s_http2) {
+        supabase_h2_stats_t h2;
+        supabase_h2_get_stats(&h2);
+        ESP_LOGI(TAG, "HTTP/2: %lu requests, %lu fallos, %lu reintentos, %lu conexiones, %u streams máx",
+                 (unsigned long)h2.requests, (unsigned long)h2.failures, (unsigned long)h2.retries,
+                 (unsigned long)h2.connections, h2.streams_peak);
+        ESP_LOGI(TAG, "  - Headers: %lu bytes con HPACK (%lu en HTTP/1.1)",
+                 (unsigned long)h2.header_bytes_hpack, (unsigned long)h2.header_bytes_plain);
+    }
+
+    supabase_warm_stats_t warm;
+    supabase_get_warm_stats(&warm);
+    ESP_LOGI(TAG, "Conexión precalentada (%s): %lu abiertas, %lu usadas, %lu descartadas",
+             warm.enabled ? "activa" : "inactiva", (unsigned long)warm.opened,
+             (unsigned long)warm.used, (unsigned long)warm.discarded);
+    ESP_LOGI(TAG, "  - Subida: lista %lu ms prom (%lu), nueva %lu ms prom (%lu)",
+             (unsigned long)warm.warm_upload_avg_ms, (unsigned long)warm.warm_uploads,
+             (unsigned long)warm.cold_upload_avg_ms, (unsigned long)warm.cold_uploads);
+    ESP_LOGI(TAG, "  - Primer evento tras cambio de estado: lista %lu ms, nueva %lu ms",
+             (unsigned long)warm.first_warm_ms, (unsigned long)warm.first_cold_ms);
+
+    supabase_dns_stats_t dns;
+    supabase_dns_get_stats(&dns);
+    ESP_LOGI(TAG, "DNS: %lu aciertos, %lu consultas (%lu ms prom, %lu máx, TTL %lu s), %lu vencidas usadas, "
+             "%lu fallos (%lu sin consultar)",
+             (unsigned long)dns.hits, (unsigned long)dns.misses, (unsigned long)dns.lookup_avg_ms,
+             (unsigned long)dns.lookup_max_ms, (unsigned long)dns.ttl_last_s,
+             (unsigned long)dns.stale_hits, (unsigned long)dns.failures, (unsigned long)dns.negative_hits);
+}
+
 // === FUNCIÓN PÚBLICA: Verificar inicialización ===
 bool supabase_is_initialized(void)
 {
@@ -610,40 +1517,12 @@ esp_err_t supabase_get_link_code(char *link_code)
         return ESP_ERR_NO_MEM;
     }
 
-    // Tomar mutex para acceso exclusivo
-    if (xSemaphoreTake(s_tls_mutex, pdMS_TO_TICKS(5000)) != pdTRUE) {
-        ESP_LOGE(TAG, "Timeout esperando mutex TLS");
-        free(json_str);
-        return ESP_ERR_TIMEOUT;
-    }
-
-    // Crear nueva conexión TLS
-    esp_tls_t *tls = create_connection();
-    if (tls == NULL) {
-        xSemaphoreGive(s_tls_mutex);
-        free(json_str);
-        return ESP_FAIL;
-    }
-
-    // Enviar petición HTTP a ghost-token-create
-    esp_err_t err = send_http_request(tls, s_ctx.host, SUPABASE_TOKEN_PATH,
-                                       DEVICE_KEY, json_str);
-    free(json_str);
-
-    if (err != ESP_OK) {
-        esp_tls_conn_destroy(tls);
-        xSemaphoreGive(s_tls_mutex);
-        return err;
-    }
-
-    // Leer respuesta
+    // POST a ghost-token-create
     int http_status = 0;
     char response_body[SUPABASE_RESPONSE_BUF_SIZE] = {0};
-    err = read_http_response(tls, &http_status, response_body, sizeof(response_body));
-
-    // Cerrar conexión
-    esp_tls_conn_destroy(tls);
-    xSemaphoreGive(s_tls_mutex);
+    esp_err_t err = post_json(SUPABASE_TOKEN_PATH, json_str, &http_status,
+                              response_body, sizeof(response_body), NULL);
+    free(json_str);
 
     if (err != ESP_OK) {
         return err;
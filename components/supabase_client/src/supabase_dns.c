@@ -0,0 +1,467 @@
+/**
+ * @file supabase_dns.c
+ * @brief Implementación de la caché DNS con TTL
+ *
+ * La consulta propia es un paquete UDP con una pregunta A (RFC 1035) al
+ * primer servidor DNS que configuró DHCP. De la respuesta se toma la
+ * primera dirección IPv4 y el menor TTL de los registros de respuesta
+ * (incluidos los CNAME de la cadena), que es lo que puede durar la IP.
+ * La respuesta se acepta solo si trae el ID y la pregunta (nombre, tipo y
+ * clase) de la consulta y no tiene el bit TC; si no, se usa getaddrinfo().
+ *
+ * lwIP también guarda las respuestas según su TTL, pero no lo expone y
+ * borra la entrada al vencer: no se sabe cuándo reabrir la conexión
+ * precalentada con la IP nueva (supabase_dns_connect), y con el DNS caído
+ * cada request espera los DNS_MAX_RETRIES de lwIP para fallar, en lugar de
+ * seguir con la IP anterior (SUPABASE_DNS_STALE_S).
+ *
+ * s_mutex protege solo la tabla: la consulta y getaddrinfo() se hacen sin
+ * él, así un host que no responde no frena a los que están en caché. Si dos
+ * requests resuelven el mismo host a la vez, consultan los dos.
+ *
+ * Un fallo también se guarda (RFC 2308): durante SUPABASE_DNS_NEGATIVE_S el
+ * host no se vuelve a consultar, así que con el DNS caído cada request no
+ * espera SUPABASE_DNS_TIMEOUT_MS más getaddrinfo() para llegar al mismo
+ * resultado.
+ */
+
+#include "supabase_dns.h"
+#include "tls_manager.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "lwip/dns.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "SUPABASE_DNS";
+
+// ============================================================================
+// Configuración
+// ============================================================================
+
+#define DNS_PORT                53
+#define DNS_PACKET_MAX          512     // Respuesta UDP sin EDNS
+#define DNS_HEADER_LEN          12
+#define DNS_TYPE_A              1
+#define DNS_CLASS_IN            1
+#define DNS_HOST_LEN            64
+#define DNS_QUERY_MAX           (DNS_HEADER_LEN + DNS_HOST_LEN + 1 + 4)
+#define DNS_FLAG_TC             0x02    // En el byte 2 de la cabecera
+
+// ============================================================================
+// Estado interno
+// ============================================================================
+
+typedef struct {
+    char host[DNS_HOST_LEN];    // "" = entrada libre
+    uint32_t addr;              // Orden de red; 0 = nunca se resolvió
+    int64_t expires_us;
+    int64_t retry_us;           // Tras un fallo, no consultar antes de este tiempo
+} dns_entry_t;
+
+static SemaphoreHandle_t s_mutex = NULL;
+static dns_entry_t s_cache[SUPABASE_DNS_CACHE_SIZE];
+static uint64_t s_lookup_total_ms = 0;
+static supabase_dns_stats_t s_stats = {0};
+
+// ============================================================================
+// Consulta DNS
+// ============================================================================
+
+static size_t build_query(uint8_t *buf, size_t size, const char *host, uint16_t id)
+{
+    size_t host_len = strlen(host);
+    if (host_len == 0 || DNS_HEADER_LEN + host_len + 2 + 4 > size) {
+        return 0;
+    }
+
+    memset(buf, 0, DNS_HEADER_LEN);
+    buf[0] = id >> 8;
+    buf[1] = id & 0xFF;
+    buf[2] = 0x01;              // RD: resolución recursiva
+    buf[5] = 1;                 // Una pregunta
+
+    size_t pos = DNS_HEADER_LEN;
+    const char *label = host;
+    while (*label != '\0') {
+        const char *dot = strchr(label, '.');
+        size_t len = dot ? (size_t)(dot - label) : strlen(label);
+        if (len == 0 || len > 63) {
+            return 0;
+        }
+        buf[pos++] = (uint8_t)len;
+        memcpy(buf + pos, label, len);
+        pos += len;
+        label += len;
+        if (*label == '.') {
+            label++;
+        }
+    }
+    buf[pos++] = 0;
+    buf[pos++] = 0;
+    buf[pos++] = DNS_TYPE_A;
+    buf[pos++] = 0;
+    buf[pos++] = DNS_CLASS_IN;
+    return pos;
+}
+
+/**
+ * @brief Salta un nombre (etiquetas o puntero de compresión)
+ * @return Posición siguiente o 0 si el nombre está mal formado
+ */
+static size_t skip_name(const uint8_t *buf, size_t len, size_t pos)
+{
+    while (pos < len) {
+        uint8_t b = buf[pos];
+        if ((b & 0xC0) == 0xC0) {
+            return pos + 2 <= len ? pos + 2 : 0;
+        }
+        if (b & 0xC0) {
+            return 0;
+        }
+        if (b == 0) {
+            return pos + 1;
+        }
+        pos += b + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Compara la pregunta de la respuesta con la enviada
+ *
+ * Sin distinguir mayúsculas: algunos resolvers cambian las de la pregunta.
+ * Los bytes de longitud, tipo y clase son menores que 'A' y no cambian.
+ */
+static bool question_matches(const uint8_t *resp, const uint8_t *query, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (tolower(resp[i]) != tolower(query[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @param query Consulta enviada (cabecera y pregunta)
+ */
+static bool parse_response(const uint8_t *buf, size_t len, const uint8_t *query, size_t query_len,
+                           uint32_t *addr, uint32_t *ttl_s)
+{
+    if (len < query_len || buf[0] != query[0] || buf[1] != query[1]) {
+        return false;
+    }
+    if (!(buf[2] & 0x80) || (buf[3] & 0x0F) != 0) {
+        return false;           // No es respuesta o RCODE con error
+    }
+    if (buf[2] & DNS_FLAG_TC) {
+        return false;           // Truncada: faltan registros que por UDP no llegan
+    }
+
+    // Una sola pregunta, la misma que se envió; las respuestas van detrás
+    uint16_t questions = (buf[4] << 8) | buf[5];
+    uint16_t answers = (buf[6] << 8) | buf[7];
+    if (questions != 1 ||
+        !question_matches(buf + DNS_HEADER_LEN, query + DNS_HEADER_LEN, query_len - DNS_HEADER_LEN)) {
+        return false;
+    }
+    size_t pos = query_len;
+
+    bool found = false;
+    uint32_t min_ttl = UINT32_MAX;
+    for (uint16_t i = 0; i < answers; i++) {
+        pos = skip_name(buf, len, pos);
+        if (pos == 0 || pos + 10 > len) {
+            break;
+        }
+        uint16_t type = (buf[pos] << 8) | buf[pos + 1];
+        uint16_t class = (buf[pos + 2] << 8) | buf[pos + 3];
+        uint32_t ttl = ((uint32_t)buf[pos + 4] << 24) | ((uint32_t)buf[pos + 5] << 16) |
+                       ((uint32_t)buf[pos + 6] << 8) | buf[pos + 7];
+        uint16_t rdlen = (buf[pos + 8] << 8) | buf[pos + 9];
+        pos += 10;
+        if (pos + rdlen > len) {
+            break;
+        }
+        if (ttl < min_ttl) {
+            min_ttl = ttl;
+        }
+        if (!found && type == DNS_TYPE_A && class == DNS_CLASS_IN && rdlen == 4) {
+            memcpy(addr, buf + pos, 4);
+            found = true;
+        }
+        pos += rdlen;
+    }
+
+    *ttl_s = min_ttl;
+    return found;
+}
+
+/**
+ * @brief Consulta A al servidor DNS de la red, con el TTL de la respuesta
+ */
+static esp_err_t query_a(const char *host, uint32_t *addr, uint32_t *ttl_s)
+{
+    const ip_addr_t *server = dns_getserver(0);
+    if (server == NULL || !IP_IS_V4(server) || ip_addr_isany(server)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint8_t query[DNS_QUERY_MAX];
+    uint8_t buf[DNS_PACKET_MAX];
+    size_t query_len = build_query(query, sizeof(query), host, esp_random() & 0xFFFF);
+    if (query_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        return ESP_FAIL;
+    }
+    struct timeval tv = {
+        .tv_sec = SUPABASE_DNS_TIMEOUT_MS / 1000,
+        .tv_usec = (SUPABASE_DNS_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    // connect() hace que solo se acepten respuestas del servidor consultado
+    struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(DNS_PORT),
+        .sin_addr.s_addr = ip4_addr_get_u32(ip_2_ip4(server)),
+    };
+    esp_err_t err = ESP_FAIL;
+    if (connect(sock, (struct sockaddr *)&to, sizeof(to)) == 0 &&
+        send(sock, query, query_len, 0) == (int)query_len) {
+        int len = recv(sock, buf, sizeof(buf), 0);
+        if (len > 0 && parse_response(buf, len, query, query_len, addr, ttl_s)) {
+            err = ESP_OK;
+        }
+    }
+    close(sock);
+    return err;
+}
+
+static esp_err_t lookup_addrinfo(const char *host, uint32_t *addr)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(host, NULL, &hints, &res) != 0 || res == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(res);
+    return ESP_OK;
+}
+
+// ============================================================================
+// Caché
+// ============================================================================
+
+static dns_entry_t *entry_find(const char *host)
+{
+    for (int i = 0; i < SUPABASE_DNS_CACHE_SIZE; i++) {
+        if (s_cache[i].host[0] != '\0' && strcmp(s_cache[i].host, host) == 0) {
+            return &s_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Entrada para un host nuevo: una libre o la que vence primero
+ */
+static dns_entry_t *entry_alloc(const char *host)
+{
+    dns_entry_t *e = &s_cache[0];
+    for (int i = 0; i < SUPABASE_DNS_CACHE_SIZE; i++) {
+        if (s_cache[i].host[0] == '\0') {
+            e = &s_cache[i];
+            break;
+        }
+        if (s_cache[i].expires_us < e->expires_us) {
+            e = &s_cache[i];
+        }
+    }
+    memset(e, 0, sizeof(*e));
+    strncpy(e->host, host, DNS_HOST_LEN - 1);
+    return e;
+}
+
+static void format_addr(uint32_t addr, char *ip, size_t ip_size)
+{
+    const uint8_t *b = (const uint8_t *)&addr;
+    snprintf(ip, ip_size, "%u.%u.%u.%u", b[0], b[1], b[2], b[3]);
+}
+
+/**
+ * @brief IP vencida que todavía puede usarse si el DNS no responde
+ */
+static bool entry_stale_usable(const dns_entry_t *e, int64_t now_us)
+{
+    return e->addr != 0 && now_us < e->expires_us + (int64_t)SUPABASE_DNS_STALE_S * 1000000;
+}
+
+// ============================================================================
+// API Pública
+// ============================================================================
+
+esp_err_t supabase_dns_init(void)
+{
+    if (s_mutex != NULL) {
+        return ESP_OK;
+    }
+    s_mutex = xSemaphoreCreateMutex();
+    return s_mutex ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t supabase_dns_resolve(const char *host, char *ip, size_t ip_size)
+{
+    if (host == NULL || ip == NULL || ip_size < 16) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_mutex == NULL || strlen(host) >= DNS_HOST_LEN) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    dns_entry_t *e = entry_find(host);
+    int64_t now_us = esp_timer_get_time();
+    if (e != NULL && e->addr != 0 && now_us < e->expires_us) {
+        s_stats.hits++;
+        format_addr(e->addr, ip, ip_size);
+        xSemaphoreGive(s_mutex);
+        return ESP_OK;
+    }
+    if (e != NULL && now_us < e->retry_us) {
+        // Falló hace menos de SUPABASE_DNS_NEGATIVE_S: el mismo resultado sin consultar
+        esp_err_t err = ESP_ERR_NOT_FOUND;
+        if (entry_stale_usable(e, now_us)) {
+            s_stats.stale_hits++;
+            format_addr(e->addr, ip, ip_size);
+            err = ESP_OK;
+        } else {
+            s_stats.negative_hits++;
+        }
+        xSemaphoreGive(s_mutex);
+        return err;
+    }
+    xSemaphoreGive(s_mutex);
+
+    uint32_t addr = 0;
+    uint32_t ttl_s = 0;
+    esp_err_t err = query_a(host, &addr, &ttl_s);
+    if (err != ESP_OK) {
+        ESP_LOGD(TAG, "Consulta propia sin respuesta (%s), usando getaddrinfo", esp_err_to_name(err));
+        err = lookup_addrinfo(host, &addr);
+        ttl_s = SUPABASE_DNS_DEFAULT_TTL_S;
+    }
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - now_us) / 1000);
+
+    // Durante la consulta la entrada pudo reutilizarse o resolverla otro request
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    e = entry_find(host);
+    if (err == ESP_OK) {
+        if (ttl_s < SUPABASE_DNS_MIN_TTL_S) {
+            ttl_s = SUPABASE_DNS_MIN_TTL_S;
+        } else if (ttl_s > SUPABASE_DNS_MAX_TTL_S) {
+            ttl_s = SUPABASE_DNS_MAX_TTL_S;
+        }
+        if (e == NULL) {
+            e = entry_alloc(host);
+        }
+        e->addr = addr;
+        e->expires_us = esp_timer_get_time() + (int64_t)ttl_s * 1000000;
+        e->retry_us = 0;
+        s_stats.misses++;
+        s_stats.ttl_last_s = ttl_s;
+        s_lookup_total_ms += elapsed_ms;
+        s_stats.lookup_avg_ms = (uint32_t)(s_lookup_total_ms / s_stats.misses);
+        if (elapsed_ms > s_stats.lookup_max_ms) {
+            s_stats.lookup_max_ms = elapsed_ms;
+        }
+        format_addr(addr, ip, ip_size);
+        ESP_LOGI(TAG, "%s -> %s (TTL %lu s, %lu ms)", host, ip,
+                 (unsigned long)ttl_s, (unsigned long)elapsed_ms);
+    } else if (e != NULL && e->addr != 0 && esp_timer_get_time() < e->expires_us) {
+        format_addr(e->addr, ip, ip_size);
+        err = ESP_OK;
+    } else if (e != NULL && entry_stale_usable(e, now_us)) {
+        s_stats.stale_hits++;
+        e->retry_us = esp_timer_get_time() + (int64_t)SUPABASE_DNS_NEGATIVE_S * 1000000;
+        format_addr(e->addr, ip, ip_size);
+        ESP_LOGW(TAG, "Sin respuesta DNS para %s, usando la IP anterior %s", host, ip);
+        err = ESP_OK;
+    } else {
+        s_stats.failures++;
+        if (e == NULL) {
+            e = entry_alloc(host);
+        }
+        e->addr = 0;
+        e->retry_us = esp_timer_get_time() + (int64_t)SUPABASE_DNS_NEGATIVE_S * 1000000;
+        ESP_LOGW(TAG, "No se pudo resolver %s", host);
+        err = ESP_ERR_NOT_FOUND;
+    }
+    xSemaphoreGive(s_mutex);
+    return err;
+}
+
+void supabase_dns_invalidate(const char *host)
+{
+    if (s_mutex == NULL || host == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    dns_entry_t *e = entry_find(host);
+    if (e != NULL) {
+        memset(e, 0, sizeof(*e));
+        s_stats.invalidations++;
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+esp_err_t supabase_dns_connect(const char *host, uint16_t port, const char **alpn_protos,
+                               uint32_t timeout_ms, esp_tls_t **tls)
+{
+    char ip[16];
+    if (supabase_dns_resolve(host, ip, sizeof(ip)) != ESP_OK) {
+        return tls_manager_acquire(host, port, alpn_protos, timeout_ms, tls);
+    }
+
+    esp_err_t err = tls_manager_acquire_at(host, ip, port, alpn_protos, timeout_ms, tls);
+    if (err == ESP_FAIL) {
+        // La IP pudo cambiar antes de vencer el TTL: reintentar solo si cambió
+        char fresh[16];
+        supabase_dns_invalidate(host);
+        if (supabase_dns_resolve(host, fresh, sizeof(fresh)) == ESP_OK && strcmp(fresh, ip) != 0) {
+            ESP_LOGW(TAG, "%s cambió de %s a %s, reintentando", host, ip, fresh);
+            err = tls_manager_acquire_at(host, fresh, port, alpn_protos, timeout_ms, tls);
+        }
+    }
+    return err;
+}
+
+esp_err_t supabase_dns_get_stats(supabase_dns_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_mutex == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return ESP_OK;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_mutex);
+    return ESP_OK;
+}
@@ -0,0 +1,1645 @@
+/**
+ * @file supabase_h2.c
+ * @brief Implementación del transporte HTTP/2 (RFC 9113) con HPACK (RFC 7541)
+ *
+ * Todo el estado de la conexión (sesión TLS, tablas HPACK, streams y parser
+ * de frames) se protege con s_io. Quien espera una respuesta toma s_io,
+ * lee lo que haya en el socket durante a lo sumo H2_POLL_MS y lo suelta;
+ * si otro request espera para enviar sus HEADERS, lo suelta antes (la
+ * espera se hace en tramos de H2_POLL_SLICE_MS).
+ *
+ * Los frames se procesan a medida que llegan, sin guardar el frame entero:
+ * DATA se copia directo al buffer del stream y solo el bloque de headers
+ * (HEADERS + CONTINUATION) se acumula para decodificarlo.
+ *
+ * El encoder HPACK no usa Huffman (el RFC lo deja a elección del encoder y
+ * los valores que se repiten terminan indexados); el decoder acepta ambas
+ * formas.
+ */
+
+#include "supabase_h2.h"
+#include "supabase_dns.h"
+#include "tls_manager.h"
+#include "esp_log.h"
+#include "esp_tls.h"
+#include "esp_timer.h"
+#include "mbedtls/ssl.h"
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "SUPABASE_H2";
+
+// ============================================================================
+// Configuración
+// ============================================================================
+
+#define H2_PORT                 443
+#define H2_POLL_MS              50      // Lectura máxima con s_io tomado
+#define H2_POLL_SLICE_MS        5       // Tramo de espera entre chequeos de s_senders
+#define H2_RX_CHUNK             512     // Lectura TLS por vuelta
+#define H2_TX_FRAME_MAX         2048    // Payload máximo de los frames propios
+#define H2_HEADER_BLOCK_MAX     4096    // Bloque de headers recibido (HEADERS + CONTINUATION)
+#define H2_FRAME_MAX            16384   // SETTINGS_MAX_FRAME_SIZE propio (valor por defecto)
+#define H2_WINDOW_DEFAULT       65535
+#define H2_HPACK_TABLE_SIZE     4096    // Tabla dinámica (valor por defecto del protocolo)
+#define H2_HPACK_DEC_ENTRIES    (H2_HPACK_TABLE_SIZE / 32)  // Cada entrada ocupa al menos 32
+#define H2_HPACK_ENC_ENTRIES    16      // Headers propios indexados
+
+// Tipos de frame
+#define H2_DATA                 0x0
+#define H2_HEADERS              0x1
+#define H2_RST_STREAM           0x3
+#define H2_SETTINGS             0x4
+#define H2_PUSH_PROMISE         0x5
+#define H2_PING                 0x6
+#define H2_GOAWAY               0x7
+#define H2_WINDOW_UPDATE        0x8
+#define H2_CONTINUATION         0x9
+
+// Flags
+#define H2_FLAG_END_STREAM      0x01
+#define H2_FLAG_ACK             0x01
+#define H2_FLAG_END_HEADERS     0x04
+#define H2_FLAG_PADDED          0x08
+#define H2_FLAG_PRIORITY        0x20
+
+// Settings
+#define H2_SET_HEADER_TABLE_SIZE    0x1
+#define H2_SET_ENABLE_PUSH          0x2
+#define H2_SET_MAX_CONCURRENT       0x3
+#define H2_SET_INITIAL_WINDOW       0x4
+#define H2_SET_MAX_FRAME_SIZE       0x5
+
+// Códigos de error
+#define H2_NO_ERROR             0x0
+#define H2_PROTOCOL_ERROR       0x1
+#define H2_FLOW_CONTROL_ERROR   0x3
+#define H2_FRAME_SIZE_ERROR     0x6
+#define H2_REFUSED_STREAM       0x7
+#define H2_CANCEL               0x8
+#define H2_COMPRESSION_ERROR    0x9
+
+#define H2_NO_GOAWAY            (-1)    // Cerrar sin avisar (la conexión ya no sirve)
+
+#define H2_MIN(a, b)            ((a) < (b) ? (a) : (b))
+
+// ============================================================================
+// Tablas HPACK (RFC 7541, apéndices A y B)
+// ============================================================================
+
+typedef struct {
+    const char *name;
+    const char *value;
+} hpack_static_t;
+
+static const hpack_static_t s_static_table[] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+#define HPACK_STATIC_COUNT      (sizeof(s_static_table) / sizeof(s_static_table[0]))
+
+/*
+ * Código Huffman canónico: cantidad de códigos por largo en bits y símbolos
+ * ordenados por (largo, símbolo). EOS (30 bits, todos unos) no figura, así
+ * que encontrarlo es un error.
+ */
+static const uint8_t s_huff_count[31] = {
+    0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3, 0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 3
+};
+
+static const uint8_t s_huff_sym[256] = {
+    0x30, 0x31, 0x32, 0x61, 0x63, 0x65, 0x69, 0x6f, 0x73, 0x74, 0x20, 0x25, 0x2d, 0x2e, 0x2f, 0x33,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3d, 0x41, 0x5f, 0x62, 0x64, 0x66, 0x67, 0x68, 0x6c, 0x6d,
+    0x6e, 0x70, 0x72, 0x75, 0x3a, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x4b, 0x4c,
+    0x4d, 0x4e, 0x4f, 0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x59, 0x6a, 0x6b, 0x71, 0x76,
+    0x77, 0x78, 0x79, 0x7a, 0x26, 0x2a, 0x2c, 0x3b, 0x58, 0x5a, 0x21, 0x22, 0x28, 0x29, 0x3f, 0x27,
+    0x2b, 0x7c, 0x23, 0x3e, 0x00, 0x24, 0x40, 0x5b, 0x5d, 0x7e, 0x5e, 0x7d, 0x3c, 0x60, 0x7b, 0x5c,
+    0xc3, 0xd0, 0x80, 0x82, 0x83, 0xa2, 0xb8, 0xc2, 0xe0, 0xe2, 0x99, 0xa1, 0xa7, 0xac, 0xb0, 0xb1,
+    0xb3, 0xd1, 0xd8, 0xd9, 0xe3, 0xe5, 0xe6, 0x81, 0x84, 0x85, 0x86, 0x88, 0x92, 0x9a, 0x9c, 0xa0,
+    0xa3, 0xa4, 0xa9, 0xaa, 0xad, 0xb2, 0xb5, 0xb9, 0xba, 0xbb, 0xbd, 0xbe, 0xc4, 0xc6, 0xe4, 0xe8,
+    0xe9, 0x01, 0x87, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8f, 0x93, 0x95, 0x96, 0x97, 0x98, 0x9b, 0x9d,
+    0x9e, 0xa5, 0xa6, 0xa8, 0xae, 0xaf, 0xb4, 0xb6, 0xb7, 0xbc, 0xbf, 0xc5, 0xe7, 0xef, 0x09, 0x8e,
+    0x90, 0x91, 0x94, 0x9f, 0xab, 0xce, 0xd7, 0xe1, 0xec, 0xed, 0xc7, 0xcf, 0xea, 0xeb, 0xc0, 0xc1,
+    0xc8, 0xc9, 0xca, 0xcd, 0xd2, 0xd5, 0xda, 0xdb, 0xee, 0xf0, 0xf2, 0xf3, 0xff, 0xcb, 0xcc, 0xd3,
+    0xd4, 0xd6, 0xdd, 0xde, 0xdf, 0xf1, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe,
+    0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x0b, 0x0c, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14,
+    0x15, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x7f, 0xdc, 0xf9, 0x0a, 0x0d, 0x16,
+};
+
+// ============================================================================
+// Estado interno
+// ============================================================================
+
+typedef struct {
+    char *data;                 // Nombre y valor consecutivos, sin terminador
+    uint16_t name_len;
+    uint16_t value_len;
+} hpack_entry_t;
+
+typedef struct {
+    hpack_entry_t *entries;     // Anillo: entries[head] es la más nueva
+    uint16_t cap;
+    uint16_t head;
+    uint16_t count;
+    uint32_t size;              // Suma de largo + 32 por entrada (RFC 7541 4.1)
+    uint32_t max_size;
+} hpack_table_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+    bool overflow;
+} hpack_writer_t;
+
+typedef struct {
+    bool in_use;
+    bool done;
+    bool sent_all;              // Se envió END_STREAM
+    bool got_response;          // Llegó un :status final
+    uint32_t id;
+    esp_err_t result;
+    supabase_h2_request_t *req;
+    size_t body_len;            // Bytes de respuesta copiados
+    size_t tx_sent;             // Bytes del body enviados
+    int32_t send_window;
+} h2_stream_t;
+
+typedef struct {
+    esp_tls_t *tls;
+    char host[64];
+    bool unsupported;           // El servidor no eligió h2: no volver a intentar
+    bool goaway;                // No abrir más streams en esta conexión
+    uint32_t next_stream_id;
+    int32_t send_window;
+    int32_t peer_initial_window;
+    uint32_t peer_max_frame;
+    uint32_t peer_max_streams;
+    int32_t enc_size_update;    // Actualización de tamaño a anunciar (-1 = ninguna)
+    uint8_t active;             // Slots de stream en uso
+    h2_stream_t streams[SUPABASE_H2_MAX_STREAMS];
+    hpack_table_t enc;
+    hpack_table_t dec;
+
+    // Parser de frames entrantes
+    uint8_t rx_hdr[9];
+    uint8_t rx_hdr_got;
+    uint32_t rx_len;
+    uint8_t rx_type;
+    uint8_t rx_flags;
+    uint32_t rx_sid;
+    uint32_t rx_got;
+    uint8_t rx_ctl[8];          // Comienzo del payload de frames de control
+    uint8_t rx_pad;             // Padding del DATA en curso
+    uint32_t block_sid;         // Stream del bloque de headers abierto (0 = ninguno)
+    bool block_end_stream;
+    bool block_overflow;
+    size_t block_len;           // Bytes completos del bloque de headers
+    size_t block_fill;          // Bytes escritos, incluido el frame en curso
+
+    uint8_t *mem;               // rx_buf + tx_buf + block, un solo malloc por conexión
+    uint8_t *rx_buf;
+    uint8_t *tx_buf;
+    uint8_t *block;
+} h2_conn_t;
+
+static SemaphoreHandle_t s_io = NULL;
+static volatile uint8_t s_senders = 0;     // Requests esperando s_io para abrir un stream
+static esp_timer_handle_t s_idle_timer = NULL;
+static supabase_h2_idle_notify_t s_idle_notify = NULL;
+static volatile bool s_idle_due = false;    // Venció el timer; cierra supabase_h2_close_idle()
+static bool s_keep_open = false;            // Sin cierre por inactividad (sistema armado)
+static hpack_entry_t s_enc_entries[H2_HPACK_ENC_ENTRIES];
+static hpack_entry_t s_dec_entries[H2_HPACK_DEC_ENTRIES];
+static h2_conn_t s_h2 = {
+    .enc = { .entries = s_enc_entries, .cap = H2_HPACK_ENC_ENTRIES, .max_size = H2_HPACK_TABLE_SIZE },
+    .dec = { .entries = s_dec_entries, .cap = H2_HPACK_DEC_ENTRIES, .max_size = H2_HPACK_TABLE_SIZE },
+};
+static supabase_h2_stats_t s_stats = {0};
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;    // s_stats y s_senders
+
+// ============================================================================
+// HPACK
+// ============================================================================
+
+static inline hpack_entry_t *table_entry(hpack_table_t *t, uint32_t k)
+{
+    return &t->entries[(t->head + k) % t->cap];
+}
+
+static void table_evict_oldest(hpack_table_t *t)
+{
+    hpack_entry_t *e = table_entry(t, t->count - 1);
+    t->size -= e->name_len + e->value_len + 32;
+    free(e->data);
+    e->data = NULL;
+    t->count--;
+}
+
+static void table_resize(hpack_table_t *t, uint32_t max_size)
+{
+    t->max_size = max_size;
+    while (t->count > 0 && t->size > t->max_size) {
+        table_evict_oldest(t);
+    }
+}
+
+static void table_clear(hpack_table_t *t)
+{
+    while (t->count > 0) {
+        table_evict_oldest(t);
+    }
+    t->head = 0;
+    t->max_size = H2_HPACK_TABLE_SIZE;
+}
+
+/**
+ * @brief Inserta una entrada (toma posesión de data)
+ *
+ * Una entrada más grande que la tabla la vacía y no se guarda.
+ */
+static void table_add(hpack_table_t *t, char *data, uint16_t name_len, uint16_t value_len)
+{
+    uint32_t size = name_len + value_len + 32;
+    while (t->count > 0 && (t->size + size > t->max_size || t->count == t->cap)) {
+        table_evict_oldest(t);
+    }
+    if (size > t->max_size) {
+        free(data);
+        return;
+    }
+    t->head = (t->head + t->cap - 1) % t->cap;
+    hpack_entry_t *e = &t->entries[t->head];
+    e->data = data;
+    e->name_len = name_len;
+    e->value_len = value_len;
+    t->size += size;
+    t->count++;
+}
+
+static char *entry_copy(const char *name, size_t name_len, const char *value, size_t value_len)
+{
+    char *data = malloc(name_len + value_len + 1);
+    if (data != NULL) {
+        memcpy(data, name, name_len);
+        memcpy(data + name_len, value, value_len);
+    }
+    return data;
+}
+
+static bool hpack_lookup(hpack_table_t *t, uint32_t index, const char **name, size_t *name_len,
+                         const char **value, size_t *value_len)
+{
+    if (index == 0) {
+        return false;
+    }
+    if (index <= HPACK_STATIC_COUNT) {
+        *name = s_static_table[index - 1].name;
+        *name_len = strlen(*name);
+        *value = s_static_table[index - 1].value;
+        *value_len = strlen(*value);
+        return true;
+    }
+    index -= HPACK_STATIC_COUNT + 1;
+    if (index >= t->count) {
+        return false;
+    }
+    hpack_entry_t *e = table_entry(t, index);
+    *name = e->data;
+    *name_len = e->name_len;
+    *value = e->data + e->name_len;
+    *value_len = e->value_len;
+    return true;
+}
+
+static bool hpack_get_int(const uint8_t **p, const uint8_t *end, int prefix, uint32_t *value)
+{
+    if (*p >= end) {
+        return false;
+    }
+    uint32_t max = (1u << prefix) - 1;
+    uint32_t v = *(*p)++ & max;
+    if (v < max) {
+        *value = v;
+        return true;
+    }
+    // Hasta 4 bytes de continuación: ningún valor útil pasa de 2^28
+    for (int shift = 0; shift <= 21; shift += 7) {
+        if (*p >= end) {
+            return false;
+        }
+        uint8_t b = *(*p)++;
+        v += (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Decodifica un string Huffman
+ * @return Largo decodificado o -1 si el código es inválido
+ */
+static int huff_decode(const uint8_t *in, size_t len, uint8_t *out, size_t out_size)
+{
+    size_t n = 0;
+    uint32_t code = 0;
+    uint32_t first = 0;
+    uint32_t index = 0;
+    int bits = 0;
+    bool ones = true;           // El código parcial son todos unos (prefijo de EOS)
+
+    for (size_t i = 0; i < len; i++) {
+        for (int b = 7; b >= 0; b--) {
+            uint32_t bit = (in[i] >> b) & 1;
+            code |= bit;
+            ones = ones && bit;
+            bits++;
+            uint32_t count = s_huff_count[bits];
+            if (code < first + count) {
+                if (n >= out_size) {
+                    return -1;
+                }
+                out[n++] = s_huff_sym[index + (code - first)];
+                code = first = index = 0;
+                bits = 0;
+                ones = true;
+                continue;
+            }
+            if (bits >= 30) {
+                return -1;      // EOS o código inexistente
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+    }
+
+    // El relleno final tiene menos de 8 bits y es prefijo de EOS
+    if (bits > 7 || !ones) {
+        return -1;
+    }
+    return (int)n;
+}
+
+static bool hpack_get_str(const uint8_t **p, const uint8_t *end, uint8_t *scratch, size_t scratch_size,
+                          size_t *used, const char **out, size_t *out_len)
+{
+    if (*p >= end) {
+        return false;
+    }
+    bool huffman = (**p & 0x80) != 0;
+    uint32_t len;
+    if (!hpack_get_int(p, end, 7, &len) || len > (size_t)(end - *p)) {
+        return false;
+    }
+    if (!huffman) {
+        *out = (const char *)*p;
+        *out_len = len;
+    } else {
+        int n = huff_decode(*p, len, scratch + *used, scratch_size - *used);
+        if (n < 0) {
+            return false;
+        }
+        *out = (const char *)scratch + *used;
+        *out_len = n;
+        *used += n;
+    }
+    *p += len;
+    return true;
+}
+
+static void on_header(h2_stream_t *s, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+    if (s == NULL || s->done) {
+        return;
+    }
+    supabase_h2_request_t *req = s->req;
+    if (name_len == 7 && memcmp(name, ":status", 7) == 0) {
+        int status = 0;
+        for (size_t i = 0; i < value_len && value[i] >= '0' && value[i] <= '9'; i++) {
+            status = status * 10 + (value[i] - '0');
+        }
+        // Las respuestas 1xx son informativas: sigue otro bloque con la final
+        if (status >= 200) {
+            req->status = status;
+            s->got_response = true;
+        }
+    } else if (name_len == 4 && memcmp(name, "etag", 4) == 0 && req->etag != NULL && req->etag_size > 0) {
+        size_t n = H2_MIN(value_len, req->etag_size - 1);
+        memcpy(req->etag, value, n);
+        req->etag[n] = '\0';
+    }
+}
+
+/**
+ * @brief Decodifica un bloque de headers completo
+ *
+ * Se decodifica aunque el stream ya no exista para mantener la tabla
+ * dinámica sincronizada con el servidor.
+ */
+static esp_err_t hpack_decode(const uint8_t *p, size_t len, h2_stream_t *s)
+{
+    const uint8_t *end = p + len;
+    // Huffman expande como mucho 8/5: alcanza para nombre y valor de un campo
+    size_t scratch_size = len * 2;
+    uint8_t *scratch = malloc(scratch_size + 1);
+    if (scratch == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = ESP_OK;
+    bool fields = false;
+    while (p < end && err == ESP_OK) {
+        const char *name = NULL;
+        const char *value = NULL;
+        size_t name_len = 0;
+        size_t value_len = 0;
+        size_t used = 0;
+        uint32_t index;
+        uint8_t b = *p;
+
+        if (b & 0x80) {
+            // Campo indexado
+            if (!hpack_get_int(&p, end, 7, &index) ||
+                !hpack_lookup(&s_h2.dec, index, &name, &name_len, &value, &value_len)) {
+                err = ESP_FAIL;
+                break;
+            }
+            on_header(s, name, name_len, value, value_len);
+        } else if ((b & 0xe0) == 0x20) {
+            // Cambio de tamaño de la tabla: solo antes del primer campo
+            if (fields || !hpack_get_int(&p, end, 5, &index) || index > H2_HPACK_TABLE_SIZE) {
+                err = ESP_FAIL;
+                break;
+            }
+            table_resize(&s_h2.dec, index);
+            continue;
+        } else {
+            // Literal: con indexado incremental (01), sin indexar (0000) o nunca indexado (0001)
+            bool incremental = (b & 0xc0) == 0x40;
+            const char *unused_value;
+            size_t unused_len;
+            if (!hpack_get_int(&p, end, incremental ? 6 : 4, &index)) {
+                err = ESP_FAIL;
+                break;
+            }
+            bool ok = index != 0 ?
+                      hpack_lookup(&s_h2.dec, index, &name, &name_len, &unused_value, &unused_len) :
+                      hpack_get_str(&p, end, scratch, scratch_size, &used, &name, &name_len);
+            if (!ok || !hpack_get_str(&p, end, scratch, scratch_size, &used, &value, &value_len)) {
+                err = ESP_FAIL;
+                break;
+            }
+            if (incremental) {
+                // Copiar antes de insertar: el nombre puede venir de una entrada que se desaloja
+                char *data = entry_copy(name, name_len, value, value_len);
+                if (data == NULL) {
+                    err = ESP_ERR_NO_MEM;
+                    break;
+                }
+                on_header(s, data, name_len, data + name_len, value_len);
+                table_add(&s_h2.dec, data, name_len, value_len);
+            } else {
+                on_header(s, name, name_len, value, value_len);
+            }
+        }
+        fields = true;
+    }
+
+    free(scratch);
+    return err;
+}
+
+static void hpack_put(hpack_writer_t *w, const void *data, size_t len)
+{
+    if (w->len + len > w->cap) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+static void hpack_put_int(hpack_writer_t *w, uint8_t first, int prefix, uint32_t value)
+{
+    uint8_t tmp[6];
+    size_t n = 0;
+    uint32_t max = (1u << prefix) - 1;
+    if (value < max) {
+        tmp[n++] = first | value;
+    } else {
+        tmp[n++] = first | max;
+        value -= max;
+        while (value >= 0x80) {
+            tmp[n++] = (value & 0x7f) | 0x80;
+            value >>= 7;
+        }
+        tmp[n++] = value;
+    }
+    hpack_put(w, tmp, n);
+}
+
+static void hpack_put_str(hpack_writer_t *w, const char *str, size_t len)
+{
+    hpack_put_int(w, 0x00, 7, len);
+    hpack_put(w, str, len);
+}
+
+/**
+ * @brief Codifica un campo
+ *
+ * Usa un índice si el par ya está en una tabla; si no, lo envía literal con
+ * el nombre indexado cuando se puede y, si index es true, lo agrega a la
+ * tabla dinámica para los próximos requests.
+ *
+ * @return Lo que ocuparía el campo como línea de HTTP/1.1
+ */
+static size_t hpack_encode_field(hpack_writer_t *w, const char *name, const char *value, bool index)
+{
+    size_t name_len = strlen(name);
+    size_t value_len = strlen(value);
+    uint32_t name_index = 0;
+
+    for (uint32_t i = 0; i < HPACK_STATIC_COUNT; i++) {
+        if (strcmp(s_static_table[i].name, name) != 0) {
+            continue;
+        }
+        if (strcmp(s_static_table[i].value, value) == 0) {
+            hpack_put_int(w, 0x80, 7, i + 1);
+            return name_len + value_len + 4;
+        }
+        if (name_index == 0) {
+            name_index = i + 1;
+        }
+    }
+
+    for (uint32_t k = 0; k < s_h2.enc.count; k++) {
+        hpack_entry_t *e = table_entry(&s_h2.enc, k);
+        if (e->name_len != name_len || memcmp(e->data, name, name_len) != 0) {
+            continue;
+        }
+        if (e->value_len == value_len && memcmp(e->data + name_len, value, value_len) == 0) {
+            hpack_put_int(w, 0x80, 7, HPACK_STATIC_COUNT + 1 + k);
+            return name_len + value_len + 4;
+        }
+        if (name_index == 0) {
+            name_index = HPACK_STATIC_COUNT + 1 + k;
+        }
+    }
+
+    char *data = NULL;
+    if (index && s_h2.enc.count < s_h2.enc.cap &&
+        name_len + value_len + 32 <= s_h2.enc.max_size) {
+        data = entry_copy(name, name_len, value, value_len);
+    }
+
+    if (data != NULL) {
+        // El índice del nombre se resuelve antes de insertar, igual que en el decoder
+        hpack_put_int(w, 0x40, 6, name_index);
+        table_add(&s_h2.enc, data, name_len, value_len);
+    } else {
+        hpack_put_int(w, 0x00, 4, name_index);
+    }
+    if (name_index == 0) {
+        hpack_put_str(w, name, name_len);
+    }
+    hpack_put_str(w, value, value_len);
+    return name_len + value_len + 4;
+}
+
+// ============================================================================
+// Frames
+// ============================================================================
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static esp_err_t h2_write(const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        int ret = esp_tls_conn_write(s_h2.tls, data, len);
+        if (ret > 0) {
+            data += ret;
+            len -= ret;
+        } else if (ret != ESP_TLS_ERR_SSL_WANT_READ && ret != ESP_TLS_ERR_SSL_WANT_WRITE) {
+            ESP_LOGW(TAG, "Error al escribir en conexión TLS: %d", ret);
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+static void frame_header(uint8_t *f, size_t len, uint8_t type, uint8_t flags, uint32_t stream_id)
+{
+    f[0] = len >> 16;
+    f[1] = len >> 8;
+    f[2] = len;
+    f[3] = type;
+    f[4] = flags;
+    put_u32(f + 5, stream_id);
+}
+
+/**
+ * @brief Envía un frame
+ * @param payload Payload (NULL si ya está en tx_buf + 9)
+ */
+static esp_err_t h2_send_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const void *payload, size_t len)
+{
+    uint8_t *f = s_h2.tx_buf;
+    if (payload != NULL) {
+        memcpy(f + 9, payload, len);
+    }
+    frame_header(f, len, type, flags, stream_id);
+    return h2_write(f, 9 + len);
+}
+
+static esp_err_t h2_send_u32(uint8_t type, uint32_t stream_id, uint32_t value)
+{
+    uint8_t payload[4];
+    put_u32(payload, value);
+    return h2_send_frame(type, 0, stream_id, payload, sizeof(payload));
+}
+
+/**
+ * @brief Devuelve la ventana de recepción consumida por un DATA
+ *
+ * Los dos WINDOW_UPDATE van en una sola escritura para no quedar separados
+ * por Nagle.
+ */
+static esp_err_t h2_send_window_update(uint32_t stream_id, uint32_t increment)
+{
+    uint8_t frames[26];
+    size_t len = 13;
+    frame_header(frames, 4, H2_WINDOW_UPDATE, 0, 0);
+    put_u32(frames + 9, increment);
+    if (stream_id != 0) {
+        frame_header(frames + 13, 4, H2_WINDOW_UPDATE, 0, stream_id);
+        put_u32(frames + 22, increment);
+        len = 26;
+    }
+    return h2_write(frames, len);
+}
+
+static h2_stream_t *stream_find(uint32_t id)
+{
+    for (int i = 0; i < SUPABASE_H2_MAX_STREAMS; i++) {
+        h2_stream_t *s = &s_h2.streams[i];
+        if (s->in_use && !s->done && s->id == id) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static void stream_finish(h2_stream_t *s, esp_err_t err)
+{
+    if (s == NULL || s->done) {
+        return;
+    }
+    s->done = true;
+    s->result = (err == ESP_OK && !s->got_response) ? ESP_FAIL : err;
+}
+
+/**
+ * @brief Cierra la conexión y termina los streams abiertos
+ *
+ * Un stream que no llegó a enviar END_STREAM no pudo ser procesado y
+ * termina con ESP_ERR_INVALID_STATE (se puede reintentar).
+ *
+ * @param goaway_code Error a anunciar con GOAWAY o H2_NO_GOAWAY
+ */
+static void conn_close(int goaway_code)
+{
+    if (s_h2.tls == NULL) {
+        return;
+    }
+    if (goaway_code != H2_NO_GOAWAY) {
+        uint8_t payload[8];
+        put_u32(payload, 0);            // No aceptamos streams del servidor
+        put_u32(payload + 4, goaway_code);
+        h2_send_frame(H2_GOAWAY, 0, 0, payload, sizeof(payload));
+    }
+
+    for (int i = 0; i < SUPABASE_H2_MAX_STREAMS; i++) {
+        h2_stream_t *s = &s_h2.streams[i];
+        if (s->in_use) {
+            stream_finish(s, s->sent_all ? ESP_FAIL : ESP_ERR_INVALID_STATE);
+        }
+    }
+
+    tls_manager_release(s_h2.tls);
+    s_h2.tls = NULL;
+    free(s_h2.mem);
+    s_h2.mem = s_h2.rx_buf = s_h2.tx_buf = s_h2.block = NULL;
+    table_clear(&s_h2.enc);
+    table_clear(&s_h2.dec);
+}
+
+static void conn_fail(uint32_t code, const char *reason)
+{
+    ESP_LOGW(TAG, "Error de protocolo (%s), cerrando conexión", reason);
+    conn_close(code);
+}
+
+static esp_err_t conn_open(const char *host, uint32_t timeout_ms)
+{
+    static const char *alpn_protos[] = { "h2", "http/1.1", NULL };
+    static const char preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+    esp_tls_t *tls = NULL;
+    esp_err_t err = supabase_dns_connect(host, H2_PORT, alpn_protos, timeout_ms, &tls);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error en conexión TLS: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    const char *proto = mbedtls_ssl_get_alpn_protocol(esp_tls_get_ssl_context(tls));
+    if (proto == NULL || strcmp(proto, "h2") != 0) {
+        ESP_LOGW(TAG, "El servidor no negoció h2 (%s), se usa HTTP/1.1", proto ? proto : "sin ALPN");
+        tls_manager_release(tls);
+        s_h2.unsupported = true;
+        portENTER_CRITICAL(&s_lock);
+        s_stats.not_negotiated++;
+        portEXIT_CRITICAL(&s_lock);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Los WINDOW_UPDATE y ACK chicos quedan sin respuesta del servidor: con
+    // Nagle, el request siguiente esperaría el ACK retardado de esos segmentos
+    int fd = -1;
+    int nodelay = 1;
+    if (esp_tls_get_conn_sockfd(tls, &fd) == ESP_OK && fd >= 0) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    }
+
+    s_h2.mem = malloc(H2_RX_CHUNK + 9 + H2_TX_FRAME_MAX + H2_HEADER_BLOCK_MAX);
+    if (s_h2.mem == NULL) {
+        tls_manager_release(tls);
+        return ESP_ERR_NO_MEM;
+    }
+    s_h2.rx_buf = s_h2.mem;
+    s_h2.tx_buf = s_h2.rx_buf + H2_RX_CHUNK;
+    s_h2.block = s_h2.tx_buf + 9 + H2_TX_FRAME_MAX;
+
+    s_h2.tls = tls;
+    strncpy(s_h2.host, host, sizeof(s_h2.host) - 1);
+    s_h2.host[sizeof(s_h2.host) - 1] = '\0';
+    s_h2.goaway = false;
+    s_h2.next_stream_id = 1;
+    s_h2.send_window = H2_WINDOW_DEFAULT;
+    s_h2.peer_initial_window = H2_WINDOW_DEFAULT;
+    s_h2.peer_max_frame = H2_FRAME_MAX;
+    s_h2.peer_max_streams = SUPABASE_H2_MAX_STREAMS;
+    s_h2.enc_size_update = -1;
+    s_h2.rx_hdr_got = 0;
+    s_h2.block_sid = 0;
+
+    // Prefacio del cliente y SETTINGS (sin server push)
+    uint8_t settings[6] = { 0, H2_SET_ENABLE_PUSH, 0, 0, 0, 0 };
+    err = h2_write((const uint8_t *)preface, sizeof(preface) - 1);
+    if (err == ESP_OK) {
+        err = h2_send_frame(H2_SETTINGS, 0, 0, settings, sizeof(settings));
+    }
+    if (err != ESP_OK) {
+        conn_close(H2_NO_GOAWAY);
+        return ESP_FAIL;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.connections++;
+    portEXIT_CRITICAL(&s_lock);
+    ESP_LOGI(TAG, "Conexión h2 abierta con %s", host);
+    return ESP_OK;
+}
+
+static void apply_setting(uint16_t id, uint32_t value)
+{
+    switch (id) {
+    case H2_SET_HEADER_TABLE_SIZE:
+        // Solo importa si achica la tabla que usa el encoder
+        if (value < s_h2.enc.max_size) {
+            table_resize(&s_h2.enc, value);
+            s_h2.enc_size_update = value;
+        }
+        break;
+    case H2_SET_MAX_CONCURRENT:
+        s_h2.peer_max_streams = value;
+        break;
+    case H2_SET_INITIAL_WINDOW:
+        // El cambio se aplica también a los streams abiertos (RFC 9113 6.9.2)
+        for (int i = 0; i < SUPABASE_H2_MAX_STREAMS; i++) {
+            if (s_h2.streams[i].in_use) {
+                s_h2.streams[i].send_window += (int32_t)value - s_h2.peer_initial_window;
+            }
+        }
+        s_h2.peer_initial_window = value;
+        break;
+    case H2_SET_MAX_FRAME_SIZE:
+        s_h2.peer_max_frame = value;
+        break;
+    default:
+        break;
+    }
+}
+
+static void headers_complete(void)
+{
+    h2_stream_t *s = stream_find(s_h2.block_sid);
+    esp_err_t err = hpack_decode(s_h2.block, s_h2.block_len, s);
+    s_h2.block_sid = 0;
+    if (err != ESP_OK) {
+        conn_fail(H2_COMPRESSION_ERROR, "bloque HPACK inválido");
+        return;
+    }
+    if (s_h2.block_end_stream) {
+        stream_finish(s, ESP_OK);
+    }
+}
+
+static bool frame_begin(void)
+{
+    // Un bloque de headers abierto solo puede seguir con CONTINUATION del mismo stream
+    if (s_h2.block_sid != 0 && (s_h2.rx_type != H2_CONTINUATION || s_h2.rx_sid != s_h2.block_sid)) {
+        conn_fail(H2_PROTOCOL_ERROR, "bloque de headers interrumpido");
+        return false;
+    }
+    if (s_h2.rx_type == H2_CONTINUATION && s_h2.block_sid == 0) {
+        conn_fail(H2_PROTOCOL_ERROR, "CONTINUATION inesperado");
+        return false;
+    }
+    if (s_h2.rx_len > H2_FRAME_MAX) {
+        conn_fail(H2_FRAME_SIZE_ERROR, "frame demasiado grande");
+        return false;
+    }
+    if (s_h2.rx_type == H2_HEADERS) {
+        s_h2.block_len = 0;
+        s_h2.block_fill = 0;
+        s_h2.block_overflow = false;
+    }
+    s_h2.rx_pad = 0;
+    return true;
+}
+
+static void frame_payload(const uint8_t *p, size_t n)
+{
+    size_t off = s_h2.rx_got;
+
+    switch (s_h2.rx_type) {
+    case H2_DATA: {
+        if ((s_h2.rx_flags & H2_FLAG_PADDED) && off == 0 && n > 0) {
+            s_h2.rx_pad = *p++;
+            n--;
+            off++;
+        }
+        h2_stream_t *s = stream_find(s_h2.rx_sid);
+        size_t data_end = s_h2.rx_len > s_h2.rx_pad ? s_h2.rx_len - s_h2.rx_pad : 0;
+        if (s == NULL || !s->got_response || off >= data_end) {
+            break;
+        }
+        supabase_h2_request_t *req = s->req;
+        size_t take = H2_MIN(n, data_end - off);
+        take = H2_MIN(take, req->resp_size - 1 - s->body_len);
+        memcpy(req->resp_body + s->body_len, p, take);
+        s->body_len += take;
+        req->resp_body[s->body_len] = '\0';
+        break;
+    }
+    case H2_HEADERS:
+    case H2_CONTINUATION:
+        if (s_h2.block_fill + n > H2_HEADER_BLOCK_MAX) {
+            s_h2.block_overflow = true;
+        } else {
+            memcpy(s_h2.block + s_h2.block_fill, p, n);
+            s_h2.block_fill += n;
+        }
+        break;
+    case H2_SETTINGS:
+        for (size_t i = 0; i < n; i++, off++) {
+            s_h2.rx_ctl[off % 6] = p[i];
+            if (off % 6 == 5 && !(s_h2.rx_flags & H2_FLAG_ACK)) {
+                apply_setting((s_h2.rx_ctl[0] << 8) | s_h2.rx_ctl[1], get_u32(s_h2.rx_ctl + 2));
+            }
+        }
+        break;
+    default:
+        if (off < sizeof(s_h2.rx_ctl)) {
+            memcpy(s_h2.rx_ctl + off, p, H2_MIN(n, sizeof(s_h2.rx_ctl) - off));
+        }
+        break;
+    }
+}
+
+static void frame_end(void)
+{
+    uint32_t sid = s_h2.rx_sid;
+    uint8_t flags = s_h2.rx_flags;
+    h2_stream_t *s = stream_find(sid);
+    esp_err_t err = ESP_OK;
+
+    switch (s_h2.rx_type) {
+    case H2_DATA:
+        if (sid == 0 || ((flags & H2_FLAG_PADDED) && s_h2.rx_pad >= s_h2.rx_len)) {
+            conn_fail(H2_PROTOCOL_ERROR, "DATA inválido");
+            return;
+        }
+        if (s_h2.rx_len > 0) {
+            err = h2_send_window_update((s != NULL && !(flags & H2_FLAG_END_STREAM)) ? sid : 0, s_h2.rx_len);
+        }
+        if (flags & H2_FLAG_END_STREAM) {
+            stream_finish(s, ESP_OK);
+        }
+        break;
+
+    case H2_HEADERS: {
+        size_t start = 0;
+        size_t pad = 0;
+        if (sid == 0 || s_h2.block_overflow) {
+            conn_fail(sid == 0 ? H2_PROTOCOL_ERROR : H2_COMPRESSION_ERROR, "HEADERS inválido");
+            return;
+        }
+        if (flags & H2_FLAG_PADDED) {
+            pad = s_h2.block_fill > 0 ? s_h2.block[0] : 0;
+            start = 1;
+        }
+        if (flags & H2_FLAG_PRIORITY) {
+            start += 5;
+        }
+        if (start + pad > s_h2.block_fill) {
+            conn_fail(H2_PROTOCOL_ERROR, "padding de HEADERS");
+            return;
+        }
+        s_h2.block_len = s_h2.block_fill - start - pad;
+        memmove(s_h2.block, s_h2.block + start, s_h2.block_len);
+        s_h2.block_fill = s_h2.block_len;
+        s_h2.block_sid = sid;
+        s_h2.block_end_stream = (flags & H2_FLAG_END_STREAM) != 0;
+        if (flags & H2_FLAG_END_HEADERS) {
+            headers_complete();
+        }
+        break;
+    }
+
+    case H2_CONTINUATION:
+        if (s_h2.block_overflow) {
+            conn_fail(H2_COMPRESSION_ERROR, "bloque de headers demasiado grande");
+            return;
+        }
+        s_h2.block_len = s_h2.block_fill;
+        if (flags & H2_FLAG_END_HEADERS) {
+            headers_complete();
+        }
+        break;
+
+    case H2_RST_STREAM:
+        if (s_h2.rx_len != 4) {
+            conn_fail(H2_FRAME_SIZE_ERROR, "RST_STREAM");
+            return;
+        }
+        if (s != NULL) {
+            uint32_t code = get_u32(s_h2.rx_ctl);
+            ESP_LOGW(TAG, "Stream %lu cancelado por el servidor (error %lu)",
+                     (unsigned long)sid, (unsigned long)code);
+            // REFUSED_STREAM garantiza que el request no se procesó
+            stream_finish(s, code == H2_REFUSED_STREAM ? ESP_ERR_INVALID_STATE : ESP_FAIL);
+        }
+        break;
+
+    case H2_SETTINGS:
+        if (flags & H2_FLAG_ACK) {
+            break;
+        }
+        if (sid != 0 || s_h2.rx_len % 6 != 0) {
+            conn_fail(H2_FRAME_SIZE_ERROR, "SETTINGS");
+            return;
+        }
+        err = h2_send_frame(H2_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+        break;
+
+    case H2_PING:
+        if (s_h2.rx_len != 8) {
+            conn_fail(H2_FRAME_SIZE_ERROR, "PING");
+            return;
+        }
+        if (!(flags & H2_FLAG_ACK)) {
+            err = h2_send_frame(H2_PING, H2_FLAG_ACK, 0, s_h2.rx_ctl, 8);
+        }
+        break;
+
+    case H2_GOAWAY: {
+        if (s_h2.rx_len < 8) {
+            conn_fail(H2_FRAME_SIZE_ERROR, "GOAWAY");
+            return;
+        }
+        uint32_t last_id = get_u32(s_h2.rx_ctl) & 0x7fffffff;
+        ESP_LOGI(TAG, "GOAWAY del servidor (último stream %lu, error %lu)",
+                 (unsigned long)last_id, (unsigned long)get_u32(s_h2.rx_ctl + 4));
+        s_h2.goaway = true;
+        portENTER_CRITICAL(&s_lock);
+        s_stats.goaways++;
+        portEXIT_CRITICAL(&s_lock);
+        // Los streams posteriores a last_id no se procesaron
+        for (int i = 0; i < SUPABASE_H2_MAX_STREAMS; i++) {
+            if (s_h2.streams[i].in_use && s_h2.streams[i].id > last_id) {
+                stream_finish(&s_h2.streams[i], ESP_ERR_INVALID_STATE);
+            }
+        }
+        break;
+    }
+
+    case H2_WINDOW_UPDATE: {
+        if (s_h2.rx_len != 4) {
+            conn_fail(H2_FRAME_SIZE_ERROR, "WINDOW_UPDATE");
+            return;
+        }
+        int32_t increment = get_u32(s_h2.rx_ctl) & 0x7fffffff;
+        if (sid == 0) {
+            if (s_h2.send_window > INT32_MAX - increment) {
+                conn_fail(H2_FLOW_CONTROL_ERROR, "ventana de conexión");
+                return;
+            }
+            s_h2.send_window += increment;
+        } else if (s != NULL) {
+            s->send_window += increment;
+        }
+        break;
+    }
+
+    case H2_PUSH_PROMISE:
+        // SETTINGS_ENABLE_PUSH = 0
+        conn_fail(H2_PROTOCOL_ERROR, "PUSH_PROMISE");
+        return;
+
+    default:
+        // PRIORITY y tipos desconocidos se ignoran
+        break;
+    }
+
+    if (err != ESP_OK) {
+        conn_close(H2_NO_GOAWAY);
+    }
+}
+
+/**
+ * @brief Procesa bytes recibidos
+ */
+static void rx_feed(const uint8_t *p, size_t n)
+{
+    // Si un frame cierra la conexión, rx_buf (de donde viene p) se libera
+    while (n > 0 && s_h2.tls != NULL) {
+        if (s_h2.rx_hdr_got < 9) {
+            size_t take = H2_MIN(n, (size_t)(9 - s_h2.rx_hdr_got));
+            memcpy(s_h2.rx_hdr + s_h2.rx_hdr_got, p, take);
+            s_h2.rx_hdr_got += take;
+            p += take;
+            n -= take;
+            if (s_h2.rx_hdr_got < 9) {
+                return;
+            }
+            s_h2.rx_len = ((uint32_t)s_h2.rx_hdr[0] << 16) | (s_h2.rx_hdr[1] << 8) | s_h2.rx_hdr[2];
+            s_h2.rx_type = s_h2.rx_hdr[3];
+            s_h2.rx_flags = s_h2.rx_hdr[4];
+            s_h2.rx_sid = get_u32(s_h2.rx_hdr + 5) & 0x7fffffff;
+            s_h2.rx_got = 0;
+            if (!frame_begin()) {
+                return;
+            }
+            if (s_h2.rx_len == 0) {
+                s_h2.rx_hdr_got = 0;
+                frame_end();
+            }
+            continue;
+        }
+
+        size_t take = H2_MIN(n, s_h2.rx_len - s_h2.rx_got);
+        frame_payload(p, take);
+        s_h2.rx_got += take;
+        p += take;
+        n -= take;
+        if (s_h2.rx_got == s_h2.rx_len) {
+            s_h2.rx_hdr_got = 0;
+            frame_end();
+        }
+    }
+}
+
+/**
+ * @brief Lee y procesa lo que llegue en hasta wait_ms
+ * @note Llamar con s_io tomado
+ */
+static void pump(uint32_t wait_ms)
+{
+    if (s_h2.tls == NULL) {
+        return;
+    }
+
+    // mbedTLS puede tener datos ya descifrados que select() no ve
+    if (esp_tls_get_bytes_avail(s_h2.tls) <= 0) {
+        int fd = -1;
+        if (esp_tls_get_conn_sockfd(s_h2.tls, &fd) != ESP_OK || fd < 0) {
+            conn_close(H2_NO_GOAWAY);
+            return;
+        }
+        int ready = 0;
+        do {
+            uint32_t slice = H2_MIN(wait_ms, (uint32_t)H2_POLL_SLICE_MS);
+            fd_set rfds;
+            FD_ZERO(&rfds);
+            FD_SET(fd, &rfds);
+            struct timeval tv = {
+                .tv_sec = 0,
+                .tv_usec = slice * 1000,
+            };
+            ready = select(fd + 1, &rfds, NULL, NULL, &tv);
+            wait_ms -= slice;
+        } while (ready == 0 && wait_ms > 0 && s_senders == 0);
+        if (ready <= 0) {
+            return;
+        }
+    }
+
+    do {
+        int ret = esp_tls_conn_read(s_h2.tls, s_h2.rx_buf, H2_RX_CHUNK);
+        if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+            return;
+        }
+        if (ret <= 0) {
+            ESP_LOGW(TAG, "Conexión cerrada por el servidor (%d)", ret);
+            conn_close(H2_NO_GOAWAY);
+            return;
+        }
+        rx_feed(s_h2.rx_buf, ret);
+    } while (s_h2.tls != NULL && esp_tls_get_bytes_avail(s_h2.tls) > 0);
+}
+
+// ============================================================================
+// Streams
+// ============================================================================
+
+static h2_stream_t *stream_open(supabase_h2_request_t *req)
+{
+    uint32_t limit = H2_MIN((uint32_t)SUPABASE_H2_MAX_STREAMS, s_h2.peer_max_streams);
+    if (s_h2.active >= limit) {
+        return NULL;
+    }
+    if (s_h2.next_stream_id > 0x7fffffff) {
+        s_h2.goaway = true;     // Sin ids: la próxima conexión empieza de nuevo
+        return NULL;
+    }
+
+    for (int i = 0; i < SUPABASE_H2_MAX_STREAMS; i++) {
+        h2_stream_t *s = &s_h2.streams[i];
+        if (s->in_use) {
+            continue;
+        }
+        memset(s, 0, sizeof(*s));
+        s->in_use = true;
+        s->id = s_h2.next_stream_id;
+        s->req = req;
+        s->send_window = s_h2.peer_initial_window;
+        s_h2.next_stream_id += 2;
+        s_h2.active++;
+        portENTER_CRITICAL(&s_lock);
+        if (s_h2.active > s_stats.streams_peak) {
+            s_stats.streams_peak = s_h2.active;
+        }
+        portEXIT_CRITICAL(&s_lock);
+        return s;
+    }
+    return NULL;
+}
+
+static void stream_free(h2_stream_t *s)
+{
+    s->in_use = false;
+    s_h2.active--;
+    if (s_h2.active == 0 && s_h2.tls != NULL) {
+        esp_timer_stop(s_idle_timer);
+        s_idle_due = false;
+        esp_timer_start_once(s_idle_timer, (uint64_t)SUPABASE_H2_IDLE_MS * 1000);
+    }
+}
+
+/**
+ * @brief Envía lo que permita la ventana del body pendiente
+ */
+static esp_err_t stream_send_data(h2_stream_t *s)
+{
+    supabase_h2_request_t *req = s->req;
+    while (!s->sent_all) {
+        int32_t window = H2_MIN(s_h2.send_window, s->send_window);
+        if (window <= 0) {
+            return ESP_OK;      // Se sigue al llegar WINDOW_UPDATE
+        }
+        size_t chunk = H2_MIN(req->body_len - s->tx_sent, (size_t)H2_TX_FRAME_MAX);
+        chunk = H2_MIN(chunk, (size_t)s_h2.peer_max_frame);
+        chunk = H2_MIN(chunk, (size_t)window);
+        bool last = s->tx_sent + chunk == req->body_len;
+        esp_err_t err = h2_send_frame(H2_DATA, last ? H2_FLAG_END_STREAM : 0, s->id,
+                                      req->body + s->tx_sent, chunk);
+        if (err != ESP_OK) {
+            return err;
+        }
+        s->tx_sent += chunk;
+        s_h2.send_window -= chunk;
+        s->send_window -= chunk;
+        s->sent_all = last;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t stream_send_headers(h2_stream_t *s, const char *host)
+{
+    supabase_h2_request_t *req = s->req;
+    hpack_writer_t w = {
+        .buf = s_h2.tx_buf + 9,
+        .cap = H2_TX_FRAME_MAX,
+    };
+    size_t plain = 0;
+
+    if (s_h2.enc_size_update >= 0) {
+        hpack_put_int(&w, 0x20, 5, s_h2.enc_size_update);
+        s_h2.enc_size_update = -1;
+    }
+
+    plain += hpack_encode_field(&w, ":method", req->method, false);
+    plain += hpack_encode_field(&w, ":scheme", "https", false);
+    plain += hpack_encode_field(&w, ":authority", host, true);
+    // Los paths con query (REST) cambian en cada request: no ocupar la tabla
+    plain += hpack_encode_field(&w, ":path", req->path, strchr(req->path, '?') == NULL);
+    for (size_t i = 0; i < req->header_count; i++) {
+        plain += hpack_encode_field(&w, req->headers[i].name, req->headers[i].value, req->headers[i].index);
+    }
+    if (req->body_len > 0) {
+        char length[12];
+        snprintf(length, sizeof(length), "%u", (unsigned)req->body_len);
+        plain += hpack_encode_field(&w, "content-length", length, false);
+    }
+
+    if (w.overflow) {
+        // La tabla del encoder ya cambió: la conexión no se puede seguir usando
+        ESP_LOGE(TAG, "Headers demasiado grandes para un frame");
+        conn_close(H2_COMPRESSION_ERROR);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.header_bytes_plain += plain;
+    s_stats.header_bytes_hpack += w.len;
+    portEXIT_CRITICAL(&s_lock);
+    ESP_LOGD(TAG, "Stream %lu: %s %s, headers %u -> %u bytes", (unsigned long)s->id,
+             req->method, req->path, (unsigned)plain, (unsigned)w.len);
+
+    // Un body chico va en la misma escritura que los HEADERS: separados, Nagle
+    // retiene el DATA hasta el ACK del primer segmento
+    uint8_t *f = s_h2.tx_buf;
+    size_t len = 9 + w.len;
+    bool inline_body = req->body_len > 0 && len + 9 + req->body_len <= 9 + H2_TX_FRAME_MAX &&
+                       (int32_t)req->body_len <= H2_MIN(s_h2.send_window, s->send_window);
+    s->sent_all = req->body_len == 0 || inline_body;
+    frame_header(f, w.len, H2_HEADERS, H2_FLAG_END_HEADERS | (req->body_len == 0 ? H2_FLAG_END_STREAM : 0), s->id);
+    if (inline_body) {
+        frame_header(f + len, req->body_len, H2_DATA, H2_FLAG_END_STREAM, s->id);
+        memcpy(f + len + 9, req->body, req->body_len);
+        len += 9 + req->body_len;
+        s->tx_sent = req->body_len;
+        s_h2.send_window -= req->body_len;
+        s->send_window -= req->body_len;
+    }
+    esp_err_t err = h2_write(f, len);
+    if (err == ESP_OK) {
+        err = stream_send_data(s);
+    }
+    if (err != ESP_OK) {
+        conn_close(H2_NO_GOAWAY);
+    }
+    return err;
+}
+
+static bool io_take(int64_t deadline_us)
+{
+    int64_t left_us = deadline_us - esp_timer_get_time();
+    if (left_us <= 0) {
+        return false;
+    }
+    return xSemaphoreTake(s_io, pdMS_TO_TICKS(left_us / 1000) + 1) == pdTRUE;
+}
+
+/**
+ * @brief Un intento de request
+ * @return ESP_ERR_INVALID_STATE si el servidor no lo procesó (se puede reintentar)
+ */
+static esp_err_t run_stream(const char *host, supabase_h2_request_t *req, int64_t deadline_us)
+{
+    h2_stream_t *s = NULL;
+    esp_err_t err;
+
+    req->reused = true;
+
+    // Conseguir una conexión y un stream libre
+    while (s == NULL) {
+        portENTER_CRITICAL(&s_lock);
+        s_senders++;
+        portEXIT_CRITICAL(&s_lock);
+        bool taken = io_take(deadline_us);
+        portENTER_CRITICAL(&s_lock);
+        s_senders--;
+        portEXIT_CRITICAL(&s_lock);
+        if (!taken) {
+            return ESP_ERR_TIMEOUT;
+        }
+        if (s_h2.unsupported) {
+            xSemaphoreGive(s_io);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        if (s_h2.tls != NULL && s_h2.active == 0) {
+            pump(0);            // GOAWAY o cierre recibidos mientras estaba inactiva
+        }
+        bool usable = s_h2.tls != NULL && !s_h2.goaway && strcmp(s_h2.host, host) == 0;
+        if (!usable && s_h2.active == 0) {
+            conn_close(H2_NO_ERROR);
+            int64_t left_ms = (deadline_us - esp_timer_get_time()) / 1000;
+            err = conn_open(host, left_ms > 0 ? left_ms : 1);
+            if (err != ESP_OK) {
+                xSemaphoreGive(s_io);
+                return err;
+            }
+            req->reused = false;
+            usable = true;
+        }
+        if (usable) {
+            s = stream_open(req);
+        }
+        if (s == NULL) {
+            // Sin lugar: avanzar los streams de los demás mientras tanto
+            pump(H2_POLL_MS);
+            xSemaphoreGive(s_io);
+            vTaskDelay(1);
+        }
+    }
+
+    err = stream_send_headers(s, host);
+    if (err == ESP_ERR_INVALID_SIZE) {
+        s->result = err;
+    }
+    xSemaphoreGive(s_io);
+
+    // Esperar la respuesta leyendo la conexión (también para los otros streams)
+    while (true) {
+        xSemaphoreTake(s_io, portMAX_DELAY);
+        if (!s->done) {
+            if (esp_timer_get_time() >= deadline_us) {
+                if (s_h2.tls != NULL) {
+                    h2_send_u32(H2_RST_STREAM, s->id, H2_CANCEL);
+                }
+                s->done = true;
+                s->result = ESP_ERR_TIMEOUT;
+            } else if (!s->sent_all && stream_send_data(s) != ESP_OK) {
+                conn_close(H2_NO_GOAWAY);
+            } else {
+                pump(H2_POLL_MS);
+            }
+        }
+        if (s->done) {
+            break;
+        }
+        xSemaphoreGive(s_io);
+        vTaskDelay(1);
+    }
+
+    // Respuesta anticipada con el body sin terminar de enviar
+    if (!s->sent_all && s_h2.tls != NULL && s->result == ESP_OK) {
+        h2_send_u32(H2_RST_STREAM, s->id, H2_CANCEL);
+    }
+    err = s->result;
+    stream_free(s);
+    xSemaphoreGive(s_io);
+    return err;
+}
+
+static void idle_timer_cb(void *arg)
+{
+    // Escribir el GOAWAY y cerrar TLS bloquearía a los demás timers
+    s_idle_due = true;
+    if (s_idle_notify != NULL) {
+        s_idle_notify();
+    }
+}
+
+// ============================================================================
+// API Pública
+// ============================================================================
+
+esp_err_t supabase_h2_init(supabase_h2_idle_notify_t idle_notify)
+{
+    if (s_io != NULL) {
+        return ESP_OK;
+    }
+    s_idle_notify = idle_notify;
+
+    s_io = xSemaphoreCreateMutex();
+    if (s_io == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = idle_timer_cb,
+        .name = "h2_idle",
+    };
+    if (esp_timer_create(&timer_args, &s_idle_timer) != ESP_OK) {
+        vSemaphoreDelete(s_io);
+        s_io = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t supabase_h2_request(const char *host, supabase_h2_request_t *req, uint32_t timeout_ms)
+{
+    if (s_io == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (host == NULL || req == NULL || req->method == NULL || req->path == NULL ||
+        req->resp_body == NULL || req->resp_size == 0 || (req->body_len > 0 && req->body == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    for (int attempt = 0; attempt < 2 && err == ESP_ERR_INVALID_STATE; attempt++) {
+        if (attempt > 0) {
+            ESP_LOGW(TAG, "El servidor no procesó el stream, reintentando");
+            portENTER_CRITICAL(&s_lock);
+            s_stats.retries++;
+            portEXIT_CRITICAL(&s_lock);
+        }
+        req->status = 0;
+        req->resp_body[0] = '\0';
+        if (req->etag != NULL && req->etag_size > 0) {
+            req->etag[0] = '\0';
+        }
+        err = run_stream(host, req, deadline_us);
+    }
+    if (err == ESP_ERR_INVALID_STATE) {
+        err = ESP_FAIL;
+    }
+
+    if (err != ESP_ERR_NOT_SUPPORTED) {
+        portENTER_CRITICAL(&s_lock);
+        if (err == ESP_OK) {
+            s_stats.requests++;
+        } else {
+            s_stats.failures++;
+        }
+        portEXIT_CRITICAL(&s_lock);
+    }
+    return err;
+}
+
+esp_err_t supabase_h2_set_warm(const char *host, bool warm, uint32_t timeout_ms)
+{
+    if (s_io == NULL || host == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    if (!io_take(deadline_us)) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    esp_err_t err = ESP_OK;
+    s_keep_open = warm;
+    if (!warm) {
+        if (s_h2.tls != NULL && s_h2.active == 0) {
+            ESP_LOGI(TAG, "Cerrando conexión h2 inactiva");
+            conn_close(H2_NO_ERROR);
+        }
+    } else if (s_h2.unsupported) {
+        err = ESP_ERR_NOT_SUPPORTED;
+    } else if (s_h2.active == 0) {
+        if (s_h2.tls != NULL) {
+            pump(0);            // PING, GOAWAY o cierre recibidos mientras estaba inactiva
+        }
+        if (s_h2.tls == NULL || s_h2.goaway || strcmp(s_h2.host, host) != 0) {
+            conn_close(H2_NO_ERROR);
+            err = conn_open(host, timeout_ms);
+        }
+    }
+    xSemaphoreGive(s_io);
+    return err;
+}
+
+void supabase_h2_close_idle(void)
+{
+    if (s_io == NULL || !s_idle_due) {
+        return;
+    }
+    // Si alguien tiene s_io hay actividad; el timer se rearma al liberar el stream
+    if (xSemaphoreTake(s_io, 0) != pdTRUE) {
+        return;
+    }
+    s_idle_due = false;
+    if (s_h2.tls != NULL && s_h2.active == 0 && !s_keep_open) {
+        ESP_LOGI(TAG, "Conexión h2 inactiva, cerrando");
+        conn_close(H2_NO_ERROR);
+    }
+    xSemaphoreGive(s_io);
+}
+
+void supabase_h2_close(void)
+{
+    if (s_io == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_io, portMAX_DELAY);
+    conn_close(H2_NO_ERROR);
+    s_h2.unsupported = false;
+    xSemaphoreGive(s_io);
+}
+
+esp_err_t supabase_h2_get_stats(supabase_h2_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
@@ -0,0 +1,232 @@
+/**
+ * @file tls_manager.h
+ * @brief Gestor compartido de sesiones TLS por host
+ *
+ * Cada sesión TLS (contexto mbedTLS, buffers de registro y cadena de
+ * certificados) cuesta decenas de KB de heap. Este componente es el único
+ * punto donde se abren las sesiones HTTPS del Gateway y donde se registran
+ * las que mantienen otros transportes (el WebSocket de Realtime), de modo que:
+ *
+ * - La configuración de confianza (bundle de CAs, common name) es una sola
+ *   y la comparten todos los clientes.
+ * - Hay un tope de sesiones simultáneas y un mínimo de heap libre para abrir
+ *   una nueva: un lease espera a que se libere otro en lugar de abrir un
+ *   contexto más cuando la memoria no alcanza.
+ * - Se mide el heap usado por las sesiones, en particular el pico durante
+ *   una ráfaga de envíos (por ejemplo, los eventos de una alarma).
+ * - Un host puede verificarse contra un conjunto chico de CAs fijadas
+ *   (pins) en lugar del bundle completo; el bundle queda solo como respaldo
+ *   si la cadena del servidor no termina en ninguno de los pins.
+ */
+
+#ifndef TLS_MANAGER_H
+#define TLS_MANAGER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_tls.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ============================================================================
+// Configuración
+// ============================================================================
+
+#define TLS_MANAGER_MAX_HOSTS           4       // Hosts distintos registrados
+#define TLS_MANAGER_MAX_SESSIONS        2       // Sesiones simultáneas (leases + externas)
+#define TLS_MANAGER_MIN_FREE_HEAP       (40 * 1024)  // Heap interno libre para abrir otra sesión
+#define TLS_MANAGER_BURST_GAP_MS        5000    // Inactividad que cierra una ráfaga
+#define TLS_MANAGER_PIN_RETRY_MS        (6 * 60 * 60 * 1000)  // Tras fallar los pins, volver a probarlos
+
+// ============================================================================
+// Tipos
+// ============================================================================
+
+/**
+ * @brief Configuración de confianza compartida para un host
+ *
+ * Los campos coinciden con los de esp_tls_cfg_t y
+ * esp_websocket_client_config_t.
+ */
+typedef struct {
+    esp_err_t (*crt_bundle_attach)(void *conf);  /**< Bundle de CAs (NULL si se usa cert_pem) */
+    const char *cert_pem;                        /**< CA en PEM/DER (NULL = bundle) */
+    size_t cert_len;                             /**< Largo de cert_pem (0 si PEM terminado en NUL) */
+    const char *common_name;                     /**< Nombre a verificar en el certificado */
+} tls_manager_trust_t;
+
+/**
+ * @brief Estadísticas de una ráfaga de sesiones
+ *
+ * Una ráfaga empieza con el primer lease tras TLS_MANAGER_BURST_GAP_MS sin
+ * actividad y termina cuando pasa ese tiempo sin leases.
+ */
+typedef struct {
+    uint32_t leases;                /**< Leases otorgados durante la ráfaga */
+    uint32_t duration_ms;           /**< Del primer lease al último release */
+    uint8_t  sessions_peak;         /**< Máximo de sesiones simultáneas (incluye externas) */
+    size_t   heap_free_start;       /**< Heap interno libre al comenzar */
+    size_t   heap_free_min;         /**< Mínimo heap interno libre observado */
+    size_t   heap_peak_used;        /**< heap_free_start - heap_free_min */
+} tls_manager_burst_t;
+
+/**
+ * @brief Estadísticas del gestor
+ */
+typedef struct {
+    uint32_t leases;                /**< Sesiones abiertas por tls_manager_acquire() */
+    uint32_t handshake_failures;    /**< Conexiones o handshakes fallidos */
+    uint32_t admission_waits;       /**< Leases que tuvieron que esperar lugar o heap */
+    uint32_t admission_timeouts;    /**< Leases rechazados por no conseguir lugar a tiempo */
+    uint32_t external_sessions;     /**< Sesiones registradas por otros transportes */
+    uint32_t handshake_avg_ms;      /**< Duración promedio de conexión + handshake */
+    uint32_t handshake_max_ms;      /**< Duración máxima de conexión + handshake */
+    uint8_t  sessions_active;       /**< Sesiones abiertas ahora */
+    uint8_t  sessions_peak;         /**< Máximo de sesiones simultáneas */
+    size_t   session_heap_last;     /**< Heap tomado por el último handshake */
+    size_t   session_heap_max;      /**< Máximo heap tomado por un handshake */
+    size_t   heap_free_min;         /**< Mínimo heap interno libre observado con sesiones abiertas */
+    uint32_t pinned_handshakes;     /**< Leases verificados con los pins */
+    uint32_t bundle_handshakes;     /**< Leases verificados con el bundle de CAs */
+    uint32_t pin_failures;          /**< Cadenas que no terminaron en los pins (pasaron al bundle) */
+    uint32_t pinned_avg_ms;         /**< Conexión + handshake promedio verificando con los pins */
+    uint32_t bundle_avg_ms;         /**< Conexión + handshake promedio verificando con el bundle */
+    uint8_t  pins_certs;            /**< Certificados en los pins */
+    size_t   pins_bytes;            /**< Flash ocupada por los pins */
+    size_t   bundle_bytes;          /**< Flash ocupada por el bundle de CAs (0 si no está habilitado) */
+    uint32_t bursts;                /**< Ráfagas terminadas */
+    tls_manager_burst_t last_burst; /**< Última ráfaga terminada */
+    tls_manager_burst_t worst_burst;/**< Ráfaga con mayor heap_peak_used */
+} tls_manager_stats_t;
+
+// ============================================================================
+// API Pública
+// ============================================================================
+
+/**
+ * @brief Inicializa el gestor (idempotente)
+ *
+ * @return ESP_OK si exitoso, ESP_ERR_NO_MEM si no se pudieron crear los recursos
+ */
+esp_err_t tls_manager_init(void);
+
+/**
+ * @brief Verifica un host contra CAs fijadas en lugar del bundle completo
+ *
+ * Hay un solo conjunto de pins; llamar de nuevo con otro host lo aplica
+ * también a ese host. Si la cadena de un servidor no termina en ninguno de
+ * los pins, la conexión se repite con el bundle y los pins no se usan
+ * durante TLS_MANAGER_PIN_RETRY_MS.
+ *
+ * @param host Host a verificar con los pins
+ * @param pem Certificados en PEM terminados en NUL (deben seguir válidos, ej: en flash)
+ * @param pem_len Largo de pem incluido el NUL
+ * @return ESP_OK, ESP_ERR_INVALID_ARG si los pins no se pueden leer
+ * @return ESP_ERR_INVALID_STATE si ya hay otro conjunto de pins
+ * @return ESP_ERR_NO_MEM si la tabla de hosts está llena
+ */
+esp_err_t tls_manager_set_pins(const char *host, const char *pem, size_t pem_len);
+
+/**
+ * @brief Informa una verificación fallida de una sesión externa
+ *
+ * La sesión externa recibe en tls_manager_get_trust() una función que elige
+ * pins o bundle en cada conexión; con esto la próxima conexión usa el
+ * bundle si la cadena no terminó en los pins.
+ *
+ * @param host Host de la sesión
+ * @param verify_flags Flags de verificación de esp_tls (0 no hace nada)
+ */
+void tls_manager_note_verify_failure(const char *host, int verify_flags);
+
+/**
+ * @brief Obtiene la configuración de confianza de un host
+ *
+ * Para transportes que abren su propia sesión (esp_websocket_client), de
+ * modo que validen el servidor igual que los leases. Para un host con pins,
+ * crt_bundle_attach elige pins o bundle en cada conexión y solo lo puede
+ * usar una sesión a la vez.
+ *
+ * @param host Nombre del host
+ * @param[out] trust Configuración a usar
+ * @return ESP_OK, ESP_ERR_INVALID_ARG si algún parámetro es NULL
+ */
+esp_err_t tls_manager_get_trust(const char *host, tls_manager_trust_t *trust);
+
+/**
+ * @brief Abre una sesión TLS con la configuración compartida
+ *
+ * Espera hasta timeout_ms a que haya lugar (menos de
+ * TLS_MANAGER_MAX_SESSIONS sesiones) y heap suficiente
+ * (TLS_MANAGER_MIN_FREE_HEAP). Si no hay otra sesión abierta se intenta
+ * igual, para no bloquear por un heap fragmentado por otra causa.
+ *
+ * @param host Host al que conectar
+ * @param port Puerto
+ * @param alpn_protos Lista ALPN terminada en NULL (NULL = sin ALPN)
+ * @param timeout_ms Espera máxima por lugar y timeout de conexión
+ * @param[out] tls Sesión abierta; devolver con tls_manager_release()
+ * @return ESP_OK si se conectó
+ * @return ESP_ERR_TIMEOUT si no hubo lugar a tiempo
+ * @return ESP_FAIL si falló la conexión o el handshake
+ */
+esp_err_t tls_manager_acquire(const char *host, uint16_t port, const char **alpn_protos,
+                              uint32_t timeout_ms, esp_tls_t **tls);
+
+/**
+ * @brief Igual que tls_manager_acquire(), pero conectando a una IP ya resuelta
+ *
+ * El SNI y la verificación del certificado usan host; addr solo evita la
+ * resolución DNS dentro de esp_tls (ver la caché de supabase_client).
+ *
+ * @param host Host del servidor
+ * @param addr IP a la que conectar (NULL = resolver host)
+ * @param port Puerto
+ * @param alpn_protos Lista ALPN terminada en NULL (NULL = sin ALPN)
+ * @param timeout_ms Espera máxima por lugar y timeout de conexión
+ * @param[out] tls Sesión abierta; devolver con tls_manager_release()
+ * @return Los mismos códigos que tls_manager_acquire()
+ */
+esp_err_t tls_manager_acquire_at(const char *host, const char *addr, uint16_t port,
+                                 const char **alpn_protos, uint32_t timeout_ms, esp_tls_t **tls);
+
+/**
+ * @brief Cierra una sesión obtenida con tls_manager_acquire()
+ *
+ * @param tls Sesión (NULL no hace nada)
+ */
+void tls_manager_release(esp_tls_t *tls);
+
+/**
+ * @brief Registra la apertura o cierre de una sesión propia de otro transporte
+ *
+ * La sesión cuenta para el tope y las estadísticas aunque no la abra el
+ * gestor. Cada apertura debe tener su cierre.
+ *
+ * @param host Host de la sesión
+ * @param open true al conectar, false al desconectar
+ */
+void tls_manager_note_external(const char *host, bool open);
+
+/**
+ * @brief Obtiene las estadísticas
+ *
+ * @param stats Estructura donde se copiarán las estadísticas
+ * @return ESP_OK, ESP_ERR_INVALID_ARG si stats es NULL
+ */
+esp_err_t tls_manager_get_stats(tls_manager_stats_t *stats);
+
+/**
+ * @brief Imprime las estadísticas (para debug)
+ */
+void tls_manager_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TLS_MANAGER_H
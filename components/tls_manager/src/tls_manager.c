@@ -0,0 +1,701 @@
+/**
+ * @file tls_manager.c
+ * @brief Implementación del gestor compartido de sesiones TLS
+ *
+ * Las sesiones abiertas con tls_manager_acquire() se registran en una tabla
+ * de leases (una por sesión viva) para poder cerrarlas y contabilizarlas en
+ * tls_manager_release(). Las sesiones externas solo suman al contador del
+ * host.
+ *
+ * El heap de una sesión se mide como la diferencia de heap interno libre
+ * antes y después del handshake; el pico de una ráfaga combina esas
+ * muestras con el mínimo histórico del heap, que solo baja si el pico
+ * ocurrió durante la ráfaga (por ejemplo, a mitad de un handshake).
+ *
+ * Los pins se pasan a esp_tls como cacert de cada conexión en lugar de
+ * parsearlos una vez: con CONFIG_MBEDTLS_DYNAMIC_FREE_CA_CERT mbedTLS libera
+ * la cadena de CAs al terminar la verificación, así que no puede
+ * compartirse, y a cambio no ocupa heap entre handshakes.
+ */
+
+#include "tls_manager.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_crt_bundle.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char *TAG = "TLS_MGR";
+
+// ============================================================================
+// Configuración
+// ============================================================================
+
+#define TLS_MANAGER_HOST_LEN        64
+#define TLS_MANAGER_WAIT_STEP_MS    100     // Re-evaluación de la admisión mientras se espera
+
+// ============================================================================
+// Estado interno
+// ============================================================================
+
+typedef struct {
+    char name[TLS_MANAGER_HOST_LEN];
+    uint8_t active;                 // Sesiones abiertas (leases + externas)
+    uint8_t external;               // Sesiones externas abiertas
+    bool pinned;                    // Verificar con los pins
+} tls_host_t;
+
+typedef struct {
+    esp_tls_t *tls;
+    int host;
+} tls_lease_t;
+
+static SemaphoreHandle_t s_mutex = NULL;
+static SemaphoreHandle_t s_released = NULL;
+static esp_timer_handle_t s_burst_timer = NULL;
+static bool s_initialized = false;
+
+static tls_host_t s_hosts[TLS_MANAGER_MAX_HOSTS];
+static tls_lease_t s_leases[TLS_MANAGER_MAX_SESSIONS];
+static uint8_t s_sessions = 0;
+
+static bool s_burst_active = false;
+static int64_t s_burst_start_us = 0;
+static int64_t s_burst_last_us = 0;
+static size_t s_burst_min_ever = 0;
+static tls_manager_burst_t s_burst = {0};
+
+static uint64_t s_handshake_total_ms = 0;
+static tls_manager_stats_t s_stats = {0};
+
+// Pins: un solo conjunto para los hosts con pinned = true
+static const char *s_pins = NULL;
+static size_t s_pins_len = 0;
+static bool s_pins_failed = false;
+static int64_t s_pins_failed_us = 0;
+static mbedtls_x509_crt s_ext_pins;         // Cadena de la sesión externa (ver attach_auto)
+static uint64_t s_pinned_total_ms = 0;
+static uint64_t s_bundle_total_ms = 0;
+
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+extern const uint8_t s_bundle_start[] asm("_binary_x509_crt_bundle_start");
+extern const uint8_t s_bundle_end[] asm("_binary_x509_crt_bundle_end");
+#endif
+
+// ============================================================================
+// Funciones privadas
+// ============================================================================
+
+static inline size_t heap_free(void)
+{
+    return heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+}
+
+/**
+ * @brief Busca (o registra) un host
+ * @note Llamar con s_mutex tomado
+ * @return Índice o -1 si la tabla está llena
+ */
+static int host_slot(const char *host)
+{
+    int free_slot = -1;
+    for (int i = 0; i < TLS_MANAGER_MAX_HOSTS; i++) {
+        if (s_hosts[i].name[0] == '\0') {
+            if (free_slot < 0) {
+                free_slot = i;
+            }
+        } else if (strcmp(s_hosts[i].name, host) == 0) {
+            return i;
+        }
+    }
+    if (free_slot >= 0) {
+        strncpy(s_hosts[free_slot].name, host, TLS_MANAGER_HOST_LEN - 1);
+    }
+    return free_slot;
+}
+
+/**
+ * @brief Registra una muestra de heap libre con sesiones abiertas
+ * @note Llamar con s_mutex tomado
+ */
+static void note_heap_sample(size_t free_now)
+{
+    if (s_stats.heap_free_min == 0 || free_now < s_stats.heap_free_min) {
+        s_stats.heap_free_min = free_now;
+    }
+    if (s_burst_active && free_now < s_burst.heap_free_min) {
+        s_burst.heap_free_min = free_now;
+    }
+}
+
+/**
+ * @brief Suma una sesión abierta
+ * @note Llamar con s_mutex tomado
+ */
+static void session_opened(int host)
+{
+    s_hosts[host].active++;
+    s_sessions++;
+    if (s_sessions > s_stats.sessions_peak) {
+        s_stats.sessions_peak = s_sessions;
+    }
+    if (s_burst_active && s_sessions > s_burst.sessions_peak) {
+        s_burst.sessions_peak = s_sessions;
+    }
+}
+
+/**
+ * @brief Resta una sesión cerrada y despierta a quien espere lugar
+ * @note Llamar con s_mutex tomado
+ */
+static void session_closed(int host)
+{
+    if (s_hosts[host].active > 0) {
+        s_hosts[host].active--;
+    }
+    if (s_sessions > 0) {
+        s_sessions--;
+    }
+    xSemaphoreGive(s_released);
+}
+
+/**
+ * @brief Comienza una ráfaga si no hay una en curso
+ * @note Llamar con s_mutex tomado
+ */
+static void burst_touch(size_t free_now)
+{
+    int64_t now_us = esp_timer_get_time();
+    if (!s_burst_active) {
+        memset(&s_burst, 0, sizeof(s_burst));
+        s_burst.heap_free_start = free_now;
+        s_burst.heap_free_min = free_now;
+        s_burst.sessions_peak = s_sessions;
+        s_burst_start_us = now_us;
+        s_burst_min_ever = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+        s_burst_active = true;
+    }
+    s_burst_last_us = now_us;
+    esp_timer_stop(s_burst_timer);
+}
+
+/**
+ * @brief Cierra la ráfaga en curso
+ *
+ * Si el mínimo histórico del heap bajó durante la ráfaga, el pico real fue
+ * ese (las muestras solo se toman entre handshakes).
+ */
+static void burst_timer_callback(void *arg)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    bool idle = true;
+    for (int i = 0; i < TLS_MANAGER_MAX_SESSIONS; i++) {
+        if (s_leases[i].tls) {
+            idle = false;
+        }
+    }
+    if (!s_burst_active || !idle) {
+        xSemaphoreGive(s_mutex);
+        return;
+    }
+
+    size_t min_ever = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    if (min_ever < s_burst_min_ever && min_ever < s_burst.heap_free_min) {
+        s_burst.heap_free_min = min_ever;
+    }
+    s_burst.duration_ms = (uint32_t)((s_burst_last_us - s_burst_start_us) / 1000);
+    s_burst.heap_peak_used = s_burst.heap_free_start > s_burst.heap_free_min ?
+                             s_burst.heap_free_start - s_burst.heap_free_min : 0;
+    s_burst_active = false;
+
+    s_stats.bursts++;
+    s_stats.last_burst = s_burst;
+    if (s_burst.heap_peak_used >= s_stats.worst_burst.heap_peak_used) {
+        s_stats.worst_burst = s_burst;
+    }
+    tls_manager_burst_t burst = s_burst;
+    xSemaphoreGive(s_mutex);
+
+    ESP_LOGI(TAG, "Ráfaga: %lu sesiones en %lu ms, máx %u simultáneas, pico de heap %u bytes (mín libre %u)",
+             (unsigned long)burst.leases, (unsigned long)burst.duration_ms, burst.sessions_peak,
+             (unsigned)burst.heap_peak_used, (unsigned)burst.heap_free_min);
+}
+
+/**
+ * @brief Indica si hay que verificar con los pins
+ * @note Llamar con s_mutex tomado
+ */
+static bool pins_usable(void)
+{
+    if (s_pins == NULL) {
+        return false;
+    }
+    return !s_pins_failed ||
+           esp_timer_get_time() - s_pins_failed_us > (int64_t)TLS_MANAGER_PIN_RETRY_MS * 1000;
+}
+
+/**
+ * @brief Registra que una cadena no terminó en los pins
+ * @note Llamar con s_mutex tomado
+ */
+static void pins_failed(void)
+{
+    s_stats.pin_failures++;
+    s_pins_failed = true;
+    s_pins_failed_us = esp_timer_get_time();
+}
+
+/**
+ * @brief crt_bundle_attach de las sesiones externas de hosts con pins
+ *
+ * esp_tls la llama en cada conexión, así que después de una falla de los
+ * pins la reconexión siguiente usa el bundle. La cadena parseada la libera
+ * mbedTLS al verificar o la llamada siguiente: una sola sesión a la vez.
+ */
+static esp_err_t attach_auto(void *conf)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    bool pinned = pins_usable();
+    xSemaphoreGive(s_mutex);
+
+    if (pinned) {
+        mbedtls_x509_crt_free(&s_ext_pins);
+        mbedtls_x509_crt_init(&s_ext_pins);
+        if (mbedtls_x509_crt_parse(&s_ext_pins, (const unsigned char *)s_pins, s_pins_len) == 0) {
+            mbedtls_ssl_conf_ca_chain((mbedtls_ssl_config *)conf, &s_ext_pins, NULL);
+            return ESP_OK;
+        }
+        mbedtls_x509_crt_free(&s_ext_pins);
+    }
+    return esp_crt_bundle_attach(conf);
+}
+
+/**
+ * @brief Conexión y handshake, verificando con los pins o con el bundle
+ *
+ * @param[out] verify_flags Flags de verificación del certificado si falló
+ * @return Sesión abierta o NULL
+ */
+static esp_tls_t *handshake(const char *host, const char *target, uint16_t port,
+                            const char **alpn_protos, uint32_t timeout_ms, bool pinned,
+                            int *verify_flags)
+{
+    esp_tls_cfg_t cfg = {
+        .crt_bundle_attach = pinned ? NULL : esp_crt_bundle_attach,
+        .cacert_buf = pinned ? (const unsigned char *)s_pins : NULL,
+        .cacert_bytes = pinned ? s_pins_len : 0,
+        .common_name = host,
+        .alpn_protos = alpn_protos,
+        .timeout_ms = timeout_ms,
+    };
+
+    *verify_flags = 0;
+    esp_tls_t *conn = esp_tls_init();
+    if (conn == NULL) {
+        return NULL;
+    }
+    if (esp_tls_conn_new_sync(target, strlen(target), port, &cfg, conn) == 1) {
+        return conn;
+    }
+
+    esp_tls_error_handle_t error_handle = NULL;
+    int tls_code = 0;
+    if (esp_tls_get_error_handle(conn, &error_handle) == ESP_OK && error_handle != NULL) {
+        esp_tls_get_and_clear_last_error(error_handle, &tls_code, verify_flags);
+    }
+    esp_tls_conn_destroy(conn);
+    return NULL;
+}
+
+/**
+ * @brief Espera a que se pueda abrir una sesión más y reserva un lease
+ *
+ * @return Índice del lease reservado (tls == NULL todavía) o -1 si venció el plazo
+ * @note Devuelve con s_mutex tomado si tuvo éxito
+ */
+static int admit(uint32_t timeout_ms)
+{
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    bool waited = false;
+
+    while (true) {
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        int lease = -1;
+        for (int i = 0; i < TLS_MANAGER_MAX_SESSIONS; i++) {
+            if (!s_leases[i].tls && s_leases[i].host < 0) {
+                lease = i;
+                break;
+            }
+        }
+        bool room = s_sessions < TLS_MANAGER_MAX_SESSIONS && lease >= 0;
+        bool heap_ok = s_sessions == 0 || heap_free() >= TLS_MANAGER_MIN_FREE_HEAP;
+        if (room && heap_ok) {
+            if (waited) {
+                s_stats.admission_waits++;
+            }
+            return lease;
+        }
+        xSemaphoreGive(s_mutex);
+
+        int64_t remaining_us = deadline_us - esp_timer_get_time();
+        if (remaining_us <= 0) {
+            xSemaphoreTake(s_mutex, portMAX_DELAY);
+            s_stats.admission_timeouts++;
+            xSemaphoreGive(s_mutex);
+            ESP_LOGW(TAG, "Sin lugar para otra sesión TLS (%u abiertas, %u bytes libres)",
+                     s_sessions, (unsigned)heap_free());
+            return -1;
+        }
+        if (!waited) {
+            ESP_LOGD(TAG, "Esperando lugar para sesión TLS (%u abiertas, %u bytes libres)",
+                     s_sessions, (unsigned)heap_free());
+        }
+        waited = true;
+        uint32_t step_ms = remaining_us / 1000 < TLS_MANAGER_WAIT_STEP_MS ?
+                           (uint32_t)(remaining_us / 1000) + 1 : TLS_MANAGER_WAIT_STEP_MS;
+        xSemaphoreTake(s_released, pdMS_TO_TICKS(step_ms));
+    }
+}
+
+// ============================================================================
+// Funciones públicas
+// ============================================================================
+
+esp_err_t tls_manager_init(void)
+{
+    if (s_initialized) {
+        return ESP_OK;
+    }
+
+    s_mutex = xSemaphoreCreateMutex();
+    s_released = xSemaphoreCreateBinary();
+    if (!s_mutex || !s_released) {
+        ESP_LOGE(TAG, "Error creando semáforos");
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = &burst_timer_callback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "tls_burst"
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &s_burst_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error creando timer de ráfagas: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    for (int i = 0; i < TLS_MANAGER_MAX_SESSIONS; i++) {
+        s_leases[i].tls = NULL;
+        s_leases[i].host = -1;
+    }
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+    s_stats.bundle_bytes = s_bundle_end - s_bundle_start;
+#endif
+    mbedtls_x509_crt_init(&s_ext_pins);
+    s_initialized = true;
+
+    ESP_LOGI(TAG, "Gestor TLS iniciado (máx %d sesiones, %d bytes libres mínimos)",
+             TLS_MANAGER_MAX_SESSIONS, TLS_MANAGER_MIN_FREE_HEAP);
+    return ESP_OK;
+}
+
+esp_err_t tls_manager_get_trust(const char *host, tls_manager_trust_t *trust)
+{
+    if (!host || !trust) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bool pinned = false;
+    if (s_initialized) {
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        int idx = host_slot(host);
+        pinned = idx >= 0 && s_hosts[idx].pinned;
+        xSemaphoreGive(s_mutex);
+    }
+
+    memset(trust, 0, sizeof(*trust));
+    trust->crt_bundle_attach = pinned ? attach_auto : esp_crt_bundle_attach;
+    trust->common_name = host;
+    return ESP_OK;
+}
+
+esp_err_t tls_manager_set_pins(const char *host, const char *pem, size_t pem_len)
+{
+    if (!host || !pem || pem_len == 0 || pem[pem_len - 1] != '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_pins != NULL && s_pins != pem) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (s_pins == NULL) {
+        // Validar una vez: cada conexión los vuelve a leer
+        mbedtls_x509_crt chain;
+        mbedtls_x509_crt_init(&chain);
+        int ret = mbedtls_x509_crt_parse(&chain, (const unsigned char *)pem, pem_len);
+        uint8_t count = 0;
+        for (mbedtls_x509_crt *crt = &chain; crt != NULL && crt->raw.len > 0; crt = crt->next) {
+            count++;
+        }
+        mbedtls_x509_crt_free(&chain);
+        if (ret != 0 || count == 0) {
+            ESP_LOGE(TAG, "Pins inválidos (%d)", ret);
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        s_pins = pem;
+        s_pins_len = pem_len;
+        s_stats.pins_certs = count;
+        s_stats.pins_bytes = pem_len;
+        xSemaphoreGive(s_mutex);
+        ESP_LOGI(TAG, "Pins: %u certificados, %u bytes de flash (bundle de CAs: %u bytes)",
+                 count, (unsigned)pem_len, (unsigned)s_stats.bundle_bytes);
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int idx = host_slot(host);
+    if (idx >= 0) {
+        s_hosts[idx].pinned = true;
+    }
+    xSemaphoreGive(s_mutex);
+    return idx >= 0 ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void tls_manager_note_verify_failure(const char *host, int verify_flags)
+{
+    if (!s_initialized || !host || !(verify_flags & MBEDTLS_X509_BADCERT_NOT_TRUSTED)) {
+        return;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int idx = host_slot(host);
+    bool pinned = idx >= 0 && s_hosts[idx].pinned && pins_usable();
+    if (pinned) {
+        pins_failed();
+    }
+    xSemaphoreGive(s_mutex);
+
+    if (pinned) {
+        ESP_LOGW(TAG, "La cadena de %s no termina en los pins (flags 0x%x), la próxima conexión usa el bundle",
+                 host, verify_flags);
+    }
+}
+
+esp_err_t tls_manager_acquire(const char *host, uint16_t port, const char **alpn_protos,
+                              uint32_t timeout_ms, esp_tls_t **tls)
+{
+    return tls_manager_acquire_at(host, NULL, port, alpn_protos, timeout_ms, tls);
+}
+
+esp_err_t tls_manager_acquire_at(const char *host, const char *addr, uint16_t port,
+                                 const char **alpn_protos, uint32_t timeout_ms, esp_tls_t **tls)
+{
+    if (!host || !tls) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *tls = NULL;
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int lease = admit(timeout_ms);
+    if (lease < 0) {
+        return ESP_ERR_TIMEOUT;
+    }
+    // admit() devuelve con s_mutex tomado
+    int host_idx = host_slot(host);
+    if (host_idx < 0) {
+        xSemaphoreGive(s_mutex);
+        ESP_LOGE(TAG, "Tabla de hosts llena, no se registra %s", host);
+        return ESP_ERR_NO_MEM;
+    }
+    // Reservar el lugar antes de soltar el mutex: el handshake es lento
+    s_leases[lease].host = host_idx;
+    session_opened(host_idx);
+    size_t free_before = heap_free();
+    burst_touch(free_before);
+    bool pinned = s_hosts[host_idx].pinned && pins_usable();
+    xSemaphoreGive(s_mutex);
+
+    // Con addr, common_name (= host) sigue definiendo el SNI y el nombre a verificar
+    const char *target = addr ? addr : host;
+    int verify_flags = 0;
+    int64_t start_us = esp_timer_get_time();
+    esp_tls_t *conn = handshake(host, target, port, alpn_protos, timeout_ms, pinned, &verify_flags);
+    if (conn == NULL && pinned && (verify_flags & MBEDTLS_X509_BADCERT_NOT_TRUSTED)) {
+        // La CA cambió y todavía no está en los pins: el bundle la conoce
+        ESP_LOGW(TAG, "La cadena de %s no termina en los pins (flags 0x%x), reintentando con el bundle",
+                 host, verify_flags);
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        pins_failed();
+        xSemaphoreGive(s_mutex);
+        pinned = false;
+        start_us = esp_timer_get_time();
+        conn = handshake(host, target, port, alpn_protos, timeout_ms, false, &verify_flags);
+    }
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    size_t free_after = heap_free();
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (conn == NULL) {
+        s_stats.handshake_failures++;
+        s_leases[lease].host = -1;
+        session_closed(host_idx);
+        s_burst_last_us = esp_timer_get_time();
+        xSemaphoreGive(s_mutex);
+        esp_timer_stop(s_burst_timer);
+        esp_timer_start_once(s_burst_timer, (uint64_t)TLS_MANAGER_BURST_GAP_MS * 1000);
+        ESP_LOGE(TAG, "Error en conexión TLS a %s (%s), flags de verificación 0x%x",
+                 host, target, verify_flags);
+        return ESP_FAIL;
+    }
+
+    if (pinned) {
+        s_stats.pinned_handshakes++;
+        s_pinned_total_ms += elapsed_ms;
+        s_stats.pinned_avg_ms = (uint32_t)(s_pinned_total_ms / s_stats.pinned_handshakes);
+        s_pins_failed = false;      // Vuelven a servir tras TLS_MANAGER_PIN_RETRY_MS
+    } else {
+        s_stats.bundle_handshakes++;
+        s_bundle_total_ms += elapsed_ms;
+        s_stats.bundle_avg_ms = (uint32_t)(s_bundle_total_ms / s_stats.bundle_handshakes);
+    }
+    s_leases[lease].tls = conn;
+    s_stats.leases++;
+    s_burst.leases++;
+    s_handshake_total_ms += elapsed_ms;
+    s_stats.handshake_avg_ms = (uint32_t)(s_handshake_total_ms / s_stats.leases);
+    if (elapsed_ms > s_stats.handshake_max_ms) {
+        s_stats.handshake_max_ms = elapsed_ms;
+    }
+    s_stats.session_heap_last = free_before > free_after ? free_before - free_after : 0;
+    if (s_stats.session_heap_last > s_stats.session_heap_max) {
+        s_stats.session_heap_max = s_stats.session_heap_last;
+    }
+    note_heap_sample(free_after);
+    size_t session_heap = s_stats.session_heap_last;
+    uint8_t sessions = s_sessions;
+    xSemaphoreGive(s_mutex);
+
+    ESP_LOGI(TAG, "✅ Sesión TLS con %s en %lu ms (%s, %u bytes, %u sesiones abiertas)",
+             host, (unsigned long)elapsed_ms, pinned ? "pins" : "bundle", (unsigned)session_heap, sessions);
+    *tls = conn;
+    return ESP_OK;
+}
+
+void tls_manager_release(esp_tls_t *tls)
+{
+    if (!tls) {
+        return;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    note_heap_sample(heap_free());
+    int lease = -1;
+    for (int i = 0; i < TLS_MANAGER_MAX_SESSIONS; i++) {
+        if (s_leases[i].tls == tls) {
+            lease = i;
+            break;
+        }
+    }
+    xSemaphoreGive(s_mutex);
+
+    esp_tls_conn_destroy(tls);
+
+    if (lease < 0) {
+        ESP_LOGW(TAG, "Release de una sesión que no es un lease");
+        return;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int host = s_leases[lease].host;
+    s_leases[lease].tls = NULL;
+    s_leases[lease].host = -1;
+    session_closed(host);
+    s_burst_last_us = esp_timer_get_time();
+    xSemaphoreGive(s_mutex);
+
+    esp_timer_stop(s_burst_timer);
+    esp_timer_start_once(s_burst_timer, (uint64_t)TLS_MANAGER_BURST_GAP_MS * 1000);
+}
+
+void tls_manager_note_external(const char *host, bool open)
+{
+    if (!s_initialized || !host) {
+        return;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int idx = host_slot(host);
+    if (idx < 0) {
+        xSemaphoreGive(s_mutex);
+        return;
+    }
+    if (open) {
+        s_hosts[idx].external++;
+        s_stats.external_sessions++;
+        session_opened(idx);
+        note_heap_sample(heap_free());
+    } else if (s_hosts[idx].external > 0) {
+        s_hosts[idx].external--;
+        session_closed(idx);
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+esp_err_t tls_manager_get_stats(tls_manager_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_initialized) {
+        memset(stats, 0, sizeof(*stats));
+        return ESP_OK;
+    }
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *stats = s_stats;
+    stats->sessions_active = s_sessions;
+    xSemaphoreGive(s_mutex);
+    return ESP_OK;
+}
+
+void tls_manager_print_stats(void)
+{
+    tls_manager_stats_t stats;
+    tls_manager_get_stats(&stats);
+
+    ESP_LOGI(TAG, "TLS: %u sesiones abiertas (máx %u), %lu leases, %lu externas, %lu fallos",
+             stats.sessions_active, stats.sessions_peak, (unsigned long)stats.leases,
+             (unsigned long)stats.external_sessions, (unsigned long)stats.handshake_failures);
+    ESP_LOGI(TAG, "  - handshake: %lu ms promedio, %lu ms máx, %u bytes por sesión (máx %u)",
+             (unsigned long)stats.handshake_avg_ms, (unsigned long)stats.handshake_max_ms,
+             (unsigned)stats.session_heap_last, (unsigned)stats.session_heap_max);
+    ESP_LOGI(TAG, "  - admisión: %lu esperas, %lu rechazos; mín heap libre con sesiones %u",
+             (unsigned long)stats.admission_waits, (unsigned long)stats.admission_timeouts,
+             (unsigned)stats.heap_free_min);
+    if (stats.pins_certs > 0) {
+        ESP_LOGI(TAG, "  - pins: %u certificados en %u bytes de flash (bundle de CAs: %u bytes), %lu fallas",
+                 stats.pins_certs, (unsigned)stats.pins_bytes, (unsigned)stats.bundle_bytes,
+                 (unsigned long)stats.pin_failures);
+        ESP_LOGI(TAG, "  - verificación: con pins %lu ms promedio (%lu), con bundle %lu ms promedio (%lu)",
+                 (unsigned long)stats.pinned_avg_ms, (unsigned long)stats.pinned_handshakes,
+                 (unsigned long)stats.bundle_avg_ms, (unsigned long)stats.bundle_handshakes);
+    }
+    if (stats.bursts > 0) {
+        ESP_LOGI(TAG, "  - %lu ráfagas; peor: %lu sesiones, %u simultáneas, pico de heap %u bytes",
+                 (unsigned long)stats.bursts, (unsigned long)stats.worst_burst.leases,
+                 stats.worst_burst.sessions_peak, (unsigned)stats.worst_burst.heap_peak_used);
+    }
+}
@@ -0,0 +1,42 @@
+/**
+ * @file sim_clock.h
+ * @brief Reloj y timers simulados de esp_timer para las pruebas de host
+ *
+ * esp_timer_get_time() es el reloj monotónico del host más el adelanto
+ * acumulado con sim_clock_advance_ms(), o solo el adelanto en modo manual.
+ * Los timers se registran con su nombre pero no disparan solos: la prueba
+ * llama a sim_timer_fire() cuando quiere que corra el callback.
+ */
+
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Timers creados a la vez (los borrados liberan su lugar) */
+#define SIM_MAX_TIMERS      8
+
+/**
+ * @brief Adelanta el reloj que ve esp_timer_get_time()
+ */
+void sim_clock_advance_ms(uint32_t ms);
+
+/**
+ * @brief Detiene el reloj real en el reloj simulado
+ *
+ * En modo manual el reloj solo avanza con sim_clock_advance_ms(); al
+ * volver al modo normal sigue desde donde quedó, al ritmo real.
+ *
+ * @param manual true = solo avance manual, false = reloj real más el adelanto
+ */
+void sim_clock_set_manual(bool manual);
+
+/**
+ * @brief Ejecuta el callback del timer creado con ese nombre
+ *
+ * @return false si no hay un timer con ese nombre
+ */
+bool sim_timer_fire(const char *name);
+
+#endif // SIM_CLOCK_H
@@ -0,0 +1,36 @@
+/**
+ * @file sim_server.h
+ * @brief Arranque de los servidores de prueba en Python (h2_server.py, mqtt_broker.py)
+ *
+ * La prueba que necesita un servidor lo inicia y espera a que acepte
+ * conexiones; si no arranca, la prueba falla. Los procesos iniciados se
+ * terminan al salir la aplicación de prueba.
+ */
+
+#ifndef SIM_SERVER_H
+#define SIM_SERVER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/** @brief Servidores iniciados a la vez */
+#define SIM_SERVER_MAX          4
+
+/** @brief Espera a que el servidor abra su puerto */
+#define SIM_SERVER_START_MS     10000
+
+/**
+ * @brief Ejecuta un script con python3 y espera a que escuche en 127.0.0.1
+ *
+ * @param script Ruta del script (los CMakeLists.txt de main la definen)
+ * @param args Argumentos del script, terminados en NULL (NULL = ninguno)
+ * @param port Puerto TCP que abre el script
+ * @return ESP_OK si el puerto acepta conexiones
+ * @return ESP_ERR_INVALID_STATE si el puerto ya estaba ocupado (otro servidor corriendo)
+ * @return ESP_ERR_TIMEOUT si el puerto no abrió en SIM_SERVER_START_MS
+ * @return ESP_FAIL si el script terminó antes (falta python3 o una biblioteca)
+ * @return ESP_ERR_NO_MEM si ya hay SIM_SERVER_MAX servidores iniciados
+ */
+esp_err_t sim_server_start(const char *script, const char *const *args, uint16_t port);
+
+#endif // SIM_SERVER_H
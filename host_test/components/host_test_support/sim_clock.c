@@ -0,0 +1,88 @@
+/**
+ * @file sim_clock.c
+ * @brief esp_timer sobre el reloj simulado
+ */
+
+#include <string.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "sim_clock.h"
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    bool used;
+};
+
+static struct esp_timer s_timers[SIM_MAX_TIMERS];
+static int64_t s_offset_us = 0;
+static bool s_manual = false;
+
+static int64_t real_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// ============================================================================
+// Simulación
+// ============================================================================
+
+void sim_clock_advance_ms(uint32_t ms)
+{
+    s_offset_us += (int64_t)ms * 1000;
+}
+
+void sim_clock_set_manual(bool manual)
+{
+    int64_t now_us = esp_timer_get_time();
+    s_manual = manual;
+    s_offset_us = manual ? now_us : now_us - real_time_us();
+}
+
+bool sim_timer_fire(const char *name)
+{
+    for (int i = 0; i < SIM_MAX_TIMERS; i++) {
+        if (s_timers[i].used && s_timers[i].name != NULL && strcmp(s_timers[i].name, name) == 0) {
+            s_timers[i].callback(s_timers[i].arg);
+            return true;
+        }
+    }
+    return false;
+}
+
+// ============================================================================
+// esp_timer
+// ============================================================================
+
+int64_t esp_timer_get_time(void)
+{
+    return s_manual ? s_offset_us : real_time_us() + s_offset_us;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    for (int i = 0; i < SIM_MAX_TIMERS; i++) {
+        if (!s_timers[i].used) {
+            s_timers[i].callback = create_args->callback;
+            s_timers[i].arg = create_args->arg;
+            s_timers[i].name = create_args->name;
+            s_timers[i].used = true;
+            *out_handle = &s_timers[i];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) { return ESP_OK; }
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) { return ESP_OK; }
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) { return ESP_OK; }
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    timer->used = false;
+    return ESP_OK;
+}
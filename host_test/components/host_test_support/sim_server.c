@@ -0,0 +1,115 @@
+/**
+ * @file sim_server.c
+ * @brief Procesos de los servidores de prueba
+ *
+ * fork() + execvp() desde una tarea de FreeRTOS: el hijo solo restablece la
+ * máscara de señales (el port POSIX bloquea las suyas en cada hilo y
+ * execvp() la conserva) antes de reemplazarse por python3.
+ */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sim_server.h"
+
+#define SIM_SERVER_MAX_ARGS     16
+#define SIM_SERVER_POLL_MS      50
+
+static pid_t s_pids[SIM_SERVER_MAX];
+static int s_pid_count = 0;
+static bool s_stop_registered = false;
+
+static bool port_open(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    bool open = connect(fd, (struct sockaddr *)&to, sizeof(to)) == 0;
+    close(fd);
+    return open;
+}
+
+static void stop_all(void)
+{
+    for (int i = 0; i < s_pid_count; i++) {
+        kill(s_pids[i], SIGKILL);
+        waitpid(s_pids[i], NULL, 0);
+    }
+    s_pid_count = 0;
+}
+
+// Reloj real: el de esp_timer_get_time() puede estar detenido (sim_clock.h)
+static int64_t real_time_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+esp_err_t sim_server_start(const char *script, const char *const *args, uint16_t port)
+{
+    if (s_pid_count == SIM_SERVER_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    // Un servidor ya corriendo podría tener otras opciones que las de la prueba
+    if (port_open(port)) {
+        fprintf(stderr, "sim_server: el puerto %u ya está ocupado\n", port);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char *argv[SIM_SERVER_MAX_ARGS + 3];
+    int argc = 0;
+    argv[argc++] = "python3";
+    argv[argc++] = (char *)script;
+    for (int i = 0; args != NULL && args[i] != NULL && i < SIM_SERVER_MAX_ARGS; i++) {
+        argv[argc++] = (char *)args[i];
+    }
+    argv[argc] = NULL;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return ESP_FAIL;
+    }
+    if (pid == 0) {
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    if (!s_stop_registered) {
+        atexit(stop_all);
+        s_stop_registered = true;
+    }
+    s_pids[s_pid_count++] = pid;
+
+    int64_t deadline_ms = real_time_ms() + SIM_SERVER_START_MS;
+    while (real_time_ms() < deadline_ms) {
+        if (waitpid(pid, NULL, WNOHANG) == pid) {
+            s_pid_count--;
+            fprintf(stderr, "sim_server: %s terminó sin abrir el puerto %u\n", script, port);
+            return ESP_FAIL;
+        }
+        if (port_open(port)) {
+            return ESP_OK;
+        }
+        vTaskDelay(pdMS_TO_TICKS(SIM_SERVER_POLL_MS));
+    }
+    fprintf(stderr, "sim_server: %s no abrió el puerto %u\n", script, port);
+    return ESP_ERR_TIMEOUT;
+}
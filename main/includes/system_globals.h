@@ -127,6 +127,7 @@ typedef struct {
     uint8_t version;                    /**< Versión del protocolo */
     char src_id[DEVICE_ID_MAX_LEN];     /**< ID del dispositivo origen */
     device_type_t src_type;             /**< Tipo de dispositivo origen */
+    uint32_t epoch;                     /**< Época de estado conocida por el sensor (0 = no informada) */
 } message_header_t;
 
 /**
@@ -136,6 +137,7 @@ typedef struct {
     message_type_t type;        /**< Tipo de mensaje */
     uint8_t action;             /**< Acción (depende del tipo) */
     uint8_t value;              /**< Valor adicional */
+    uint16_t hb_interval_s;     /**< Intervalo de heartbeat aplicado por el sensor (0 = no informado) */
 } message_payload_t;
 
 /**
@@ -152,11 +154,16 @@ typedef struct {
  */
 typedef struct {
     char device_id[DEVICE_ID_MAX_LEN];  /**< ID único del sensor */
+    uint8_t mac_addr[6];                 /**< MAC ESP-Now del sensor */
     device_type_t type;                  /**< Tipo de sensor */
     uint8_t state;                       /**< Estado actual (0=cerrado, 1=abierto) */
     uint8_t is_registered;               /**< Flag de registro activo */
     uint32_t last_seen;                  /**< Timestamp del último heartbeat */
     int8_t last_rssi;                    /**< Último RSSI reportado */
+    uint8_t online;                      /**< Dentro del timeout de liveness */
+    uint16_t hb_interval_s;              /**< Intervalo de heartbeat asignado (0 = sin asignar) */
+    uint32_t liveness_timeout_ms;        /**< Silencio máximo antes de considerarlo offline */
+    uint8_t tx_slot;                     /**< Slot de transmisión para tráfico no urgente */
 } sensor_info_t;
 
 /**
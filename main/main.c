@@ -27,6 +27,7 @@
 #include "supabase_client.h"
 #include "sntp_sync.h"
 #include "realtime_commands.h"
+#include "mqtt_backend.h"
 
 // ============================================================================
 // Constantes y configuración
@@ -245,6 +246,15 @@ static void init_wifi_services(void)
     } else {
         ESP_LOGI(TAG, "✅ Comandos realtime iniciados - WebSocket activo");
     }
+
+#if MQTT_BACKEND_ENABLED
+    // Broker del sitio: comandos por MQTT; eventos también con SUPABASE_EVENT_TRANSPORT_MQTT
+    ESP_LOGI(TAG, "Inicializando backend MQTT...");
+    ret = mqtt_backend_init(MQTT_BACKEND_BROKER_URI, MQTT_BACKEND_USERNAME, MQTT_BACKEND_PASSWORD);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Error inicializando backend MQTT: %s", esp_err_to_name(ret));
+    }
+#endif
 }
 
 // ============================================================================